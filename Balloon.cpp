@@ -183,28 +183,26 @@ int DefineBalloon(unsigned char* ballcolor, int* xoff, int* yoff,
 	int noffsets = 0;
 	
 	
-	for (int x = -radius; x < radius; x++)
+	// row by row, so that offsets are in frame memory order
+	for (int y = -radius; y < radius; y++)
 	{
-		int xsq = x * x;
-		for (int y = -radius; y < radius; y++)
+		int dx = discHalfWidth(rsq, y);
+		
+		for (int x = VSMAX(-dx, -radius); x < VSMIN(dx + 1, radius); x++)
 		{
-			if (xsq +  y * y <= rsq)
+			xoff[noffsets] = x;
+			yoff[noffsets] = y;
+			// find distance from light
+			int dsq = (xoffset - x) * (xoffset - x) + (yoffset - y) * (yoffset - y) + rsq;
+		
+			for (int i = 0; i < 3; i++)
 			{
-				xoff[noffsets] = x;
-				yoff[noffsets] = y;
-				// find distance from light
-				int dsq = (xoffset - x) * (xoffset - x) + (yoffset - y) * (yoffset - y) + rsq;
-			
-				for (int i = 0; i < 3; i++)
-				{
-					ballcolor[3 * noffsets + i] =
-						(col[i] + inc / dsq) > max ? max :
-						(uint8_t)(col[i] + inc / dsq);
-				}
-
-				noffsets++;
-
+				ballcolor[3 * noffsets + i] =
+					(col[i] + inc / dsq) > max ? max :
+					(uint8_t)(col[i] + inc / dsq);
 			}
+
+			noffsets++;
 		}
 	}
 
@@ -250,12 +248,13 @@ static const VSFrameRef* VS_CC balloonGetFrame(int n, int activationReason, void
 		int* xoff = NULL, * yoff = NULL;
 		unsigned char* ballcolor = NULL;
 		int noffsets = 0;
+		ScratchArena* scratch = scratchBegin();
 		
 		if (d->light == 0) // "frame"
 		{
-			ballcolor = (unsigned char*)vs_aligned_malloc<unsigned char>( sizeof(unsigned char) * 3 * 4 * d->radius * d->radius, 16);
-			xoff = (int*)vs_aligned_malloc<int>(sizeof(int) * 4 * d->radius * d->radius, 32);
-			yoff = (int*)vs_aligned_malloc<int>(sizeof(int) * 4 * d->radius * d->radius, 32);	// second half of xoff buf
+			ballcolor = scratchAlloc<unsigned char>(scratch, sizeof(unsigned char) * 3 * 4 * d->radius * d->radius);
+			xoff = scratchAlloc<int>(scratch, sizeof(int) * 4 * d->radius * d->radius);
+			yoff = scratchAlloc<int>(scratch, sizeof(int) * 4 * d->radius * d->radius);
 				// current balloon center x and y coord distances squares from light. prevent being zero
 			int dsx = (d->lightx - xx) * (d->lightx - xx);
 			int dsy = (d->lighty - yy) * (d->lighty - yy);
@@ -429,12 +428,7 @@ static const VSFrameRef* VS_CC balloonGetFrame(int n, int activationReason, void
 		}
 		
 	
-		if (d->light == 0)
-		{
-			vs_aligned_free(ballcolor);
-			vs_aligned_free(xoff);
-			vs_aligned_free(yoff);
-		}
+		scratchEnd(scratch);
 
 		vsapi->freeFrame( src);
 		return (dst);
@@ -28,9 +28,21 @@ typedef struct {
     int ecentery;		// end center y coord
     int emagx;			// ending magnification
     float* cubic;       // cubic interpolation coefficients buffer
+    int16_t* q14Coeff;  // same for 8 bit in integer. NULL for other formats
     int quantiles;      // number of quants of interpolation
+    WarpCache* cache;   // maps of view for center and magnification
+    int cacheMB;        // budget of cache
 } BinocularsData;
 
+// map of view with a row for each h of sy to ey, holding samples of disc span
+// within sx to ex. Entries with source outside frame have qx WARP_SKIP
+WarpMap* binocularsWarpMap(const BinocularsData* d, int centerx, int centery, float mag,
+    int sx, int sy, int ex, int ey);
+template <typename finc, bool subsampled>
+void binocularsKernel(uint8_t** dp8, const uint8_t** sp8, const int* pitch, int np, int subW, int subH,
+    const finc* min, const finc* max, const BinocularsData* d, const WarpMap* map,
+    int centerx, int centery, int sx, int sy, int ex, int ey);
+
 
 
 static void VS_CC binocularsInit(VSMap* in, VSMap* out, void** instanceData,
@@ -43,9 +55,157 @@ static void VS_CC binocularsInit(VSMap* in, VSMap* out, void** instanceData,
     d->cubic = (float*)vs_aligned_malloc<float>(sizeof(float) * 4 * (d->quantiles + 1), 32);
     // populate buffer with interpolation coefficients for quantile number of intervals
     CubicIntCoeff(d->cubic, d->quantiles);
+    // integer coefficients for 8 bit samples
+    d->q14Coeff = NULL;
+
+    if (d->vi->format->sampleType == stInteger && d->vi->format->bitsPerSample == 8)
+    {
+        d->q14Coeff = (int16_t*)vs_aligned_malloc(sizeof(int16_t) * 4 * (d->quantiles + 1), 32);
+        Q14Coeff(d->q14Coeff, d->cubic, 4, d->quantiles + 1);
+    }
+    d->cache = warpCacheCreate((size_t)d->cacheMB << 20);
+}
+
+WarpMap* binocularsWarpMap(const BinocularsData* d, int centerx, int centery, float mag,
+    int sx, int sy, int ex, int ey)
+{
+    int ht = d->vi->height;
+    int wd = d->vi->width;
+    int rsq = d->radius * d->radius;
+    ScratchArena* scratch = scratchBegin();
+    int* rowLength = scratchAlloc<int>(scratch, sizeof(int) * (ey - sy + 1));
+
+    for (int h = sy; h <= ey; h++)
+    {
+        int x0, x1;
+        rowLength[h - sy] = discRowSpan(&x0, &x1, centerx, rsq, h - centery, 0, sx, ex) ? x1 - x0 : 0;
+    }
+    WarpMap* map = warpMapCreate(ey - sy + 1, rowLength);
+    scratchEnd(scratch);
+
+    for (int h = sy; h <= ey; h++)
+    {
+        int x0, x1;
+        if (!discRowSpan(&x0, &x1, centerx, rsq, h - centery, 0, sx, ex))
+            continue;
+        WarpEntry* e = warpMapRow(map, h - sy) - x0;
+
+        float ih = (h - centery) * mag + centery;
+        int ihy = (int)ih;
+        float fy = ih - ihy;
+        bool rowOut = ihy < 1 || ihy >= ht - 1;
+        int qy = (int)(fy * d->quantiles);
+
+        for (int w = x0; w < x1; w++)
+        {
+            float iw = (w - centerx) * mag + centerx;
+            int iwx = (int)iw;
+            float fx = iw - iwx;
+
+            e[w].dx = (int16_t)(iwx - w);
+            e[w].dy = (int16_t)(ihy - h);
+            e[w].qy = (uint8_t)qy;
+            e[w].qx = rowOut || iwx < 1 || iwx >= wd - 1 ? WARP_SKIP : (uint8_t)(int)(fx * d->quantiles);
+        }
+    }
+    return map;
 }
 
 
+// magnified view of disc is written radius to left and right of it. finc and subsampling
+// are fixed at compile time so that inner loop has no format checks
+template <typename finc, bool subsampled>
+void binocularsKernel(uint8_t** dp8, const uint8_t** sp8, const int* pitch, int np, int subW, int subH,
+    const finc* min, const finc* max, const BinocularsData* d, const WarpMap* map,
+    int centerx, int centery, int sx, int sy, int ex, int ey)
+{
+    finc* dp[] = { (finc*)dp8[0], (finc*)dp8[1], (finc*)dp8[2] };
+    const finc* sp[] = { (const finc*)sp8[0], (const finc*)sp8[1], (const finc*)sp8[2] };
+    int andH = (1 << subH) - 1;
+    int andW = (1 << subW) - 1;
+    int wd = d->vi->width;
+    int radius = d->radius;
+    int rsq = radius * radius;
+    int npfull = subsampled ? 1 : np;
+
+    // interpolated samples of a row are done as a batch
+    int maxn = VSMAX(ex - sx, 0) + 1;
+    ScratchArena* scratch = scratchBegin();
+    int* ws = scratchAlloc<int>(scratch, sizeof(int) * maxn);
+    int* iws = scratchAlloc<int>(scratch, sizeof(int) * maxn);
+    int* offs = scratchAlloc<int>(scratch, sizeof(int) * maxn);
+    int* qxs = scratchAlloc<int>(scratch, sizeof(int) * maxn);
+    int* qys = scratchAlloc<int>(scratch, sizeof(int) * maxn);
+    float* out = scratchAlloc<float>(scratch, sizeof(float) * maxn);
+    int* iout = scratchAlloc<int>(scratch, sizeof(int) * maxn);
+    bool q14 = sizeof(finc) == 1 && d->q14Coeff != NULL;
+
+    for (int h = sy; h <= ey; h++)
+    {
+        int x0, x1;
+        // pixels of this row within the eye piece
+        if (!discRowSpan(&x0, &x1, centerx, rsq, h - centery, 0, sx, ex))
+            continue;
+        const WarpEntry* e = warpMapRow(map, h - sy) - x0;
+        int ihy = h + e[x0].dy;
+        int n = 0;
+
+        for (int w = x0; w < x1; w++)
+        {
+            if (e[w].qx == WARP_SKIP) continue;
+            int iwx = w + e[w].dx;
+
+            ws[n] = w;
+            iws[n] = iwx;
+            qxs[n] = e[w].qx;
+            qys[n++] = e[w].qy;
+
+            if (subsampled && (h & andH) == 0 && (w & andW) == 0)
+            {
+                bool right = (w + radius) >= 0 && (w + radius) < wd;
+                bool left = (w - radius) >= 0 && (w - radius) < wd;
+
+                for (int p = 1; p < np; p++)
+                {
+                    finc val = sp[p][(ihy >> subH) * pitch[p] + (iwx >> subW)];
+
+                    if (right)
+                        dp[p][(h >> subH) * pitch[p] + ((w + radius) >> subW)] = val;
+
+                    if (left)
+                        dp[p][(h >> subH) * pitch[p] + ((w - radius) >> subW)] = val;
+                }
+            }
+        }
+
+        for (int p = 0; p < npfull && n > 0; p++)
+        {
+            for (int k = 0; k < n; k++)
+                offs[k] = ihy * pitch[p] + iws[k];
+
+            if (q14)
+                LaQuantileBatchQ14(iout, (const uint8_t*)sp[p], pitch[p], offs, qxs, qys, n, 4, d->q14Coeff);
+            else
+                LaQuantileBatch(out, sp[p], pitch[p], offs, qxs, qys, n, 4, d->cubic);
+
+            for (int k = 0; k < n; k++)
+            {
+                int w = ws[k];
+                const finc* spp = sp[p] + offs[k];
+                finc val = needNotInterpolate(spp, pitch[p], 1) ? *spp
+                    : q14 ? iclamp(iout[k], min[p], max[p]) : clamp(out[k], min[p], max[p]);
+
+                if ((w + radius) >= 0 && (w + radius) < wd)
+                    dp[p][h * pitch[p] + w + radius] = val;
+
+                if ((w - radius) >= 0 && (w - radius) < wd)
+                    dp[p][h * pitch[p] + (w - radius)] = val;
+            }
+        }
+    }
+    scratchEnd(scratch);
+}
+
 static const VSFrameRef* VS_CC binocularsGetFrame(int in, int activationReason, void** instanceData, void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi) {
     BinocularsData* d = (BinocularsData*)*instanceData;
 
@@ -66,13 +226,12 @@ static const VSFrameRef* VS_CC binocularsGetFrame(int in, int activationReason,
         unsigned char* dp[] = { NULL, NULL, NULL };
         int subH = fi->subSamplingH;
         int subW = fi->subSamplingW;
-        int andH = (1 << subH) - 1;
-        int andW = (1 << subW) - 1;
 
         int pitch[] = { 0,0,0 };
         int nbytes = fi->bytesPerSample;
         int nbits = fi->bitsPerSample;
         int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;
+        bool subsampled = np > 1 && (subW != 0 || subH != 0);
 
         int ht = d->vi->height;
         int wd = d->vi->width;
@@ -87,8 +246,13 @@ static const VSFrameRef* VS_CC binocularsGetFrame(int in, int activationReason,
         int ex = (centerx + radius) < 0 ? 0 : (centerx + radius) > wd - 1 ? wd - 1 : (centerx + radius);
         int ey = (centery + radius) < 0 ? 0 : (centery + radius) > ht - 1 ? ht - 1 : (centery + radius);
 
-        int rsq = radius * radius;
         float mag = 1.0f / magx;
+        // view depends on center and magnification
+        int key[WARP_KEY_SIZE] = { centerx, centery, warpKeyFloat(mag), 0 };
+        const WarpMap* map = warpCacheFind(d->cache, key);
+
+        if (map == NULL)
+            map = warpCacheInsert(d->cache, key, binocularsWarpMap(d, centerx, centery, mag, sx, sy, ex, ey));
 
         for (int p = 0; p < np; p++)
         {
@@ -97,187 +261,54 @@ static const VSFrameRef* VS_CC binocularsGetFrame(int in, int activationReason,
             pitch[p] = vsapi->getStride(dst, p) / nbytes;
         }
 
-        for (int h = sy; h <= ey; h++)
+        // format decides kernel once per frame
+        if (nbytes == 1)
         {
-            int hsq = (h - centery) * (h - centery);
+            uint8_t min[] = { 0, 0, 0 }, max[] = { 255, 255, 255 };
 
-            for (int w = sx; w < ex; w++)
-            {
-                if (hsq + (w - centerx) * (w - centerx) <= rsq)
+            if (fi->colorFamily == cmYUV)
+                for (int p = 0; p < 3; p++)
                 {
-                    float ih = (h - centery) * mag + centery;
-                    int ihy = (int)ih;
-                    float fy = ih - ihy;
-                    if (ihy < 1 || ihy >= ht - 1) continue;
-                    int qy = (int)(fy * d->quantiles);
-
-                    float iw = (w - centerx) * mag + centerx;
-                    int iwx = (int)iw;
-                    float fx = iw - iwx;
-
-                    if (iwx < 1 || iwx >= wd - 1) continue;
-
-                    int qx = (int)(fx * d->quantiles);
-
-                    for (int p = 0; p < np; p++)
-                    {
-                        if (fi->sampleType == stInteger && nbytes == 1)
-                        {
-                            uint8_t* dpp = dp[p];
-                            const uint8_t* spp = sp[p];
-                            uint8_t min = 0, max = 255;
-
-                            if (fi->colorFamily == cmYUV)
-                            {
-                                min = 16;
-                                max = 235;
-                            }
-
-                            if (p == 0 || (subH == 0 && subW == 0))
-                            {
-
-                                if (needNotInterpolate(sp[p] + ihy * pitch[p] + iwx, pitch[p], 1) )
-                                {
-                                    if ((w + radius) >= 0 && (w + radius) < wd)
-                                        dpp[h * pitch[p] + w + radius] = spp[p + ihy * pitch[p] + iwx];
-
-                                        if ((w - radius) >= 0 && (w - radius) < wd)
-                                            dpp[h * pitch[p] + (w - radius)] = spp[p + ihy * pitch[p] + iwx];
-                                }
-                                else
-                                {
-
-
-                                    unsigned char val = clamp(LaQuantile(spp + (ihy)*pitch[p] + iwx, pitch[p], 4, qx, qy, d->cubic), min, max);
-
-                                    if ((w + radius) >= 0 && (w + radius) < wd)
-                                        dpp[h * pitch[p] + w + radius] = val;
-
-                                    if ((w - radius) >= 0 && (w - radius) < wd)
-                                        dpp[h * pitch[p] + (w - radius)] = val;
-                                }
-                            }
-
-                            else
-                            {
-                                if ((h & andH) == 0 && (w & andW) == 0)
-                                {
-                                    unsigned char val = spp[(ihy >> subH) * pitch[p] + (iwx >> subW)];
-                                    if ((w + radius) >= 0 && (w + radius) < wd)
-                                        dpp[(h >> subH) * pitch[p] + ((w + radius) >> subW)] = val;
-
-                                    if ((w - radius) >= 0 && (w - radius) < wd)
-                                        dpp[(h >> subH) * pitch[p] + ((w - radius) >> subW)] = val;
-                                }
-                            }
-                        }
-
-                        else if (fi->sampleType == stInteger && nbytes == 2)
-                        {
-                            uint16_t* dpp = (uint16_t*)dp[p];
-                            const uint16_t* spp = (uint16_t*)sp[p];
-                            uint16_t min = 0, max = (1 << nbits) - 1;
-
-                            if (fi->colorFamily == cmYUV)
-                            {
-                                min = (uint16_t) (16 << (nbits - 8));
-                                max = (uint16_t) (240 << (nbits - 8));
-                            }
-
-                            if (p == 0 || (subH == 0 && subW == 0))
-                            {
-
-                                if (needNotInterpolate(spp + ihy * pitch[p] + iwx, pitch[p], 1))
-                                {
-                                    if ((w + radius) >= 0 && (w + radius) < wd)
-                                        dpp[h * pitch[p] + w + radius] = spp[p + ihy * pitch[p] + iwx];
-
-                                    if ((w - radius) >= 0 && (w - radius) < wd)
-                                        dpp[h * pitch[p] + (w - radius)] = spp[p + ihy * pitch[p] + iwx];
-                                }
-                                else
-                                {
-
-
-                                    uint16_t val = clamp(LaQuantile(spp + (ihy)*pitch[p] + iwx, pitch[p], 4, qx, qy, d->cubic), min, max);
-
-                                    if ((w + radius) >= 0 && (w + radius) < wd)
-                                        dpp[h * pitch[p] + w + radius] = val;
-
-                                    if ((w - radius) >= 0 && (w - radius) < wd)
-                                        dpp[h * pitch[p] + (w - radius)] = val;
-                                }
-                            }
-
-                            else
-                            {
-                                if ((h & andH) == 0 && (w & andW) == 0)
-                                {
-                                    uint16_t val = spp[(ihy >> subH) * pitch[p] + (iwx >> subW)];
-                                    if ((w + radius) >= 0 && (w + radius) < wd)
-                                        dpp[(h >> subH) * pitch[p] + ((w + radius) >> subW)] = val;
-
-                                    if ((w - radius) >= 0 && (w - radius) < wd)
-                                        dpp[(h >> subH) * pitch[p] + ((w - radius) >> subW)] = val;
-                                }
-                            }
-                        }
-
-                        else if (fi->sampleType == stFloat)
-                        {
-                            float* dpp = (float*)dp[p];
-                            const float* spp = (float*)sp[p];
-                            float min = 0, max = 1.0;                            
-
-                            if (p == 0 || (subH == 0 && subW == 0))
-                            {
-                                if ( p != 0 && fi->colorFamily == cmYUV)
-                                {
-                                    min = -0.5f;
-                                    max = 0.5f;
-                                }
-
-                                if (needNotInterpolate(spp + ihy * pitch[p] + iwx, pitch[p], 1))
-                                {
-                                    if ((w + radius) >= 0 && (w + radius) < wd)
-                                        dpp[h * pitch[p] + w + radius] = spp[p + ihy * pitch[p] + iwx];
-
-                                    if ((w - radius) >= 0 && (w - radius) < wd)
-                                        dpp[h * pitch[p] + (w - radius)] = spp[p + ihy * pitch[p] + iwx];
-                                }
-                                else
-                                {
-
-
-                                    float val = clamp(LaQuantile(spp + (ihy)*pitch[p] + iwx, pitch[p], 4, qx, qy, d->cubic), min, max);
-
-                                    if ((w + radius) >= 0 && (w + radius) < wd)
-                                        dpp[h * pitch[p] + w + radius] = val;
-
-                                    if ((w - radius) >= 0 && (w - radius) < wd)
-                                        dpp[h * pitch[p] + (w - radius)] = val;
-                                }
-                            }
-
-                            else
-                            {
-                                if ((h & andH) == 0 && (w & andW) == 0)
-                                {
-                                    float val = spp[(ihy >> subH) * pitch[p] + (iwx >> subW)];
-                                    if ((w + radius) >= 0 && (w + radius) < wd)
-                                        dpp[(h >> subH) * pitch[p] + ((w + radius) >> subW)] = val;
-
-                                    if ((w - radius) >= 0 && (w - radius) < wd)
-                                        dpp[(h >> subH) * pitch[p] + ((w - radius) >> subW)] = val;
-                                }
-                            }
-                        }
-                    }
+                    min[p] = 16;
+                    max[p] = 235;
                 }
+            if (subsampled)
+                binocularsKernel<uint8_t, true>(dp, sp, pitch, np, subW, subH, min, max, d, map, centerx, centery, sx, sy, ex, ey);
+            else
+                binocularsKernel<uint8_t, false>(dp, sp, pitch, np, 0, 0, min, max, d, map, centerx, centery, sx, sy, ex, ey);
+        }
+        else if (nbytes == 2)
+        {
+            uint16_t min[3], max[3];
+
+            for (int p = 0; p < 3; p++)
+            {
+                min[p] = fi->colorFamily == cmYUV ? (uint16_t)(16 << (nbits - 8)) : 0;
+                max[p] = fi->colorFamily == cmYUV ? (uint16_t)(240 << (nbits - 8)) : (uint16_t)((1 << nbits) - 1);
             }
+            if (subsampled)
+                binocularsKernel<uint16_t, true>(dp, sp, pitch, np, subW, subH, min, max, d, map, centerx, centery, sx, sy, ex, ey);
+            else
+                binocularsKernel<uint16_t, false>(dp, sp, pitch, np, 0, 0, min, max, d, map, centerx, centery, sx, sy, ex, ey);
+        }
+        else
+        {
+            float min[] = { 0, 0, 0 }, max[] = { 1.0f, 1.0f, 1.0f };
+
+            if (fi->colorFamily == cmYUV)
+                for (int p = 1; p < 3; p++)
+                {
+                    min[p] = -0.5f;
+                    max[p] = 0.5f;
+                }
+            if (subsampled)
+                binocularsKernel<float, true>(dp, sp, pitch, np, subW, subH, min, max, d, map, centerx, centery, sx, sy, ex, ey);
+            else
+                binocularsKernel<float, false>(dp, sp, pitch, np, 0, 0, min, max, d, map, centerx, centery, sx, sy, ex, ey);
         }
 
-        // your code here...
+
+        warpCacheRelease(d->cache, map);
         vsapi->freeFrame(src);
         return dst;
     }
@@ -289,6 +320,10 @@ static void VS_CC binocularsFree(void* instanceData, VSCore* core, const VSAPI*
     BinocularsData* d = (BinocularsData*)instanceData;
     vsapi->freeNode(d->node);
     vs_aligned_free(d->cubic);
+    if (d->q14Coeff != NULL)
+        vs_aligned_free(d->q14Coeff);
+    warpCacheLog(d->cache, "Binoculars", vsapi);
+    warpCacheFree(d->cache);
     free(d);
 }
 
@@ -392,6 +427,15 @@ static void VS_CC binocularsCreate(const VSMap* in, VSMap* out, void* userData,
         vsapi->freeNode(d.node);
         return;
     }
+    d.cacheMB = int64ToIntS(vsapi->propGetInt(in, "cache", 0, &err));
+    if (err)
+        d.cacheMB = 32;
+    else if (d.cacheMB < 0 || d.cacheMB > 1024)
+    {
+        vsapi->setError(out, "Binoculars: cache must be 0 to 1024 MB");
+        vsapi->freeNode(d.node);
+        return;
+    }
 
     data = (BinocularsData*)malloc(sizeof(d));
     *data = d;
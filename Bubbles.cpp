@@ -39,358 +39,300 @@ typedef struct {
     int radius;	    //radius of bubbles : 8
     int nbf;        // number of new bubblescreated in frame
     int* px, * py; 	// parabola px values
+    int* dspan;     // x travel of bubble over its life
+    int* brad;      // radius of bubble, varies with px
+    float* pp;      // parameter p of parabola
 } BubblesData;
 
+template <typename finc>
+void bubblesKernel(const FramePlane* pl, int np, const VSFormat* fi, const BubblesData* d, int n);
+// appends bubbles m0 to m0 + count - 1 that are wholly between floor and highest rise.
+// nmax - nx of bubble m0 is t0, and one less for each next
+void bubblesTrack(Particles* ps, const BubblesData* d, int m0, int count, int t0, int nbbls);
+
 static void VS_CC bubblesInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
     BubblesData *d = (BubblesData *) * instanceData;
     vsapi->setVideoInfo(d->vi, 1, node);
 
     //int radius = 8;
    // d->nbf = 200;
-    d->px = (int *) vs_aligned_malloc<int>(sizeof(int)* 2 * d->life * d->nbf, 32);
+    d->px = (int *) vs_aligned_malloc<int>(sizeof(int)* 5 * d->life * d->nbf, 32);
     d->py = d->px + d->nbf * d->life;
-    srand (((d->EndFrame - d->StartFrame) * (d->EndFrame - d->StartFrame)
-        * (d->EndFrame - d->StartFrame)) | 1 );
+    d->dspan = d->py + d->nbf * d->life;
+    d->brad = d->dspan + d->nbf * d->life;
+    d->pp = (float*)(d->brad + d->nbf * d->life);
+    uint32_t nf = (uint32_t)(d->EndFrame - d->StartFrame);
+    RandomSequence rs;
+    startRandomSequence(&rs, (nf * nf * nf) | 1);
     for (int i = 0; i < d->nbf * d->life; i++)
     {
         // trajectory constants for 200 bubbles
-        d->px[i] = (rand() % (d->farx - d->srcx)) + 10 * d->radius;
-        d->py[i] = 10 * d->radius + (rand() % (d->rise - 10 * d->radius));
+        d->px[i] = nextRandom(&rs, d->farx - d->srcx) + 10 * d->radius;
+        d->py[i] = 10 * d->radius + nextRandom(&rs, d->rise - 10 * d->radius);
+        // trajectory constants so that a frame finds positions without division by them
+        d->pp[i] = (d->px[i] * d->px[i]) / (4.0f * (d->py[i]));
+        d->dspan[i] = (d->farx - d->srcx) % (2 * d->px[i]);
+        d->brad[i] = 5 + d->px[i] % 10;	//  radius value dependant on px to get some variation of size
     }
 
  }
 
-static const VSFrameRef* VS_CC bubblesGetFrame(int in, int activationReason, void** instanceData, void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi) {
-    BubblesData* d = (BubblesData*)*instanceData;
-
-    if (activationReason == arInitial) {
-        vsapi->requestFrameFilter(in, d->node, frameCtx);
+#ifdef VFX_X86_SIMD
+// returns bubbles done. Integer division of dx is done in double, which is exact for 32 bit values
+VFX_TARGET("sse4.1") int bubblesTrackSse41(Particles* ps, const BubblesData* d, int m0, int count, int t0, int nbbls)
+{
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3), zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi32(nbbls / 2), srcx = _mm_set1_epi32(d->srcx);
+    const __m128i top = _mm_set1_epi32(d->srcy - d->rise), floory = _mm_set1_epi32(d->floory);
+    const __m128 four = _mm_set1_ps(4.0f);
+    bool back = d->farx < d->srcx;
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        int m = m0 + i;
+        __m128i t = _mm_sub_epi32(_mm_set1_epi32(t0 - i), lanes);
+        __m128i num = _mm_mullo_epi32(_mm_loadu_si128((const __m128i*)(d->dspan + m)), t);
+        __m128i den = _mm_add_epi32(half, _mm_srli_epi32(t, 1));
+        __m128d lo = _mm_div_pd(_mm_cvtepi32_pd(num), _mm_cvtepi32_pd(den));
+        __m128d hi = _mm_div_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(num, num)), _mm_cvtepi32_pd(_mm_unpackhi_epi64(den, den)));
+        __m128i dx = _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+        __m128i px = _mm_loadu_si128((const __m128i*)(d->px + m));
+        __m128i xx = back ? _mm_add_epi32(px, dx) : _mm_sub_epi32(px, dx);
+        __m128 drop = _mm_div_ps(_mm_cvtepi32_ps(_mm_mullo_epi32(xx, xx)), _mm_mul_ps(four, _mm_loadu_ps(d->pp + m)));
+        __m128i fy = _mm_add_epi32(_mm_sub_epi32(_mm_set1_epi32(d->srcy), _mm_loadu_si128((const __m128i*)(d->py + m))),
+            _mm_cvttps_epi32(drop));
+        __m128i r = _mm_loadu_si128((const __m128i*)(d->brad + m));
+        __m128i ytop = _mm_sub_epi32(fy, r), ybot = _mm_add_epi32(fy, r);
+        __m128i in = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(ytop, zero), _mm_cmplt_epi32(ytop, floory)),
+            _mm_and_si128(_mm_cmplt_epi32(ybot, floory), _mm_cmpgt_epi32(ybot, top)));
+
+        particlesPackSse41(ps, _mm_add_epi32(srcx, dx), fy, _mm_add_epi32(_mm_set1_epi32(m), lanes),
+            _mm_movemask_ps(_mm_castsi128_ps(in)));
     }
-    else if (activationReason == arAllFramesReady) {
-        const VSFrameRef* src = vsapi->getFrameFilter(in, d->node, frameCtx);
-
-        if (in < d->StartFrame || in > d->EndFrame)
-            return src;
-        int n = in - d->StartFrame;
-        int nframes = d->EndFrame - d->StartFrame + 1;
+    return i;
+}
 
-        VSFrameRef* dst = vsapi->copyFrame(src, core);
-        const VSFormat* fi = d->vi->format;
+VFX_TARGET("avx2") int bubblesTrackAvx2(Particles* ps, const BubblesData* d, int m0, int count, int t0, int nbbls)
+{
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), zero = _mm256_setzero_si256();
+    const __m256i half = _mm256_set1_epi32(nbbls / 2), srcx = _mm256_set1_epi32(d->srcx);
+    const __m256i top = _mm256_set1_epi32(d->srcy - d->rise), floory = _mm256_set1_epi32(d->floory);
+    const __m256 four = _mm256_set1_ps(4.0f);
+    bool back = d->farx < d->srcx;
+    int i = 0;
 
-        unsigned char* dp[] = { NULL, NULL, NULL };
-        int subH = fi->subSamplingH;
-        int subW = fi->subSamplingW;
-        int andH = (1 << subH) - 1;
-        int andW = (1 << subW) - 1;
+    for (; i + 8 <= count; i += 8)
+    {
+        int m = m0 + i;
+        __m256i t = _mm256_sub_epi32(_mm256_set1_epi32(t0 - i), lanes);
+        __m256i num = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(d->dspan + m)), t);
+        __m256i den = _mm256_add_epi32(half, _mm256_srli_epi32(t, 1));
+        __m256d lo = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(num)), _mm256_cvtepi32_pd(_mm256_castsi256_si128(den)));
+        __m256d hi = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(num, 1)), _mm256_cvtepi32_pd(_mm256_extracti128_si256(den, 1)));
+        __m256i dx = _mm256_setr_m128i(_mm256_cvttpd_epi32(lo), _mm256_cvttpd_epi32(hi));
+        __m256i px = _mm256_loadu_si256((const __m256i*)(d->px + m));
+        __m256i xx = back ? _mm256_add_epi32(px, dx) : _mm256_sub_epi32(px, dx);
+        __m256 drop = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_mullo_epi32(xx, xx)), _mm256_mul_ps(four, _mm256_loadu_ps(d->pp + m)));
+        __m256i fy = _mm256_add_epi32(_mm256_sub_epi32(_mm256_set1_epi32(d->srcy), _mm256_loadu_si256((const __m256i*)(d->py + m))),
+            _mm256_cvttps_epi32(drop));
+        __m256i r = _mm256_loadu_si256((const __m256i*)(d->brad + m));
+        __m256i ytop = _mm256_sub_epi32(fy, r), ybot = _mm256_add_epi32(fy, r);
+        __m256i in = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(ytop, zero), _mm256_cmpgt_epi32(floory, ytop)),
+            _mm256_and_si256(_mm256_cmpgt_epi32(floory, ybot), _mm256_cmpgt_epi32(ybot, top)));
+
+        particlesPackAvx2(ps, _mm256_add_epi32(srcx, dx), fy, _mm256_add_epi32(_mm256_set1_epi32(m), lanes),
+            _mm256_movemask_ps(_mm256_castsi256_ps(in)));
+    }
+    return i;
+}
+#endif
+
+void bubblesTrack(Particles* ps, const BubblesData* d, int m0, int count, int t0, int nbbls)
+{
+    int i = 0;
+#ifdef VFX_X86_SIMD
+    if (simdLevel >= SIMD_AVX2)
+        i = bubblesTrackAvx2(ps, d, m0, count, t0, nbbls);
+    else if (simdLevel >= SIMD_SSE41)
+        i = bubblesTrackSse41(ps, d, m0, count, t0, nbbls);
+#endif
+    int k = ps->count;
+
+    for (; i < count; i++)
+    {		// origin of parabola 0,0 is  frame coords px+srcx, srcy-py=0
+            // the parabola coord of bubble origin is px[nx],py=srcx
+        int modnx = m0 + i, t = t0 - i;
+        int dx = d->dspan[modnx] * t / (nbbls / 2 + t / 2);
+        // distance interval travel by bubble relative to source
+        // in the denominator (nmax-nx)/2 is to slow down bubbles progressively
+        // in their travel towards farx
+        int xx = d->farx < d->srcx ? d->px[modnx] + dx : d->px[modnx] - dx;	// xx relative to parabola zero
+        int fy = d->srcy - d->py[modnx] + (int)((xx * xx) / (4 * d->pp[modnx]));       // frame y
+        int bradius = d->brad[modnx];
+
+        ps->x[k] = d->srcx + dx;
+        ps->y[k] = fy;
+        ps->id[k] = modnx;
+        k += fy - bradius > 0 && fy - bradius < d->floory && fy + bradius < d->floory
+            && fy + bradius > d->srcy - d->rise;
+    }
+    ps->count = k;
+}
 
-        int dpitch[] = { 0,0,0 };
-        int nbytes = fi->bytesPerSample;
-        int nbits = fi->bitsPerSample;
-        int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;
+// draws bubbles alive in frame n. finc and subsampling are fixed at compile time so
+// that inner loop has no format checks
+template <typename finc>
+void bubblesKernel(const FramePlane* pl, int np, const VSFormat* fi, const BubblesData* d, int n)
+{
+    int nbits = fi->bitsPerSample;
+    int nbbls = d->life * d->nbf;
+    // each frame nbf new bubbles start. after n = life remains 200 total living
+  //  int nmax = n > d->life ? n + d->life : n + n + 1;
+    int nmax = n  > d->life ? n  + nbbls :   n * d->nbf  + n;
+    
+    ScratchArena* scratch = scratchBegin();
+    Particles ps;
+    particlesBegin(&ps, scratch, nmax - n);
+    // positions of all bubbles, keeping those wholly between floor and highest rise.
+    // bubble of nx is nx % nbbls, so runs of nx up to a wrap have consecutive tables
+    for (int nx = n; nx < nmax; )
+    {
+        int modnx = nx % nbbls;
+        int run = VSMIN(nmax - nx, nbbls - modnx);
 
-        int ht = d->vi->height;
-        int wd = d->vi->width;
+        bubblesTrack(&ps, d, modnx, run, nmax - nx, nbbls);
+        nx += run;
+    }
 
-        for (int p = 0; p < np; p++)
+    for (int i = 0; i < ps.count; i++)
+    {
+        int modnx = ps.id[i];
+        float pp = d->pp[modnx];
+        int fx = ps.x[i], fy = ps.y[i];
+        int bradius = d->brad[modnx];
+
+        int rsq = bradius * bradius;
+        int r1sq = (bradius - 1) * (bradius - 1);   // rsq to r1sq is outer rim
+        int r4sq = (bradius - 4) * (bradius - 4);   // r4sq  and r6sq is for glint
+        int r6sq = (bradius - 6) * (bradius - 6);   // even if radius becomes -ve square sts right
+        int sx = fx - bradius;
+        int sy = fy - bradius;
+        int ex = fx + bradius;
+        int ey = fy + bradius;
+
+        // using px and pp which are random but continue frame to frame
+        //for consistant but random color of bubble
+        int red = d->px[modnx] % 140;
+        int green = ((int)pp) % 140;
+        int blue = (2 * (red + green)) % 140;
+        if (!d->color)
         {
-            dp[p] = vsapi->getWritePtr(dst, p);
-            dpitch[p] = vsapi->getStride(dst, p) / nbytes;
+            red = 128;
+            green = 128;
+            blue = 128;
         }
 
-        int nbbls = d->life * d->nbf;
-        // each frame nbf new bubbles start. after n = life remains 200 total living
-      //  int nmax = n > d->life ? n + d->life : n + n + 1;
-        int nmax = n  > d->life ? n  + nbbls :   n * d->nbf  + n;
-        
-        for (int nx = n; nx < nmax; nx++)
-        {		// origin of parabola 0,0 is  frame coords px+srcx, srcy-py=0
-                // the parabola coord of bubble origin is px[nx],py=srcx
-            int modnx = nx % nbbls; // 
-            // int modnx = nx % d->nbf;
-            float pp = (d->px[modnx] * d->px[modnx]) / (4.0f * (d->py[modnx]));	// parameter p of parabola
-
-            int dx = ((d->farx - d->srcx) % (2 * d->px[modnx])) * (nmax - nx) / (nbbls / 2 + (nmax - nx) / 2);
-            // distance interval travel by bubble relative to source
-            // in the denominator (nmax-nx)/2 is to slow down bubbles progressively						
-            // in their travel towards farx
-            int xx = d->px[modnx] - dx;	// xx relative to parabola zero
-            int fx = d->srcx + dx;
-
-            if (d->farx < d->srcx)
-                xx = d->px[modnx] + dx;	// relative x
-
-            int yy = (int)((xx * xx) / (4 * pp));				//yy relative to parabola zero
-
-            int fy = d->srcy - d->py[modnx] + yy;       // frame y
-                    // limits of check to ensure minimum search
-            
-            int bradius = 5 + d->px[modnx] % 10;	//  radius value dependant on px to get some variation of size
-
-            int rsq = bradius * bradius;
-            int r1sq = (bradius - 1) * (bradius - 1);   // rsq to r1sq is outer rim
-            int r4sq = (bradius - 4) * (bradius - 4);   // r4sq  and r6sq is for glint
-            int r6sq = (bradius - 6) * (bradius - 6);   // even if radius becomes -ve square sts right
-            int sx = fx - bradius;
-            int sy = fy - bradius;
-            int ex = fx + bradius;
-            int ey = fy + bradius;
-            // using px and pp which are random but continue frame to frame
-            //for consistant but random color of bubble
-            int red = d->px[modnx] % 140;
-            int green = ((int)pp) % 140;
-            int blue = (2 * (red + green)) % 140;
-            if (!d->color)
-            {
-                red = 128;
-                green = 128;
-                blue = 128;
-            }
+        unsigned char bgr[] = { (uint8_t)blue, (uint8_t)green, (uint8_t)red }, BGR[] = { (uint8_t)200, (uint8_t)200, (uint8_t)200 };
+        unsigned char yuv[3], YUV[3];
+        unsigned char* col, * Gray;
 
-            unsigned char bgr[] = { (uint8_t)blue, (uint8_t)green, (uint8_t)red }, BGR[] = { (uint8_t)200, (uint8_t)200, (uint8_t)200 };
-            unsigned char yuv[3], YUV[3];
-            unsigned char* col, * Gray;
+        if (fi->colorFamily != cmRGB)
+        {
+            BGR2YUV(bgr, yuv);	// for use of YUV formats
+            BGR2YUV(BGR, YUV);
+            col = d->color ? yuv : YUV;
+            Gray = YUV;
+        }
+        else
+        {
+            col = d->color ? bgr : BGR;
+            Gray = BGR;
+        }
+        // bubble and rim values in sample type
+        finc hue[3], HUE[3];
+        float max = fi->colorFamily == cmRGB ? 255.0f : 235.0f;
 
-            if (fi->colorFamily != cmRGB)
+        for (int p = 0; p < np; p++)
+        {
+            if (sizeof(finc) == 4)
             {
-                BGR2YUV(bgr, yuv);	// for use of YUV formats
-                BGR2YUV(BGR, YUV);
-                if (d->color)
-                {
-                    col = yuv;
-                    Gray = YUV;
-                }
-                else
-                {
-                    col = YUV;
-                    Gray = YUV;
-                }
+                float offset = p != 0 && fi->colorFamily == cmYUV ? 0.5f : 0.0f;
+                hue[p] = (finc)((float)col[p] / max - offset);
+                HUE[p] = (finc)((float)Gray[p] / max - offset);
             }
             else
             {
-                if (d->color)
-                {
-                    col = bgr;
-                    Gray = BGR;
-                }
-                else
-                {
-                    col = BGR;
-                    Gray = BGR;
-                }
+                hue[p] = (finc)((int)col[p] << (nbits - 8));
+                HUE[p] = (finc)((int)Gray[p] << (nbits - 8));
             }
+        }
 
-            float max = fi->colorFamily == cmRGB ? 255.0f : 235.0f;
+        // luma size planes, then subsampled ones. each at own resolution
+        int nfull = lumaSizePlanes(pl, np);
 
-            if (sy > 0 && sy < d->floory && ey < d->floory && ey > d->srcy - d->rise)
-            {
-                int hdpitch = (sy)* dpitch[0];
+        for (int p0 = 0; p0 < np; p0 += nfull, nfull = np - nfull)
+        {
+            int subW = pl[p0].subW, subH = pl[p0].subH;
+            int pitch = pl[p0].pitch;
+            // bubbles are culled in y only. Near a side, clip to plane width
+            int wstart = VSMAX(planeStart(sx, subW), 0), wend = VSMIN(planeStart(ex, subW), pl[p0].width);
 
-                for (int h = sy; h < ey; h++)
+            for (int hp = planeStart(sy, subH); hp < planeStart(ey, subH); hp++)
+            {
+                int h = hp << subH;     // luma coordinates
+                int hsq = (h - fy) * (h - fy);
+                int x0, x1;
+                // samples of this row within bubble
+                if (!discRowSpan(&x0, &x1, fx, rsq, h - fy, subW, wstart, wend))
+                    continue;
+
+                for (int wp = x0, w = x0 << subW; wp < x1; wp++, w += 1 << subW)
                 {
+                    int radsq = hsq + (w - fx) * (w - fx);
+                    // rim, or a glint
+                    bool rim = radsq > r1sq
+                        || (radsq < r4sq && radsq > r6sq && w < fx + 3 && w > fx - 3);
 
-                    int hsq = (h - fy) * (h - fy);
-
-                    for (int w = sx; w < ex; w++)
+                    for (int p = p0; p < p0 + nfull; p++)
                     {
-                        int radsq = hsq + (w - fx) * (w - fx);
-
-                        if (radsq <= rsq)
-                        {
-
-                            for (int p = 0; p < np; p++)
-                            {
-                                if (fi->sampleType == stInteger)
-                                {
-                                    if (nbytes == 1)
-                                    {
-                                        unsigned char hue = col[p];
-                                        unsigned char HUE = Gray[p];
-                                        //  unsigned char val = *(dp[p] + (h >> subH) * dpitch[p] + (w >> subW));
-                                        if (p == 0 || fi->colorFamily == cmRGB || (subH == 0 && subW == 0))
-                                        {
-
-                                            if (radsq > (r1sq))
-                                            {
-                                                *(dp[p] + (h)*dpitch[p] + (w)) = HUE;
-
-                                            }
-                                            // To get a glint
-                                            else if (radsq < (r4sq)
-                                                && radsq >(r6sq)
-                                                && (w < fx + 3 && w > fx - 3))
-                                            {
-                                                *(dp[p] + (h)*dpitch[p] + (w)) = HUE;
-
-                                            }
-                                            else 
-                                            {
-                                                unsigned char val = *(dp[p] + (h)*dpitch[p] + (w));
-                                                *(dp[p] + (h)*dpitch[p] + (w)) = val > hue ?
-                                                    (val * 2 + hue) / 3 : hue;
-                                            }
-
-                                        }
-                                        else
-                                        {
-                                            if ((h & andH) == 0 && (w & andW) == 0)
-                                            {
-                                                
-                                                if (radsq > (r1sq))
-                                                {
-                                                    *(dp[p] + (h >> subH) * dpitch[p] + (w >> subW)) = HUE;
-
-                                                }
-                                                // To get a glint
-                                                else if (radsq < (r4sq)
-                                                    && radsq >(r6sq)
-                                                    && (w < fx + 3 && w > fx - 3))
-                                                {
-                                                    *(dp[p] + (h >> subH) * dpitch[p] + (w >> subW)) = HUE;
-
-                                                }
-                                                else 
-                                                {
-                                                    unsigned char val = *(dp[p] + (h >> subH) * dpitch[p] + (w >> subW));
-                                                    *(dp[p] + (h >> subH) * dpitch[p] + (w >> subW)) = val > hue ?
-                                                        (val * 2 + hue) / 3 : hue;
-
-                                                }
-                                            }
-                                        }
-                                    }
-
-                                    else if ( nbytes == 2)
-                                    {
-                                        uint16_t hue = (uint16_t)( (int)col[p] << (nbits - 8) );
-                                        uint16_t HUE = (uint16_t)( (int)Gray[p] << (nbits - 8) );
-                                        
-                                        if (p == 0 || fi->colorFamily == cmRGB || (subH == 0 && subW == 0))
-                                        {
-
-                                            if (radsq > (r1sq))
-                                            {
-                                                *((uint16_t*)dp[p] + (h)*dpitch[p] + (w)) =  HUE;
-
-                                            }
-                                            // To get a glint
-                                            else if (radsq < (r4sq)
-                                                && radsq >(r6sq)
-                                                && (w < fx + 3 && w > fx - 3))
-                                            {
-                                                *((uint16_t*)dp[p] + (h)*dpitch[p] + (w)) =  HUE;
-
-                                            }
-                                            else 
-                                            {
-                                                uint16_t val = *((uint16_t*)dp[p] + (h)*dpitch[p] + (w));
-                                                *( (uint16_t*)dp[p] + (h)*dpitch[p] + (w)) = val > hue ?
-                                                    (val * 2 + hue) / 3 : hue;
-                                            }
-
-                                        }
-                                        else
-                                        {
-                                            if ((h & andH) == 0 && (w & andW) == 0)
-                                            {
-                                                uint16_t val = *( (uint16_t*)dp[p] + (h >> subH) * dpitch[p] + (w >> subW));
-                                                *( (uint16_t*)dp[p] + (h >> subH) * dpitch[p] + (w >> subW)) = val > hue ?
-                                                    (val * 2 + hue) / 3 : hue;
-
-                                                if (radsq > (r1sq))
-                                                {
-                                                    *((uint16_t*)dp[p] + (h >> subH) * dpitch[p] + (w >> subW)) = HUE;
-
-                                                }
-                                                // To get a glint
-                                                else if (radsq < (r4sq)
-                                                    && radsq >(r6sq)
-                                                    && (w < fx + 3 && w > fx - 3))
-                                                {
-                                                    *((uint16_t*)dp[p] + (h >> subH) * dpitch[p] + (w >> subW)) = HUE;
-
-                                                }
-                                                else
-                                                {
-                                                    uint16_t val = *((uint16_t*)dp[p] + (h >> subH)*dpitch[p] + (w >> subW));
-                                                    *((uint16_t*)dp[p] + (h >> subH)*dpitch[p] + (w >> subW)) = val > hue ?
-                                                        (val * 2 + hue) / 3 : hue;
-                                                }
-                                            }
-                                        }
-                                    }
-
-                                }
-                                else if (fi->sampleType == stFloat)
-                                {
-                                
-                                    float hue = (float)col[p] / max;
-                                    float HUE = (float)Gray[p] / max;
-                                    if (p != 0 && fi->colorFamily == cmYUV)
-                                    {
-                                        hue -= 0.5f;
-                                        HUE -= 0.5f;
-                                    }
-
-                                    if (p == 0 || fi->colorFamily == cmRGB || (subH == 0 && subW == 0))
-                                    {
-
-                                        if (radsq > (r1sq))
-                                        {
-                                            *((float*)dp[p] + (h)*dpitch[p] + (w)) = HUE;
-
-                                        }
-                                        // To get a glint
-                                        else if (radsq < (r4sq)
-                                            && radsq >(r6sq)
-                                            && (w < fx + 3 && w > fx - 3))
-                                        {
-                                            *((float*)dp[p] + (h)*dpitch[p] + (w)) = HUE;
-
-                                        }
-                                        else
-                                        {
-                                            float val = *((float*)dp[p] + (h)*dpitch[p] + (w));
-                                            *((float*)dp[p] + (h)*dpitch[p] + (w)) = val > hue ?
-                                                (val * 2 + hue) / 3 : hue;
-                                        }
-
-                                    }
-                                    else
-                                    {
-                                        if ((h & andH) == 0 && (w & andW) == 0)
-                                        {
-                                            float val = *((float*)dp[p] + (h >> subH) * dpitch[p] + (w >> subW));
-                                            *((float*)dp[p] + (h >> subH) * dpitch[p] + (w >> subW)) = val > hue ?
-                                                (val * 2 + hue) / 3 : hue;
-
-                                            if (radsq > (r1sq))
-                                            {
-                                                *((float*)dp[p] + (h >> subH) * dpitch[p] + (w >> subW)) = HUE;
-
-                                            }
-                                            // To get a glint
-                                            else if (radsq < (r4sq)
-                                                && radsq >(r6sq)
-                                                && (w < fx + 3 && w > fx - 3))
-                                            {
-                                                *((float*)dp[p] + (h >> subH) * dpitch[p] + (w >> subW)) = HUE;
-
-                                            }
-                                            else
-                                            {
-                                                float val = *((float*)dp[p] + (h >> subH) * dpitch[p] + (w >> subW));
-                                                *((float*)dp[p] + (h >> subH) * dpitch[p] + (w >> subW)) = val > hue ?
-                                                    (val * 2 + hue) / 3 : hue;
-                                            }
-                                        }
-                                    }
-                                }
-                            }
-                        }
+                        finc* dpp = (finc*)pl[p].dp + hp * pitch + wp;
+                        *dpp = rim ? HUE[p] : *dpp > hue[p] ? (finc)((*dpp * 2 + hue[p]) / 3) : hue[p];
                     }
                 }
             }
         }
+    }
+    scratchEnd(scratch);
+}
+
+static const VSFrameRef* VS_CC bubblesGetFrame(int in, int activationReason, void** instanceData, void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi) {
+    BubblesData* d = (BubblesData*)*instanceData;
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(in, d->node, frameCtx);
+    }
+    else if (activationReason == arAllFramesReady) {
+        const VSFrameRef* src = vsapi->getFrameFilter(in, d->node, frameCtx);
+
+        if (in < d->StartFrame || in > d->EndFrame)
+            return src;
+        int n = in - d->StartFrame;
+        int nframes = d->EndFrame - d->StartFrame + 1;
+
+        VSFrameRef* dst = vsapi->copyFrame(src, core);
+        const VSFormat* fi = d->vi->format;
+
+        FramePlane pl[3];
+        int np = getFramePlanes(pl, dst, NULL, vsapi);
+        int nbytes = fi->bytesPerSample;
+        // format decides kernel once per frame
+        if (nbytes == 1)
+            bubblesKernel<uint8_t>(pl, np, fi, d, n);
+        else if (nbytes == 2)
+            bubblesKernel<uint16_t>(pl, np, fi, d, n);
+        else
+            bubblesKernel<float>(pl, np, fi, d, n);
     
         vsapi->freeFrame(src);
         return dst;
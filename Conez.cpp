@@ -20,11 +20,40 @@ typedef struct {
     int top;
     
     float* cubic;
+    int16_t* q14Coeff;  // integer coefficients for 8 bit
+    int32_t* q30Coeff;  // and for 9 to 16 bit. NULL if not used
     int quantiles;
     int span;
+    WarpMap* map;       // wrap of a cone that does not change. NULL if progressive
+    WarpCache* cache;   // maps of progressive cone. NULL if map is static
+    int cacheMB;        // budget of cache
+    int threads;        // threads doing bands of lines of a frame
    
 } ConezData;
 
+// cone of a frame, for bands of its lines
+typedef struct {
+    uint8_t** dp;
+    const uint8_t** sp;
+    const int* pitch;
+    int np;
+    const ConezData* d;
+    const WarpMap* map;
+} ConezBand;
+
+// radius of cone at line l of nlines
+int conezRadius(int l, int nlines, int diaTop, int diaBot);
+// map with a row for each line across cone axis, holding source offset and
+// quantile of samples 0 to radius - 1 from axis. Other side is symmetrical
+WarpMap* conezWarpMap(const ConezData* d, int diaTop, int diaBot);
+template <typename finc, bool subsampled>
+void conezKernel(uint8_t** dp8, const uint8_t** sp8, const int* pitch, int np, int subW, int subH,
+    const finc* min, const finc* max, const ConezData* d, const WarpMap* map, int l0, int l1);
+template <typename finc>
+finc conezSample(const finc* point, int step, int quant, const ConezData* d, finc min, finc max);
+// all planes in lines row0 to row1 - 1. Lines are rows if vertical, else columns
+static void conezBand(void* work, int row0, int row1);
+
 static void VS_CC conezInit(VSMap *in, VSMap *out, void **instanceData,
                             VSNode *node, VSCore *core, const VSAPI *vsapi)
 {
@@ -34,6 +63,247 @@ static void VS_CC conezInit(VSMap *in, VSMap *out, void **instanceData,
     d->span = 4;
     d->cubic = (float*)vs_aligned_malloc(sizeof(float) * 4 * (d->quantiles + 1), 32);
     CubicIntCoeff(d->cubic, d->quantiles);
+    d->q14Coeff = NULL;
+    d->q30Coeff = NULL;
+
+    if (d->vi->format->sampleType == stInteger && d->vi->format->bitsPerSample == 8)
+    {
+        d->q14Coeff = (int16_t*)vs_aligned_malloc(sizeof(int16_t) * 4 * (d->quantiles + 1), 32);
+        Q14Coeff(d->q14Coeff, d->cubic, 4, d->quantiles + 1);
+    }
+    else if (d->vi->format->sampleType == stInteger)
+    {
+        d->q30Coeff = (int32_t*)vs_aligned_malloc(sizeof(int32_t) * 4 * (d->quantiles + 1), 32);
+        Q30Coeff(d->q30Coeff, d->cubic, 4, d->quantiles + 1);
+    }
+    d->map = NULL;
+
+    if (!d->progressive)
+        d->map = conezWarpMap(d, d->top, d->base);
+    // cache is only for animated geometry
+    d->cache = NULL;
+
+    if (d->map == NULL)
+        d->cache = warpCacheCreate((size_t)d->cacheMB << 20);
+}
+
+int conezRadius(int l, int nlines, int diaTop, int diaBot)
+{
+    return VSMAX((diaBot - ((diaBot - diaTop) * (nlines - l)) / nlines) / 2, 0);
+}
+
+WarpMap* conezWarpMap(const ConezData* d, int diaTop, int diaBot)
+{
+    // lines are rows if vertical, else columns
+    int nlines = d->vert ? d->vi->height : d->vi->width;
+    int length = d->vert ? d->vi->width : d->vi->height;
+    ScratchArena* tmp = scratchBegin();
+    int* rowLength = scratchAlloc<int>(tmp, sizeof(int) * nlines);
+
+    for (int l = 0; l < nlines; l++)
+        rowLength[l] = conezRadius(l, nlines, diaTop, diaBot);
+
+    WarpMap* map = warpMapCreate(nlines, rowLength);
+    scratchEnd(tmp);
+
+    for (int l = 0; l < nlines; l++)
+    {
+        int rad = conezRadius(l, nlines, diaTop, diaBot);
+        float ratio = (float)(length / (M_PI * rad)); // length /  (pi * r)
+        WarpEntry* e = warpMapRow(map, l);
+
+        for (int k = 0; k < rad; k++)
+        {
+            //  alfa is angle between axis line through center , and line joining 
+            //projection point on to circle perimeter.
+            // so angle = acos(x/r). alfa = (PI / 2 - angle). 
+            // length of arc = r * alfa. Half perimeter = PI * rad
+            // mult ratio = length /(half perimeter) 
+            float angle = acos((float)k / (float)rad);
+            float x = (float)(rad * (M_PI_2 - angle));
+            float originalLocation = x * ratio;
+            // lower integer nearest
+            int knew = (int)originalLocation;
+            // fraction is at this quantile
+            int q = (int)((originalLocation - knew) * d->quantiles);
+
+            e[k].dx = (int16_t)(d->vert ? knew - k : 0);
+            e[k].dy = (int16_t)(d->vert ? 0 : knew - k);
+            e[k].qx = (uint8_t)(d->vert ? q : 0);
+            e[k].qy = (uint8_t)(d->vert ? 0 : q);
+        }
+    }
+    return map;
+}
+
+// interpolated sample along a line. 8 and 16 bit samples are done in integer
+template <typename finc>
+finc conezSample(const finc* point, int step, int quant, const ConezData* d, finc min, finc max)
+{
+    if (sizeof(finc) == 1)
+        return iclamp(alongLineInterpolateQ14((const uint8_t*)point, step, d->span, quant, d->q14Coeff), min, max);
+    if (sizeof(finc) == 2)
+        return iclamp(alongLineInterpolateQ30((const uint16_t*)point, step, d->span, quant, d->q30Coeff), min, max);
+    return clamp(alongLineInterpolate(point, step, d->span, quant, d->cubic), min, max);
+}
+
+// wraps image on cone in lines l0 to l1 - 1. finc and subsampling are fixed at compile
+// time so that inner loops have no format checks
+template <typename finc, bool subsampled>
+void conezKernel(uint8_t** dp8, const uint8_t** sp8, const int* pitch, int np, int subW, int subH,
+    const finc* min, const finc* max, const ConezData* d, const WarpMap* map, int l0, int l1)
+{
+    finc* dp[] = { (finc*)dp8[0], (finc*)dp8[1], (finc*)dp8[2] };
+    const finc* sp[] = { (const finc*)sp8[0], (const finc*)sp8[1], (const finc*)sp8[2] };
+    int andH = (1 << subH) - 1;
+    int andW = (1 << subW) - 1;
+    int ht = d->vi->height;
+    int wd = d->vi->width;
+    int npfull = subsampled ? 1 : np;   // planes at full resolution
+
+    if (d->vert)
+    {
+        // chroma rows advance once in 1 << subH luma rows
+        for (int p = 0; p < np; p++)
+        {
+            int rows = p == 0 ? l0 : planeStart(l0, subH);
+            sp[p] += rows * pitch[p];
+            dp[p] += rows * pitch[p];
+        }
+
+        for (int h = l0; h < l1; h++)
+        {
+            // radius at current h. 
+            int rad = map->rowStart[h + 1] - map->rowStart[h];
+            const WarpEntry* e = warpMapRow(map, h);
+            
+            for (int w = 0; w < rad; w++)
+            {
+                int wnew = w + e[w].dx;
+                int qx = e[w].qx;
+
+                for (int p = 0; p < npfull; p++)
+                {
+                    dp[p][wd / 2 + w] = conezSample(sp[p] + wd / 2 + wnew,
+                                    1, qx, d, min[p], max[p]);
+                    // symmetrical position
+                    dp[p][wd / 2 - w] = conezSample(sp[p] + wd / 2 - wnew,
+                                    -1, qx, d, min[p], max[p]);
+                }
+
+                if (subsampled && (w & andW) == 0 && (h & andH) == 0)
+                {
+                    for (int p = 1; p < np; p++)
+                    {
+                        dp[p][(wd / 2 + w) >> subW] = sp[p][(wd / 2 + wnew) >> subW];
+                        dp[p][(wd / 2 - w) >> subW] = sp[p][(wd / 2 - wnew) >> subW];
+                    }
+                }
+            }
+
+            for (int p = 0; p < np; p++)
+            {
+                if (p == 0 || (h & andH) == 0)
+                {
+                    sp[p] += pitch[p];
+                    dp[p] += pitch[p];
+                }
+            }
+        }
+    }
+
+    else // if (!d->vert) Horizontal orientation
+    {
+        for (int w = l0; w < l1; w++)
+        {
+            // even number as we will divide by 2 for each half.
+            // diameter of cone at this value of W
+            int rad = map->rowStart[w + 1] - map->rowStart[w];
+            const WarpEntry* e = warpMapRow(map, w);
+
+            for (int h = 0; h < rad; h++)
+            {
+                int hOrig = h + e[h].dy;
+                int qy = e[h].qy;
+
+                for (int p = 0; p < npfull; p++)
+                {
+                    dp[p][(ht / 2 + h) * pitch[p] + w] = conezSample(sp[p] + (ht / 2 + hOrig) * pitch[p] + w,
+                        pitch[p], qy, d, min[p], max[p]);
+                    // symmetrical position
+                    dp[p][(ht / 2 - h) * pitch[p] + w] = conezSample(sp[p] + (ht / 2 - hOrig) * pitch[p] + w,
+                        -pitch[p], qy, d, min[p], max[p]);
+                }
+
+                if (subsampled && (w & andW) == 0 && (h & andH) == 0)
+                {
+                    for (int p = 1; p < np; p++)
+                    {
+                        dp[p][((ht / 2 + h) >> subH) * pitch[p] + (w >> subW)]
+                            = sp[p][((ht / 2 + hOrig) >> subH) * pitch[p] + (w >> subW)];
+                        dp[p][((ht / 2 - h) >> subH) * pitch[p] + (w >> subW)]
+                            = sp[p][((ht / 2 - hOrig) >> subH) * pitch[p] + (w >> subW)];
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void conezBand(void* work, int row0, int row1)
+{
+    const ConezBand* b = (const ConezBand*)work;
+    const VSFormat* fi = b->d->vi->format;
+    int subH = fi->subSamplingH;
+    int subW = fi->subSamplingW;
+    int nbytes = fi->bytesPerSample;
+    int nbits = fi->bitsPerSample;
+    bool subsampled = b->np > 1 && (subW != 0 || subH != 0);
+    // format decides kernel once per band
+    if (nbytes == 1)
+    {
+        uint8_t min[] = { 0, 0, 0 }, max[] = { 255, 255, 255 };
+
+        if (fi->colorFamily == cmYUV)
+            for (int p = 0; p < 3; p++)
+            {
+                min[p] = 16;
+                max[p] = 240;
+            }
+        if (subsampled)
+            conezKernel<uint8_t, true>(b->dp, b->sp, b->pitch, b->np, subW, subH, min, max, b->d, b->map, row0, row1);
+        else
+            conezKernel<uint8_t, false>(b->dp, b->sp, b->pitch, b->np, 0, 0, min, max, b->d, b->map, row0, row1);
+    }
+    else if (nbytes == 2)
+    {
+        uint16_t min[3], max[3];
+
+        for (int p = 0; p < 3; p++)
+        {
+            min[p] = fi->colorFamily == cmYUV ? (uint16_t)(16 << (nbits - 8)) : 0;
+            max[p] = fi->colorFamily == cmYUV ? (uint16_t)(240 << (nbits - 8)) : (uint16_t)((1 << nbits) - 1);
+        }
+        if (subsampled)
+            conezKernel<uint16_t, true>(b->dp, b->sp, b->pitch, b->np, subW, subH, min, max, b->d, b->map, row0, row1);
+        else
+            conezKernel<uint16_t, false>(b->dp, b->sp, b->pitch, b->np, 0, 0, min, max, b->d, b->map, row0, row1);
+    }
+    else
+    {
+        float min[] = { 0, 0, 0 }, max[] = { 1.0f, 1.0f, 1.0f };
+
+        if (fi->colorFamily == cmYUV)
+            for (int p = 1; p < 3; p++)
+            {
+                min[p] = -0.5f;
+                max[p] = 0.5f;
+            }
+        if (subsampled)
+            conezKernel<float, true>(b->dp, b->sp, b->pitch, b->np, subW, subH, min, max, b->d, b->map, row0, row1);
+        else
+            conezKernel<float, false>(b->dp, b->sp, b->pitch, b->np, 0, 0, min, max, b->d, b->map, row0, row1);
+    }
 }
 
 static const VSFrameRef* VS_CC conezGetFrame(int in, int activationReason, void** instanceData, 
@@ -64,14 +334,9 @@ static const VSFrameRef* VS_CC conezGetFrame(int in, int activationReason, void*
         const VSFormat* fi = d->vi->format;
         const unsigned char* sp[] = { NULL, NULL, NULL };
         unsigned char* dp[] = { NULL, NULL, NULL };
-        int subH = fi->subSamplingH;
-        int subW = fi->subSamplingW;
-        int andH = (1 << subH) - 1;
-        int andW = (1 << subW) - 1;
 
         int pitch[] = { 0,0,0 };
         int nbytes = fi->bytesPerSample;
-        int nbits = fi->bitsPerSample;
         int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;
 
         int ht = d->vi->height;
@@ -84,323 +349,33 @@ static const VSFrameRef* VS_CC conezGetFrame(int in, int activationReason, void*
             pitch[p] = vsapi->getStride(dst, p) / nbytes;
         }
         // process
+        int diaTop, diaBot;
+
         if (d->vert)
         {
-            int diaTop = wd - ((wd - d->top) * n) / nframes;
-            int diaBot = wd - ((wd - d->base) * n) / nframes;
-
-            if (!d->progressive)
-            {
-                diaTop = d->top;
-                diaBot = d->base;
-            }
-            for (int h = 0; h < ht; h++)
-            {
-                // radius at current h. 
-                int rad = (diaBot - ((diaBot - diaTop) * (ht - h)) / ht) / 2;
-                
-                float ratio = (float)(wd / (M_PI * rad)); // width /  (pi * r)
-                
-                for (int w = 0; w < rad; w++)
-                {
-                    //  alfa is angle between vertical axis line through center , and line joining 
-                    //projection point on to circle perimeter.
-                    // so angle = acos(x/r). alfa = (PI / 2 - angle). 
-                    // length of arc = r * alfa. Half perimeter = PI * rad
-                    // mult ratio = wd /(half perimeter) 
-                    float angle = acos((float)w / (float)rad);
-                   // float alfa = M_PI_2 - angle;
-                    float x = (float)(rad * (M_PI_2 - angle));
-                    float originalLocation = x * ratio;
-                    // lower integer nearest
-                    int wnew = (int)originalLocation;
-                    // fraction is at this quantile
-                    int qx = (int)((originalLocation - wnew) * d->quantiles);
-
-                    if (fi->sampleType == stInteger && nbytes == 1)
-                    {
-                        for (int p = 0; p < np; p++)
-                        {
-                            uint8_t min = 0, max = 255;
-
-                            if (fi->colorFamily == cmYUV)
-                            {
-                                min = 16;
-                                max = 240;
-                            }
-
-                            const uint8_t* spp = sp[p];
-                            uint8_t* dpp = dp[p];
-
-                            if (p == 0 || fi->colorFamily == cmRGB || (subH == 0 && subW == 0))
-                            {
-                                int newval = (int)clamp( alongLineInterpolate(spp + wd / 2 + wnew,
-                                                1, d->span, qx, d->cubic), min, max ) ;
-                                dpp[wd / 2 + w] = newval;
-                                // symmetrical position
-                                newval = (int)clamp(alongLineInterpolate(spp + wd / 2 - wnew ,
-                                                -1, d->span, qx, d->cubic), min, max);
-                                dpp[ wd / 2 - w] = newval;
-
-                            }
-                            else
-                            {
-                                if ((w & andW) == 0 && (h & andH) == 0)
-                                {
-                                    *(dpp + ((wd / 2 + w) >> subW) )
-                                    = *(spp + ( (wd / 2 + wnew) >> subW) );
-                                    *(dpp + ( (wd / 2 - w) >> subW) )
-                                    = *(spp + ( (wd / 2 - wnew) >> subW) );
-                                }
-                            }
-                        }
-                    }
-
-                    if (fi->sampleType == stInteger && nbytes == 2)
-                    {
-                        for (int p = 0; p < np; p++)
-                        {
-                            uint16_t min = 0, max = (1 << nbits) - 1;
-
-                            if (fi->colorFamily == cmYUV)
-                            {
-                                min = (16 << (nbits - 8) );
-                                max = (240 << (nbits - 8) );
-                            }
-
-                            const uint16_t* spp = (uint16_t*)(sp[p]);
-                            uint16_t* dpp = (uint16_t *)(dp[p]);
-
-                            if (p == 0 || fi->colorFamily == cmRGB || (subH == 0 && subW == 0))
-                            {
-                                int newval = (int)clamp(alongLineInterpolate(spp + wd / 2 + wnew,
-                                    1, d->span, qx, d->cubic), min, max);
-                                dpp[wd / 2 + w] = newval;
-                                // symmetrical position
-                                newval = (int)clamp(alongLineInterpolate(spp + wd / 2 - wnew,
-                                    -1, d->span, qx, d->cubic), min, max);
-                                dpp[wd / 2 - w] = newval;
-
-                            }
-                            else
-                            {
-                                if ((w & andW) == 0 && (h & andH) == 0)
-                                {
-                                    *(dpp + ((wd / 2 + w) >> subW))
-                                        = *(spp + ((wd / 2 + wnew) >> subW));
-                                    *(dpp + ((wd / 2 - w) >> subW))
-                                        = *(spp + ((wd / 2 - wnew) >> subW));
-                                }
-                            }
-                        }
-                    }
-                    if (fi->sampleType == stFloat)
-                    {
-                        for (int p = 0; p < np; p++)
-                        {
-                            float min = 0, max = 1.0f;
-
-                            if (fi->colorFamily == cmYUV && p > 0)
-                            {
-                                min = -0.5f;
-                                max = 0.5f;
-                            }
-
-                            const float* spp = (float*)(sp[p]);
-                            float* dpp = (float*)(dp[p]);
-
-                            if (p == 0 || fi->colorFamily == cmRGB || (subH == 0 && subW == 0))
-                            {
-                                
-                                float newval = (float)clamp(alongLineInterpolate(spp + wd / 2 + wnew,
-                                    1, d->span, qx, d->cubic), min, max);
-                                dpp[wd / 2 + w] = newval; 
-                                // symmetrical position
-                                newval = (float)clamp(alongLineInterpolate(spp + wd / 2 - wnew,
-                                    -1, d->span, qx, d->cubic), min, max);
-                                dpp[wd / 2 - w] = newval;
-
-                            }
-                            else
-                            {
-                                if ((w & andW) == 0 && (h & andH) == 0)
-                                {
-                                    *(dpp + ((wd / 2 + w) >> subW))
-                                        = *(spp + ((wd / 2 + wnew) >> subW));
-                                    *(dpp + ((wd / 2 - w) >> subW))
-                                        = *(spp + ((wd / 2 - wnew) >> subW));
-                                }
-                            }
-                        }
-                    }
-                }
-
-                for (int p = 0; p < np; p++)
-                {
-                    if (p == 0 || (h & andH) == 0)
-                    {
-                        sp[p] += pitch[p] * nbytes;
-                        dp[p] += pitch[p] * nbytes;
-                    }
-                    
-                }
-            }
+            diaTop = wd - ((wd - d->top) * n) / nframes;
+            diaBot = wd - ((wd - d->base) * n) / nframes;
         }
-
-        else // if (!d->vert) Horizontal orientation
+        else // Horizontal orientation
         {
-
-            int diaTop = ht - ((ht - d->top) * n) / nframes;
-            int diaBot = ht - ((ht - d->base) * n) / nframes;
-
-            if (!d->progressive)
-            {
-                diaTop = d->top;
-                diaBot = d->base;
-            }
-            for (int w = 0; w < wd; w++)
-            {
-                // even number as we will divide by 2 for each half.
-                // diameter of cone at this value of W
-                int rad = (diaBot - ((diaBot - diaTop) * (wd - w)) / wd) / 2;
-               
-                float ratio = (float)(ht / ( M_PI * rad)); 
-                //unsigned char max = 255;
-
-                for (int h = 0; h < rad; h++)
-                {
-                    //  alfa is angle between vertical axis line through center , and line joining 
-                    //projection point on to circle perimeter.
-                    // so angle = acos(x/r). alfa = (PI / 2 - angle). 
-                    // length of arc = r * alfa. Half perimeter = PI * rad
-                    // mult ratio = wd /(half perimeter) 
-                    float angle = acos((float)h / (float)rad);
-                   // float alfa = M_PI_2 - angle;
-                    float y = (float)(rad * (M_PI_2 - angle));
-
-                    float originalLocation = y * ratio;
-                    int hOrig = (int)originalLocation;
-                    int qy = (int)((originalLocation - hOrig) * d->quantiles);
-
-                    for (int p = 0; p < np; p++)
-                    {
-                        if (fi->sampleType == stInteger && nbytes == 1)
-                        {
-
-                            uint8_t min = 0, max = 255;
-
-                            if (fi->colorFamily == cmYUV)
-                            {
-                                min = 16;
-                                max = 240;
-                            }
-
-                            const uint8_t* spp = sp[p];
-                            uint8_t* dpp = dp[p];
-
-                            if (p == 0 || fi->colorFamily == cmRGB || (subH == 0 && subW == 0))
-                            {
-                                int newval = (int)clamp(alongLineInterpolate(spp + (ht / 2 + hOrig) * pitch[p] + w,
-                                    pitch[p], d->span, qy, d->cubic), min, max);
-                                dpp[(ht / 2 + h) * pitch[p] + w] = newval; 
-                                // symmetrical position
-                                newval = (int)clamp(alongLineInterpolate(spp + (ht / 2 - hOrig) * pitch[p] + w,
-                                    -pitch[p], d->span, qy, d->cubic), min, max);
-                                dpp[(ht / 2 - h) * pitch[p] + w] = newval; 
-
-                            }
-                            else
-                            {
-                                if ((w & andW) == 0 && (h & andH) == 0)
-                                {
-                                    *(dpp + ((ht / 2 + h) >> subH) * pitch[p] + (w >> subW))
-                                        = *(spp + ((ht / 2 + hOrig) >> subH) * pitch[p] + (w >> subW));
-                                    *(dpp + ((ht / 2 - h) >> subH) * pitch[p] + (w >> subW))
-                                        = *(spp + ((ht / 2 - hOrig) >> subH) * pitch[p] + (w >> subW));
-                                }
-                            }
-                        }
-
-
-                        if (fi->sampleType == stInteger && nbytes == 2)
-                        {
-
-                            uint16_t min = 0, max = (1 << nbits) - 1;
-
-                            if (fi->colorFamily == cmYUV)
-                            {
-                                min = (16 << (nbits - 8));
-                                max = (240 << (nbits - 8));
-                            }
-
-                            const uint16_t* spp = (uint16_t*)(sp[p]);
-                            uint16_t* dpp = (uint16_t*)(dp[p]);
-
-                            if (p == 0 || fi->colorFamily == cmRGB || (subH == 0 && subW == 0))
-                            {
-                                int newval = (int)clamp(alongLineInterpolate(spp + (ht / 2 + hOrig) * pitch[p] + w,
-                                    pitch[p], d->span, qy, d->cubic), min, max);
-                                dpp[(ht / 2 + h) * pitch[p] + w] = newval; 
-                                // symmetrical position
-                                newval = (int)clamp(alongLineInterpolate(spp + (ht / 2 - hOrig) * pitch[p] + w,
-                                    -pitch[p], d->span, qy, d->cubic), min, max);
-                                dpp[(ht / 2 - h) * pitch[p] + w] = newval; 
-
-                            }
-                            else
-                            {
-                                if ((w & andW) == 0 && (h & andH) == 0)
-                                {
-                                    *(dpp + ((ht / 2 + h) >> subH) * pitch[p] + (w >> subW))
-                                        = *(spp + ((ht / 2 + hOrig) >> subH) * pitch[p] + (w >> subW));
-                                    *(dpp + ((ht / 2 - h) >> subH) * pitch[p] + (w >> subW))
-                                        = *(spp + ((ht / 2 - hOrig) >> subH) * pitch[p] + (w >> subW));
-                                }
-                            }
-
-                        }
-                        if (fi->sampleType == stFloat)
-                        {
-
-                            float min = 0, max = 1.0f;
-
-                            if (fi->colorFamily == cmYUV && p > 0)
-                            {
-                                min = -0.5f;
-                                max = 0.5f;
-                            }
-
-                            const float* spp = (float*)(sp[p]);
-                            float* dpp = (float*)(dp[p]);
-                          
-
-                            if (p == 0 || fi->colorFamily == cmRGB || (subH == 0 && subW == 0))
-                            {
-                                float newval = clamp(alongLineInterpolate(spp + (ht / 2 + hOrig) * pitch[p] + w,
-                                    pitch[p], d->span, qy, d->cubic), min, max);
-                                dpp[(ht / 2 + h) * pitch[p] + w] = newval; 
-                                // symmetrical position
-                                newval = clamp(alongLineInterpolate(spp + (ht / 2 - hOrig) * pitch[p] + w,
-                                    -pitch[p], d->span, qy, d->cubic), min, max);
-                                dpp[(ht / 2 - h) * pitch[p] + w] = newval; 
-
-                            }
-                            else
-                            {
-                                if ((w & andW) == 0 && (h & andH) == 0)
-                                {
-                                    *(dpp + ((ht / 2 + h) >> subH) * pitch[p] + (w >> subW))
-                                        = *(spp + ((ht / 2 + hOrig) >> subH) * pitch[p] + (w >> subW));
-                                    *(dpp + ((ht / 2 - h) >> subH) * pitch[p] + (w >> subW))
-                                        = *(spp + ((ht / 2 - hOrig) >> subH) * pitch[p] + (w >> subW));
-                                }
-                            }
-
-                        }
-                    }
-
-                }
-            }
+            diaTop = ht - ((ht - d->top) * n) / nframes;
+            diaBot = ht - ((ht - d->base) * n) / nframes;
+        }
+        // progressive cone has a map for each pair of diameters
+        int key[WARP_KEY_SIZE] = { diaTop, diaBot, 0, 0 };
+        const WarpMap* map = d->map;
+
+        if (map == NULL)
+            map = warpCacheFind(d->cache, key);
+        if (map == NULL)
+            map = warpCacheInsert(d->cache, key, conezWarpMap(d, diaTop, diaBot));
+        // in bands of lines
+        ConezBand band = { dp, sp, pitch, np, d, map };
+        bandsRun(d->threads, d->vert ? ht : wd, conezBand, &band);
+
+        if (d->map == NULL)
+        {
+            warpCacheRelease(d->cache, map);
         }
         vsapi->freeFrame(src);
         vsapi->freeFrame(bkg);
@@ -415,6 +390,14 @@ static void VS_CC conezFree(void *instanceData, VSCore *core, const VSAPI *vsapi
     vsapi->freeNode(d->node);
     vsapi->freeNode(d->bnode);
     vs_aligned_free(d->cubic);
+    if (d->q14Coeff != NULL)
+        vs_aligned_free(d->q14Coeff);
+    if (d->q30Coeff != NULL)
+        vs_aligned_free(d->q30Coeff);
+    warpMapFree(d->map);
+    warpCacheLog(d->cache, "Conez", vsapi);
+    warpCacheFree(d->cache);
+    bandsDetach();
     free(d);
 }
 
@@ -505,11 +488,34 @@ static void VS_CC conezCreate(const VSMap *in, VSMap *out, void *userData, VSCor
         vsapi->freeNode(d.node);
         return;
     }
+    d.cacheMB = int64ToIntS(vsapi->propGetInt(in, "cache", 0, &err));
+    if (err)
+        d.cacheMB = 32;
+    else if (d.cacheMB < 0 || d.cacheMB > 1024)
+    {
+        vsapi->setError(out, "Conez: cache must be 0 to 1024 MB");
+        vsapi->freeNode(d.node);
+        vsapi->freeNode(d.bnode);
+        return;
+    }
+
+    d.threads = int64ToIntS(vsapi->propGetInt(in, "threads", 0, &err));
+    if (err)
+        d.threads = 1;
+    else if (d.threads < 0 || d.threads > BAND_MAX_THREADS)
+    {
+        vsapi->setError(out, "Conez: threads must be 1 to 64, or 0 for all cores");
+        vsapi->freeNode(d.node);
+        vsapi->freeNode(d.bnode);
+        return;
+    }
+    d.threads = bandThreads(d.threads);
     
 
     data = (ConezData*)malloc(sizeof(d));
     *data = d;
 
+    bandsAttach();
     vsapi->createFilter(in, out, "Conez", conezInit, conezGetFrame, conezFree, fmParallel, 0, data, core);
 }
 /*
@@ -82,24 +82,25 @@ static void VS_CC discolightsInit(VSMap *in, VSMap *out, void **instanceData,
 	d->rad = d->ix + 4 * nxy;		// 5
 	d->colFlag = d->ix + 5 * nxy;  // 6
 
-	srand(((d->EndFrame - d->StartFrame) * (d->EndFrame - d->StartFrame)
-		* (d->EndFrame - d->StartFrame)) | 1);
+	uint32_t nf = (uint32_t)(d->EndFrame - d->StartFrame);
+	RandomSequence rs;
+	startRandomSequence(&rs, (nf * nf * nf) | 1);
 	// random x, y, radius, preset color of spot	
 	for (int i = 0; i < nxy; i++)
 	{
-		d->rad[i] = (1 + (rand() % nrad)) * minRad; // get (1,2 or 3)* minRad
-		d->colFlag[i] = 1 + (rand() % ncol);	// we have 6 colors get 1 to 6
+		d->rad[i] = (1 + nextRandom(&rs, nrad)) * minRad; // get (1,2 or 3)* minRad
+		d->colFlag[i] = 1 + nextRandom(&rs, ncol);	// we have 6 colors get 1 to 6
 
 		if (d->type == 1 || d->type == 2)
 		{
-			d->ix[i] = rand() % wd;
-			d->iy[i] = rand() % ht;
-			d->fx[i] = rand() % wd;
-			d->fy[i] = rand() % ht;
+			d->ix[i] = nextRandom(&rs, wd);
+			d->iy[i] = nextRandom(&rs, ht);
+			d->fx[i] = nextRandom(&rs, wd);
+			d->fy[i] = nextRandom(&rs, ht);
 		}
 		else if ( d->type == 3)
 		{
-			int temp = rand() % 8;
+			int temp = nextRandom(&rs, 8);
 			switch (temp)
 			{
 				case 0:
@@ -22,9 +22,49 @@ typedef struct {
     int span;
    // int nOffsets, noffsetsUV;
     float* cubicCoeff;
+    int16_t* q14Coeff;  // for 8 bit. NULL for other formats
+    WarpMap* map;       // geometry of a disc, shared by all discs of all frames
+    int threads;        // threads doing bands of rows of a frame
   //  int* offsets, * offsetsUV;
 } FiguredGlassData;
 
+// frame of discs, for bands of its rows
+typedef struct {
+    const FramePlane* pl;
+    int np;
+    const FiguredGlassData* d;
+} FiguredGlassBand;
+
+// discs in rows row0 to row1 - 1. Order of discs is as of whole frame
+static void figuredglassBand(void* work, int row0, int row1)
+{
+    const FiguredGlassBand* b = (const FiguredGlassBand*)work;
+    const FiguredGlassData* d = b->d;
+    const VSFormat* fi = d->vi->format;
+    int ht = d->vi->height;
+    int wd = d->vi->width;
+    int nbytes = fi->bytesPerSample;
+
+    for (int cx = d->rad; cx < wd; cx += 2 * d->rad)
+    {
+        for (int cy = d->rad; cy < ht; cy += 2 * d->rad)
+        {
+            // discs not in band
+            if (cy + d->rad <= row0 || cy - d->rad >= row1)
+                continue;
+            if (nbytes == 1)
+                lensMagnifyPlanes<uint8_t>(b->pl, b->np, fi, ht, wd, d->rad, cx, cy, d->map, d->span,
+                    d->cubicCoeff, d->q14Coeff, row0, row1);
+            else if (nbytes == 2)
+                lensMagnifyPlanes<uint16_t>(b->pl, b->np, fi, ht, wd, d->rad, cx, cy, d->map, d->span,
+                    d->cubicCoeff, NULL, row0, row1);
+            else
+                lensMagnifyPlanes<float>(b->pl, b->np, fi, ht, wd, d->rad, cx, cy, d->map, d->span,
+                    d->cubicCoeff, NULL, row0, row1);
+        }
+    }
+}
+
 static void VS_CC figuredglassInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
     FiguredGlassData *d = (FiguredGlassData *) * instanceData;
     vsapi->setVideoInfo(d->vi, 1, node);
@@ -34,7 +74,15 @@ static void VS_CC figuredglassInit(VSMap *in, VSMap *out, void **instanceData, V
     // using cubic interpolation at 64 quantiles preset intervals
     d->cubicCoeff = (float*)vs_aligned_malloc(sizeof(float) * (d->quantiles + 1) * d->span, 32);
     CubicIntCoeff(d->cubicCoeff, d->quantiles);
-    
+    // integer coefficients for 8 bit samples
+    d->q14Coeff = NULL;
+
+    if (d->vi->format->sampleType == stInteger && d->vi->format->bitsPerSample == 8)
+    {
+        d->q14Coeff = (int16_t*)vs_aligned_malloc(sizeof(int16_t) * (d->quantiles + 1) * d->span, 32);
+        Q14Coeff(d->q14Coeff, d->cubicCoeff, d->span, d->quantiles + 1);
+    }
+    d->map = lensWarpMap(d->rad, d->imag, d->quantiles, d->drop);
 }
 
 static const VSFrameRef *VS_CC figuredglassGetFrame(int in, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
@@ -51,100 +99,15 @@ static const VSFrameRef *VS_CC figuredglassGetFrame(int in, int activationReason
             return src;
         }
 
-        int n = in - d->StartFrame;
-        const VSFormat* fi = d->vi->format;
-        int ht = d->vi->height;
-        int wd = d->vi->width;
         // to ensure inbetween spaces are filled properly
         VSFrameRef* dst = vsapi->copyFrame(src, core);
 
-        const unsigned char* sp[] = { NULL, NULL, NULL };
-        unsigned char* dp[] = { NULL, NULL, NULL };
-        int subH[] = { 0, fi->subSamplingH, fi->subSamplingH };
-        int subW[] = { 0, fi->subSamplingW, fi->subSamplingW };
-       // int andH = (1 << subH[1]) - 1;
-        //int andW = (1 << subW[1]) - 1;
-
-        int pitch[] = { 0,0,0 };
-        int nbytes = fi->bytesPerSample;
-        int nbits = fi->bitsPerSample;
-        int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;
+        FramePlane pl[3];
+        int np = getFramePlanes(pl, dst, src, vsapi);
+        // create discs with magnifications, in bands of rows
+        FiguredGlassBand band = { pl, np, d };
+        bandsRun(d->threads, d->vi->height, figuredglassBand, &band);
 
-        for (int p = 0; p < np; p++)
-        {
-            sp[p] = vsapi->getReadPtr(src, p);
-            dp[p] = vsapi->getWritePtr(dst, p);
-            pitch[p] = vsapi->getStride(dst, p) / nbytes;
-        }
-        
-        // create discs with magnifications
-        for (int cx = d->rad ; cx < wd   ; cx += 2 * d->rad)
-        {
-            for (int cy = d->rad ; cy < ht  ; cy += 2 * d->rad)
-            {
-                if (fi->sampleType == stInteger && nbytes == 1)
-                {
-                    uint8_t min = fi->colorFamily == cmRGB ? 0 : 16;
-                    uint8_t max = fi->colorFamily == cmRGB ? 255 : 236;
-
-                    circularLensMagnification(dp, sp, np, pitch, ht, wd, subW, subH, min, max,
-                                                d->rad, cx, cy, d->imag, d->span,
-                                                d->cubicCoeff, d->quantiles, d->drop);
-
-                }
-
-                else if (fi->sampleType == stInteger && nbytes == 2)
-                {
-                    uint16_t min = (fi->colorFamily == cmRGB ? 0 : 16) << (nbits - 8);
-                    uint16_t max = (fi->colorFamily == cmRGB ? 255 : 236) << (nbits - 8);
-
-                    circularLensMagnification((uint16_t**)dp, (const uint16_t**)sp, np, pitch, ht, wd, subW, subH, min, max,
-                        d->rad, cx, cy, d->imag, d->span,
-                        d->cubicCoeff, d->quantiles, d->drop);
-
-                }
-
-                else if (fi->sampleType == stFloat && nbytes == 4)
-                {
-                    
-                    if (fi->colorFamily != cmYUV)
-                    {
-                        float min = 0;
-                        float max = 1.0f;
-
-                        circularLensMagnification((float**)dp, (const float**)sp, np, pitch, ht, wd, subW, subH, min, max,
-                            d->rad, cx, cy, d->imag, d->span,
-                            d->cubicCoeff, d->quantiles, d->drop);
-                    }
-
-                    else if (fi->colorFamily == cmYUV)
-                    {
-                        // go around for yuv as min and max values differ for Y and UV planes
-                        float min = 0;
-                        float max = 1.0f;
-
-                        circularLensMagnification((float**)dp, (const float**)sp, 1, pitch, ht, wd, subW, subH, min, max,
-                            d->rad, cx, cy, d->imag, d->span,
-                            d->cubicCoeff, d->quantiles, d->drop);
-
-
-                        if (np > 1)
-                        {
-                            // U,V planes 
-                            float min = -0.5f;
-                            float max = 0.5f;
-
-                            circularLensMagnification((float**)(dp + 1), (const float**)(sp + 1), 2, pitch, ht, wd, subW, subH, min, max,
-                                d->rad, cx, cy, d->imag, d->span,
-                                d->cubicCoeff, d->quantiles, d->drop);
-                        }
-                    }
-
-                }
-            }
-        }
-
-        
         vsapi->freeFrame(src);
         return dst;
     }
@@ -156,6 +119,10 @@ static void VS_CC figuredglassFree(void *instanceData, VSCore *core, const VSAPI
     FiguredGlassData *d = (FiguredGlassData *)instanceData;
     vsapi->freeNode(d->node);
     vs_aligned_free(d->cubicCoeff);
+    if (d->q14Coeff != NULL)
+        vs_aligned_free(d->q14Coeff);
+    warpMapFree(d->map);
+    bandsDetach();
     free(d);
 }
 
@@ -231,10 +198,22 @@ static void VS_CC figuredglassCreate(const VSMap *in, VSMap *out, void *userData
         d.drop = true;
     else
         d.drop = false;
+
+    d.threads = int64ToIntS(vsapi->propGetInt(in, "threads", 0, &err));
+    if (err)
+        d.threads = 1;
+    else if (d.threads < 0 || d.threads > BAND_MAX_THREADS)
+    {
+        vsapi->setError(out, "FiguredGlass: threads must be 1 to 64, or 0 for all cores");
+        vsapi->freeNode(d.node);
+        return;
+    }
+    d.threads = bandThreads(d.threads);
     
     data = (FiguredGlassData*)malloc(sizeof(d));
     *data = d;
 
+    bandsAttach();
     vsapi->createFilter(in, out, "FiguredGlass", figuredglassInit, figuredglassGetFrame, figuredglassFree, fmParallel, 0, data, core);
 }
 
@@ -22,6 +22,7 @@ typedef struct {
     int nSmoke;
     int ntFlash;
     int* coord;
+    uint32_t seed;  // instance seed for counter based random numbers
 } FlashesData;
 
 static void VS_CC flashesInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
@@ -31,12 +32,15 @@ static void VS_CC flashesInit(VSMap *in, VSMap *out, void **instanceData, VSNode
     d-> nFlashes = 200;
     d->coord = (int *)vs_aligned_malloc(sizeof(int) * d->nFlashes, 32);
 
-    srand(((d->EndFrame - d->StartFrame) * (d->EndFrame - d->StartFrame)
-        * (d->EndFrame - d->StartFrame)) | 1);
+    uint32_t nf = (uint32_t)(d->EndFrame - d->StartFrame);
+    d->seed = (nf * nf * nf) | 1;
+    RandomSequence rs;
+    startRandomSequence(&rs, d->seed);
+
     for (int i = 0; i < d->nFlashes; i++)
     {
         // flash coordinates - rad to + rad wrt cloud center
-        d->coord[i] = - d->radmax + rand() % (2 * d->radmax);
+        d->coord[i] = - d->radmax + nextRandom(&rs, 2 * d->radmax);
 
     }
 }
@@ -91,6 +95,7 @@ static const VSFrameRef *VS_CC flashesGetFrame(int in, int activationReason, voi
         int fcycle = flash_duration / 4;	// 4 times the point flashes before disappearing 
 
         int add[] = { 0, 127, 127 };	// required for float data
+        uint32_t key = randomKey(d->seed, n);
             // fill with smoke
         for (int h = d->ycoord - smoke_radius; h < d->ycoord + smoke_radius; h++)
         {
@@ -101,11 +106,11 @@ static const VSFrameRef *VS_CC flashesGetFrame(int in, int activationReason, voi
                     if (w > 2 && w < wd - 2)
                     {
                         // to create wooly effect
-                        int delta = smoke_radius - rand() % (2 + smoke_radius / 8);	// to create hazy boundary
+                        int delta = smoke_radius - randomInRange(key, 2 * h, w, 2 + smoke_radius / 8);	// to create hazy boundary
 
                         if ((w - d->xcoord) * (w - d->xcoord) + (h - d->ycoord) * (h - d->ycoord) <= delta * delta)
                         {
-                            uint8_t grey[] = { (uint8_t)((rand() % 60) + 60), (uint8_t)127, (uint8_t)127 };// for changing smoke grey value
+                            uint8_t grey[] = { (uint8_t)(randomInRange(key, 2 * h + 1, w, 60) + 60), (uint8_t)127, (uint8_t)127 };// for changing smoke grey value
 
                             if (fi->colorFamily == cmRGB)
                             {
@@ -44,6 +44,13 @@ typedef struct {
 	unsigned char* red;
 } FlowerPotData;
 
+// embers of beams alive in frame n, drawn as particles. finc is fixed at compile time
+template <typename finc>
+void flowerpotKernel(const FramePlane* pl, int np, const VSFormat* fi, const FlowerPotData* d, int n, int nframes);
+// sx embers of a beam on each side, left ones from ps->count and right ones after them
+void flowerpotBeam(Particles* ps, int sx, int px, int py, int dx, double pp4, int xcoord, int ycoord,
+	float zmag, int id);
+
 
 static void VS_CC flowerpotInit(VSMap* in, VSMap* out, void** instanceData, VSNode* node, VSCore* core, const VSAPI* vsapi) {
     FlowerPotData* d = (FlowerPotData*)*instanceData;
@@ -61,22 +68,187 @@ static void VS_CC flowerpotInit(VSMap* in, VSMap* out, void** instanceData, VSNo
 	d->red = (uint8_t*)vs_aligned_malloc(d->nbeams + 2, 8);
 	int max = d->vi->format->colorFamily == cmRGB ? 255 : 235;
 
-	srand(((d->EndFrame - d->StartFrame) * (d->EndFrame - d->StartFrame)
-		* (d->EndFrame - d->StartFrame)) | 1);
+	uint32_t nf = (uint32_t)(d->EndFrame - d->StartFrame);
+	RandomSequence rs;
+	startRandomSequence(&rs, (nf * nf * nf) | 1);
 
 	for (int i = 0; i < d->nbeams + 2; i++)
 	{
-		d->py[i] = 1 + rand() % (d->rise );	// parabola y
-		d->px[i] = 1 + rand() % (d->rise / 4);	// parabola x
+		d->py[i] = 1 + nextRandom(&rs, d->rise);	// parabola y
+		d->px[i] = 1 + nextRandom(&rs, d->rise / 4);	// parabola x
 
 		if (d->color)
-			d->red[i] = (uint8_t)(50 + rand() % (max - 50));
+			d->red[i] = (uint8_t)(50 + nextRandom(&rs, max - 50));
 		else
 			d->red[i] = (uint8_t)max;
 	}
 	
 }
 //------------------------------------------------------------------------
+#ifdef VFX_X86_SIMD
+// returns embers done on each side
+VFX_TARGET("sse4.1") int flowerpotBeamSse41(int* x, int* y, int* id, int sx, int px, int py, int dx, double pp4,
+	int xcoord, int ycoord, float zmag, int bid)
+{
+	const __m128d vpp4 = _mm_set1_pd(pp4), vpy = _mm_set1_pd((double)py), vyc = _mm_set1_pd((double)ycoord);
+	const __m128 vzmag = _mm_set1_ps(zmag);
+	const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3), vid = _mm_set1_epi32(bid);
+	const __m128i vy = _mm_set1_epi32(ycoord), even = _mm_set1_epi32((int)0xfffffffe);
+	int ww = 0;
+
+	for (; ww + 4 <= sx; ww += 4)
+	{
+		__m128i w = _mm_add_epi32(_mm_set1_epi32(ww), lanes);
+		__m128i xx = _mm_sub_epi32(_mm_set1_epi32(px - dx), w);
+		__m128i xsq = _mm_mullo_epi32(xx, xx);
+		// xx * xx / pp4 - py + ycoord in double, two lanes at a time
+		__m128d lo = _mm_add_pd(_mm_sub_pd(_mm_div_pd(_mm_cvtepi32_pd(xsq), vpp4), vpy), vyc);
+		__m128d hi = _mm_add_pd(_mm_sub_pd(_mm_div_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(xsq, xsq)), vpp4), vpy), vyc);
+		__m128i yy = _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+		__m128i dw = _mm_add_epi32(_mm_set1_epi32(dx), w);
+
+		yy = _mm_add_epi32(_mm_cvttps_epi32(_mm_mul_ps(vzmag, _mm_cvtepi32_ps(_mm_sub_epi32(yy, vy)))), vy);
+		yy = _mm_and_si128(yy, even);
+		_mm_storeu_si128((__m128i*)(y + ww), yy);
+		_mm_storeu_si128((__m128i*)(y + sx + ww), yy);
+		_mm_storeu_si128((__m128i*)(x + ww), _mm_sub_epi32(_mm_set1_epi32(xcoord), dw));
+		_mm_storeu_si128((__m128i*)(x + sx + ww), _mm_add_epi32(_mm_set1_epi32(xcoord), dw));
+		_mm_storeu_si128((__m128i*)(id + ww), vid);
+		_mm_storeu_si128((__m128i*)(id + sx + ww), vid);
+	}
+	return ww;
+}
+
+VFX_TARGET("avx2") int flowerpotBeamAvx2(int* x, int* y, int* id, int sx, int px, int py, int dx, double pp4,
+	int xcoord, int ycoord, float zmag, int bid)
+{
+	const __m256d vpp4 = _mm256_set1_pd(pp4), vpy = _mm256_set1_pd((double)py), vyc = _mm256_set1_pd((double)ycoord);
+	const __m256 vzmag = _mm256_set1_ps(zmag);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), vid = _mm256_set1_epi32(bid);
+	const __m256i vy = _mm256_set1_epi32(ycoord), even = _mm256_set1_epi32((int)0xfffffffe);
+	int ww = 0;
+
+	for (; ww + 8 <= sx; ww += 8)
+	{
+		__m256i w = _mm256_add_epi32(_mm256_set1_epi32(ww), lanes);
+		__m256i xx = _mm256_sub_epi32(_mm256_set1_epi32(px - dx), w);
+		__m256i xsq = _mm256_mullo_epi32(xx, xx);
+		// xx * xx / pp4 - py + ycoord in double, four lanes at a time
+		__m256d lo = _mm256_add_pd(_mm256_sub_pd(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(xsq)), vpp4), vpy), vyc);
+		__m256d hi = _mm256_add_pd(_mm256_sub_pd(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(xsq, 1)), vpp4), vpy), vyc);
+		__m256i yy = _mm256_setr_m128i(_mm256_cvttpd_epi32(lo), _mm256_cvttpd_epi32(hi));
+		__m256i dw = _mm256_add_epi32(_mm256_set1_epi32(dx), w);
+
+		yy = _mm256_add_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(vzmag, _mm256_cvtepi32_ps(_mm256_sub_epi32(yy, vy)))), vy);
+		yy = _mm256_and_si256(yy, even);
+		_mm256_storeu_si256((__m256i*)(y + ww), yy);
+		_mm256_storeu_si256((__m256i*)(y + sx + ww), yy);
+		_mm256_storeu_si256((__m256i*)(x + ww), _mm256_sub_epi32(_mm256_set1_epi32(xcoord), dw));
+		_mm256_storeu_si256((__m256i*)(x + sx + ww), _mm256_add_epi32(_mm256_set1_epi32(xcoord), dw));
+		_mm256_storeu_si256((__m256i*)(id + ww), vid);
+		_mm256_storeu_si256((__m256i*)(id + sx + ww), vid);
+	}
+	return ww;
+}
+#endif
+
+void flowerpotBeam(Particles* ps, int sx, int px, int py, int dx, double pp4, int xcoord, int ycoord,
+	float zmag, int id)
+{
+	int* x = ps->x + ps->count, * y = ps->y + ps->count, * pid = ps->id + ps->count;
+	int ww = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_AVX2)
+		ww = flowerpotBeamAvx2(x, y, pid, sx, px, py, dx, pp4, xcoord, ycoord, zmag, id);
+	else if (simdLevel >= SIMD_SSE41)
+		ww = flowerpotBeamSse41(x, y, pid, sx, px, py, dx, pp4, xcoord, ycoord, zmag, id);
+#endif
+	for (; ww < sx; ww++)
+	{
+		int xx = px - dx - ww;
+		// relative y coord shift to image coord
+		int yy = (int)(xx * xx / pp4 - py + ycoord);
+		yy = (int)(zmag * (yy - ycoord)) + ycoord;
+		// left and right embers of a beam are at same height
+		y[ww] = yy & 0xfffffffe;
+		y[sx + ww] = y[ww];
+		x[ww] = xcoord - (dx + ww);
+		x[sx + ww] = xcoord + dx + ww;
+		pid[ww] = id;
+		pid[sx + ww] = id;
+	}
+	ps->count += 2 * sx;
+}
+
+template <typename finc>
+void flowerpotKernel(const FramePlane* pl, int np, const VSFormat* fi, const FlowerPotData* d, int n, int nframes)
+{
+	int ht = d->vi->height;
+	int wd = d->vi->width;
+	int nmax = n > d->spread ? n + d->spread : n + n + 1;
+	// Parabola eqn is 4*P*Y=X*X
+	int ylimit = d->yfloor1 + (n * (d->yfloor2 - d->yfloor1)) / nframes;
+	if (ylimit > ht - 2)
+		ylimit = ht - 2;
+	int xcoord = d->initx + (n * (d->endx - d->initx)) / nframes;	// x direction movement
+	int ycoord = d->inity + (n * (d->endy - d->inity)) / nframes;	// y direction movement
+	float zmag = 1.0f + (n * (d->zoom - 1.0f) ) / nframes;	// z direction movement (magnification)
+	ScratchArena* scratch = scratchBegin();
+	// color of each beam in sample type
+	finc* colors = scratchAlloc<finc>(scratch, sizeof(finc) * 3 * d->spread);
+	float max = fi->colorFamily == cmRGB ? 255.0f : 235.0f;
+
+	for (int m = 0; m < d->spread; m++)
+	{
+		unsigned char yuv[] = { d->red[m], d->red[m + 1], d->red[m + 2] };
+		if (!d->color)
+		{
+			if (fi->colorFamily == cmYUV)
+			{
+				yuv[1] = 127;
+				yuv[2] = 127;
+			}
+			else if (fi->colorFamily == cmRGB)
+			{
+				yuv[1] = yuv[0];
+				yuv[2] = yuv[0];
+			}
+		}
+		for (int p = 0; p < np; p++)
+		{
+			if (sizeof(finc) == 4)
+				colors[3 * m + p] = (finc)((float)(yuv[p]) / max - (fi->colorFamily == cmYUV && p > 0 ? 0.5f : 0.0f));
+			else
+				colors[3 * m + p] = (finc)((int)(yuv[p]) << (fi->bitsPerSample - 8));
+		}
+	}
+	// each beam has sx embers on either side
+	int capacity = 0;
+
+	for (int nx = n; nx < nmax; nx++)
+		capacity += 2 * (16 * d->px[nx % d->spread] / d->spread);
+	Particles ps;
+	particlesBegin(&ps, scratch, capacity);
+
+	for (int nx = n; nx < nmax; nx++)
+	{
+		int modnx = nx % d->spread;
+		// parabola constant P
+		float pp = (d->px[modnx] * d->px[modnx]) / (4.0f * (d->py[modnx]));	
+		double pp4 = 4.0 * pp;
+		// position of the ember wrt center of source
+		int dx = ((d->px[modnx]) * (nmax - nx)) / (d->spread / 2);
+		dx = (int)(zmag * dx);
+
+		int sx = 16 * d->px[modnx] / d->spread;
+
+		flowerpotBeam(&ps, sx, d->px[modnx], d->py[modnx], dx, pp4, xcoord, ycoord, zmag, modnx);
+	}
+	// ensure within frame and above pot. give each ember a little body
+	particlesCull(&ps, 2, 2, wd - 2, ylimit);
+	particlesStamp(pl, np, &ps, colors, 2, 2, PARTICLE_CHROMA_ALIGNED);
+	scratchEnd(scratch);
+}
 
 //----------------------------------------------------------------------------------------------
 static const VSFrameRef* VS_CC flowerpotGetFrame(int in, int activationReason, void** instanceData,
@@ -96,172 +268,18 @@ static const VSFrameRef* VS_CC flowerpotGetFrame(int in, int activationReason, v
 		int nframes = d->EndFrame - d->StartFrame + 1;
 
 		const VSFormat* fi = d->vi->format;
-		int ht = d->vi->height;
-		int wd = d->vi->width;
-
-		int nmax = n > d->spread ? n + d->spread : n + n + 1;
-		// Parabola eqn is 4*P*Y=X*X
-		int ylimit = d->yfloor1 + (n * (d->yfloor2 - d->yfloor1)) / nframes;
-		if (ylimit > ht - 2)
-			ylimit = ht - 2;
-		int xcoord = d->initx + (n * (d->endx - d->initx)) / nframes;	// x direction movement
-		int ycoord = d->inity + (n * (d->endy - d->inity)) / nframes;	// y direction movement
-		float zmag = 1.0f + (n * (d->zoom - 1.0f) ) / nframes;	// z direction movement (magnification)
-		// why we want this
-		srand(((n + 1) * (n + 2) * (n + 3)) & 0xfffffffe);			
 
 		VSFrameRef* dst = vsapi->copyFrame(src, core);		
-		int height = vsapi->getFrameHeight(src, 0);
-		int width = vsapi->getFrameWidth(src, 0);
+		FramePlane pl[3];
+		int np = getFramePlanes(pl, dst, NULL, vsapi);
 		int nbytes = fi->bytesPerSample;
-		int nbits = fi->bitsPerSample;
-		int nb = fi->bitsPerSample;
-		int subH[] = { 0,fi->subSamplingH, fi->subSamplingH };
-		int subW[] = { 0,fi->subSamplingW, fi->subSamplingW };
-
-		int andH = ( 1 << subH[1]) - 1;
-		int andW = (1 << subW[1]) - 1;
-		int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;		
-
-		uint8_t* dpt[] = { NULL, NULL, NULL, NULL };
-		int dpitch[] = { 0,0,0 };		
-		
-		for (int p = 0; p < np; p++)
-		{
-			dpt[p] = vsapi->getWritePtr(dst, p);
-			dpitch[p] = vsapi->getStride(dst, p) / nbytes;			
-		}
-
-
-		for (int nx = n; nx < nmax; nx++)
-		{
-			int modnx = nx % d->spread;
-			// parabola constant P
-			float pp = (d->px[modnx] * d->px[modnx]) / (4.0f * (d->py[modnx]));	
-			// position of the ember wrt center of source
-			int dx = ((d->px[modnx]) * (nmax - nx)) / (d->spread / 2);
-			dx = (int)(zmag * dx);
-
-			int sx = 16 * d->px[modnx] / d->spread;
-
-			int  yy;
-			
-			unsigned char yuv[] = { d->red[modnx], d->red[modnx + 1], d->red[modnx + 2] };
-			if (!d->color)
-			{
-				if (fi->colorFamily == cmYUV)
-				{
-					yuv[1] = 127;
-					yuv[2] = 127;
-				}
-				else if (fi->colorFamily == cmRGB)
-				{
-					yuv[1] = yuv[0];
-					yuv[2] = yuv[0];
-				}
-			}
-			
-			for (int ww = 0; ww < sx; ww++)
-			{
-				// relative y coord shift to image coord
-				yy = (int)(((d->px[modnx] - dx - ww) * (d->px[modnx] - dx - ww) 
-					/ (4.0 * pp) - d->py[modnx] + ycoord));  
-				yy = (int)(zmag * (yy - ycoord)) + ycoord;
-				yy = yy & 0xfffffffe;
-
-				if (yy < ylimit && yy > 2)		// ensure within frame and above pot
-				{
-					for (int i = -1; i <= 1; i += 2)
-					{
-						int w = xcoord + i * (dx + ww);
-
-						if (w < wd - 2 && w > 2)
-						{
-							for (int p = 0; p < np; p++)
-							{
-								if (fi->sampleType == stInteger && nbytes == 1)
-								{
-									uint8_t* dp = dpt[p];
-									// give each beam a little body
-									if (p == 0 || (subH[p] == 0 && subW[p] == 0))
-									{
-										*(dp + yy * dpitch[p] + w)
-											= yuv[p];
-										*(dp + (yy + 1) * dpitch[p] + w)
-											= yuv[p];
-										*(dp + yy * dpitch[p] + w + 1)
-											= yuv[p];
-										*(dp + (yy + 1) * dpitch[p] + w + 1)
-											= yuv[p];
-
-									}
-									else if ((yy & andH) == 0 && (w & andW) == 0)
-									{
-										*(dp + (yy >> subH[p]) * dpitch[p] + (w >> subW[p]))
-											= yuv[p];
-									}
-								}
-
-								else if (fi->sampleType == stInteger &&  nbytes == 2)
-								{
-									uint16_t* dp = (uint16_t*)(dpt[p]);
-									uint16_t val = (uint16_t)((int)(yuv[p]) << (nbits - 8));
-									if (p == 0 || (subH[p] == 0 && subW[p] == 0))
-									{
-										*(dp + yy * dpitch[p] + w)
-											= val;
-										*(dp + (yy + 1) * dpitch[p] + w)
-											= val;
-										*(dp + yy * dpitch[p] + w + 1)
-											= val;
-										*(dp + (yy + 1) * dpitch[p] + w + 1)
-											= val;
-
-									}
-									else if ((yy & andH) == 0 && (w & andW) == 0)
-									{
-										*(dp + (yy >> subH[p]) * dpitch[p] + (w >> subW[p]))
-											= val;
-									}
-								}
-
-								if (nbytes == 4)
-								{
-									float max = fi->colorFamily == cmRGB ? 255.0f : 235.0f;
-									float* dp = (float*)(dpt[p]);
-									float val = (float)((float)(yuv[p]) / max);
-
-									if (fi->colorFamily == cmYUV && p > 0)
-										val -= 0.5f;
-
-									if (p == 0 || (subH[p] == 0 && subW[p] == 0))
-									{
-										*(dp + yy * dpitch[p] + w)
-											= val;
-										*(dp + (yy + 1) * dpitch[p] + w)
-											= val;
-										*(dp + yy * dpitch[p] + w + 1)
-											= val;
-										*(dp + (yy + 1) * dpitch[p] + w + 1)
-											= val;
-
-									}
-									else if ((yy & andH) == 0 && (w & andW) == 0)
-									{
-										*(dp + (yy >> subH[p]) * dpitch[p] + (w >> subW[p]))
-											= val;
-									}
-								}
-							}
-
-
-						}	// if w 
-					}	// for i = - 1						
-				}	// if yy
-			}	// for int ww = 0;
-		}	// for int nx
-		// 
-	
+		// format decides kernel once per frame
+		if (nbytes == 1)
+			flowerpotKernel<uint8_t>(pl, np, fi, d, n, nframes);
+		else if (nbytes == 2)
+			flowerpotKernel<uint16_t>(pl, np, fi, d, n, nframes);
+		else
+			flowerpotKernel<float>(pl, np, fi, d, n, nframes);
 
 		vsapi->freeFrame( src);
 		return (dst);
@@ -22,6 +22,7 @@ see < http://www.gnu.org/licenses/>.
 ---------------------------------------------------------------------------- - */
 //#include "VapourSynth.h"
 //#include "VSHelper.h"
+#include "simdLevel.h"
 
 typedef struct {
     VSNodeRef* node;
@@ -32,16 +33,536 @@ typedef struct {
 	float fog;	// start  greyness
 	float efog;		// end  value
 	float vary;	// variation
+	uint32_t seed;	// instance seed for counter based random numbers
+	uint8_t* noise;	// tile of FOG_TILE_W x FOG_TILE_H noise values 0 to 255
+	int mode;		// 0 white noise, 1 fractal
+	int scale;		// size of largest fractal features
+	int octaves;
+	float windx;	// drift of fractal fog, samples a frame
+	float windy;
+	float grad;		// fog less at top if positive, at bottom if negative
+	int lowres;		// fractal is made at 1 / lowres resolution, 4 or 8
 } FogData;
 
+// noise tile. Each frame and plane reads it from a random origin, wrapping around
+#define FOG_TILE_W 1024
+#define FOG_TILE_H 512
+
+// fog of value base to base + variation over RGB or Y plane. Noise tile is read from ox, oy
+template <typename finc>
+void fogPlane(finc* dp, int dpitch, int wd, int ht, const uint8_t* noise, int ox, int oy,
+	int base, int variation, int nbits);
+template <typename finc>
+void fogGrayPlane(finc* dp, int dpitch, int wd, int ht, finc gray);
+// fog = base + (t * variation >> 8), 0 to 255 at sample scale. dp = max(fog, (dp + fog) / 2),
+// which is fog where dp is less
+template <typename finc>
+void fogBlendRow(finc* dp, const uint8_t* t, int n, int base, int variation, int nbits);
+// dp = (dp + gray) / 2
+template <typename finc>
+void fogGrayRow(finc* dp, int n, finc gray);
+// fractal noise 0 to 1 at n points x0 + i * dx, y
+void fogFractalRow(float* out, int n, float x0, float dx, float y, int octaves, uint32_t seed);
+// dp moves to fog by a, 0 to 1
+template <typename finc>
+void fogMixRow(finc* dp, const float* a, int n, float fog);
+// fractal fog of a frame over all planes. ramp is fog of frame
+template <typename finc>
+void fogFractalFrame(const FramePlane* pl, int np, const VSFormat* fi, const FogData* d, int n, float ramp);
 
 static void VS_CC fogInit(VSMap* in, VSMap* out, void** instanceData, VSNode* node, VSCore* core, const VSAPI* vsapi) {
     FogData* d = (FogData*)*instanceData;
     vsapi->setVideoInfo(d->vi, 1, node);
-	
+	uint32_t nf = (uint32_t)(d->EndFrame - d->StartFrame);
+	d->seed = (nf * nf * nf) | 1;
+	// hashed value field. Made once, as every frame only moves over it
+	d->noise = (uint8_t*)vs_aligned_malloc(FOG_TILE_W * FOG_TILE_H, 32);
+	uint32_t key = randomKey(d->seed, -1);
+	uint32_t row[FOG_TILE_W];
+
+	for (int h = 0; h < FOG_TILE_H; h++)
+	{
+		fillRandom(row, FOG_TILE_W, key, h, 0);
+
+		for (int w = 0; w < FOG_TILE_W; w++)
+			d->noise[h * FOG_TILE_W + w] = (uint8_t)(row[w] >> 24);
+	}
+}
+//------------------------------------------------------------------------
+#ifdef VFX_X86_SIMD
+// samples done are returned
+template <typename finc>
+VFX_TARGET("sse4.1") int fogBlendSse41(finc* dp, const uint8_t* t, int n, int base, int variation, int nbits)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i vvar = _mm_set1_epi16((short)variation);
+	const __m128i vbase = _mm_set1_epi16((short)base);
+	int k = 0;
+
+	if (sizeof(finc) == 1)
+	{
+		const __m128i one = _mm_set1_epi8(1);
+
+		for (; k + 16 <= n; k += 16)
+		{
+			// t << 8 in 16 bit lanes, so that high half of product is t * variation >> 8
+			__m128i tv = _mm_loadu_si128((const __m128i*)(t + k));
+			__m128i lo = _mm_add_epi16(_mm_mulhi_epu16(_mm_unpacklo_epi8(zero, tv), vvar), vbase);
+			__m128i hi = _mm_add_epi16(_mm_mulhi_epu16(_mm_unpackhi_epi8(zero, tv), vvar), vbase);
+			// saturating pack clamps to 0 to 255
+			__m128i fog = _mm_packus_epi16(lo, hi);
+			__m128i d = _mm_loadu_si128((const __m128i*)(dp + k));
+			// pavgb rounds up
+			__m128i avg = _mm_sub_epi8(_mm_avg_epu8(d, fog), _mm_and_si128(_mm_xor_si128(d, fog), one));
+			_mm_storeu_si128((__m128i*)(dp + k), _mm_max_epu8(fog, avg));
+		}
+	}
+	else if (sizeof(finc) == 2)
+	{
+		const __m128i one = _mm_set1_epi16(1);
+		const __m128i shift = _mm_cvtsi32_si128(nbits - 8);
+		const __m128i vmax = _mm_set1_epi16(255);
+
+		for (; k + 8 <= n; k += 8)
+		{
+			__m128i tv = _mm_loadl_epi64((const __m128i*)(t + k));
+			__m128i f = _mm_add_epi16(_mm_mulhi_epu16(_mm_unpacklo_epi8(zero, tv), vvar), vbase);
+			__m128i fog = _mm_sll_epi16(_mm_min_epi16(_mm_max_epi16(f, zero), vmax), shift);
+			__m128i d = _mm_loadu_si128((const __m128i*)(dp + k));
+			__m128i avg = _mm_sub_epi16(_mm_avg_epu16(d, fog), _mm_and_si128(_mm_xor_si128(d, fog), one));
+			_mm_storeu_si128((__m128i*)(dp + k), _mm_max_epu16(fog, avg));
+		}
+	}
+	else
+	{
+		const __m128i var32 = _mm_set1_epi32(variation);
+		const __m128i base32 = _mm_set1_epi32(base);
+		const __m128i vmax = _mm_set1_epi32(255);
+		const __m128 scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+
+		for (; k + 4 <= n; k += 4)
+		{
+			int t4;
+			memcpy(&t4, t + k, sizeof(int));
+			__m128i f = _mm_add_epi32(_mm_srli_epi32(_mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(t4)), var32), 8), base32);
+			__m128 fog = _mm_div_ps(_mm_cvtepi32_ps(_mm_min_epi32(_mm_max_epi32(f, zero), vmax)), scale);
+			__m128 d = _mm_loadu_ps((const float*)(dp + k));
+			_mm_storeu_ps((float*)(dp + k), _mm_max_ps(fog, _mm_mul_ps(_mm_add_ps(d, fog), half)));
+		}
+	}
+	return k;
+}
+
+template <typename finc>
+VFX_TARGET("avx2") int fogBlendAvx2(finc* dp, const uint8_t* t, int n, int base, int variation, int nbits)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i vvar = _mm256_set1_epi16((short)variation);
+	const __m256i vbase = _mm256_set1_epi16((short)base);
+	int k = 0;
+
+	if (sizeof(finc) == 1)
+	{
+		const __m256i one = _mm256_set1_epi8(1);
+
+		for (; k + 32 <= n; k += 32)
+		{
+			// unpack and pack are both within 128 bit lanes, so order is kept
+			__m256i tv = _mm256_loadu_si256((const __m256i*)(t + k));
+			__m256i lo = _mm256_add_epi16(_mm256_mulhi_epu16(_mm256_unpacklo_epi8(zero, tv), vvar), vbase);
+			__m256i hi = _mm256_add_epi16(_mm256_mulhi_epu16(_mm256_unpackhi_epi8(zero, tv), vvar), vbase);
+			__m256i fog = _mm256_packus_epi16(lo, hi);
+			__m256i d = _mm256_loadu_si256((const __m256i*)(dp + k));
+			__m256i avg = _mm256_sub_epi8(_mm256_avg_epu8(d, fog), _mm256_and_si256(_mm256_xor_si256(d, fog), one));
+			_mm256_storeu_si256((__m256i*)(dp + k), _mm256_max_epu8(fog, avg));
+		}
+	}
+	else if (sizeof(finc) == 2)
+	{
+		const __m256i one = _mm256_set1_epi16(1);
+		const __m128i shift = _mm_cvtsi32_si128(nbits - 8);
+		const __m256i vmax = _mm256_set1_epi16(255);
+
+		for (; k + 16 <= n; k += 16)
+		{
+			__m256i tv = _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(t + k))), 8);
+			__m256i f = _mm256_add_epi16(_mm256_mulhi_epu16(tv, vvar), vbase);
+			__m256i fog = _mm256_sll_epi16(_mm256_min_epi16(_mm256_max_epi16(f, zero), vmax), shift);
+			__m256i d = _mm256_loadu_si256((const __m256i*)(dp + k));
+			__m256i avg = _mm256_sub_epi16(_mm256_avg_epu16(d, fog), _mm256_and_si256(_mm256_xor_si256(d, fog), one));
+			_mm256_storeu_si256((__m256i*)(dp + k), _mm256_max_epu16(fog, avg));
+		}
+	}
+	else
+	{
+		const __m256i var32 = _mm256_set1_epi32(variation);
+		const __m256i base32 = _mm256_set1_epi32(base);
+		const __m256i vmax = _mm256_set1_epi32(255);
+		const __m256 scale = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f);
+
+		for (; k + 8 <= n; k += 8)
+		{
+			__m256i tv = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(t + k)));
+			__m256i f = _mm256_add_epi32(_mm256_srli_epi32(_mm256_mullo_epi32(tv, var32), 8), base32);
+			__m256 fog = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_min_epi32(_mm256_max_epi32(f, zero), vmax)), scale);
+			__m256 d = _mm256_loadu_ps((const float*)(dp + k));
+			_mm256_storeu_ps((float*)(dp + k), _mm256_max_ps(fog, _mm256_mul_ps(_mm256_add_ps(d, fog), half)));
+		}
+	}
+	return k;
+}
+
+template <typename finc>
+VFX_TARGET("sse4.1") int fogGraySse41(finc* dp, int n, finc gray)
+{
+	int k = 0;
+
+	if (sizeof(finc) == 4)
+	{
+		const __m128 g = _mm_set1_ps((float)gray), half = _mm_set1_ps(0.5f);
+
+		for (; k + 4 <= n; k += 4)
+			_mm_storeu_ps((float*)(dp + k), _mm_mul_ps(_mm_add_ps(_mm_loadu_ps((const float*)(dp + k)), g), half));
+		return k;
+	}
+	const __m128i g = sizeof(finc) == 1 ? _mm_set1_epi8((char)gray) : _mm_set1_epi16((short)gray);
+	const __m128i one = sizeof(finc) == 1 ? _mm_set1_epi8(1) : _mm_set1_epi16(1);
+	const int lanes = 16 / sizeof(finc);
+
+	for (; k + lanes <= n; k += lanes)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i*)(dp + k));
+		__m128i avg = sizeof(finc) == 1 ? _mm_avg_epu8(d, g) : _mm_avg_epu16(d, g);
+		__m128i odd = _mm_and_si128(_mm_xor_si128(d, g), one);
+		_mm_storeu_si128((__m128i*)(dp + k), sizeof(finc) == 1 ? _mm_sub_epi8(avg, odd) : _mm_sub_epi16(avg, odd));
+	}
+	return k;
+}
+
+template <typename finc>
+VFX_TARGET("avx2") int fogGrayAvx2(finc* dp, int n, finc gray)
+{
+	int k = 0;
+
+	if (sizeof(finc) == 4)
+	{
+		const __m256 g = _mm256_set1_ps((float)gray), half = _mm256_set1_ps(0.5f);
+
+		for (; k + 8 <= n; k += 8)
+			_mm256_storeu_ps((float*)(dp + k), _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps((const float*)(dp + k)), g), half));
+		return k;
+	}
+	const __m256i g = sizeof(finc) == 1 ? _mm256_set1_epi8((char)gray) : _mm256_set1_epi16((short)gray);
+	const __m256i one = sizeof(finc) == 1 ? _mm256_set1_epi8(1) : _mm256_set1_epi16(1);
+	const int lanes = 32 / sizeof(finc);
+
+	for (; k + lanes <= n; k += lanes)
+	{
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dp + k));
+		__m256i avg = sizeof(finc) == 1 ? _mm256_avg_epu8(d, g) : _mm256_avg_epu16(d, g);
+		__m256i odd = _mm256_and_si256(_mm256_xor_si256(d, g), one);
+		_mm256_storeu_si256((__m256i*)(dp + k), sizeof(finc) == 1 ? _mm256_sub_epi8(avg, odd) : _mm256_sub_epi16(avg, odd));
+	}
+	return k;
+}
+#endif
+
+template <typename finc>
+void fogBlendRow(finc* dp, const uint8_t* t, int n, int base, int variation, int nbits)
+{
+	int k = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_AVX2)
+		k = fogBlendAvx2(dp, t, n, base, variation, nbits);
+	else if (simdLevel >= SIMD_SSE41)
+		k = fogBlendSse41(dp, t, n, base, variation, nbits);
+#endif
+	for (; k < n; k++)
+	{
+		int f = VSMIN(VSMAX(base + ((t[k] * variation) >> 8), 0), 255);
+		finc fog = sizeof(finc) == 4 ? (finc)((float)f / 255.0f) : (finc)(f << (nbits - 8));
+		finc avg = (finc)((dp[k] + fog) / 2);
+
+		dp[k] = VSMAX(fog, avg);
+	}
+}
+
+template <typename finc>
+void fogGrayRow(finc* dp, int n, finc gray)
+{
+	int k = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_AVX2)
+		k = fogGrayAvx2(dp, n, gray);
+	else if (simdLevel >= SIMD_SSE41)
+		k = fogGraySse41(dp, n, gray);
+#endif
+	for (; k < n; k++)
+		dp[k] = (finc)((dp[k] + gray) / 2);
+}
+
+template <typename finc>
+void fogPlane(finc* dp, int dpitch, int wd, int ht, const uint8_t* noise, int ox, int oy,
+	int base, int variation, int nbits)
+{
+	for (int h = 0; h < ht; h++)
+	{
+		const uint8_t* t = noise + ((oy + h) % FOG_TILE_H) * FOG_TILE_W;
+		// row in runs up to the right end of tile
+		for (int w = 0, tx = ox; w < wd; tx = 0)
+		{
+			int n = VSMIN(wd - w, FOG_TILE_W - tx);
+			fogBlendRow(dp + w, t + tx, n, base, variation, nbits);
+			w += n;
+		}
+		dp += dpitch;
+	}
+}
+// U and V move half way to gray
+template <typename finc>
+void fogGrayPlane(finc* dp, int dpitch, int wd, int ht, finc gray)
+{
+	for (int h = 0; h < ht; h++)
+	{
+		fogGrayRow(dp, wd, gray);
+		dp += dpitch;
+	}
 }
 //------------------------------------------------------------------------
+// value noise. Lattice values are hashed from integer position, octave seeds differ
+#define FOG_SEED_STEP 0x9E3779B9u
+
+static inline uint32_t fogHash(uint32_t x, uint32_t y, uint32_t seed)
+{
+	uint32_t h = (x * 0x8DA6B343u) ^ (y * 0xD8163841u) ^ seed;
+	h ^= h >> 15;
+	h *= 0x2C1B3C6Du;
+	h ^= h >> 12;
+	h *= 0x297A2D39u;
+	h ^= h >> 15;
+	return h;
+}
+
+static inline float fogLattice(int x, int y, uint32_t seed)
+{
+	return (float)(fogHash((uint32_t)x, (uint32_t)y, seed) >> 8) * (1.0f / 16777216.0f);
+}
 
+#ifdef VFX_X86_SIMD
+VFX_TARGET("avx2") static inline __m256i fogHashAvx2(__m256i x, __m256i y, __m256i seed)
+{
+	__m256i h = _mm256_xor_si256(_mm256_xor_si256(_mm256_mullo_epi32(x, _mm256_set1_epi32((int)0x8DA6B343u)),
+		_mm256_mullo_epi32(y, _mm256_set1_epi32((int)0xD8163841u))), seed);
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+	h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x2C1B3C6D));
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 12));
+	h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x297A2D39));
+	return _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+}
+
+VFX_TARGET("avx2") static inline __m256 fogLatticeAvx2(__m256i x, __m256i y, __m256i seed)
+{
+	return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(fogHashAvx2(x, y, seed), 8)),
+		_mm256_set1_ps(1.0f / 16777216.0f));
+}
+
+// same operations in same order as scalar, so results are equal. Returns points done
+VFX_TARGET("avx2") int fogFractalAvx2(float* out, int n, float x0, float dx, float y, int octaves, uint32_t seed)
+{
+	const __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f), three = _mm256_set1_ps(3.0f);
+	const __m256i ione = _mm256_set1_epi32(1);
+	float norm = 0.0f;
+
+	for (int o = 0, amp = 1; o < octaves; o++, amp *= 2)
+		norm += 1.0f / amp;
+	const __m256 inorm = _mm256_set1_ps(1.0f / norm);
+	int k = 0;
+
+	for (; k + 8 <= n; k += 8)
+	{
+		__m256 idx = _mm256_cvtepi32_ps(_mm256_setr_epi32(k, k + 1, k + 2, k + 3, k + 4, k + 5, k + 6, k + 7));
+		__m256 fx = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_mul_ps(idx, _mm256_set1_ps(dx)));
+		__m256 fy = _mm256_set1_ps(y);
+		__m256 sum = _mm256_setzero_ps(), amp = one;
+		uint32_t oseed = seed;
+
+		for (int o = 0; o < octaves; o++, oseed += FOG_SEED_STEP)
+		{
+			__m256 xf = _mm256_floor_ps(fx), yf = _mm256_floor_ps(fy);
+			__m256i ix = _mm256_cvttps_epi32(xf), iy = _mm256_cvttps_epi32(yf);
+			__m256 tx = _mm256_sub_ps(fx, xf), ty = _mm256_sub_ps(fy, yf);
+			// smoothstep
+			tx = _mm256_mul_ps(_mm256_mul_ps(tx, tx), _mm256_sub_ps(three, _mm256_mul_ps(two, tx)));
+			ty = _mm256_mul_ps(_mm256_mul_ps(ty, ty), _mm256_sub_ps(three, _mm256_mul_ps(two, ty)));
+			__m256i s = _mm256_set1_epi32((int)oseed);
+			__m256i ix1 = _mm256_add_epi32(ix, ione), iy1 = _mm256_add_epi32(iy, ione);
+			__m256 v00 = fogLatticeAvx2(ix, iy, s), v10 = fogLatticeAvx2(ix1, iy, s);
+			__m256 v01 = fogLatticeAvx2(ix, iy1, s), v11 = fogLatticeAvx2(ix1, iy1, s);
+			__m256 a = _mm256_add_ps(v00, _mm256_mul_ps(_mm256_sub_ps(v10, v00), tx));
+			__m256 b = _mm256_add_ps(v01, _mm256_mul_ps(_mm256_sub_ps(v11, v01), tx));
+			__m256 v = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), ty));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(v, amp));
+			fx = _mm256_mul_ps(fx, two);
+			fy = _mm256_mul_ps(fy, two);
+			amp = _mm256_mul_ps(amp, _mm256_set1_ps(0.5f));
+		}
+		_mm256_storeu_ps(out + k, _mm256_mul_ps(sum, inorm));
+	}
+	return k;
+}
+
+template <typename finc>
+VFX_TARGET("avx2") int fogMixAvx2(finc* dp, const float* a, int n, float fog)
+{
+	const __m256 f = _mm256_set1_ps(fog), half = _mm256_set1_ps(0.5f);
+	int k = 0;
+
+	for (; k + 8 <= n; k += 8)
+	{
+		__m256 av = _mm256_loadu_ps(a + k);
+
+		if (sizeof(finc) == 4)
+		{
+			__m256 d = _mm256_loadu_ps((const float*)(dp + k));
+			_mm256_storeu_ps((float*)(dp + k), _mm256_add_ps(d, _mm256_mul_ps(_mm256_sub_ps(f, d), av)));
+			continue;
+		}
+		__m256i di = sizeof(finc) == 1 ? _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(dp + k)))
+			: _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(dp + k)));
+		__m256 d = _mm256_cvtepi32_ps(di);
+		__m256i r = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_add_ps(d, _mm256_mul_ps(_mm256_sub_ps(f, d), av)), half));
+		__m128i r16 = _mm_packus_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+
+		if (sizeof(finc) == 1)
+			_mm_storel_epi64((__m128i*)(dp + k), _mm_packus_epi16(r16, r16));
+		else
+			_mm_storeu_si128((__m128i*)(dp + k), r16);
+	}
+	return k;
+}
+#endif
+
+void fogFractalRow(float* out, int n, float x0, float dx, float y, int octaves, uint32_t seed)
+{
+	int k = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_AVX2)
+		k = fogFractalAvx2(out, n, x0, dx, y, octaves, seed);
+#endif
+	float norm = 0.0f;
+
+	for (int o = 0, amp = 1; o < octaves; o++, amp *= 2)
+		norm += 1.0f / amp;
+	float inorm = 1.0f / norm;
+
+	for (; k < n; k++)
+	{
+		float fx = x0 + (float)k * dx, fy = y;
+		float sum = 0.0f, amp = 1.0f;
+		uint32_t oseed = seed;
+
+		for (int o = 0; o < octaves; o++, oseed += FOG_SEED_STEP)
+		{
+			float xf = floorf(fx), yf = floorf(fy);
+			int ix = (int)xf, iy = (int)yf;
+			float tx = fx - xf, ty = fy - yf;
+			tx = (tx * tx) * (3.0f - 2.0f * tx);
+			ty = (ty * ty) * (3.0f - 2.0f * ty);
+			float v00 = fogLattice(ix, iy, oseed), v10 = fogLattice(ix + 1, iy, oseed);
+			float v01 = fogLattice(ix, iy + 1, oseed), v11 = fogLattice(ix + 1, iy + 1, oseed);
+			float a = v00 + (v10 - v00) * tx;
+			float b = v01 + (v11 - v01) * tx;
+			sum += (a + (b - a) * ty) * amp;
+			fx *= 2.0f;
+			fy *= 2.0f;
+			amp *= 0.5f;
+		}
+		out[k] = sum * inorm;
+	}
+}
+
+template <typename finc>
+void fogMixRow(finc* dp, const float* a, int n, float fog)
+{
+	int k = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_AVX2)
+		k = fogMixAvx2(dp, a, n, fog);
+#endif
+	for (; k < n; k++)
+	{
+		float d = (float)dp[k];
+		float r = d + (fog - d) * a[k];
+
+		// saturates as packus of SIMD path
+		dp[k] = sizeof(finc) == 4 ? (finc)r : (finc)VSMIN(VSMAX((int)(r + 0.5f), 0), sizeof(finc) == 1 ? 255 : 65535);
+	}
+}
+
+// density is fractal noise on a grid of lowres spacing, bilinearly upsampled.
+// Fog of each sample is ramp * (1 - vary + 2 * vary * density), times vertical gradient
+template <typename finc>
+void fogFractalFrame(const FramePlane* pl, int np, const VSFormat* fi, const FogData* d, int n, float ramp)
+{
+	int wd = pl[0].width, ht = pl[0].height;
+	int lr = d->lowres, lrshift = lr == 4 ? 2 : 3;
+	int gw = (wd - 1) / lr + 2, gh = (ht - 1) / lr + 2;
+	bool yuv = fi->colorFamily == cmYUV;
+	// fog is light gray. U, V go to gray by same amount
+	float fogval = sizeof(finc) == 4 ? 180.0f / 255.0f : (float)(180 << (fi->bitsPerSample - 8));
+	float gray = sizeof(finc) == 4 ? 0.0f : (float)(1 << (fi->bitsPerSample - 1));
+	ScratchArena* scratch = scratchBegin();
+	float* grid = scratchAlloc<float>(scratch, sizeof(float) * gw * gh);
+	float* col = scratchAlloc<float>(scratch, sizeof(float) * gw);
+	float* a = scratchAlloc<float>(scratch, sizeof(float) * (wd + 8));
+	float* ca = scratchAlloc<float>(scratch, sizeof(float) * (wd + 8));
+	// noise space has features of scale samples, moving with wind
+	float step = (float)lr / d->scale;
+	float x0 = d->windx * n / d->scale, y0 = d->windy * n / d->scale;
+
+	for (int j = 0; j < gh; j++)
+		fogFractalRow(grid + j * gw, gw, x0, step, y0 + (float)j * step, d->octaves, d->seed);
+
+	for (int h = 0; h < ht; h++)
+	{
+		int j = h >> lrshift;
+		float fy = (float)(h & (lr - 1)) / lr;
+		const float* g0 = grid + j * gw;
+		const float* g1 = g0 + gw;
+
+		for (int i = 0; i < gw; i++)
+			col[i] = g0[i] + (g1[i] - g0[i]) * fy;
+		// vertical gradient, 0 at top to 1 at bottom
+		float y = (float)h / (ht - 1);
+		float gy = d->grad >= 0 ? 1.0f - d->grad * (1.0f - y) : 1.0f + d->grad * y;
+		float c0 = ramp * (1.0f - d->vary) * gy, c1 = 2.0f * ramp * d->vary * gy;
+
+		for (int w = 0; w < wd; w++)
+		{
+			int i = w >> lrshift;
+			float fx = (float)(w & (lr - 1)) / lr;
+			float density = col[i] + (col[i + 1] - col[i]) * fx;
+			// vary over 1 makes c0 negative
+			a[w] = VSMIN(VSMAX(c0 + c1 * density, 0.0f), 1.0f);
+		}
+		int nfull = yuv ? lumaSizePlanes(pl, np) : np;
+
+		for (int p = 0; p < nfull; p++)
+			fogMixRow((finc*)pl[p].dp + h * pl[p].pitch, a, wd, yuv && p > 0 ? gray : fogval);
+
+		if (nfull == np)
+			continue;
+		int subW = pl[nfull].subW, subH = pl[nfull].subH;
+
+		if ((h & ((1 << subH) - 1)) != 0)
+			continue;
+		for (int wp = 0; wp < pl[nfull].width; wp++)
+			ca[wp] = a[wp << subW];
+		for (int p = nfull; p < np; p++)
+			fogMixRow((finc*)pl[p].dp + (h >> subH) * pl[p].pitch, ca, pl[p].width, gray);
+	}
+	scratchEnd(scratch);
+}
 //----------------------------------------------------------------------------------------------
 static const VSFrameRef* VS_CC fogGetFrame(int in, int activationReason, void** instanceData,
 					void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi)
@@ -60,114 +581,62 @@ static const VSFrameRef* VS_CC fogGetFrame(int in, int activationReason, void**
 		int nframes = d->EndFrame - d->StartFrame + 1;
 
 		const VSFormat* fi = d->vi->format;
-		int ht = d->vi->height;
-		int wd = d->vi->width;
 		// fog values
 		int maxval = 180; // fi->colorFamily == cmRGB ? 255 : 235;
 		int shade = (int)(((d->fog + ((d->efog - d->fog) * n) / nframes) * maxval));
 		int variation = (int)(d->vary * shade);
 
 		VSFrameRef* dst = vsapi->copyFrame(src, core);		
+		uint32_t key = randomKey(d->seed, n);
 		
 		int nbytes = fi->bytesPerSample;
 		int nbits = fi->bitsPerSample;
-		int nb = fi->bitsPerSample;
-		int subH[] = { 0,fi->subSamplingH, fi->subSamplingH };
-		int subW[] = { 0,fi->subSamplingW, fi->subSamplingW };
-
-		int andH = ( 1 << subH[1]) - 1;
-		int andW = (1 << subW[1]) - 1;
 		int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;		
+		int base = shade - variation / 2;
 
-		//uint8_t* dpt[] = { NULL, NULL, NULL, NULL };
-		//int dpitch[] = { 0,0,0 };		
+		if (d->mode == 1)
+		{
+			FramePlane pl[3];
+			getFramePlanes(pl, dst, NULL, vsapi);
+			float ramp = d->fog + ((d->efog - d->fog) * n) / nframes;
+
+			if (nbytes == 1)
+				fogFractalFrame<uint8_t>(pl, np, fi, d, n, ramp);
+			else if (nbytes == 2)
+				fogFractalFrame<uint16_t>(pl, np, fi, d, n, ramp);
+			else
+				fogFractalFrame<float>(pl, np, fi, d, n, ramp);
+			np = 0;
+		}
 		
 		for (int p = 0; p < np; p++)
 		{
 			uint8_t* dp = vsapi->getWritePtr(dst, p);
-			int dpitch = vsapi->getStride(dst, p);
+			int dpitch = vsapi->getStride(dst, p) / nbytes;
 			int ht = vsapi->getFrameHeight(dst, p);
 			int wd = vsapi->getFrameWidth(dst, p);
-
-			for (int h = 0; h < ht; h++)
+			// plane kind and format decide kernel once per plane
+			if (fi->colorFamily == cmRGB || p == 0)
 			{
-				for (int w = 0; w < wd; w++)
-				{
-					if (fi->sampleType == stInteger && nbytes == 1)
-					{
-						if (fi->colorFamily == cmRGB || p == 0)
-						{
-							uint8_t fog = (uint8_t)(shade - variation / 2 +  (rand() % variation));
-
-							if (*(dp + w) <= fog)
-							{
-								*(dp + w) = fog;
-							}
-							else
-							{
-								*(dp + w) = (*(dp + w) + fog) / 2;
-							}
-						}
-						else // yuv
-						{
-							uint8_t gray = 1 << (nbits - 1);
-
-							*(dp + w) = (*(dp + w) + gray) / 2;
-						}
-
-					}
-
-					else if (fi->sampleType == stInteger && nbytes == 2)
-					{
-						if (fi->colorFamily == cmRGB || p == 0)
-						{
-							uint16_t fog = (uint16_t) ((shade - variation / 2 + (rand() % variation)) << (nbits - 8));
-
-							if (*((uint16_t *)dp + w) <= fog)
-							{
-								*((uint16_t*)dp + w) = fog;
-							}
-							else
-							{
-								*((uint16_t*)dp + w) = (*((uint16_t*)dp + w) + fog) / 2;
-							}
-						}
-						else // yuv
-						{
-							uint16_t gray = (uint16_t)( 1 << (nbits - 1));
-
-							*((uint16_t*)dp + w) = (*((uint16_t*)dp + w) + gray) / 2;
-						}
-
-					}
-
-					else if (fi->sampleType == stFloat && nbytes == 4)
-					{
-						if (fi->colorFamily == cmRGB || p == 0)
-						{
-
-							float fog = (float)(shade - variation / 2 + (rand() % variation))/ 255.0f;
-
-							if (*( (float*)dp + w) <= fog)
-							{
-								*((float*)dp + w) = fog;
-							}
-							else
-							{
-								*((float*)dp + w) = (*((float*)dp + w) + fog) / 2;
-							}
-						}
-						else // yuv
-						{
-							//(float)gray = 0.0f;
-
-							*((float*)dp + w) = (*((float*)dp + w) ) / 2;
-						}
-
-					}
-				}
-
-				dp += dpitch;
+				// fresh looking noise each frame and plane from another part of tile
+				int ox = randomInRange(key, p, 0, FOG_TILE_W);
+				int oy = randomInRange(key, p, 1, FOG_TILE_H);
+
+				if (nbytes == 1)
+					fogPlane(dp, dpitch, wd, ht, d->noise, ox, oy, base, variation, nbits);
+				else if (nbytes == 2)
+					fogPlane((uint16_t*)dp, dpitch, wd, ht, d->noise, ox, oy, base, variation, nbits);
+				else
+					fogPlane((float*)dp, dpitch, wd, ht, d->noise, ox, oy, base, variation, nbits);
+			}
+			else // yuv
+			{
+				if (nbytes == 1)
+					fogGrayPlane(dp, dpitch, wd, ht, (uint8_t)(1 << (nbits - 1)));
+				else if (nbytes == 2)
+					fogGrayPlane((uint16_t*)dp, dpitch, wd, ht, (uint16_t)(1 << (nbits - 1)));
+				else
+					fogGrayPlane((float*)dp, dpitch, wd, ht, 0.0f);
 			}
 		}
 		vsapi->freeFrame( src);
@@ -180,6 +649,7 @@ static const VSFrameRef* VS_CC fogGetFrame(int in, int activationReason, void**
 static void VS_CC fogFree(void* instanceData, VSCore* core, const VSAPI* vsapi) {
     FogData* d = (FogData*)instanceData;
     vsapi->freeNode(d->node);	
+	vs_aligned_free(d->noise);
 	
     free(d);
 }
@@ -242,8 +712,23 @@ static void VS_CC fogCreate(const VSMap* in, VSMap* out, void* userData, VSCore*
 		vsapi->freeNode(d.node);
 		return;
 	}
-	d.vary = (float)vsapi->propGetFloat(in, "vary", 0, &err);
+	d.mode = int64ToIntS(vsapi->propGetInt(in, "mode", 0, &err));
 	if (err)
+		d.mode = 0;
+	else if (d.mode < 0 || d.mode > 1)
+	{
+		vsapi->setError(out, "Fog: mode can be 0 for white noise or 1 for fractal fog");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.vary = (float)vsapi->propGetFloat(in, "vary", 0, &err);
+	if (err && d.mode == 1)
+	{
+		// patches from clear to the most fog allowed
+		float fmax = VSMAX(d.fog, d.efog);
+		d.vary = fmax > 0 ? VSMIN(1.0f, (1.0f - fmax) / fmax) : 1.0f;
+	}
+	else if (err)
 		d.vary =  d.fog * 0.1f;
 	if (d.vary < 0 || d.fog  + d.fog * d.vary > 1.0f  || d.efog  + d.efog * d.vary > 1.0f)
 	{
@@ -251,6 +736,54 @@ static void VS_CC fogCreate(const VSMap* in, VSMap* out, void* userData, VSCore*
 		vsapi->freeNode(d.node);
 		return;
 	}
+	d.scale = int64ToIntS(vsapi->propGetInt(in, "scale", 0, &err));
+	if (err)
+		d.scale = VSMAX(d.vi->width, d.vi->height) / 4;
+	if (d.scale < 8)
+	{
+		vsapi->setError(out, "Fog: scale must be 8 or more");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.octaves = int64ToIntS(vsapi->propGetInt(in, "octaves", 0, &err));
+	if (err)
+		d.octaves = 4;
+	else if (d.octaves < 1 || d.octaves > 8)
+	{
+		vsapi->setError(out, "Fog: octaves can be 1 to 8");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.windx = (float)vsapi->propGetFloat(in, "windx", 0, &err);
+	if (err)
+		d.windx = 2.0f;
+	d.windy = (float)vsapi->propGetFloat(in, "windy", 0, &err);
+	if (err)
+		d.windy = 0.0f;
+	if (fabsf(d.windx) > 100.0f || fabsf(d.windy) > 100.0f)
+	{
+		vsapi->setError(out, "Fog: windx and windy can be -100 to 100 samples a frame");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.grad = (float)vsapi->propGetFloat(in, "grad", 0, &err);
+	if (err)
+		d.grad = 0.5f;
+	else if (d.grad < -1.0f || d.grad > 1.0f)
+	{
+		vsapi->setError(out, "Fog: grad can be -1 to 1");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.lowres = int64ToIntS(vsapi->propGetInt(in, "lowres", 0, &err));
+	if (err)
+		d.lowres = 4;
+	else if (d.lowres != 4 && d.lowres != 8)
+	{
+		vsapi->setError(out, "Fog: lowres can be 4 or 8");
+		vsapi->freeNode(d.node);
+		return;
+	}
 
 	
     data = (FogData*)malloc(sizeof(d));
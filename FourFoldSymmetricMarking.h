@@ -1,5 +1,6 @@
 #ifndef FOURFOLD_SYMMETRIC_MARKING_H_V_C_MOHAN
 #define FOURFOLD_SYMMETRIC_MARKING_H_V_C_MOHAN
+#include "simdLevel.h"
 // using four fold symmetry output is marked
 // requires interpolationmethods.h for some functions
 // ensure no access violation occurs
@@ -40,6 +41,36 @@ void interpolate9pt4FoldSymIfChecks(finc* dp, const int dpitch, const finc* sp,
 	const int width, const int height, const int centerx, const int centery,
 	const int dw, const int dh, const int sw, const int sh,
 	const int index);
+// Row ordered variants. The four mirrored samples of each (dw, dh) are gathered
+// into quadrant row buffers at index dw: q[0] is (+h, +w), q[1] (+h, -w), q[2]
+// (-h, +w) and q[3] (-h, -w). store4FoldSymRows then writes rows +dh and -dh
+// contiguously, -w halves lane reversed, instead of four scattered stores per
+// sample. Planar only (kb 1). Samples shared by quadrants, at dw or dh 0, end as
+// left by the per sample function. storeReversed requires simdLevel.h
+template <typename finc>
+void gather4FoldSym(finc* const* q, const finc* sp, const int spitch,
+	const int dw, const int sw, const int sh);
+template <typename finc>
+void gatherInterpolated4FoldSym(finc* const* q, const finc* sp, const int spitch,
+	const int dw, const int sw, const int sh,
+	const int qx, const int qy, const int span,
+	const float* iCoeff, finc min, finc max);
+template <typename finc>
+void gather9pt4FoldSym(finc* const* q, const finc* sp, const int spitch,
+	const int dw, const int dh, const int sw, const int sh,
+	const int index);
+// present output, for samples that are not to change
+template <typename finc>
+void keep4FoldSym(finc* const* q, const finc* dp, const int dpitch, const int dw, const int dh);
+// col from dw0 upto dw1
+template <typename finc>
+void fill4FoldSym(finc* const* q, const int dw0, const int dw1, const finc col);
+// writes dw 0 to n - 1 of rows +dh and -dh
+template <typename finc>
+void store4FoldSymRows(finc* dp, const int dpitch, const int dh, finc* const* q, const int n);
+// dp[-k] = s[k] for k 0 to n - 1
+template <typename finc>
+void storeReversed(finc* dp, const finc* s, const int n);
 //.......................................................................................
 template <typename finc>
 void paint4FoldSym(finc* dp, const int dpitch, const int kb, const int dw, const int dh, const finc col)
@@ -214,4 +245,108 @@ void interpolate9pt4FoldSymIfChecks(finc* dp, const int dpitch, const finc* sp,
 				sw, sh, index);
 	}
 }
+
+//.......................................................................................
+template <typename finc>
+void gather4FoldSym(finc* const* q, const finc* sp, const int spitch,
+	const int dw, const int sw, const int sh)
+{
+	q[0][dw] = *(sp + sh * spitch + sw);
+	q[1][dw] = *(sp + sh * spitch - sw);
+	q[2][dw] = *(sp - sh * spitch + sw);
+	q[3][dw] = *(sp - sh * spitch - sw);
+}
+
+template <typename finc>
+void gatherInterpolated4FoldSym(finc* const* q, const finc* sp, const int spitch,
+	const int dw, const int sw, const int sh,
+	const int qx, const int qy, const int span,
+	const float* iCoeff, finc min, finc max)
+{
+	q[0][dw] = clamp(LaQuantile(sp + sh * spitch + sw, spitch, 1,
+		span, qx, qy, iCoeff), min, max);
+	q[1][dw] = clamp(LaQuantile(sp + sh * spitch - sw, spitch, -1,
+		span, qx, qy, iCoeff), min, max);
+	q[2][dw] = clamp(LaQuantile(sp - sh * spitch + sw, -spitch, 1,
+		span, qx, qy, iCoeff), min, max);
+	q[3][dw] = clamp(LaQuantile(sp - sh * spitch - sw, -spitch, -1,
+		span, qx, qy, iCoeff), min, max);
+}
+
+template <typename finc>
+void gather9pt4FoldSym(finc* const* q, const finc* sp, const int spitch,
+	const int dw, const int dh, const int sw, const int sh,
+	const int index)
+{
+	q[0][dw] = bestOfNine(sp, spitch, 1, sw, sh, index);
+	q[1][dw] = bestOfNine(sp, spitch, -1, sw, sh, index);
+	q[2][dw] = bestOfNine(sp, -spitch, 1, sw, sh, index);
+	q[3][dw] = bestOfNine(sp, -spitch, -1, sw, sh, index);
+	// interpolate9pt4FoldSym writes (-h, -w) before (-h, +w) and (+h, -w)
+	if (dh == 0)
+		q[3][dw] = q[1][dw];
+	else if (dw == 0)
+		q[3][dw] = q[2][dw];
+}
+
+template <typename finc>
+void keep4FoldSym(finc* const* q, const finc* dp, const int dpitch, const int dw, const int dh)
+{
+	q[0][dw] = *(dp + dh * dpitch + dw);
+	q[1][dw] = *(dp + dh * dpitch - dw);
+	q[2][dw] = *(dp - dh * dpitch + dw);
+	q[3][dw] = *(dp - dh * dpitch - dw);
+}
+
+template <typename finc>
+void fill4FoldSym(finc* const* q, const int dw0, const int dw1, const finc col)
+{
+	for (int k = 0; k < 4; k++)
+		for (int w = dw0; w < dw1; w++)
+			q[k][w] = col;
+}
+
+#ifdef VFX_X86_SIMD
+// lanes of 16 bytes are reversed with pshufb. Returns samples done
+template <typename finc>
+VFX_TARGET("sse4.1") int storeReversedSse41(finc* dp, const finc* s, const int n)
+{
+	const int lanes = 16 / sizeof(finc);
+	const __m128i rev = sizeof(finc) == 1
+		? _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+		: sizeof(finc) == 2
+		? _mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1)
+		: _mm_setr_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	int k = 0;
+
+	for (; k + lanes <= n; k += lanes)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(s + k));
+		_mm_storeu_si128((__m128i*)(dp - k - lanes + 1), _mm_shuffle_epi8(v, rev));
+	}
+	return k;
+}
+#endif
+
+template <typename finc>
+void storeReversed(finc* dp, const finc* s, const int n)
+{
+	int k = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_SSE41)
+		k = storeReversedSse41(dp, s, n);
+#endif
+	for (; k < n; k++)
+		*(dp - k) = s[k];
+}
+
+template <typename finc>
+void store4FoldSymRows(finc* dp, const int dpitch, const int dh, finc* const* q, const int n)
+{
+	// +w half first, so that w 0 is of -w half as in per sample order
+	memcpy(dp + dh * dpitch, q[0], sizeof(finc) * n);
+	storeReversed(dp + dh * dpitch, q[1], n);
+	memcpy(dp - dh * dpitch, q[2], sizeof(finc) * n);
+	storeReversed(dp - dh * dpitch, q[3], n);
+}
 #endif
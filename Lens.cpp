@@ -25,9 +25,44 @@ typedef struct {
     int span;
    
     float* cubicCoeff;
+    int16_t* q14Coeff;  // for 8 bit. NULL for other formats
+    WarpMap* map;       // lens geometry if rad and mag do not change, else NULL
+    WarpCache* cache;   // maps of changing lens. NULL if map is static
+    int cacheMB;        // budget of cache
+    int threads;        // threads doing bands of rows of a frame
   
 } LensData;
 
+// lens of a frame, for bands of its rows
+typedef struct {
+    const FramePlane* pl;
+    int np;
+    const LensData* d;
+    const WarpMap* map;
+    int rad, cx, cy;
+} LensBand;
+
+// rows row0 to row1 - 1 of lens, counted from its top
+static void lensBand(void* work, int row0, int row1)
+{
+    const LensBand* b = (const LensBand*)work;
+    const LensData* d = b->d;
+    const VSFormat* fi = d->vi->format;
+    int ht = d->vi->height;
+    int wd = d->vi->width;
+    int y0 = b->cy - b->rad + row0, y1 = b->cy - b->rad + row1;
+
+    if (fi->bytesPerSample == 1)
+        lensMagnifyPlanes<uint8_t>(b->pl, b->np, fi, ht, wd, b->rad, b->cx, b->cy, b->map, d->span,
+            d->cubicCoeff, d->q14Coeff, y0, y1);
+    else if (fi->bytesPerSample == 2)
+        lensMagnifyPlanes<uint16_t>(b->pl, b->np, fi, ht, wd, b->rad, b->cx, b->cy, b->map, d->span,
+            d->cubicCoeff, NULL, y0, y1);
+    else
+        lensMagnifyPlanes<float>(b->pl, b->np, fi, ht, wd, b->rad, b->cx, b->cy, b->map, d->span,
+            d->cubicCoeff, NULL, y0, y1);
+}
+
 static void VS_CC lensInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
     LensData *d = (LensData *) * instanceData;
     vsapi->setVideoInfo(d->vi, 1, node);
@@ -37,7 +72,24 @@ static void VS_CC lensInit(VSMap *in, VSMap *out, void **instanceData, VSNode *n
     // using cubic interpolation at 64 quantiles preset intervals
     d->cubicCoeff = (float*)vs_aligned_malloc(sizeof(float) * (d->quantiles + 1) * d->span, 32);
     CubicIntCoeff(d->cubicCoeff, d->quantiles);
-    
+    // integer coefficients for 8 bit samples
+    d->q14Coeff = NULL;
+
+    if (d->vi->format->sampleType == stInteger && d->vi->format->bitsPerSample == 8)
+    {
+        d->q14Coeff = (int16_t*)vs_aligned_malloc(sizeof(int16_t) * (d->quantiles + 1) * d->span, 32);
+        Q14Coeff(d->q14Coeff, d->cubicCoeff, d->span, d->quantiles + 1);
+    }
+    // map does not depend on position, so a moving lens can also use it
+    d->map = NULL;
+
+    if (d->irad == d->erad && d->imag == d->emag)
+        d->map = lensWarpMap(d->irad, d->imag, d->quantiles, d->drop);
+    // cache is only for animated geometry
+    d->cache = NULL;
+
+    if (d->map == NULL)
+        d->cache = warpCacheCreate((size_t)d->cacheMB << 20);
 }
 
 static const VSFrameRef *VS_CC lensGetFrame(int in, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
@@ -57,100 +109,32 @@ static const VSFrameRef *VS_CC lensGetFrame(int in, int activationReason, void *
         int n = in - d->StartFrame;
         int nFrames = d->EndFrame - d->StartFrame + 1;
 
-        const VSFormat* fi = d->vi->format;
-        int ht = d->vi->height;
-        int wd = d->vi->width;
         // to ensure outside of lens spaces are filled properly
         VSFrameRef* dst = vsapi->copyFrame(src, core);
 
-        const unsigned char* sp[] = { NULL, NULL, NULL };
-        unsigned char* dp[] = { NULL, NULL, NULL };
-        int subH[] = { 0, fi->subSamplingH, fi->subSamplingH };
-        int subW[] = { 0, fi->subSamplingW, fi->subSamplingW };
-       // int andH = (1 << subH[1]) - 1;
-        //int andW = (1 << subW[1]) - 1;
-
-        int pitch[] = { 0,0,0 };
-        int nbytes = fi->bytesPerSample;
-        int nbits = fi->bitsPerSample;
-        int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;
-
-        for (int p = 0; p < np; p++)
-        {
-            sp[p] = vsapi->getReadPtr(src, p);
-            dp[p] = vsapi->getWritePtr(dst, p);
-            pitch[p] = vsapi->getStride(dst, p) / nbytes;
-        }
+        FramePlane pl[3];
+        int np = getFramePlanes(pl, dst, src, vsapi);
         // calculate current values of parameters
         int cx = d->ix + ((d->ex - d->ix) * n) / nFrames;
         int cy = d->iy + ((d->ey - d->iy) * n) / nFrames;
         int rad = d->irad + ((d->erad - d->irad) * n) / nFrames;
         float mag = (float)(d->imag + ((d->emag - d->imag) * n) / nFrames);
-        // create discs with magnifications
-        
-        if (fi->sampleType == stInteger && nbytes == 1)
-        {
-            uint8_t min = fi->colorFamily == cmRGB ? 0 : 16;
-            uint8_t max = fi->colorFamily == cmRGB ? 255 : 236;
-
-            circularLensMagnification(dp, sp, np, pitch, ht, wd, subW, subH, min, max,
-                rad, cx, cy, mag, d->span,
-                d->cubicCoeff, d->quantiles, d->drop);
-
-        }
-
-        else if (fi->sampleType == stInteger && nbytes == 2)
-        {
-            uint16_t min = (fi->colorFamily == cmRGB ? 0 : 16) << (nbits - 8);
-            uint16_t max = (fi->colorFamily == cmRGB ? 255 : 236) << (nbits - 8);
-
-            circularLensMagnification((uint16_t**)dp, (const uint16_t**)sp, np, 
-                pitch, ht, wd, subW, subH, min, max,
-                rad, cx, cy, mag, d->span,
-                d->cubicCoeff, d->quantiles, d->drop);
-
-        }
-
-        else if (fi->sampleType == stFloat && nbytes == 4)
+        // changing lens has a map for each rad and mag. position does not matter
+        int key[WARP_KEY_SIZE] = { rad, warpKeyFloat(mag), 0, 0 };
+        const WarpMap* map = d->map;
+
+        if (map == NULL)
+            map = warpCacheFind(d->cache, key);
+        if (map == NULL)
+            map = warpCacheInsert(d->cache, key, lensWarpMap(rad, mag, d->quantiles, d->drop));
+        // create disc with magnification, in bands of rows
+        LensBand band = { pl, np, d, map, rad, cx, cy };
+        bandsRun(d->threads, 2 * rad, lensBand, &band);
+
+        if (d->map == NULL)
         {
-            if (fi->colorFamily != cmYUV)
-            {
-                float min = 0;
-                float max = 1.0f;
-
-                circularLensMagnification((float**)dp, (const float**)sp, np, 
-                    pitch, ht, wd, subW, subH, min, max,
-                    rad, cx, cy, mag, d->span,
-                    d->cubicCoeff, d->quantiles, d->drop);
-            }
-
-            else if (fi->colorFamily == cmYUV)
-            {
-                // go around for yuv as min and max values differ for Y and UV planes
-                float min = 0;
-                float max = 1.0f;
-
-                circularLensMagnification((float**)dp, (const float**)sp, 1, 
-                    pitch, ht, wd, subW, subH, min, max,
-                    rad, cx, cy, mag, d->span,
-                    d->cubicCoeff, d->quantiles, d->drop);
-
-
-                if (np > 1)
-                {
-                    // U,V planes 
-                    float min = -0.5f;
-                    float max = 0.5f;
-
-                    circularLensMagnification((float**)(dp + 1), (const float**)(sp + 1), 2,
-                        pitch, ht, wd, subW, subH, min, max,
-                        rad, cx, cy, mag, d->span,
-                        d->cubicCoeff, d->quantiles, d->drop);
-                }
-            }
-
+            warpCacheRelease(d->cache, map);
         }
-            
         
         vsapi->freeFrame(src);
         return dst;
@@ -163,6 +147,12 @@ static void VS_CC lensFree(void *instanceData, VSCore *core, const VSAPI *vsapi)
     LensData *d = (LensData *)instanceData;
     vsapi->freeNode(d->node);
     vs_aligned_free(d->cubicCoeff);
+    if (d->q14Coeff != NULL)
+        vs_aligned_free(d->q14Coeff);
+    warpMapFree(d->map);
+    warpCacheLog(d->cache, "Lens", vsapi);
+    warpCacheFree(d->cache);
+    bandsDetach();
     free(d);
 }
 
@@ -292,10 +282,32 @@ static void VS_CC lensCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         d.drop = true;
     else
         d.drop = false;
+
+    d.cacheMB = int64ToIntS(vsapi->propGetInt(in, "cache", 0, &err));
+    if (err)
+        d.cacheMB = 32;
+    else if (d.cacheMB < 0 || d.cacheMB > 1024)
+    {
+        vsapi->setError(out, "Lens: cache must be 0 to 1024 MB");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    d.threads = int64ToIntS(vsapi->propGetInt(in, "threads", 0, &err));
+    if (err)
+        d.threads = 1;
+    else if (d.threads < 0 || d.threads > BAND_MAX_THREADS)
+    {
+        vsapi->setError(out, "Lens: threads must be 1 to 64, or 0 for all cores");
+        vsapi->freeNode(d.node);
+        return;
+    }
+    d.threads = bandThreads(d.threads);
     
     data = (LensData*)malloc(sizeof(d));
     *data = d;
 
+    bandsAttach();
     vsapi->createFilter(in, out, "Lens", lensInit, lensGetFrame, lensFree, fmParallel, 0, data, core);
 }
 
@@ -0,0 +1,518 @@
+/******************************************************************************
+LensCorrect corrects, or produces, lens distortion of the full frame about a
+center, by the methods of FisheyeMethods.h
+1 to 5	fisheye ortho, linear, equisolid, panoramic, radial correction
+6 to 10	produce fisheye ortho, linear, equisolid, panoramic, radial
+11, 12	barrel and pincushion of coefficient k
+13		Brown Conrady model of coefficients abc
+14		division model of coefficients abc
+Distances are normalized by rad. Geometry is the same in all four quadrants, so
+source positions of one quadrant are made once in Init and mirrored to others.
+That table can be kept in mapfile, and is read from it when made for same frame
+and parameters. Samples whose source is outside the frame are black.
+*************************************************************************************************/
+#include "VapourSynth.h"
+#include "VSHelper.h"
+
+#define LENSCORRECT_MAGIC "vfxLCmap"
+#define LENSCORRECT_VERSION 2
+
+typedef struct {
+	VSNodeRef* node;
+	const VSVideoInfo* vi;
+
+	int method;
+	int cx, cy;		// center
+	int rad;		// radius of normalization
+	float fov;		// field of view of methods 1 to 10
+	float cvx;		// refractive index like factor of methods 1 to 10
+	float k;		// coefficient of barrel and pincushion
+	float abc[3];	// coefficients of methods 13 and 14
+	int q;			// 0 nearest, 1 bilinear, 2 bicubic, 3 lanczos
+	int span;		// interpolation taps. 0 for nearest
+	int quantiles;
+	float* coeff;	// interpolation coefficients
+	int16_t* q14Coeff;	// same for 8 bit in integer. NULL for other formats
+	char* mapfile;	// kept table, or NULL
+	int qw, qh;		// quadrant size. Largest distance of a sample from center
+	WarpMap* map;	// source of quadrant offsets (w, h) from center, at (w + dx, h + dy)
+	int threads;	// threads doing bands of rows of a frame
+} LensCorrectData;
+
+// written ahead of entries in mapfile. Entries are kept only if all of it matches
+typedef struct {
+	char magic[8];
+	int version;
+	int entrySize;
+	int width, height;
+	int method;
+	int cx, cy;
+	int rad;
+	int quantiles;
+	int nearest;
+	int qw, qh;
+	float fov, cvx, k;
+	float abc[3];
+} LensCorrectFileHeader;
+
+// correction of a frame, for bands of its rows. fill is of sample type
+typedef struct {
+	const FramePlane* pl;
+	int np;
+	const LensCorrectData* d;
+	const void* fill;
+} LensCorrectBand;
+
+// quadrant table of source positions
+void lenscorrectBuildMap(LensCorrectData* d);
+// reads table from mapfile if it was made for same header. false if not
+bool lenscorrectReadMap(LensCorrectData* d, const LensCorrectFileHeader* header);
+void lenscorrectWriteMap(const LensCorrectData* d, const LensCorrectFileHeader* header);
+// entries of frame row h, mirrored from quadrant table
+void lenscorrectRow(WarpEntry* e, const LensCorrectData* d, int h);
+template <typename finc>
+void lenscorrectBand(void* work, int row0, int row1);
+
+//------------------------------------------------------------------------------
+void lenscorrectBuildMap(LensCorrectData* d)
+{
+	// fisheye methods take focal from fov. Barrel and pincushion, k and squared radius
+	double focal = d->method <= 10 ? getFocalLength(d->rad, d->method, d->fov) : d->k;
+	double rNorm = d->method <= 10 ? focal : (double)d->rad * d->rad;
+	bool nearest = d->span == 0;
+	float xy[2];
+
+	for (int h = 0; h <= d->qh; h++)
+	{
+		WarpEntry* e = warpMapRow(d->map, h);
+
+		for (int w = 0; w <= d->qw; w++)
+		{
+			// methods 1 to 10 add half a sample to x, which is taken off here so
+			// that quadrants mirror about center sample
+			if (d->method <= 10)
+				getSourceXY(xy, w - 0.5f, (float)h, d->method, focal, rNorm, d->cvx);
+			else if (d->method <= 12)
+				getSourceXY(xy, (float)w, (float)h, d->method, focal, rNorm, d->cvx);
+			else
+				getSourceCoord(xy, (float)w, (float)h, d->method - 12, (float)d->rad, d->abc);
+			// on the axes source is on the axes too. Center is 0 / 0 for methods 1 to 10
+			if (w == 0)
+				xy[0] = 0.0f;
+			if (h == 0)
+				xy[1] = 0.0f;
+			// farther than any sample in either direction, or not a number. A source
+			// on the other side of center is where denominator of barrel or division
+			// model has gone to zero or below
+			if (!(fabsf(xy[0]) <= d->qw && fabsf(xy[1]) <= d->qh) || xy[0] < 0.0f || xy[1] < 0.0f)
+			{
+				e[w].qx = WARP_SKIP;
+				continue;
+			}
+			int x = (int)floorf(xy[0]), y = (int)floorf(xy[1]);
+			int qx = (int)((xy[0] - x) * d->quantiles + 0.5f);
+			int qy = (int)((xy[1] - y) * d->quantiles + 0.5f);
+
+			if (nearest)
+			{
+				x += 2 * qx >= d->quantiles;
+				y += 2 * qy >= d->quantiles;
+				qx = qy = 0;
+			}
+			if (qx == d->quantiles)
+			{
+				x++;
+				qx = 0;
+			}
+			if (qy == d->quantiles)
+			{
+				y++;
+				qy = 0;
+			}
+			e[w].dx = (int16_t)(x - w);
+			e[w].dy = (int16_t)(y - h);
+			e[w].qx = (uint8_t)qx;
+			e[w].qy = (uint8_t)qy;
+		}
+	}
+}
+
+bool lenscorrectReadMap(LensCorrectData* d, const LensCorrectFileHeader* header)
+{
+	std::ifstream file(d->mapfile, std::ios::binary);
+	LensCorrectFileHeader kept;
+
+	if (!file.read((char*)&kept, sizeof(kept)) || memcmp(&kept, header, sizeof(kept)) != 0)
+		return false;
+	size_t bytes = sizeof(WarpEntry) * (size_t)(d->qw + 1) * (d->qh + 1);
+
+	if (!file.read((char*)d->map->entry, bytes))
+		return false;
+	// a stale or damaged file must not give quantiles past coefficient tables or
+	// sources outside quadrant, so every entry is checked
+	for (int h = 0; h <= d->qh; h++)
+	{
+		const WarpEntry* e = warpMapRow(d->map, h);
+
+		for (int w = 0; w <= d->qw; w++)
+		{
+			if (e[w].qx == WARP_SKIP)
+				continue;
+			if (e[w].qx > d->quantiles || e[w].qy > d->quantiles
+				|| abs(w + e[w].dx) > d->qw || abs(h + e[w].dy) > d->qh)
+				return false;
+		}
+	}
+	return true;
+}
+
+void lenscorrectWriteMap(const LensCorrectData* d, const LensCorrectFileHeader* header)
+{
+	// written whole under another name, so that a reader never sees part of it
+	std::string temp = std::string(d->mapfile) + ".tmp";
+	bool written;
+	{
+		std::ofstream file(temp.c_str(), std::ios::binary | std::ios::trunc);
+		size_t bytes = sizeof(WarpEntry) * (size_t)(d->qw + 1) * (d->qh + 1);
+
+		file.write((const char*)header, sizeof(*header));
+		file.write((const char*)d->map->entry, bytes);
+		// close flushes, so that a short write is seen too
+		file.close();
+		written = file.good();
+	}
+	// old file is kept if new one could not be written whole
+	if (!written)
+	{
+		remove(temp.c_str());
+		return;
+	}
+	remove(d->mapfile);
+	rename(temp.c_str(), d->mapfile);
+}
+
+// a quadrant position mirrored to negative side is floor -x - 1 of quantile q - qx
+void lenscorrectRow(WarpEntry* e, const LensCorrectData* d, int h)
+{
+	int wd = d->vi->width, ht = d->vi->height;
+	int oh = h - d->cy;
+	const WarpEntry* qe = warpMapRow(d->map, abs(oh));
+
+	for (int w = 0; w < wd; w++)
+	{
+		int ow = w - d->cx;
+		const WarpEntry* s = qe + abs(ow);
+
+		if (s->qx == WARP_SKIP)
+		{
+			e[w].qx = WARP_SKIP;
+			continue;
+		}
+		int sx = abs(ow) + s->dx, sy = abs(oh) + s->dy;
+		int qx = s->qx, qy = s->qy;
+
+		if (ow < 0)
+		{
+			sx = -sx - (qx > 0);
+			qx = qx > 0 ? d->quantiles - qx : 0;
+		}
+		if (oh < 0)
+		{
+			sy = -sy - (qy > 0);
+			qy = qy > 0 ? d->quantiles - qy : 0;
+		}
+		int x = d->cx + sx, y = d->cy + sy;
+
+		if (x < 0 || x >= wd || y < 0 || y >= ht)
+		{
+			e[w].qx = WARP_SKIP;
+			continue;
+		}
+		e[w].dx = (int16_t)(x - w);
+		e[w].dy = (int16_t)(y - h);
+		e[w].qx = (uint8_t)qx;
+		e[w].qy = (uint8_t)qy;
+	}
+}
+
+template <typename finc>
+void lenscorrectBand(void* work, int row0, int row1)
+{
+	const LensCorrectBand* b = (const LensCorrectBand*)work;
+	const LensCorrectData* d = b->d;
+	int wd = d->vi->width, ht = d->vi->height;
+	WarpSampler sampler = { d->span, d->quantiles, d->coeff, d->q14Coeff };
+	ScratchArena* scratch = scratchBegin();
+	WarpRowBuffers buf;
+	warpRowBuffers(&buf, scratch, wd);
+	WarpEntry* row = scratchAlloc<WarpEntry>(scratch, sizeof(WarpEntry) * wd);
+
+	for (int h = row0; h < row1; h++)
+	{
+		lenscorrectRow(row, d, h);
+		warpSampleRow<finc>(b->pl, b->np, d->vi->format, wd, ht, row, h, &sampler, (const finc*)b->fill, &buf);
+	}
+	scratchEnd(scratch);
+}
+
+static void VS_CC lenscorrectInit(VSMap* in, VSMap* out, void** instanceData,
+	VSNode* node, VSCore* core, const VSAPI* vsapi)
+{
+	LensCorrectData* d = (LensCorrectData*)*instanceData;
+	vsapi->setVideoInfo(d->vi, 1, node);
+
+	d->span = d->q == 0 ? 0 : d->q == 1 ? 2 : d->q == 2 ? 4 : 6;
+	d->quantiles = 64;
+	d->coeff = NULL;
+	d->q14Coeff = NULL;
+
+	if (d->span > 0)
+	{
+		d->coeff = (float*)vs_aligned_malloc(sizeof(float) * (d->quantiles + 1) * d->span, 32);
+
+		if (d->span == 2)
+			LinearIntCoeff(d->coeff, d->quantiles);
+		else if (d->span == 4)
+			CubicIntCoeff(d->coeff, d->quantiles);
+		else
+			LanczosCoeff(d->coeff, d->span, d->quantiles);
+
+		if (d->vi->format->sampleType == stInteger && d->vi->format->bitsPerSample == 8)
+		{
+			d->q14Coeff = (int16_t*)vs_aligned_malloc(sizeof(int16_t) * (d->quantiles + 1) * d->span, 32);
+			Q14Coeff(d->q14Coeff, d->coeff, d->span, d->quantiles + 1);
+		}
+	}
+	d->qw = VSMAX(d->cx, d->vi->width - 1 - d->cx);
+	d->qh = VSMAX(d->cy, d->vi->height - 1 - d->cy);
+
+	int* rowLength = vs_aligned_malloc<int>(sizeof(int) * (d->qh + 1), 32);
+
+	for (int h = 0; h <= d->qh; h++)
+		rowLength[h] = d->qw + 1;
+	d->map = warpMapCreate(d->qh + 1, rowLength);
+	vs_aligned_free(rowLength);
+
+	if (d->mapfile == NULL)
+	{
+		lenscorrectBuildMap(d);
+		return;
+	}
+	LensCorrectFileHeader header;
+	// padding too is compared
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LENSCORRECT_MAGIC, sizeof(header.magic));
+	header.version = LENSCORRECT_VERSION;
+	header.entrySize = sizeof(WarpEntry);
+	header.width = d->vi->width;
+	header.height = d->vi->height;
+	header.method = d->method;
+	header.cx = d->cx;
+	header.cy = d->cy;
+	header.rad = d->rad;
+	header.quantiles = d->quantiles;
+	header.nearest = d->span == 0;
+	header.qw = d->qw;
+	header.qh = d->qh;
+	header.fov = d->fov;
+	header.cvx = d->cvx;
+	header.k = d->k;
+	memcpy(header.abc, d->abc, sizeof(header.abc));
+
+	if (!lenscorrectReadMap(d, &header))
+	{
+		lenscorrectBuildMap(d);
+		lenscorrectWriteMap(d, &header);
+	}
+}
+//----------------------------------------------------------------------------------------------
+static const VSFrameRef* VS_CC lenscorrectGetFrame(int n, int activationReason, void** instanceData,
+	void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi)
+{
+	LensCorrectData* d = (LensCorrectData*)*instanceData;
+
+	if (activationReason == arInitial)
+	{
+		vsapi->requestFrameFilter(n, d->node, frameCtx);
+	}
+	else if (activationReason == arAllFramesReady)
+	{
+		const VSFrameRef* src = vsapi->getFrameFilter(n, d->node, frameCtx);
+		const VSFormat* fi = d->vi->format;
+		VSFrameRef* dst = vsapi->newVideoFrame(fi, d->vi->width, d->vi->height, src, core);
+		FramePlane pl[3];
+		int np = getFramePlanes(pl, dst, src, vsapi);
+		bool yuv = fi->colorFamily == cmYUV;
+
+		if (fi->bytesPerSample == 1)
+		{
+			uint8_t fill[] = { (uint8_t)(yuv ? 16 : 0), (uint8_t)(yuv ? 128 : 0), (uint8_t)(yuv ? 128 : 0) };
+			LensCorrectBand band = { pl, np, d, fill };
+			bandsRun(d->threads, d->vi->height, lenscorrectBand<uint8_t>, &band);
+		}
+		else if (fi->bytesPerSample == 2)
+		{
+			int shift = fi->bitsPerSample - 8;
+			uint16_t fill[] = { (uint16_t)(yuv ? 16 << shift : 0), (uint16_t)(yuv ? 128 << shift : 0),
+				(uint16_t)(yuv ? 128 << shift : 0) };
+			LensCorrectBand band = { pl, np, d, fill };
+			bandsRun(d->threads, d->vi->height, lenscorrectBand<uint16_t>, &band);
+		}
+		else
+		{
+			// U, V float planes are centered on 0
+			float fill[] = { 0.0f, 0.0f, 0.0f };
+			LensCorrectBand band = { pl, np, d, fill };
+			bandsRun(d->threads, d->vi->height, lenscorrectBand<float>, &band);
+		}
+		vsapi->freeFrame(src);
+		return dst;
+	}
+	return 0;
+}
+
+static void VS_CC lenscorrectFree(void* instanceData, VSCore* core, const VSAPI* vsapi)
+{
+	LensCorrectData* d = (LensCorrectData*)instanceData;
+	vsapi->freeNode(d->node);
+	vs_aligned_free(d->coeff);
+	vs_aligned_free(d->q14Coeff);
+	warpMapFree(d->map);
+	free(d->mapfile);
+	bandsDetach();
+	free(d);
+}
+
+static void VS_CC lenscorrectCreate(const VSMap* in, VSMap* out, void* userData,
+	VSCore* core, const VSAPI* vsapi)
+{
+	LensCorrectData d;
+	LensCorrectData* data;
+	int err;
+
+	d.node = vsapi->propGetNode(in, "clip", 0, 0);
+	d.vi = vsapi->getVideoInfo(d.node);
+
+	if (!isConstantFormat(d.vi) || (d.vi->format->colorFamily != cmRGB && d.vi->format->colorFamily != cmYUV
+		&& d.vi->format->colorFamily != cmGray))
+	{
+		vsapi->setError(out, "LensCorrect: RGB, YUV and Gray constant format input only is supported");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	if (d.vi->format->sampleType == stFloat && d.vi->format->bitsPerSample == 16)
+	{
+		vsapi->setError(out, "LensCorrect: half float input not allowed");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	// offsets of table are 16 bit and reach across a frame
+	if (d.vi->width > 16384 || d.vi->height > 16384)
+	{
+		vsapi->setError(out, "LensCorrect: frame width and height can be up to 16384");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.method = int64ToIntS(vsapi->propGetInt(in, "method", 0, &err));
+	if (err)
+		d.method = 1;
+	else if (d.method < 1 || d.method > 14)
+	{
+		vsapi->setError(out, "LensCorrect: method must be 1 to 14");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.cx = int64ToIntS(vsapi->propGetInt(in, "x", 0, &err));
+	if (err)
+		d.cx = d.vi->width / 2;
+	d.cy = int64ToIntS(vsapi->propGetInt(in, "y", 0, &err));
+	if (err)
+		d.cy = d.vi->height / 2;
+	if (d.cx < 0 || d.cx >= d.vi->width || d.cy < 0 || d.cy >= d.vi->height)
+	{
+		vsapi->setError(out, "LensCorrect: x and y must be within frame");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.rad = int64ToIntS(vsapi->propGetInt(in, "rad", 0, &err));
+	if (err)
+		d.rad = (int)sqrt((double)d.vi->width * d.vi->width + (double)d.vi->height * d.vi->height) / 2;
+	else if (d.rad < 16)
+	{
+		vsapi->setError(out, "LensCorrect: rad must be 16 or more");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.fov = (float)vsapi->propGetFloat(in, "fov", 0, &err);
+	if (err)
+		d.fov = 120.0f;
+	else if (d.fov < 20 || d.fov > 170)
+	{
+		vsapi->setError(out, "LensCorrect: fov can be 20 to 170 only");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.cvx = (float)vsapi->propGetFloat(in, "cvx", 0, &err);
+	if (err)
+		d.cvx = 1.0f;
+	else if (d.cvx < 1.0f || d.cvx > 1.5f)
+	{
+		vsapi->setError(out, "LensCorrect: cvx must be 1.0 to 1.5");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.k = (float)vsapi->propGetFloat(in, "k", 0, &err);
+	if (err)
+		d.k = 0.1f;
+	else if (d.k < 0.0f || d.k >= 1.0f)
+	{
+		vsapi->setError(out, "LensCorrect: k must be 0 or more and less than 1");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	for (int i = 0; i < 3; i++)
+		d.abc[i] = 0.0f;
+
+	if (d.method >= 13)
+	{
+		if (vsapi->propNumElements(in, "abc") != 3)
+		{
+			vsapi->setError(out, "LensCorrect: methods 13 and 14 need 3 values of abc");
+			vsapi->freeNode(d.node);
+			return;
+		}
+		for (int i = 0; i < 3; i++)
+			d.abc[i] = (float)vsapi->propGetFloat(in, "abc", i, &err);
+	}
+	d.q = int64ToIntS(vsapi->propGetInt(in, "q", 0, &err));
+	if (err)
+		d.q = 2;
+	else if (d.q < 0 || d.q > 3)
+	{
+		vsapi->setError(out, "LensCorrect: q can be 0 for nearest, 1 bilinear, 2 bicubic or 3 lanczos sampling");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.threads = int64ToIntS(vsapi->propGetInt(in, "threads", 0, &err));
+	if (err)
+		d.threads = 1;
+	else if (d.threads < 0 || d.threads > BAND_MAX_THREADS)
+	{
+		vsapi->setError(out, "LensCorrect: threads must be 1 to 64, or 0 for all cores");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.threads = bandThreads(d.threads);
+
+	d.coeff = NULL;
+	d.q14Coeff = NULL;
+	d.map = NULL;
+	const char* mapfile = vsapi->propGetData(in, "mapfile", 0, &err);
+	d.mapfile = err || mapfile[0] == 0 ? NULL : strdup(mapfile);
+
+	data = (LensCorrectData*)malloc(sizeof(d));
+	*data = d;
+
+	bandsAttach();
+	vsapi->createFilter(in, out, "LensCorrect", lenscorrectInit, lenscorrectGetFrame, lenscorrectFree, fmParallel, 0, data, core);
+}
@@ -43,6 +43,8 @@ typedef struct {
     int span;
    
     float* cubicCoeff;
+    int16_t* q14Coeff;  // integer coefficients for 8 bit
+    int32_t* q30Coeff;  // and for 9 to 16 bit. NULL if not used
     int* nearxy;
     int* qxy;
 } LineMagnifierData;
@@ -56,6 +58,19 @@ static void VS_CC linemagnifierInit(VSMap *in, VSMap *out, void **instanceData,
     // using cubic interpolation at 64 quantiles preset intervals
     d->cubicCoeff = (float*)vs_aligned_malloc(sizeof(float) * (d->quantiles + 1) * d->span, 32);
     CubicIntCoeff(d->cubicCoeff, d->quantiles);
+    d->q14Coeff = NULL;
+    d->q30Coeff = NULL;
+
+    if (d->vi->format->sampleType == stInteger && d->vi->format->bitsPerSample == 8)
+    {
+        d->q14Coeff = (int16_t*)vs_aligned_malloc(sizeof(int16_t) * (d->quantiles + 1) * d->span, 32);
+        Q14Coeff(d->q14Coeff, d->cubicCoeff, d->span, d->quantiles + 1);
+    }
+    else if (d->vi->format->sampleType == stInteger)
+    {
+        d->q30Coeff = (int32_t*)vs_aligned_malloc(sizeof(int32_t) * (d->quantiles + 1) * d->span, 32);
+        Q30Coeff(d->q30Coeff, d->cubicCoeff, d->span, d->quantiles + 1);
+    }
 
     d->nearxy = (int*)vs_aligned_malloc(sizeof(int) * d->lwidth * 2, 32);
     d->qxy = d->nearxy + d->lwidth;
@@ -138,8 +153,8 @@ static const VSFrameRef *VS_CC linemagnifierGetFrame(int in, int activationReaso
 
                             if (p == 0 ||  subW == 0)
 
-                                *(dp + w + lw) = clamp(alongLineInterpolate(sp + w + d->nearxy[lw], 1,
-                                    d->span, d->qxy[lw], d->cubicCoeff), min, max);
+                                *(dp + w + lw) = iclamp(alongLineInterpolateQ14(sp + w + d->nearxy[lw], 1,
+                                    d->span, d->qxy[lw], d->q14Coeff), min, max);
 
                             else if (((w + lw) & andW) == 0)
 
@@ -159,8 +174,8 @@ static const VSFrameRef *VS_CC linemagnifierGetFrame(int in, int activationReaso
                             if (p == 0 || subW == 0)
 
                                 *(( uint16_t*)dp + w + lw) 
-                                = clamp(alongLineInterpolate((const uint16_t*)sp + w + d->nearxy[lw], 1,
-                                    d->span, d->qxy[lw], d->cubicCoeff), min, max);
+                                = iclamp(alongLineInterpolateQ30((const uint16_t*)sp + w + d->nearxy[lw], 1,
+                                    d->span, d->qxy[lw], d->q30Coeff), min, max);
 
                             else if (((w + lw) & andW) == 0)
 
@@ -224,8 +239,8 @@ static const VSFrameRef *VS_CC linemagnifierGetFrame(int in, int activationReaso
                             if (p == 0 || subH == 0)
 
                                 *(dp + (h + lw) * pitch + w)  
-                                = clamp(alongLineInterpolate(sp + (h + d->nearxy[lw]) * pitch + w, pitch,
-                                    d->span, d->qxy[lw], d->cubicCoeff), min, max);
+                                = iclamp(alongLineInterpolateQ14(sp + (h + d->nearxy[lw]) * pitch + w, pitch,
+                                    d->span, d->qxy[lw], d->q14Coeff), min, max);
 
                             else if ( ((h + lw) & andH) == 0)
 
@@ -246,8 +261,8 @@ static const VSFrameRef *VS_CC linemagnifierGetFrame(int in, int activationReaso
                             if (p == 0 || subH == 0)
 
                                 *((uint16_t*)dp + (h + lw) * pitch + w)
-                                = clamp(alongLineInterpolate((const uint16_t*)sp + (h + d->nearxy[lw]) * pitch + w, pitch,
-                                    d->span, d->qxy[lw], d->cubicCoeff), min, max);
+                                = iclamp(alongLineInterpolateQ30((const uint16_t*)sp + (h + d->nearxy[lw]) * pitch + w, pitch,
+                                    d->span, d->qxy[lw], d->q30Coeff), min, max);
 
                             else if (((h + lw) & andH) == 0)
 
@@ -295,6 +310,10 @@ static void VS_CC linemagnifierFree(void *instanceData, VSCore *core, const VSAP
     LineMagnifierData *d = (LineMagnifierData *)instanceData;
     vsapi->freeNode(d->node);
     vs_aligned_free(d->cubicCoeff);
+    if (d->q14Coeff != NULL)
+        vs_aligned_free(d->q14Coeff);
+    if (d->q30Coeff != NULL)
+        vs_aligned_free(d->q30Coeff);
     vs_aligned_free(d->nearxy);
     free(d);
 }
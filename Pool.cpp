@@ -49,78 +49,74 @@ typedef struct {
 	unsigned char bgr[3], yuv[3];
 
 	int* sintbl; // *sinx, * siny;
+	int threads;	// threads doing bands of rows of a frame
 
 
 } PoolData;
 
-void poolPaintCode(PoolData* d, VSFrameRef* dst, const VSAPI* vsapi, int w, int h);
-
-void poolPaintCode(PoolData* d, VSFrameRef* dst, const VSAPI* vsapi, int w, int h)
+// wave of a frame, for bands of pool rows
+typedef struct {
+	const FramePlane* pl;
+	int np;
+	const PoolData* d;
+	const int* siny;
+	int hmin, hmax, wmin, wmax;
+} PoolBand;
+
+template <typename finc>
+void poolFillRect(const FramePlane* pl, int np, const finc* col, int wmin, int hmin, int wmax, int hmax);
+template <typename finc>
+void poolPaintBorders(const FramePlane* pl, int np, const PoolData* d, int hmin, int hmax, int wmin, int wmax, int border);
+template <typename finc>
+void poolWavePlanes(const FramePlane* pl, int np, const int* siny, int hmin, int hmax, int wmin, int wmax,
+	int y0, int y1);
+// all planes in pool rows row0 to row1 - 1
+static void poolBand(void* work, int row0, int row1);
+
+// fills luma rectangle [wmin, wmax) x [hmin, hmax) of np planes with col, each at own
+// resolution. Clipped to planes
+template <typename finc>
+void poolFillRect(const FramePlane* pl, int np, const finc* col, int wmin, int hmin, int wmax, int hmax)
 {
-	const VSFormat* fi = d->vi->format;
-	int nbytes = fi->bytesPerSample;
-	int nbits = fi->bitsPerSample;
-	int subH = fi->subSamplingH;
-	int subW = fi->subSamplingW;
-
-	int andH = (1 << subH) - 1;
-	int andW = (1 << subW) - 1;
-	int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;
 	for (int p = 0; p < np; p++)
 	{
-		unsigned char* dp = vsapi->getWritePtr(dst, p);
-		int pitch = vsapi->getStride(dst, p) / nbytes;
-
-		if (fi->sampleType == stInteger && nbytes == 1)
+		int x0 = VSMAX(planeStart(wmin, pl[p].subW), 0);
+		int x1 = VSMIN(planeStart(wmax, pl[p].subW), pl[p].width);
+		int y0 = VSMAX(planeStart(hmin, pl[p].subH), 0);
+		int y1 = VSMIN(planeStart(hmax, pl[p].subH), pl[p].height);
+
+		if (x0 >= x1)
+			continue;
+		for (int y = y0; y < y1; y++)
 		{
-			if (p == 0 || (subH == 0 && subW == 0))
-			{
-				*(dp + h * pitch + w)
-					= fi->colorFamily == cmRGB ? d->bgr[p] : d->yuv[p];
-			}
-
-			else if ((w & andW) == 0 && (h & andH) == 0)
-			{
-				*(dp + (h >> subH) * pitch + (w >> subW))
-					= fi->colorFamily == cmRGB ? d->bgr[p] : d->yuv[p];
-			}
+			finc* dp = (finc*)pl[p].dp + y * pl[p].pitch;
 
+			if (sizeof(finc) == 1)
+				memset(dp + x0, (int)col[p], x1 - x0);
+			else
+				for (int x = x0; x < x1; x++)
+					dp[x] = col[p];
 		}
-		else if (fi->sampleType == stInteger && nbytes == 2)
-		{
-			if (p == 0 || (subH == 0 && subW == 0))
-			{
-				*((uint16_t*)dp + h * pitch + w)
-					= (uint16_t)(fi->colorFamily == cmRGB ? ((int)d->bgr[p]) << (nbits - 8)
-						: ((int)d->yuv[p]) << (nbits - 8));
-			}
-
-			else if ((w & andW) == 0 && (h & andH) == 0)
-			{
-				*((uint16_t*)dp + (h >> subH) * pitch + (w >> subW))
-					= (uint16_t)(fi->colorFamily == cmRGB ? ((int)d->bgr[p]) << (nbits - 8)
-						: ((int)d->yuv[p]) << (nbits - 8));
-			}
+	}
+}
 
-		}
-		else if (fi->sampleType == stFloat && nbytes == 4)
-		{
-			if (p == 0 || (subH == 0 && subW == 0))
-			{
-				*((float*)dp + h * pitch + w)
-					= (float)(fi->colorFamily == cmRGB ? ((float)d->bgr[p]) / 255.0f
-						: ((float)d->yuv[p]) / 255.0f);
-			}
+// paints the four border strips of pool, of border width, with paint color
+template <typename finc>
+void poolPaintBorders(const FramePlane* pl, int np, const PoolData* d, int hmin, int hmax, int wmin, int wmax, int border)
+{
+	const VSFormat* fi = d->vi->format;
+	finc col[3];
 
-			else if ((w & andW) == 0 && (h & andH) == 0)
-			{
-				*((float*)dp + (h >> subH) * pitch + (w >> subW))
-					= (float)(fi->colorFamily == cmRGB ? ((float)d->bgr[p]) / 255.0f
-						: ((float)d->yuv[p]) / 255.0f);
-			}
+	for (int p = 0; p < np; p++)
+	{
+		int c = fi->colorFamily == cmRGB ? d->bgr[p] : d->yuv[p];
 
-		}
+		col[p] = fi->sampleType == stFloat ? (finc)(c / 255.0f) : (finc)(c << (fi->bitsPerSample - 8));
 	}
+	poolFillRect(pl, np, col, wmin, hmin, wmax, hmin + border);
+	poolFillRect(pl, np, col, wmax - border, hmin, wmax, hmax);
+	poolFillRect(pl, np, col, wmin, hmin, wmin + border, hmax);
+	poolFillRect(pl, np, col, wmin, hmax - border, wmax, hmax);
 }
 
 static void VS_CC poolInit(VSMap* in, VSMap* out, void** instanceData, 
@@ -139,6 +135,61 @@ static void VS_CC poolInit(VSMap* in, VSMap* out, void** instanceData,
 }
 //------------------------------------------------------------------------
 
+//----------------------------------------------------------------------------------------------
+// moves pixels of pool by wave in np planes of same size, at their own resolution, in luma
+// rows y0 to y1 - 1. finc is fixed at compile time so that inner loop has no format checks
+template <typename finc>
+void poolWavePlanes(const FramePlane* pl, int np, const int* siny, int hmin, int hmax, int wmin, int wmax,
+	int y0, int y1)
+{
+	finc* dp[] = { (finc*)pl[0].dp, np > 1 ? (finc*)pl[1].dp : NULL, np > 2 ? (finc*)pl[2].dp : NULL };
+	const finc* sp[] = { (const finc*)pl[0].sp, np > 1 ? (const finc*)pl[1].sp : NULL, np > 2 ? (const finc*)pl[2].sp : NULL };
+	int pitch = pl[0].pitch;
+	int subW = pl[0].subW, subH = pl[0].subH;
+
+	int wstart = planeStart(wmin, subW), wend = planeStart(wmax, subW);
+
+	for (int hp = planeStart(VSMAX(hmin, y0), subH); hp < planeStart(VSMIN(hmax, y1), subH); hp++)
+	{
+		int h = hp << subH;	// luma coordinates
+		int hs = h + siny[h - hmin];
+
+		if (hs < hmax && hs > hmin)
+		{
+			const int srow = (hs >> subH) * pitch;
+
+			for (int wp = wstart, w = wstart << subW; wp < wend; wp++, w += 1 << subW)
+			{
+				int ws = w + siny[w - wmin];
+
+				if (ws < wmax && ws > wmin)
+				{
+					for (int p = 0; p < np; p++)
+						dp[p][hp * pitch + wp] = sp[p][srow + (ws >> subW)];
+				}
+			}
+		}
+	}
+}
+
+static void poolBand(void* work, int row0, int row1)
+{
+	const PoolBand* b = (const PoolBand*)work;
+	int nbytes = b->d->vi->format->bytesPerSample;
+	int y0 = b->hmin + row0, y1 = b->hmin + row1;
+	int nfull = lumaSizePlanes(b->pl, b->np);
+	// luma size planes, then subsampled ones at own size. format decides kernel once per band
+	for (int p = 0; p < b->np; p += nfull, nfull = b->np - nfull)
+	{
+		if (nbytes == 1)
+			poolWavePlanes<uint8_t>(b->pl + p, nfull, b->siny, b->hmin, b->hmax, b->wmin, b->wmax, y0, y1);
+		else if (nbytes == 2)
+			poolWavePlanes<uint16_t>(b->pl + p, nfull, b->siny, b->hmin, b->hmax, b->wmin, b->wmax, y0, y1);
+		else
+			poolWavePlanes<float>(b->pl + p, nfull, b->siny, b->hmin, b->hmax, b->wmin, b->wmax, y0, y1);
+	}
+}
+
 //----------------------------------------------------------------------------------------------
 static const VSFrameRef* VS_CC poolGetFrame(int in, int activationReason, void** instanceData,
 					void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi)
@@ -177,7 +228,8 @@ static const VSFrameRef* VS_CC poolGetFrame(int in, int activationReason, void**
 		int maxh = (poolHeight > poolWidth ?
 			poolHeight : poolWidth);
 
-		int * siny = (int*)vs_aligned_malloc(sizeof(int) * maxh, 32);
+		ScratchArena* scratch = scratchBegin();
+		int * siny = scratchAlloc<int>(scratch, sizeof(int) * maxh);
 	
 
 		for (int h = 0; h < maxh; h++)
@@ -197,137 +249,26 @@ static const VSFrameRef* VS_CC poolGetFrame(int in, int activationReason, void**
 		int wmax = xcoord + poolWidth;
 
 		VSFrameRef* dst = vsapi->copyFrame(src, core);		
-		int height = vsapi->getFrameHeight(src, 0);
-		int width = vsapi->getFrameWidth(src, 0);
 		int nbytes = fi->bytesPerSample;
-		int nbits = fi->bitsPerSample;
-		int nb = fi->bitsPerSample;
-		int subH[] = { 0,fi->subSamplingH, fi->subSamplingH };
-		int subW[] = { 0,fi->subSamplingW, fi->subSamplingW };
-
-		int andH = ( 1 << subH[1]) - 1;
-		int andW = (1 << subW[1]) - 1;
-		int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;		
-
-		uint8_t* dp[] = { NULL, NULL, NULL, NULL };
-		const uint8_t* sp[] = { NULL, NULL, NULL, NULL };
-		int pitch[] = { 0,0,0 };		
-		
-		for (int p = 0; p < np; p++)
-		{
-			sp[p] = vsapi->getReadPtr(src, p);
-			dp[p] = vsapi->getWritePtr(dst, p);
-			pitch[p] = vsapi->getStride(dst, p) / nbytes;			
-		}
-
-
-		for (int h = hmin; h < hmax; h++)
-		{
-			if (h + siny[h - hmin] < hmax && h + siny[h - hmin] > hmin)
-			{
-				for (int w = wmin; w < wmax; w++)
-				{
-					if (w + siny[w - wmin] < wmax && w + siny[w - wmin] > wmin)
-					{
-						for ( int p = 0; p < np; p ++)
-						{
-							if (fi->sampleType == stInteger && nbytes == 1)
-							{
-								if (p == 0 || (subH[p] == 0 && subW[p] == 0))
-								{
-									*(dp[p] + (h)*pitch[p] + w)
-										= *(sp[p] + (h + siny[h - hmin]) * pitch[p] 
-											+ (w + siny[w - wmin]));
-								}
-
-								else if ((w & andW) == 0 && (h & andH) == 0)
-								{
-									*(dp[p] + (h >> subH[p]) * pitch[p] + (w >> subW[p]))
-										= *(sp[p] + ((h + siny[h - hmin]) >> subH[p]) * pitch[p]
-											+ ((w + siny[w - wmin]) >> subW[p]));
-								}
-							}
-
-							else if (fi->sampleType == stInteger && nbytes == 2)
-							{
-								if (p == 0 || (subH[p] == 0 && subW[p] == 0))
-								{
-									*((uint16_t*)(dp[p]) + (h)*pitch[p] + w)
-										= *((const uint16_t*)(sp[p]) + (h + siny[h - hmin]) * pitch[p]
-											+ (w + siny[w - wmin]));
-								}
-
-								else if ((w & andW) == 0 && (h & andH) == 0)
-								{
-									*((uint16_t*)(dp[p]) + (h >> subH[p]) * pitch[p] + (w >> subW[p]))
-										= *((const uint16_t*)(sp[p]) + ((h + siny[h - hmin]) >> subH[p]) * pitch[p]
-											+ ((w + siny[w - wmin]) >> subW[p]));
-								}
-							}
-
-							else if (fi->sampleType == stFloat && nbytes == 4)
-							{
-								if (p == 0 || (subH[p] == 0 && subW[p] == 0))
-								{
-									*((float*)(dp[p]) + (h)*pitch[p] + w)
-										= *((const float*)(sp[p]) + (h + siny[h - hmin]) * pitch[p]
-											+ (w + siny[w - wmin]));
-								}
-
-								else if ((w & andW) == 0 && (h & andH) == 0)
-								{
-									*((float*)(dp[p]) + (h >> subH[p]) * pitch[p] + (w >> subW[p]))
-										= *((const float*)(sp[p]) + ((h + siny[h - hmin]) >> subH[p]) * pitch[p]
-											+ ((w + siny[w - wmin]) >> subW[p]));
-								}
-							}
-						}
-					}
-				}
-			}
-		}
+		FramePlane pl[3];
+		int np = getFramePlanes(pl, dst, src, vsapi);
+		// wave in bands of pool rows
+		PoolBand band = { pl, np, d, siny, hmin, hmax, wmin, wmax };
+		bandsRun(d->threads, hmax - hmin, poolBand, &band);
 
 		if (d->paint)
 		{
-
-			xcoord = xcoord & 0xfffffffe;
-			ampl = ampl & 0xfffffffc;
-			width = width & 0xfffffffc;
-			ycoord = ycoord & 0xfffffffe;
-			height = height & 0xfffffffc;
-
-			// paint likely affected image with color. plain drudgery.
-			for (int h = hmin; h < hmin + ampl / 2; h++)
-			{
-				for (int w = wmin; w < wmax; w++)
-				{
-					poolPaintCode(d, dst, vsapi, w, h);
-					
-				}
-			}
-			for (int h = hmin; h < hmax; h++)
-			{
-				for (int w = wmax - ampl / 2; w < wmax; w++)
-				{
-					poolPaintCode(d, dst, vsapi, w, h);
-					
-				}
-				for (int w = wmin; w < wmin + ampl / 2; w++)
-				{
-					poolPaintCode(d, dst, vsapi, w, h);
-					
-				}
-			}
-			for (int h = hmax - ampl / 2; h < hmax; h++)
-			{
-				for (int w = wmin; w < wmax; w++)
-				{
-					poolPaintCode(d, dst, vsapi, w, h);
-					
-				}
-			}
+			// paint likely affected image with color
+			int border = (ampl & 0xfffffffc) / 2;
+
+			if (nbytes == 1)
+				poolPaintBorders<uint8_t>(pl, np, d, hmin, hmax, wmin, wmax, border);
+			else if (nbytes == 2)
+				poolPaintBorders<uint16_t>(pl, np, d, hmin, hmax, wmin, wmax, border);
+			else
+				poolPaintBorders<float>(pl, np, d, hmin, hmax, wmin, wmax, border);
 		}
-		vs_aligned_free (siny);
+		scratchEnd(scratch);
 		vsapi->freeFrame( src);
 		return (dst);
     }
@@ -339,6 +280,7 @@ static void VS_CC poolFree(void* instanceData, VSCore* core, const VSAPI* vsapi)
     PoolData* d = (PoolData*)instanceData;
     vsapi->freeNode(d->node);	
 	vs_aligned_free(d->sintbl);	
+    bandsDetach();
     free(d);
 }
 
@@ -518,7 +460,7 @@ static void VS_CC poolCreate(const VSMap* in, VSMap* out, void* userData, VSCore
 	if (d.paint)
 	{
 		temp = vsapi->propNumElements(in, "color");
-		if (temp == 0)
+		if (temp <= 0)
 		{
 			d.bgr[0] = 150;
 			d.bgr[1] = 55;
@@ -554,10 +496,21 @@ static void VS_CC poolCreate(const VSMap* in, VSMap* out, void* userData, VSCore
 
 	}
 
+	d.threads = int64ToIntS(vsapi->propGetInt(in, "threads", 0, &err));
+	if (err)
+		d.threads = 1;
+	else if (d.threads < 0 || d.threads > BAND_MAX_THREADS)
+	{
+		vsapi->setError(out, "Pool: threads must be 1 to 64, or 0 for all cores");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.threads = bandThreads(d.threads);
 	
     data = (PoolData*)malloc(sizeof(d));
     *data = d;	
 
+    bandsAttach();
     vsapi->createFilter(in, out, "Pool", poolInit, poolGetFrame, poolFree, fmParallel, 0, data, core);
 }
 
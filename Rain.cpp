@@ -22,6 +22,7 @@ see < http://www.gnu.org/licenses/>.
 ---------------------------------------------------------------------------- - */
 //#include "VapourSynth.h"
 //#include "VSHelper.h"
+#include "simdLevel.h"
 
 typedef struct {
     VSNodeRef* node;
@@ -39,9 +40,21 @@ typedef struct {
 	int span;
 	int nwBox, boxw;
 	int nhBox, boxh;
+	uint32_t seed;	// instance seed for counter based random numbers
 
 } RainData;
 
+// streaks of drops of one box, unwrapped, into a tile of th rows and tw columns, 0 or 255.
+// Tile column pad is box column 0, as slanted streaks go out of box
+void rainTile(uint8_t* tile, int tw, int th, int pad, const RainData* d, uint32_t key, int ndrops, int yspan, float cspan);
+// coverage of frame row y by tiles of all boxes, wrapped around frame as drops are
+void rainRowMask(uint8_t* m, const uint8_t* tile, int tw, int th, int pad, int y, const RainData* d);
+// streak on luma or RGB: lighter of rain and its average with source, where m is set
+template <typename finc>
+void rainStreakRow(finc* dp, const finc* sp, const uint8_t* m, int n, finc rcol);
+// U and V average with rain where m is set
+template <typename finc>
+void rainTintRow(finc* dp, const finc* sp, const uint8_t* m, int n, finc rcol);
 
 static void VS_CC rainInit(VSMap* in, VSMap* out, void** instanceData, 
 		VSNode* node, VSCore* core, const VSAPI* vsapi) {
@@ -72,9 +85,174 @@ static void VS_CC rainInit(VSMap* in, VSMap* out, void** instanceData,
 		temp++;
 	d->boxh = d->vi->height / temp;
 	d->nhBox = temp;
+
+	uint32_t nf = (uint32_t)(d->EndFrame - d->StartFrame);
+	d->seed = (nf * nf * nf) | 1;
 	
 }
 //------------------------------------------------------------------------
+// Drops are same in every box. Their streaks are drawn once into a tile and
+// frame rows are then made by laying the tile over each box, so that work
+// does not grow with number of drops and boxes.
+void rainTile(uint8_t* tile, int tw, int th, int pad, const RainData* d, uint32_t key, int ndrops, int yspan, float cspan)
+{
+	memset(tile, 0, (size_t)tw * th);
+
+	for (int i = 0; i < ndrops; i++)
+	{
+		int droph = randomInRange(key, 0, 2 * i, d->boxh);
+		int dropw = randomInRange(key, 0, 2 * i + 1, d->boxw);
+
+		for (int y = 0; y < yspan; y++)
+			tile[(droph + y) * tw + pad + dropw + (int)(y * cspan)] = 255;
+	}
+}
+
+void rainRowMask(uint8_t* m, const uint8_t* tile, int tw, int th, int pad, int y, const RainData* d)
+{
+	int ht = d->vi->height, wd = d->vi->width;
+	// rows below last box wrap to top of frame
+	int yend = (d->nhBox - 1) * d->boxh + th;
+
+	memset(m, 0, wd);
+
+	for (int yw = y; yw < yend; yw += ht)
+	{
+		int nhb0 = yw - th < 0 ? 0 : (yw - th) / d->boxh + 1;
+		int nhb1 = VSMIN(d->nhBox - 1, yw / d->boxh);
+
+		for (int nhb = nhb0; nhb <= nhb1; nhb++)
+		{
+			const uint8_t* t = tile + (yw - nhb * d->boxh) * tw;
+
+			for (int nwb = 0; nwb < d->nwBox; nwb++)
+			{
+				int x0 = nwb * d->boxw - pad;
+				// columns left of frame are not drawn, right of it wrap
+				int i = x0 < 0 ? -x0 : 0;
+				int iend = VSMIN(tw, wd - x0);
+
+				for (; i < iend; i++)
+					m[x0 + i] |= t[i];
+
+				for (; i < tw; i++)
+					m[(x0 + i) % wd] |= t[i];
+			}
+		}
+	}
+}
+
+#ifdef VFX_X86_SIMD
+// 8 or 16 bit average rounding down, from pavg which rounds up
+VFX_TARGET("avx2") static inline __m256i rainAvgAvx2(__m256i a, __m256i b, bool words)
+{
+	__m256i lsb = _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi16(words ? 1 : 0x0101));
+
+	return words ? _mm256_sub_epi16(_mm256_avg_epu16(a, b), lsb) : _mm256_sub_epi8(_mm256_avg_epu8(a, b), lsb);
+}
+
+// mask of 32 / sizeof(finc) samples from their mask bytes
+template <typename finc>
+VFX_TARGET("avx2") static inline __m256i rainMaskAvx2(const uint8_t* m)
+{
+	if (sizeof(finc) == 1)
+		return _mm256_loadu_si256((const __m256i*)m);
+	if (sizeof(finc) == 2)
+		return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)m));
+	return _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)m));
+}
+
+// returns samples done
+template <typename finc>
+VFX_TARGET("avx2") int rainBlendAvx2(finc* dp, const finc* sp, const uint8_t* m, int n, finc rcol, bool streak)
+{
+	const int step = 32 / sizeof(finc);
+	int k = 0;
+
+	for (; k + step <= n; k += step)
+	{
+		__m256i mk = rainMaskAvx2<finc>(m + k);
+		__m256i s = _mm256_loadu_si256((const __m256i*)(sp + k)), v;
+
+		if (sizeof(finc) == 4)
+		{
+			__m256 sf = _mm256_castsi256_ps(s), r = _mm256_set1_ps((float)rcol);
+			__m256 a = _mm256_mul_ps(_mm256_add_ps(sf, r), _mm256_set1_ps(0.5f));
+			v = _mm256_castps_si256(streak ? _mm256_max_ps(a, r) : a);
+		}
+		else
+		{
+			__m256i r = sizeof(finc) == 1 ? _mm256_set1_epi8((char)rcol) : _mm256_set1_epi16((short)rcol);
+			__m256i a = rainAvgAvx2(s, r, sizeof(finc) == 2);
+			// source lighter than rain gives average, else rain
+			v = !streak ? a : sizeof(finc) == 1 ? _mm256_max_epu8(a, r) : _mm256_max_epu16(a, r);
+		}
+		_mm256_storeu_si256((__m256i*)(dp + k), _mm256_blendv_epi8(s, v, mk));
+	}
+	return k;
+}
+#endif
+
+template <typename finc>
+void rainStreakRow(finc* dp, const finc* sp, const uint8_t* m, int n, finc rcol)
+{
+	int k = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_AVX2)
+		k = rainBlendAvx2(dp, sp, m, n, rcol, true);
+#endif
+	for (; k < n; k++)
+		dp[k] = !m[k] ? sp[k] : sp[k] > rcol ? (finc)((sp[k] + rcol) / 2) : rcol;
+}
+
+template <typename finc>
+void rainTintRow(finc* dp, const finc* sp, const uint8_t* m, int n, finc rcol)
+{
+	int k = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_AVX2)
+		k = rainBlendAvx2(dp, sp, m, n, rcol, false);
+#endif
+	for (; k < n; k++)
+		dp[k] = !m[k] ? sp[k] : (finc)((sp[k] + rcol) / 2);
+}
+
+// all planes of frame in one pass from source. finc is fixed at compile time so
+// that inner loops have no format checks
+template <typename finc>
+void rainFrame(const FramePlane* pl, int np, bool isRGB, const finc* rcol, const uint8_t* tile,
+	int tw, int th, int pad, const RainData* d, ScratchArena* scratch)
+{
+	int wd = pl[0].width;
+	uint8_t* m = scratchAlloc<uint8_t>(scratch, wd);
+	uint8_t* cm = scratchAlloc<uint8_t>(scratch, wd);
+	int npfull = isRGB ? np : 1;	// planes at full resolution
+
+	for (int y = 0; y < pl[0].height; y++)
+	{
+		rainRowMask(m, tile, tw, th, pad, y, d);
+
+		for (int p = 0; p < npfull; p++)
+			rainStreakRow((finc*)pl[p].dp + y * pl[p].pitch, (const finc*)pl[p].sp + y * pl[p].pitch, m, wd, rcol[p]);
+
+		if (npfull == np)
+			continue;
+		int subW = pl[1].subW, subH = pl[1].subH;
+
+		if ((y & ((1 << subH) - 1)) != 0)
+			continue;
+		// chroma sample is tinted by luma on it and by the one left of it
+		cm[0] = m[0];
+		for (int c = 1; c < pl[1].width; c++)
+			cm[c] = m[c << subW] | m[(c << subW) - 1];
+
+		for (int p = 1; p < np; p++)
+		{
+			int off = (y >> subH) * pl[p].pitch;
+			rainTintRow((finc*)pl[p].dp + off, (const finc*)pl[p].sp + off, cm, pl[p].width, rcol[p]);
+		}
+	}
+}
 
 //----------------------------------------------------------------------------------------------
 static const VSFrameRef* VS_CC rainGetFrame(int in, int activationReason, void** instanceData,
@@ -129,7 +307,7 @@ static const VSFrameRef* VS_CC rainGetFrame(int in, int activationReason, void**
 
 		}
 		
-		srand(((n + 101) * (n + 203) * (n + 307)) % (1 << 15));
+		uint32_t key = randomKey(d->seed, n);
 		
 		int yspan =  d->span;	// length of rain streak along Y
 		int xspan = (int)(yspan * cspan);// length of rain streak along X
@@ -171,176 +349,47 @@ static const VSFrameRef* VS_CC rainGetFrame(int in, int activationReason, void**
 					ndrops = heavy; 
 		}
 
-		VSFrameRef* dst = vsapi->copyFrame(src, core);		
-		int height = vsapi->getFrameHeight(src, 0);
-		int width = vsapi->getFrameWidth(src, 0);
+		// every sample is written from source
+		VSFrameRef* dst = vsapi->newVideoFrame(fi, wd, ht, src, core);
 		int nbytes = fi->bytesPerSample;
 		int nbits = fi->bitsPerSample;
-		int nb = fi->bitsPerSample;
-		int subH[] = { 0,fi->subSamplingH, fi->subSamplingH };
-		int subW[] = { 0,fi->subSamplingW, fi->subSamplingW };
-
-		int andH = ( 1 << subH[1]) - 1;
-		int andW = (1 << subW[1]) - 1;
-		int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;		
+		bool isRGB = fi->colorFamily == cmRGB;
+		FramePlane pl[3];
+		int np = getFramePlanes(pl, dst, src, vsapi);
+
+		// now create rain in a tile of one box
+		int pad = absxspan;
+		int tw = d->boxw + 2 * pad, th = d->boxh + yspan - 1;
+		ScratchArena* scratch = scratchBegin();
+		uint8_t* tile = scratchAlloc<uint8_t>(scratch, (size_t)tw * th);
+
+		rainTile(tile, tw, th, pad, d, key, ndrops, yspan, cspan);
+		// format decides kernel once per frame
+		if (nbytes == 1)
+		{
+			uint8_t rcol[] = { d->col[0], d->col[1], d->col[2] };
 
-		uint8_t* dp[] = { NULL, NULL, NULL, NULL };
-		const uint8_t* sp[] = { NULL, NULL, NULL, NULL };
-		int pitch[] = { 0,0,0 };		
-		
-		for (int p = 0; p < np; p++)
+			rainFrame(pl, np, isRGB, rcol, tile, tw, th, pad, d, scratch);
+		}
+		else if (nbytes == 2)
 		{
-			sp[p] = vsapi->getReadPtr(src, p);
-			dp[p] = vsapi->getWritePtr(dst, p);
-			pitch[p] = vsapi->getStride(dst, p) / nbytes;			
+			uint16_t rcol[3];
+
+			for (int p = 0; p < 3; p++)
+				rcol[p] = (uint16_t)((int)d->col[p] << (nbits - 8));
+
+			rainFrame(pl, np, isRGB, rcol, tile, tw, th, pad, d, scratch);
 		}
-						// now create rain
-		
-		for (int i = 0; i < ndrops; i++)
+		else
 		{
-			int droph = rand() % (d->boxh );
-			int dropw = rand() % (d->boxw);
+			float rcol[3];
 
-			for (int nhb = 0; nhb < d->nhBox; nhb++)
-			{
-				int hoffset = nhb * d->boxh + droph;
-
-				for (int nwb = 0; nwb < d->nwBox; nwb++)
-				{
-					int woffset = nwb * d->boxw + dropw;
-
-					for (int y = 0; y < yspan; y++)
-					{
-						int x = (int)(y * cspan); //  wspan[y];
-						int cy = (hoffset + y) % ht;
-						int cx = (woffset + x) % wd;
-						if (cx < 0) continue;
-
-						for (int p = 0; p < np; p++)
-						{
-							if (fi->sampleType == stInteger && nbytes == 1)
-							{
-								if (p == 0 || fi->colorFamily == cmRGB)
-								{
-									uint8_t lcol = *(sp[p] + (cy)*pitch[p] + (cx));
-									*(dp[p] + (cy)*pitch[p] + (cx))
-										= lcol > d->col[p] ? (lcol + d->col[p]) / 2 : d->col[p];
-									// adjacent pixel
-									lcol = *(sp[p] + (cy)*pitch[p] + (cx));
-									*(dp[p] + (cy)*pitch[p] + (cx))
-										= lcol > d->col[p] ? (lcol + d->col[p]) / 2 : d->col[p];
-								}
-
-								else
-								{
-									// yuv U and V planes
-									if (((cx)&andW) == 0 && ((cy)&andH) == 0)
-									{
-										uint8_t lcol = *(sp[p] + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx) >> subW[p]));
-										*(dp[p] + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx) >> subW[p]))
-											= (lcol + d->col[p]) / 2;
-
-									}
-
-									if (((cx + 1) & andW) == 0 && ((cy) & andH) == 0)
-									{
-										uint8_t lcol = *(sp[p] + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx + 1) >> subW[p]));
-										*(dp[p] + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx + 1) >> subW[p]))
-											= (lcol + d->col[p]) / 2;
-									}
-
-								}
-							}
-
-							else if (fi->sampleType == stInteger && nbytes == 2)
-							{
-								if (p == 0 || fi->colorFamily == cmRGB)
-								{
-									uint16_t lcol = *((uint16_t*)(sp[p]) + (cy)*pitch[p] + (cx));
-									uint16_t rcol = (uint16_t)((int)d->col[p] << (nbits - 8));
-									*( (uint16_t*)(dp[p]) + (cy)*pitch[p] + (cx))
-										= lcol > rcol ? (lcol + rcol) / 2 : rcol;
-									// adjacent pixel
-									lcol = *((uint16_t*)(sp[p]) + (cy)*pitch[p] + (cx));
-									*((uint16_t*)(dp[p]) + (cy)*pitch[p] + (cx))
-										= lcol > rcol ? (lcol + rcol) / 2 : rcol;
-								}
-
-								else
-								{
-									// yuv U and V planes
-									if (((cx) & andW) == 0 && ((cy) & andH) == 0)
-									{
-										uint16_t lcol = *((uint16_t*)(sp[p]) + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx) >> subW[p]));
-										uint16_t rcol = (uint16_t)((int)d->col[p] << (nbits - 8));
-										*((uint16_t*)(dp[p]) + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx) >> subW[p]))
-											= (lcol + rcol) / 2;
-
-									}
-
-									if (((cx + 1) & andW) == 0 && ((cy)&andH) == 0)
-									{
-										uint16_t lcol = *((uint16_t*)(sp[p]) + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx + 1) >> subW[p]));
-										uint16_t rcol = (uint16_t)((int)d->col[p] << (nbits - 8));
-										*((uint16_t*)(dp[p]) + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx + 1) >> subW[p]))
-											= (lcol + rcol) / 2;
-									}
-
-								}
-							}
-
-							else if (fi->sampleType == stFloat && nbytes == 4)
-							{
-								if (p == 0 || fi->colorFamily == cmRGB)
-								{
-									float lcol = *((float*)(sp[p]) + (cy)*pitch[p] + (cx));
-									float rcol = (float)(d->col[p]/ 256.0f);
-									*((float*)(dp[p]) + (cy)*pitch[p] + (cx))
-										= lcol > rcol ? (lcol + rcol) / 2 : rcol;
-									// adjacent pixel
-									lcol = *((float*)(sp[p]) + (cy)*pitch[p] + (cx));
-									*((float*)(dp[p]) + (cy)*pitch[p] + (cx))
-										= lcol > rcol ? (lcol + rcol) / 2 : rcol;
-								}
-
-								else
-								{
-									// yuv U and V planes
-									if (((cx)&andW) == 0 && ((cy)&andH) == 0)
-									{
-										float lcol = *((float*)(sp[p]) + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx) >> subW[p]));
-										float rcol = (float)(d->col[p]-128) / 256.0f;
-										*((float*)(dp[p]) + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx) >> subW[p]))
-											= (lcol + rcol) / 2;
-
-									}
-
-									if (((cx + 1) & andW) == 0 && ((cy)&andH) == 0)
-									{
-										float lcol = *((float*)(sp[p]) + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx + 1) >> subW[p]));
-										float rcol = (float)(d->col[p] - 128) / 256.0f;
-										*((float*)(dp[p]) + ((cy) >> subH[p]) * pitch[p]
-											+ ((cx + 1) >> subW[p]))
-											= (lcol + rcol) / 2;
-									}
-								}
-							}
-						}
-					}
-				}
-			}
+			for (int p = 0; p < 3; p++)
+				rcol[p] = isRGB || p == 0 ? d->col[p] / 256.0f : (float)(d->col[p] - 128) / 256.0f;
+
+			rainFrame(pl, np, isRGB, rcol, tile, tw, th, pad, d, scratch);
 		}
+		scratchEnd(scratch);
 		
 		//vs_aligned_free (wspan);
 		vsapi->freeFrame( src);
@@ -41,16 +41,23 @@ typedef struct {
 	int exright;// final right x cutoff
 
 	uint8_t * col;
+	uint32_t seed;	// instance seed for counter based random numbers
 
 } RainbowData;
 
+#define RAINBOW_BANDS 72	// color bands of rainbow, each one pixel wide
 
+template <typename finc>
+void rainbowKernel(const FramePlane* pl, int np, const VSFormat* fi, const RainbowData* d,
+	uint32_t key, int initx, int inity, int radius, int sx, int sy, int ex, int ey);
 
 static void VS_CC rainbowInit(VSMap* in, VSMap* out, void** instanceData, 
 		VSNode* node, VSCore* core, const VSAPI* vsapi) {
     RainbowData* d = (RainbowData*)*instanceData;
     vsapi->setVideoInfo(d->vi, 1, node);
 	d->col = (uint8_t*)vs_aligned_malloc( 3 * 80, 8);
+	uint32_t nf = (uint32_t)(d->EndFrame - d->StartFrame);
+	d->seed = (nf * nf * nf) | 1;
 	
 
 	// rainbow colors gradients
@@ -109,7 +116,7 @@ static void VS_CC rainbowInit(VSMap* in, VSMap* out, void** instanceData,
 	{
 		unsigned char yuv[] = { 0,0,0 };
 		
-		for ( int i = 0 ; i < 82; i ++)
+		for ( int i = 0 ; i < 76; i ++)
 		{
 			BGR8YUV(yuv, d->col + 3 * i);
 
@@ -125,7 +132,7 @@ static void VS_CC rainbowInit(VSMap* in, VSMap* out, void** instanceData,
 		// this part is nonsense. May be my colorconverter is wrong. This corrects it
 		// it looks the internal order is RGB and not BGR as in documentation?
 		unsigned char BGR[] = { 0,0,0 };
-		for (int i = 0; i < 82; i++)
+		for (int i = 0; i < 76; i++)
 		{
 			for (int k = 0; k < 3; k++)
 			{
@@ -141,6 +148,80 @@ static void VS_CC rainbowInit(VSMap* in, VSMap* out, void** instanceData,
 
 //------------------------------------------------------------------------
 
+//----------------------------------------------------------------------------------------------
+// draws rainbow in one pass over its ring. Band of a sample is found from its distance
+// to center. Planes of luma size and then subsampled ones are processed at their own
+// resolution, with distance, haze and blur at the luma position of a sample
+template <typename finc>
+void rainbowKernel(const FramePlane* pl, int np, const VSFormat* fi, const RainbowData* d,
+	uint32_t key, int initx, int inity, int radius, int sx, int sy, int ex, int ey)
+{
+	int nbits = fi->bitsPerSample;
+	finc col[3][76];	// rainbow colors in sample type
+
+	for (int p = 0; p < np; p++)
+	{
+		for (int k = 0; k < 76; k++)
+		{
+			int c = d->col[3 * k + p];
+
+			if (sizeof(finc) == 4)
+				col[p][k] = (finc)(p == 0 || fi->colorFamily == cmRGB ? c / 255.0f : (c - 128.0f) / 256.0f);
+			else
+				col[p][k] = (finc)(c << (nbits - 8));
+		}
+	}
+	int rsq = radius * radius;
+	// haziness of edge bands, added to squared distance
+	int haze = radius / 4;
+	// samples this close to center stay clear even when hazy
+	int clearsq = (radius - RAINBOW_BANDS) * (radius - RAINBOW_BANDS) - haze;
+	int nfull = lumaSizePlanes(pl, np);
+
+	for (int p0 = 0; p0 < np; p0 += nfull, nfull = np - nfull)
+	{
+		int subW = pl[p0].subW, subH = pl[p0].subH;
+		int pitch = pl[p0].pitch;
+		int wstart = planeStart(sx, subW), wend = planeStart(ex, subW);
+		finc* dp[] = { (finc*)pl[p0].dp, p0 + 1 < np ? (finc*)pl[p0 + 1].dp : NULL,
+			p0 + 2 < np ? (finc*)pl[p0 + 2].dp : NULL };
+
+		for (int hp = planeStart(sy, subH); hp < planeStart(ey, subH); hp++)
+		{
+			int h = hp << subH;	// luma coordinates
+			int hsq = (h - inity) * (h - inity);
+			int x0[2], x1[2];
+			int nspans = ringRowSpans(x0, x1, initx, rsq, clearsq, h - inity, subW, wstart, wend);
+
+			for (int k = 0; k < nspans; k++)
+			{
+				for (int wp = x0[k], w = x0[k] << subW; wp < x1[k]; wp++, w += 1 << subW)
+				{
+					int dsq = hsq + (w - initx) * (w - initx);
+					int dist = isqrt(dsq);
+					// band i covers distances radius - i - 1 < dist <= radius - i
+					int i = radius - (dist * dist < dsq ? dist + 1 : dist);
+
+					if (i < 2 || i > RAINBOW_BANDS - 2)
+					{
+						// Add a little haziness in the border bands
+						dsq += 1 + randomInRange(key, 2 * h, w, haze);
+						dist = isqrt(dsq);
+						i = radius - (dist * dist < dsq ? dist + 1 : dist);
+					}
+					if (i < 0 || i >= RAINBOW_BANDS)
+						continue;
+					// to make rainbow colors appear lightly blurred
+					int blur = randomInRange(key, 2 * h + 1, w, 3);
+
+					for (int p = 0; p < nfull; p++)
+						dp[p][hp * pitch + wp] = col[p0 + p][i + blur];
+				}
+			}
+		}
+	}
+}
+
 //----------------------------------------------------------------------------------------------
 static const VSFrameRef* VS_CC rainbowGetFrame(int in, int activationReason, void** instanceData,
 					void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi)
@@ -181,104 +262,19 @@ static const VSFrameRef* VS_CC rainbowGetFrame(int in, int activationReason, voi
 		
 
 		VSFrameRef* dst = vsapi->copyFrame(src, core);		
-		int height = vsapi->getFrameHeight(src, 0);
-		int width = vsapi->getFrameWidth(src, 0);
 		int nbytes = fi->bytesPerSample;
-		int nbits = fi->bitsPerSample;
-		int nb = fi->bitsPerSample;
-		int subH[] = { 0,fi->subSamplingH, fi->subSamplingH };
-		int subW[] = { 0,fi->subSamplingW, fi->subSamplingW };
-
-		int andH = ( 1 << subH[1]) - 1;
-		int andW = (1 << subW[1]) - 1;
-		int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;		
-
-		uint8_t* dp[] = { NULL, NULL, NULL, NULL };
-		const uint8_t* sp[] = { NULL, NULL, NULL, NULL };
-		int pitch[] = { 0,0,0 };		
-		
-		for (int p = 0; p < np; p++)
-		{
-			sp[p] = vsapi->getReadPtr(src, p);
-			dp[p] = vsapi->getWritePtr(dst, p);
-			pitch[p] = vsapi->getStride(dst, p) / nbytes;			
-		}
+		FramePlane pl[3];
+		int np = getFramePlanes(pl, dst, src, vsapi);
 						// now create rainbow
-		int radsq = radius * radius;
-		int thick = 1;
-		int radtsq = (radius - thick) * (radius - thick);
-
-		for (int i = 0; i < 72; i+= thick)
-		{
-			int rsq = (radius - i) * (radius - i);
-			int rtsq = (radius - i - thick) * (radius - i - thick);			
-
-			for (int h = sy; h < ey; h++)
-			{				
-				int hsq = (h  - inity) * (h  - inity);
-
-				for (int w = sx; w < ex; w++)
-				{
-					int pblur = 0;
-					// Add a little haziness in the border pixels
-					if (i < 2 || i > 70)
-					{
-						pblur = (rand() % (radius / 4)) - radius / 4;
-					}
-					if (hsq + (w  - initx) * (w  - initx)  <= rsq + pblur
-						&& hsq + (w  - initx) * (w  - initx)  >= rtsq + pblur )
-					{
-						int blur =  (rand() % 3); // to make rainbow colors appear lightly blurred
-
-						for (int p = 0; p < np; p++)
-						{
-							if (fi->sampleType == stInteger && nbytes == 1)
-							{
-								if ( p == 0 || (subH[p] == 0 && subW[p] == 0 ))
-
-									*(dp[p] + (h  * pitch[p]) + (w))
-									= d->col[3 * (i + blur) + p ];
-
-								else if ( ( h & andH) == 0 && (w & andW) == 0)
-
-									*(dp[p] + (h >> subH[p]) * pitch[p] + (w >> subW[p]))
-										= d->col[3 * (i + blur) + p];
-
-							}
-							else if (fi->sampleType == stInteger &&  nbytes == 2)
-							{
-								if (p == 0 || (subH[p] == 0 && subW[p] == 0))
-
-									*((uint16_t*)(dp[p]) + (h * pitch[p]) + (w))
-										= d->col[3 * (i + blur) + p] << ( nbits - 8);
-
-								else if ((h & andH) == 0 && (w & andW) == 0)
-
-										*((uint16_t*)(dp[p]) + (h >> subH[p]) * pitch[p] + (w >> subW[p]))
-										= d->col[3 * (i + blur) + p] << (nbits - 8);
-							}
-
-							else if (fi->sampleType == stFloat && nbytes == 4)
-							{
-								if (p == 0 || fi->colorFamily == cmRGB)
-
-									*((float *)(dp[p]) + (h * pitch[p]) + (w))
-										= d->col[3 * (i + blur) + p] / 255.0f;
-
-								else if ((h & andH) == 0 && (w & andW) == 0)
-
-										*((float*)(dp[p]) + (h >> subH[p]) * pitch[p] + (w >> subW[p]))
-										= (d->col[3 * (i + blur) + p] - 128.0f) / 256.0f;
-
-							}
-						}
-					}
-				}
-			}
-						
-		}
+		uint32_t key = randomKey(d->seed, n);
+
+		if (nbytes == 1)
+			rainbowKernel<uint8_t>(pl, np, fi, d, key, initx, inity, radius, sx, sy, ex, ey);
+		else if (nbytes == 2)
+			rainbowKernel<uint16_t>(pl, np, fi, d, key, initx, inity, radius, sx, sy, ex, ey);
+		else
+			rainbowKernel<float>(pl, np, fi, d, key, initx, inity, radius, sx, sy, ex, ey);
 		
-		//vs_aligned_free (wspan);
 		vsapi->freeFrame( src);
 		return (dst);
     }
@@ -289,6 +285,7 @@ static const VSFrameRef* VS_CC rainbowGetFrame(int in, int activationReason, voi
 static void VS_CC rainbowFree(void* instanceData, VSCore* core, const VSAPI* vsapi) {
     RainbowData* d = (RainbowData*)instanceData;
     vsapi->freeNode(d->node);	
+	vs_aligned_free(d->col);
 		
     free(d);
 }
@@ -67,11 +67,39 @@ typedef struct {
 	int quantile;	// Accuracy of fraction to which values are interpolated
 	int span;		// interpolation function 1d span or taps
 	unsigned char col[16];		// color components for fill
-	int* xyAndQ;
+	WarpMap* map;	// source of mirror samples of a quadrant. qx is bestOfNine index if q is 1
+	int* borderEnd;	// border of row h is from end of its map row to borderEnd[h]
+	WarpMap* cmap;	// final writer of each chroma sample of subsampled formats. else NULL
+	int threads;	// threads doing bands of rows of a frame
 	double rNorm;
-	int nEntries;
 } RearViewMirrorData;
 
+// mirror of a frame, for bands of its rows. col, min and max are of sample type
+typedef struct {
+	VSFrameRef* dst;
+	const VSFrameRef* src;
+	const RearViewMirrorData* d;
+	const void* col;
+	const void* min;
+	const void* max;
+	const VSAPI* vsapi;
+} RearViewMirrorBand;
+
+// qx of a chroma entry painted as border
+#define RVM_BORDER 254
+
+// chroma quadrant as left by writing chroma at each luma sample in row order.
+// Entries are source chroma offsets, or WARP_SKIP if not written, or RVM_BORDER
+WarpMap* rearviewmirrorChromaMap(const RearViewMirrorData* d, int subW, int subH);
+// all planes of mirror in one pass over map, row by row. col, min and max are per plane.
+// Rows h0 to h1 - 1 of quadrant, and chroma rows of them
+template <typename finc>
+void rearviewmirrorKernel(VSFrameRef* dst, const VSFrameRef* src, const RearViewMirrorData* d,
+	const finc* col, const finc* min, const finc* max, const VSAPI* vsapi, int h0, int h1);
+// kernel on quadrant rows row0 to row1 - 1
+template <typename finc>
+void rearviewmirrorBand(void* work, int row0, int row1);
+
 
 /*--------------------------------------------------
  * The following is the implementation
@@ -120,24 +148,12 @@ static void VS_CC rearviewmirrorInit(VSMap* in, VSMap* out, void** instanceData,
 	int nbytes = fi->bytesPerSample;
 	int nbits = fi->bitsPerSample;
 	d->quantile = 64;
-	d->nEntries = d->test ? 2 : d->q == 1 ? 3 : 4;
 	d->fborder = d->frad + d->borderWidth;
-	//double rNorm = (double)d->iRadius; // dummy value. not used
-	d->xyAndQ = (int*)vs_aligned_malloc<int>(sizeof(int) * d->fborder * d->fborder * d->nEntries, 32);
-
-	int* xyQ = d->xyAndQ;
-	float xy[2];
-	int x, y, qx, qy;
-
 	d->iCoeff = NULL;
 
 	if (!d->test)
 		d->iCoeff = setInterpolationScheme(d->q, d->quantile, &d->span);
-	int count = 0;
-	int hoff, woff;
-	bool insideFrame = false;
-	bool onMirror = false;
-	bool inBorder = false;
+
 	float sMJsq = (float)sMajor * sMajor;
 	float sMJBsq = (float)(sMajor + d->borderWidth) * (sMajor + d->borderWidth);
 	float sMNsq = (float)sMinor * sMinor;
@@ -147,97 +163,81 @@ static void VS_CC rearviewmirrorInit(VSMap* in, VSMap* out, void** instanceData,
 
 	int mwdB = sMajor + d->borderWidth;
 	int mhtB = sMinor + d->borderWidth;
+	// each row of quadrant is mirror samples from w = 0, then border, then outside.
+	// Mirror samples are in the map and border is a span after them
+	int* rowLength = (int*)vs_aligned_malloc<int>(sizeof(int) * d->fborder, 32);
+	d->borderEnd = (int*)vs_aligned_malloc<int>(sizeof(int) * d->fborder, 32);
 
 	for (int h = 0; h < d->fborder; h++)
 	{
-		hoff = h * d->fborder * d->nEntries;
+		int w = 0;
 
-		for (int w = 0; w < d->fborder; w++)
+		if (d->oval)
 		{
-			onMirror = false;
-			inBorder = false;
-			insideFrame = false;
+			while (w < d->fborder && (w * w) * sMNsq + (h * h) * sMJsq <= absq)
+				w++;
+			rowLength[h] = w;
 
-			woff = d->nEntries * w;
-			if (d->oval)
-			{
+			while (w < d->fborder && (w * w) * sMNBsq + (h * h) * sMJBsq <= abbsq)
+				w++;
+		}
+		else
+		{
+			// rectangle
+			if (h <= d->mht / 2)
+				w = VSMIN(d->mwd / 2 + 1, d->fborder);
+			rowLength[h] = w;
 
-				if ((w * w) * sMNsq + (h * h) * sMJsq <= absq)
-				{
-					onMirror = true;
-					inBorder = false;
-				}
+			if (h <= mhtB)
+				w = VSMAX(w, VSMIN(mwdB + 1, d->fborder));
+		}
+		d->borderEnd[h] = w;
+	}
+	d->map = warpMapCreate(d->fborder, rowLength);
+	vs_aligned_free(rowLength);
 
-				else if ((w * w) * sMNBsq + (h * h) * sMJBsq <= abbsq)
-				{
-					inBorder = true;
-					onMirror = false;
-					insideFrame = false;
-				}
+	float xy[2];
 
-			}
-			else
-			{
-				// rectangle
-				if (w <= d->mwd / 2 && h <= d->mht / 2)
-				{
-					onMirror = true;
-				}
-				else if (w <= mwdB && h <= mhtB)
-					inBorder = true;
+	for (int h = 0; h < d->fborder; h++)
+	{
+		WarpEntry* e = warpMapRow(d->map, h);
 
-			}
+		for (int w = 0; w < d->map->rowStart[h + 1] - d->map->rowStart[h]; w++)
+		{
+			getSourceXY(xy, (float)w, (float)h, d->method + 5, focal,focal, d->cvx);
 
-			if (onMirror)
+			e[w].qx = 0;
+			e[w].qy = 0;
+			// source is outside frame, or not a number. Tested before int conversion
+			if (!(xy[0] >= 0 && xy[0] < swidth / 2 && xy[1] >= 0 && xy[1] < sheight / 2))
 			{
-				insideFrame = false;
-				getSourceXY(xy, (float)w, (float)h, d->method + 5, focal,focal, d->cvx);
-
-				x = (int)floor(xy[0]);
-				y = (int)floor(xy[1]);
-
-				if (x < swidth / 2 && y < sheight / 2 && x >= 0 && y >= 0)
-				{
-					insideFrame = true;
-
-					if (insideFrame)
-					{
-						// calculate nearest quantile of the fraction
-						qx = (int)((xy[0] - x) * d->quantile);
-						qy = (int)((xy[1] - y) * d->quantile);
+				e[w].dx = 0;
+				e[w].dy = 0;
+				e[w].qx = WARP_SKIP;
+				continue;
+			}
+			int x = (int)floor(xy[0]);
+			int y = (int)floor(xy[1]);
 
-						d->xyAndQ[hoff + woff] = x;
-						d->xyAndQ[hoff + woff + 1] = y;
+			e[w].dx = (int16_t)(x - w);
+			e[w].dy = (int16_t)(y - h);
 
-						if (!d->test)
-						{
-							if (d->q > 1)
-							{
-								d->xyAndQ[hoff + woff + 2] = qx;
-								d->xyAndQ[hoff + woff + 3] = qy;
-							}
-							else
-							{
-								// manipal hybrid near point
-								d->xyAndQ[hoff + woff + 2] = bestOfNineIndex(qx, qy, d->quantile);
-
-							}
-						}
+			if (!d->test)
+			{
+				// calculate nearest quantile of the fraction
+				int qx = (int)((xy[0] - x) * d->quantile);
+				int qy = (int)((xy[1] - y) * d->quantile);
 
-					}
+				if (d->q > 1)
+				{
+					e[w].qx = (uint8_t)qx;
+					e[w].qy = (uint8_t)qy;
+				}
+				else
+				{
+					// manipal hybrid near point
+					e[w].qx = (uint8_t)bestOfNineIndex(qx, qy, d->quantile);
 				}
-			}
-
-			else if (inBorder)
-			{				
-				d->xyAndQ[hoff + woff] = -1;
-				d->xyAndQ[hoff + woff + 1] = -1;
-				count++;
-			}
-			else if (!insideFrame )
-			{
-				d->xyAndQ[hoff + woff] = -swidth - sheight;
-				d->xyAndQ[hoff + woff + 1] = -swidth - sheight;
 			}
 		}
 	}
@@ -254,7 +254,178 @@ static void VS_CC rearviewmirrorInit(VSMap* in, VSMap* out, void** instanceData,
 	}
 
 	convertBGRforInputFormat(d->col, bgr, fi);	
-	
+	d->cmap = NULL;
+
+	if (!d->test && fi->colorFamily == cmYUV && (fi->subSamplingW > 0 || fi->subSamplingH > 0))
+		d->cmap = rearviewmirrorChromaMap(d, fi->subSamplingW, fi->subSamplingH);
+}
+
+WarpMap* rearviewmirrorChromaMap(const RearViewMirrorData* d, int subW, int subH)
+{
+	int cfw = ((d->fborder - 1) >> subW) + 1;
+	int cfh = ((d->fborder - 1) >> subH) + 1;
+	// source chroma coordinates of final write. -1 not written, -2 border
+	int* csx = (int*)vs_aligned_malloc<int>(sizeof(int) * cfw * cfh, 32);
+	int* csy = (int*)vs_aligned_malloc<int>(sizeof(int) * cfw * cfh, 32);
+
+	for (int i = 0; i < cfw * cfh; i++)
+		csx[i] = -1;
+
+	for (int h = 0; h < d->fborder; h++)
+	{
+		const WarpEntry* e = warpMapRow(d->map, h);
+		int nmirror = d->map->rowStart[h + 1] - d->map->rowStart[h];
+		int* rsx = csx + (h >> subH) * cfw;
+		int* rsy = csy + (h >> subH) * cfw;
+
+		for (int w = 0; w < nmirror; w++)
+		{
+			if (e[w].qx == WARP_SKIP)
+				continue;
+			rsx[w >> subW] = (w + e[w].dx) >> subW;
+			rsy[w >> subW] = (h + e[w].dy) >> subH;
+		}
+		for (int w = nmirror; w < d->borderEnd[h]; w++)
+			rsx[w >> subW] = -2;
+	}
+	int* rowLength = (int*)vs_aligned_malloc<int>(sizeof(int) * cfh, 32);
+
+	for (int ch = 0; ch < cfh; ch++)
+	{
+		rowLength[ch] = cfw;
+		while (rowLength[ch] > 0 && csx[ch * cfw + rowLength[ch] - 1] == -1)
+			rowLength[ch]--;
+	}
+	WarpMap* cmap = warpMapCreate(cfh, rowLength);
+
+	for (int ch = 0; ch < cfh; ch++)
+	{
+		WarpEntry* e = warpMapRow(cmap, ch);
+
+		for (int cw = 0; cw < rowLength[ch]; cw++)
+		{
+			int sx = csx[ch * cfw + cw];
+
+			e[cw].dx = (int16_t)(sx < 0 ? 0 : sx - cw);
+			e[cw].dy = (int16_t)(sx < 0 ? 0 : csy[ch * cfw + cw] - ch);
+			e[cw].qx = (uint8_t)(sx == -1 ? WARP_SKIP : sx == -2 ? RVM_BORDER : 0);
+			e[cw].qy = 0;
+		}
+	}
+	vs_aligned_free(rowLength);
+	vs_aligned_free(csx);
+	vs_aligned_free(csy);
+	return cmap;
+}
+
+template <typename finc>
+void rearviewmirrorKernel(VSFrameRef* dst, const VSFrameRef* src, const RearViewMirrorData* d,
+	const finc* col, const finc* min, const finc* max, const VSAPI* vsapi, int h0, int h1)
+{
+	const VSFormat* fi = d->vi->format;
+	int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;
+	int swidth = d->vi->width;
+	int sheight = d->vi->height;
+	// planes of luma size, then subsampled chroma if any
+	int nfull = d->cmap != NULL ? 1 : np;
+	finc* dp[3];
+	const finc* sp[3];
+	int dpitch[3], spitch[3];
+
+	for (int p = 0; p < np; p++)
+	{
+		int subH = p < nfull ? 0 : fi->subSamplingH;
+		int subW = p < nfull ? 0 : fi->subSamplingW;
+
+		dpitch[p] = vsapi->getStride(dst, p) / fi->bytesPerSample;
+		spitch[p] = vsapi->getStride(src, p) / fi->bytesPerSample;
+		// output and input pointers at centers
+		dp[p] = (finc*)vsapi->getWritePtr(dst, p) + (d->mcy >> subH) * dpitch[p] + (d->mcx >> subW);
+		sp[p] = (const finc*)vsapi->getReadPtr(src, p) + (sheight >> subH) / 2 * spitch[p] + (swidth >> subW) / 2;
+	}
+	int span2 = d->span / 2;
+	ScratchArena* arena = scratchBegin();
+	// quadrant row buffers of each plane. Rows are gathered, then stored contiguously
+	finc* q[3][4];
+
+	for (int p = 0; p < np; p++)
+		for (int k = 0; k < 4; k++)
+			q[p][k] = scratchAlloc<finc>(arena, sizeof(finc) * d->fborder);
+
+	for (int h = h0; h < h1; h++)
+	{
+		const WarpEntry* e = warpMapRow(d->map, h);
+		int nmirror = d->map->rowStart[h + 1] - d->map->rowStart[h];
+
+		for (int w = 0; w < nmirror; w++)
+		{
+			if (e[w].qx == WARP_SKIP)
+			{
+				// source is out of frame
+				for (int p = 0; p < nfull; p++)
+					keep4FoldSym(q[p], dp[p], dpitch[p], w, h);
+				continue;
+			}
+			int x = w + e[w].dx;
+			int y = h + e[w].dy;
+			//  interpolation does not have sufficient points near frame edge
+			bool nearPoint = (x >= swidth / 2 - span2 - 1 && x < swidth) || (y >= sheight / 2 - span2 - 1 && y < sheight);
+
+			for (int p = 0; p < nfull; p++)
+			{
+				if (nearPoint)
+					gather4FoldSym(q[p], sp[p], spitch[p], w, x, y);
+				else if (d->q == 1)
+					gather9pt4FoldSym(q[p], sp[p], spitch[p], w, h, x, y, e[w].qx);
+				else
+					gatherInterpolated4FoldSym(q[p], sp[p], spitch[p], w, x, y,
+						e[w].qx, e[w].qy, d->span, d->iCoeff, min[p], max[p]);
+			}
+		}
+		for (int p = 0; p < nfull; p++)
+		{
+			// border. paint black
+			fill4FoldSym(q[p], nmirror, d->borderEnd[h], col[p]);
+			store4FoldSymRows(dp[p], dpitch[p], h, q[p], d->borderEnd[h]);
+		}
+	}
+
+	if (d->cmap != NULL)
+	{
+		// subsampled chroma takes near point
+		int ch1 = VSMIN(planeStart(h1, fi->subSamplingH), d->cmap->nrows);
+
+		for (int ch = planeStart(h0, fi->subSamplingH); ch < ch1; ch++)
+		{
+			const WarpEntry* e = warpMapRow(d->cmap, ch);
+			int len = d->cmap->rowStart[ch + 1] - d->cmap->rowStart[ch];
+
+			for (int cw = 0; cw < len; cw++)
+			{
+				for (int p = nfull; p < np; p++)
+				{
+					if (e[cw].qx == WARP_SKIP)
+						keep4FoldSym(q[p], dp[p], dpitch[p], cw, ch);
+					else if (e[cw].qx == RVM_BORDER)
+						fill4FoldSym(q[p], cw, cw + 1, col[p]);
+					else
+						gather4FoldSym(q[p], sp[p], spitch[p], cw, cw + e[cw].dx, ch + e[cw].dy);
+				}
+			}
+			for (int p = nfull; p < np; p++)
+				store4FoldSymRows(dp[p], dpitch[p], ch, q[p], len);
+		}
+	}
+	scratchEnd(arena);
+}
+
+template <typename finc>
+void rearviewmirrorBand(void* work, int row0, int row1)
+{
+	const RearViewMirrorBand* b = (const RearViewMirrorBand*)work;
+
+	rearviewmirrorKernel(b->dst, b->src, b->d, (const finc*)b->col, (const finc*)b->min,
+		(const finc*)b->max, b->vsapi, row0, row1);
 }
 //------------------------------------------------------------------------------------------------
 
@@ -300,16 +471,16 @@ static const VSFrameRef* VS_CC rearviewmirrorGetFrame(int n, int activationReaso
 		int dwidth = vsapi->getFrameWidth(dst, 0);
 		int dheight = vsapi->getFrameHeight(dst, 0);		
 
-		for (int p = 0; p < np; p++)
+		if (d->test)
 		{
-			const uint8_t* sp = vsapi->getReadPtr(src, p);
-			uint8_t* dp = vsapi->getWritePtr(dst, p);
-			int spitch = vsapi->getStride(src, p) / nbytes;
-			int dpitch = vsapi->getStride(dst, p) / nbytes;
-			int subH = p == 0 || fi->colorFamily == cmRGB ? 0 : fi->subSamplingH;
-			int subW = p == 0 || fi->colorFamily == cmRGB ? 0 : fi->subSamplingW;
-			if (d->test)
+			for (int p = 0; p < np; p++)
 			{
+				const uint8_t* sp = vsapi->getReadPtr(src, p);
+				uint8_t* dp = vsapi->getWritePtr(dst, p);
+				int spitch = vsapi->getStride(src, p) / nbytes;
+				int dpitch = vsapi->getStride(dst, p) / nbytes;
+				int subH = p == 0 || fi->colorFamily == cmRGB ? 0 : fi->subSamplingH;
+				int subW = p == 0 || fi->colorFamily == cmRGB ? 0 : fi->subSamplingW;
 				if (fi->colorFamily == cmRGB)
 				{
 					if (nbytes == 1)
@@ -342,16 +513,15 @@ static const VSFrameRef* VS_CC rearviewmirrorGetFrame(int n, int activationReaso
 				// we will put dots
 				for (int h = d->ddensity / 2; h < d->fborder; h += d->ddensity)
 				{
-					int hoff = d->nEntries * h * d->fborder;
+					const WarpEntry* e = warpMapRow(d->map, h);
+					int nmirror = d->map->rowStart[h + 1] - d->map->rowStart[h];
 
-					for (int w = d->ddensity / 2; w < d->fborder; w += d->ddensity)
+					for (int w = d->ddensity / 2; w < nmirror; w += d->ddensity)
 					{
-						int woff = d->nEntries * w;
-
-						int x = d->xyAndQ[hoff + woff];
-						int y = d->xyAndQ[hoff + woff + 1];
+						int x = w + e[w].dx;
+						int y = h + e[w].dy;
 						// ensure points are within frame
-						if (x >= 0)
+						if (e[w].qx != WARP_SKIP)
 						{
 							// white dots are placed
 							if (nbytes == 1)
@@ -363,146 +533,44 @@ static const VSFrameRef* VS_CC rearviewmirrorGetFrame(int n, int activationReaso
 						}
 					}
 				}
-			}	// if test
+			}
+		}
+		else if (nbytes == 1)
+		{
+			uint8_t min[3], max[3];
 
-			else	// not test. normal processing
+			for (int p = 0; p < 3; p++)
 			{
-				// offset to center of output image
-				int oCenter = (d->mcy >> subH) * dpitch + (d->mcx >> subW);// fish image is centered about this origin
-				// offset to center of input image
-				int iCenter = (sheight >> subH) / 2 * spitch + (swidth >> subW) / 2;
-				// during interpolation limiting values for clamping
-				uint8_t min8 = (uint8_t)(fi->colorFamily == cmYUV ? 16 : 0);
-				uint8_t max8 = (uint8_t)(fi->colorFamily == cmYUV ? 235 : 255);
-				uint16_t min16 = (uint16_t)(fi->colorFamily == cmYUV ? 16 << (nbits - 8) : 0);
-				uint16_t max16 = (uint16_t)((fi->colorFamily == cmYUV ? 235 : 255 << (nbits - 8)) << (nbits - 8));
-				float minf = 0, maxf = 1.0f;
-
-				if (p > 0 && fi->colorFamily == cmYUV)
-				{
-					minf = -0.5f;
-					maxf = 0.5f;
-				}
+				min[p] = (uint8_t)(fi->colorFamily == cmYUV ? 16 : 0);
+				max[p] = (uint8_t)(fi->colorFamily == cmYUV ? 235 : 255);
+			}
+			RearViewMirrorBand band = { dst, src, d, d->col, min, max, vsapi };
+			bandsRun(d->threads, d->fborder, rearviewmirrorBand<uint8_t>, &band);
+		}
+		else if (nbytes == 2)
+		{
+			uint16_t min[3], max[3];
 
-				int x, y, qx, qy, span2 = d->span / 2;
-				int offh, offw;
-				int index;
+			for (int p = 0; p < 3; p++)
+			{
+				min[p] = (uint16_t)(fi->colorFamily == cmYUV ? 16 << (nbits - 8) : 0);
+				max[p] = (uint16_t)((fi->colorFamily == cmYUV ? 235 : 255 << (nbits - 8)) << (nbits - 8));
+			}
+			RearViewMirrorBand band = { dst, src, d, d->col, min, max, vsapi };
+			bandsRun(d->threads, d->fborder, rearviewmirrorBand<uint16_t>, &band);
+		}
+		else
+		{
+			float min[] = { 0, 0, 0 }, max[] = { 1.0f, 1.0f, 1.0f };
 
-				for (int h = 0; h < d->fborder; h++)
+			if (fi->colorFamily == cmYUV)
+				for (int p = 1; p < 3; p++)
 				{
-					offh = h * d->fborder * d->nEntries;
-
-					for (int w = 0; w < d->fborder; w++)
-					{
-						offw = d->nEntries * w;
-
-						x = d->xyAndQ[offh + offw];
-						y = d->xyAndQ[offh + offw + 1];
-
-						if (d->q > 1)
-						{
-							qx = d->xyAndQ[offh + offw + 2];
-							qy = d->xyAndQ[offh + offw + 3];
-						}
-						else
-						{
-							index = d->xyAndQ[offh + offw + 2];
-						}
-
-						if (x == -swidth - sheight && y == -swidth - sheight)
-						{
-							continue; // out of field flag seen
-						}
-
-						else if (x == -1 && y == -1)
-						{
-							// in the border flag seen. paint black
-							if (nbytes == 1)
-								paint4FoldSym(dp + oCenter, dpitch, 1, w >> subW, h >> subH, d->col[p]);
-							else if (nbytes == 2)
-								paint4FoldSym((uint16_t*)dp + oCenter, dpitch, 1, w >> subW, h >> subH, *((uint16_t*)d->col + p));
-							else if (nbytes == 4)
-								paint4FoldSym((float*)dp + oCenter, dpitch, 1, w >> subW, h >> subH, *((float*)d->col + p));
-						}
-
-						else if ((x >= swidth / 2 - span2 - 1 && x < swidth) || (y >= sheight / 2 - span2 - 1 && y < sheight))
-						{
-							
-							//  interpolation does not have sufficient points
-							// points are within src frame
-							if (nbytes == 1)
-							{
-								// near point
-								copy4FoldSym(dp + oCenter, dpitch, sp + iCenter, spitch, 1,
-									w >> subW, h >> subH, x >> subW, y >> subH);
-							}
-							else if (nbytes == 2)
-							{
-								copy4FoldSym((uint16_t*)dp + oCenter, dpitch, (uint16_t*)sp + iCenter, spitch, 1,
-									w >> subW, h >> subH, x >> subW, y >> subH);
-							}
-							else if (nbytes == 4)
-							{
-								// near point
-								copy4FoldSym((float*)dp + oCenter, dpitch, (float*)sp + iCenter, spitch, 1,
-									w >> subW, h >> subH, x >> subW, y >> subH);
-							}
-						}
-						
-						else if (x < swidth / 2 - span2 - 1 && y < sheight / 2 - span2 - 1)
-						{							
-							
-							// sufficient points for interpolation are available
-							if (nbytes == 1)
-							{
-								if (subH > 0 || subW > 0)
-								{
-									copy4FoldSym(dp + oCenter, dpitch, sp + iCenter, spitch, 1,
-										w >> subW, h >> subH, x >> subW, y >> subH);
-								}
-								else if (d->q == 1)
-									interpolate9pt4FoldSym(dp + oCenter, dpitch, sp + iCenter, spitch,
-										1, w, h, x, y, index);
-								else
-									interpolate4FoldSym(dp + oCenter, dpitch, sp + iCenter, spitch,
-										1, w, h, x, y, qx, qy, d->span, d->iCoeff, min8, max8);
-							}
-
-							else if (nbytes == 2)
-							{
-								if (subH > 0 || subW > 0)
-								{
-									copy4FoldSym((uint16_t*)dp + oCenter, dpitch, (uint16_t*)sp + iCenter, spitch, 1,
-										w >> subW, h >> subH, x >> subW, y >> subH);
-								}
-								else if (d->q == 1)
-									interpolate9pt4FoldSym((uint16_t*)dp + oCenter, dpitch, (uint16_t*)sp + iCenter, spitch,
-										1, w, h, x, y, index);
-								else
-
-									interpolate4FoldSym((uint16_t*)dp + oCenter, dpitch, (uint16_t*)sp + iCenter, spitch,
-										1, w, h, x, y, qx, qy, d->span, d->iCoeff, min16, max16);
-							}
-
-							else if (nbytes == 4)
-							{
-								if (subH > 0 || subW > 0)
-								{
-									copy4FoldSym((float*)dp + oCenter, dpitch, (float*)sp + iCenter, spitch, 1,
-										w >> subW, h >> subH, x >> subW, y >> subH);
-								}
-								else if (d->q == 1)
-									interpolate9pt4FoldSym((float*)dp + oCenter, dpitch, (float*)sp + iCenter, spitch,
-										1, w, h, x, y, index);
-								else
-
-									interpolate4FoldSym((float*)dp + oCenter, dpitch, (float*)sp + iCenter, spitch,
-										1, w, h, x, y, qx, qy, d->span, d->iCoeff, minf, maxf);
-							}
-						}
-					}
+					min[p] = -0.5f;
+					max[p] = 0.5f;
 				}
-			}
+			RearViewMirrorBand band = { dst, src, d, d->col, min, max, vsapi };
+			bandsRun(d->threads, d->fborder, rearviewmirrorBand<float>, &band);
 		}
 		
 		vsapi->freeFrame(src);
@@ -520,10 +588,13 @@ static void VS_CC rearviewmirrorFree(void* instanceData, VSCore* core, const VSA
 	vsapi->freeNode(d->node);
 	vsapi->freeNode(d->bnode);
 
-	vs_aligned_free(d->xyAndQ);
+	warpMapFree(d->map);
+	warpMapFree(d->cmap);
+	vs_aligned_free(d->borderEnd);
 	if (!d->iCoeff == NULL)
 		vs_aligned_free(d->iCoeff);
 
+	bandsDetach();
 	free(d);
 }
 
@@ -687,6 +758,18 @@ static void VS_CC rearviewmirrorCreate(const VSMap* in, VSMap* out, void* userDa
 		}
 
 	}
+
+	d.threads = int64ToIntS(vsapi->propGetInt(in, "threads", 0, &err));
+	if (err)
+		d.threads = 1;
+	else if (d.threads < 0 || d.threads > BAND_MAX_THREADS)
+	{
+		vsapi->setError(out, "RearViewMirror: threads must be 1 to 64, or 0 for all cores");
+		vsapi->freeNode(d.node);
+		vsapi->freeNode(d.bnode);
+		return;
+	}
+	d.threads = bandThreads(d.threads);
 	
 	// I usually keep the filter data struct on the stack and don't allocate it
 // until all the input validation is done.
@@ -694,6 +777,7 @@ static void VS_CC rearviewmirrorCreate(const VSMap* in, VSMap* out, void* userDa
 	*data = d;
 
 
+	bandsAttach();
 	vsapi->createFilter(in, out, "RearViewMirror", rearviewmirrorInit, rearviewmirrorGetFrame, rearviewmirrorFree, fmParallel, 0, data, core);
 
 }
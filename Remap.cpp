@@ -0,0 +1,350 @@
+/******************************************************************************
+Remap takes each output sample from the source position given by two float
+Gray clips, mapx and mapy, of frame size. Positions are in luma samples, or are
+offsets from the output position if rel is set. Luma size planes are sampled as
+q asks, subsampled planes take the nearest sample. Samples whose source is
+outside the frame, or not a number, are left as input.
+Maps of one frame are made into a warp map once. Longer maps give the positions
+of each frame and are converted a row at a time.
+*************************************************************************************************/
+#include "VapourSynth.h"
+#include "VSHelper.h"
+
+typedef struct {
+	VSNodeRef* node;
+	VSNodeRef* xnode;
+	VSNodeRef* ynode;
+	const VSVideoInfo* vi;
+
+	bool rel;		// map gives offsets from output position
+	bool dynamic;	// map has positions of each frame
+	int q;			// 0 nearest, 1 bilinear, 2 bicubic, 3 lanczos
+	int span;		// interpolation taps. 0 for nearest
+	int quantiles;
+	float* coeff;	// interpolation coefficients
+	int16_t* q14Coeff;	// same for 8 bit in integer. NULL for other formats
+	WarpMap* map;	// positions of a single frame map, else NULL
+	int threads;	// threads doing bands of rows of a frame
+} RemapData;
+
+// remap of a frame, for bands of its rows
+typedef struct {
+	const FramePlane* pl;
+	int np;
+	const RemapData* d;
+	const float* mx;	// float maps of frame if dynamic
+	const float* my;
+	int mpitch;
+} RemapBand;
+
+// entries of row h of wd samples from positions fx, fy
+void remapEntries(WarpEntry* e, const float* fx, const float* fy, int h, int wd, int ht,
+	int quantiles, bool round, bool rel);
+static void remapBand(void* work, int row0, int row1);
+
+//------------------------------------------------------------------------------
+// qx, qy are 0 to quantiles - 1 of floor position, or 0 of nearest if round
+void remapEntries(WarpEntry* e, const float* fx, const float* fy, int h, int wd, int ht,
+	int quantiles, bool round, bool rel)
+{
+	for (int w = 0; w < wd; w++)
+	{
+		float sx = rel ? fx[w] + w : fx[w];
+		float sy = rel ? fy[w] + h : fy[w];
+		// also false for NaN
+		if (!(sx >= 0 && sx <= wd - 1 && sy >= 0 && sy <= ht - 1))
+		{
+			e[w].qx = WARP_SKIP;
+			continue;
+		}
+		int x = (int)sx, y = (int)sy;
+		int qx = (int)((sx - x) * quantiles + 0.5f);
+		int qy = (int)((sy - y) * quantiles + 0.5f);
+
+		if (round)
+		{
+			x += 2 * qx >= quantiles;
+			y += 2 * qy >= quantiles;
+			qx = qy = 0;
+		}
+		// last quantile is next sample. Within frame as sx <= wd - 1
+		if (qx == quantiles)
+		{
+			x++;
+			qx = 0;
+		}
+		if (qy == quantiles)
+		{
+			y++;
+			qy = 0;
+		}
+		e[w].dx = (int16_t)(x - w);
+		e[w].dy = (int16_t)(y - h);
+		e[w].qx = (uint8_t)qx;
+		e[w].qy = (uint8_t)qy;
+	}
+}
+
+static void remapBand(void* work, int row0, int row1)
+{
+	const RemapBand* b = (const RemapBand*)work;
+	const RemapData* d = b->d;
+	const VSFormat* fi = d->vi->format;
+	int wd = d->vi->width, ht = d->vi->height;
+	WarpSampler sampler = { d->span, d->quantiles, d->coeff, d->q14Coeff };
+	ScratchArena* scratch = scratchBegin();
+	WarpRowBuffers buf;
+	warpRowBuffers(&buf, scratch, wd);
+	WarpEntry* row = d->dynamic ? scratchAlloc<WarpEntry>(scratch, sizeof(WarpEntry) * wd) : NULL;
+
+	for (int h = row0; h < row1; h++)
+	{
+		const WarpEntry* e;
+
+		if (d->dynamic)
+		{
+			remapEntries(row, b->mx + h * b->mpitch, b->my + h * b->mpitch, h, wd, ht,
+				d->quantiles, d->span == 0, d->rel);
+			e = row;
+		}
+		else
+			e = warpMapRow(d->map, h);
+
+		if (fi->bytesPerSample == 1)
+			warpSampleRow<uint8_t>(b->pl, b->np, fi, wd, ht, e, h, &sampler, NULL, &buf);
+		else if (fi->bytesPerSample == 2)
+			warpSampleRow<uint16_t>(b->pl, b->np, fi, wd, ht, e, h, &sampler, NULL, &buf);
+		else
+			warpSampleRow<float>(b->pl, b->np, fi, wd, ht, e, h, &sampler, NULL, &buf);
+	}
+	scratchEnd(scratch);
+}
+
+static void VS_CC remapInit(VSMap* in, VSMap* out, void** instanceData,
+	VSNode* node, VSCore* core, const VSAPI* vsapi)
+{
+	RemapData* d = (RemapData*)*instanceData;
+	vsapi->setVideoInfo(d->vi, 1, node);
+}
+//----------------------------------------------------------------------------------------------
+static const VSFrameRef* VS_CC remapGetFrame(int n, int activationReason, void** instanceData,
+	void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi)
+{
+	RemapData* d = (RemapData*)*instanceData;
+
+	if (activationReason == arInitial)
+	{
+		vsapi->requestFrameFilter(n, d->node, frameCtx);
+
+		if (d->dynamic)
+		{
+			vsapi->requestFrameFilter(n, d->xnode, frameCtx);
+			vsapi->requestFrameFilter(n, d->ynode, frameCtx);
+		}
+	}
+	else if (activationReason == arAllFramesReady)
+	{
+		const VSFrameRef* src = vsapi->getFrameFilter(n, d->node, frameCtx);
+		const VSFrameRef* xf = d->dynamic ? vsapi->getFrameFilter(n, d->xnode, frameCtx) : NULL;
+		const VSFrameRef* yf = d->dynamic ? vsapi->getFrameFilter(n, d->ynode, frameCtx) : NULL;
+		VSFrameRef* dst = vsapi->copyFrame(src, core);
+		FramePlane pl[3];
+		int np = getFramePlanes(pl, dst, src, vsapi);
+
+		RemapBand band = { pl, np, d, NULL, NULL, 0 };
+
+		if (d->dynamic)
+		{
+			band.mx = (const float*)vsapi->getReadPtr(xf, 0);
+			band.my = (const float*)vsapi->getReadPtr(yf, 0);
+			// both maps are of one format and size
+			band.mpitch = vsapi->getStride(xf, 0) / sizeof(float);
+		}
+		bandsRun(d->threads, d->vi->height, remapBand, &band);
+
+		vsapi->freeFrame(src);
+		vsapi->freeFrame(xf);
+		vsapi->freeFrame(yf);
+		return dst;
+	}
+	return 0;
+}
+
+static void VS_CC remapFree(void* instanceData, VSCore* core, const VSAPI* vsapi)
+{
+	RemapData* d = (RemapData*)instanceData;
+	vsapi->freeNode(d->node);
+	vsapi->freeNode(d->xnode);
+	vsapi->freeNode(d->ynode);
+	vs_aligned_free(d->coeff);
+	vs_aligned_free(d->q14Coeff);
+	warpMapFree(d->map);
+	bandsDetach();
+	free(d);
+}
+
+// warp map of first frames of single frame maps. NULL and msg set if a frame is not got
+static WarpMap* remapBuildMap(const RemapData* d, char* msg, int msgSize, const VSAPI* vsapi)
+{
+	int wd = d->vi->width, ht = d->vi->height;
+	const VSFrameRef* xf = vsapi->getFrame(0, d->xnode, msg, msgSize);
+	const VSFrameRef* yf = xf != NULL ? vsapi->getFrame(0, d->ynode, msg, msgSize) : NULL;
+
+	if (yf == NULL)
+	{
+		vsapi->freeFrame(xf);
+		return NULL;
+	}
+	const float* mx = (const float*)vsapi->getReadPtr(xf, 0);
+	const float* my = (const float*)vsapi->getReadPtr(yf, 0);
+	int mpitch = vsapi->getStride(xf, 0) / sizeof(float);
+	ScratchArena* scratch = scratchBegin();
+	int* rowLength = scratchAlloc<int>(scratch, sizeof(int) * ht);
+
+	for (int h = 0; h < ht; h++)
+		rowLength[h] = wd;
+	WarpMap* map = warpMapCreate(ht, rowLength);
+	scratchEnd(scratch);
+
+	for (int h = 0; h < ht; h++)
+		remapEntries(warpMapRow(map, h), mx + h * mpitch, my + h * mpitch, h, wd, ht,
+			d->quantiles, d->span == 0, d->rel);
+
+	vsapi->freeFrame(xf);
+	vsapi->freeFrame(yf);
+	return map;
+}
+
+static void VS_CC remapCreate(const VSMap* in, VSMap* out, void* userData,
+	VSCore* core, const VSAPI* vsapi)
+{
+	RemapData d;
+	RemapData* data;
+	int err;
+
+	d.node = vsapi->propGetNode(in, "clip", 0, 0);
+	d.vi = vsapi->getVideoInfo(d.node);
+	d.xnode = vsapi->propGetNode(in, "mapx", 0, 0);
+	d.ynode = vsapi->propGetNode(in, "mapy", 0, 0);
+	const VSVideoInfo* xvi = vsapi->getVideoInfo(d.xnode);
+	const VSVideoInfo* yvi = vsapi->getVideoInfo(d.ynode);
+
+	if (!isConstantFormat(d.vi) || (d.vi->format->colorFamily != cmRGB && d.vi->format->colorFamily != cmYUV
+		&& d.vi->format->colorFamily != cmGray))
+	{
+		vsapi->setError(out, "Remap: RGB, YUV and Gray constant format input only is supported");
+		vsapi->freeNode(d.node);
+		vsapi->freeNode(d.xnode);
+		vsapi->freeNode(d.ynode);
+		return;
+	}
+	// map offsets are 16 bit
+	if (d.vi->width > 32767 || d.vi->height > 32767)
+	{
+		vsapi->setError(out, "Remap: frame width and height can be up to 32767");
+		vsapi->freeNode(d.node);
+		vsapi->freeNode(d.xnode);
+		vsapi->freeNode(d.ynode);
+		return;
+	}
+	for (int k = 0; k < 2; k++)
+	{
+		const VSVideoInfo* mvi = k == 0 ? xvi : yvi;
+
+		if (!isConstantFormat(mvi) || mvi->format->colorFamily != cmGray || mvi->format->sampleType != stFloat
+			|| mvi->format->bitsPerSample != 32 || mvi->width != d.vi->width || mvi->height != d.vi->height)
+		{
+			vsapi->setError(out, "Remap: mapx and mapy must be GrayS clips of frame size of clip");
+			vsapi->freeNode(d.node);
+			vsapi->freeNode(d.xnode);
+			vsapi->freeNode(d.ynode);
+			return;
+		}
+	}
+	if (xvi->numFrames != yvi->numFrames || (xvi->numFrames != 1 && xvi->numFrames < d.vi->numFrames))
+	{
+		vsapi->setError(out, "Remap: mapx and mapy must both be of one frame, or both as long as clip at least");
+		vsapi->freeNode(d.node);
+		vsapi->freeNode(d.xnode);
+		vsapi->freeNode(d.ynode);
+		return;
+	}
+	d.dynamic = xvi->numFrames != 1;
+
+	d.q = int64ToIntS(vsapi->propGetInt(in, "q", 0, &err));
+	if (err)
+		d.q = 2;
+	else if (d.q < 0 || d.q > 3)
+	{
+		vsapi->setError(out, "Remap: q can be 0 for nearest, 1 bilinear, 2 bicubic or 3 lanczos sampling");
+		vsapi->freeNode(d.node);
+		vsapi->freeNode(d.xnode);
+		vsapi->freeNode(d.ynode);
+		return;
+	}
+	d.rel = !!int64ToIntS(vsapi->propGetInt(in, "rel", 0, &err));
+	if (err)
+		d.rel = false;
+
+	d.threads = int64ToIntS(vsapi->propGetInt(in, "threads", 0, &err));
+	if (err)
+		d.threads = 1;
+	else if (d.threads < 0 || d.threads > BAND_MAX_THREADS)
+	{
+		vsapi->setError(out, "Remap: threads must be 1 to 64, or 0 for all cores");
+		vsapi->freeNode(d.node);
+		vsapi->freeNode(d.xnode);
+		vsapi->freeNode(d.ynode);
+		return;
+	}
+	d.threads = bandThreads(d.threads);
+
+	d.span = d.q == 0 ? 0 : d.q == 1 ? 2 : d.q == 2 ? 4 : 6;
+	d.quantiles = 64;
+	d.coeff = NULL;
+	d.q14Coeff = NULL;
+
+	if (d.span > 0)
+	{
+		d.coeff = (float*)vs_aligned_malloc(sizeof(float) * (d.quantiles + 1) * d.span, 32);
+
+		if (d.span == 2)
+			LinearIntCoeff(d.coeff, d.quantiles);
+		else if (d.span == 4)
+			CubicIntCoeff(d.coeff, d.quantiles);
+		else
+			LanczosCoeff(d.coeff, d.span, d.quantiles);
+
+		if (d.vi->format->sampleType == stInteger && d.vi->format->bitsPerSample == 8)
+		{
+			d.q14Coeff = (int16_t*)vs_aligned_malloc(sizeof(int16_t) * (d.quantiles + 1) * d.span, 32);
+			Q14Coeff(d.q14Coeff, d.coeff, d.span, d.quantiles + 1);
+		}
+	}
+	d.map = NULL;
+
+	if (!d.dynamic)
+	{
+		char msg[256];
+		d.map = remapBuildMap(&d, msg, sizeof(msg), vsapi);
+
+		if (d.map == NULL)
+		{
+			char emsg[300];
+			snprintf(emsg, sizeof(emsg), "Remap: map frame not got. %s", msg);
+			vsapi->setError(out, emsg);
+			vsapi->freeNode(d.node);
+			vsapi->freeNode(d.xnode);
+			vsapi->freeNode(d.ynode);
+			vs_aligned_free(d.coeff);
+			vs_aligned_free(d.q14Coeff);
+			return;
+		}
+	}
+
+	data = (RemapData*)malloc(sizeof(d));
+	*data = d;
+
+	bandsAttach();
+	vsapi->createFilter(in, out, "Remap", remapInit, remapGetFrame, remapFree, fmParallel, 0, data, core);
+}
@@ -46,9 +46,26 @@ typedef struct {
 	int dfr;				// ripples subside from this %age of frames to end frame
 
 	float* sintbl;
+	uint16_t* radmap;	// radius of each pool pixel from ripple origin
+	int maxrad;		// largest radius in radmap
+	int threads;	// threads doing bands of rows of a frame
 
 } RippleData;
 
+// ripple of a frame, for bands of pool rows
+typedef struct {
+	const FramePlane* pl;
+	int np;
+	const RippleData* d;
+	const int* ytab;
+	const int* xtab;
+} RippleBand;
+
+template <typename finc>
+void ripplePlanes(const FramePlane* pl, int np, const RippleData* d, const int* ytab, const int* xtab,
+	int y0, int y1);
+// all planes in pool rows row0 to row1 - 1
+static void rippleBand(void* work, int row0, int row1);
 
 
 static void VS_CC rippleInit(VSMap* in, VSMap* out, void** instanceData, 
@@ -99,6 +116,84 @@ static void VS_CC rippleInit(VSMap* in, VSMap* out, void** instanceData,
 		d->yo = d->y;
 		break;
 	}
+	// pool and origin are fixed, so radius of each pool pixel is found once here
+	d->radmap = (uint16_t*)vs_aligned_malloc(sizeof(uint16_t) * d->swd * d->sht, 32);
+	d->maxrad = 0;
+
+	for (int h = 0; h < d->sht; h++)
+	{
+		int hh = (h + d->y - d->yo);
+		int hsq = hh * hh;
+
+		for (int w = 0; w < d->swd; w++)
+		{
+			int ww = (w + d->x - d->xo);
+			int radix = (int)sqrt((float)(hsq + (ww * ww))); // radius of circle
+
+			d->radmap[h * d->swd + w] = (uint16_t)radix;
+			d->maxrad = VSMAX(d->maxrad, radix);
+		}
+	}
+}
+
+//----------------------------------------------------------------------------------------------
+// displaces pixels of pool in np planes of same size, at their own resolution.
+// ytab, xtab are displacements of this frame for each radius of radmap. Only luma
+// rows y0 to y1 - 1 are done. finc is fixed at compile time so that inner loop has no format checks
+template <typename finc>
+void ripplePlanes(const FramePlane* pl, int np, const RippleData* d, const int* ytab, const int* xtab,
+	int y0, int y1)
+{
+	finc* dp[] = { (finc*)pl[0].dp, np > 1 ? (finc*)pl[1].dp : NULL, np > 2 ? (finc*)pl[2].dp : NULL };
+	const finc* sp[] = { (const finc*)pl[0].sp, np > 1 ? (const finc*)pl[1].sp : NULL, np > 2 ? (const finc*)pl[2].sp : NULL };
+	int pitch = pl[0].pitch;
+	int subW = pl[0].subW, subH = pl[0].subH;
+	int poolHeight = d->sht;
+	int poolWidth = d->swd;
+	int hstart = planeStart(VSMAX(d->y, y0), subH), hend = planeStart(VSMIN(d->y + poolHeight, y1), subH);
+	int wstart = planeStart(d->x, subW), wend = planeStart(d->x + poolWidth, subW);
+
+	for (int hp = hstart; hp < hend; hp++)
+	{
+		int h = hp << subH;	// luma coordinates
+		const uint16_t* radrow = d->radmap + (h - d->y) * poolWidth - d->x;
+
+		for (int wp = wstart, w = wstart << subW; wp < wend; wp++, w += 1 << subW)
+		{
+			int radix = radrow[w];
+			int ydisp = ytab[radix];	// how much we move in y direction 
+			int xdisp = xtab[radix];	// how much we move in x direction
+
+			if ((ydisp | xdisp) != 0 
+				&& (h + ydisp) >= 0 && (h + ydisp) < poolHeight 
+				&& w + xdisp >= 0 && w + xdisp < poolWidth)
+			{
+				int soff = ((h + ydisp) >> subH) * pitch + ((w + xdisp) >> subW);
+
+				for (int p = 0; p < np; p++)
+					dp[p][hp * pitch + wp] = sp[p][soff];
+
+			}	// if h + ydisp
+		}	// for w
+	}
+}
+
+static void rippleBand(void* work, int row0, int row1)
+{
+	const RippleBand* b = (const RippleBand*)work;
+	const RippleData* d = b->d;
+	int nbytes = d->vi->format->bytesPerSample;
+	int nfull = lumaSizePlanes(b->pl, b->np);
+	// luma size planes, then subsampled ones at own size
+	for (int p = 0; p < b->np; p += nfull, nfull = b->np - nfull)
+	{
+		if (nbytes == 1)
+			ripplePlanes<uint8_t>(b->pl + p, nfull, d, b->ytab, b->xtab, d->y + row0, d->y + row1);
+		else if (nbytes == 2)
+			ripplePlanes<uint16_t>(b->pl + p, nfull, d, b->ytab, b->xtab, d->y + row0, d->y + row1);
+		else
+			ripplePlanes<float>(b->pl + p, nfull, d, b->ytab, b->xtab, d->y + row0, d->y + row1);
+	}
 }
 
 //----------------------------------------------------------------------------------------------
@@ -118,16 +213,11 @@ static const VSFrameRef* VS_CC rippleGetFrame(int in, int activationReason, void
 		int n = in - d->StartFrame;
 		int nframes = d->EndFrame - d->StartFrame + 1;
 
-		const VSFormat* fi = d->vi->format;
 		
 		// calculate current coordinates, width and height
 
 		int iframe = (nframes * d->ifr) / 100;		// ripples grow upto this frame
 		int dframe = (nframes * d->dfr) / 100;		// ripples subside from this frame
-		int poolx = d->x;
-		int pooly = d->y;
-		int poolWidth = d->swd;
-		int poolHeight = d->sht;
 		int ampl = d->samp;
 		
 		float speed = d->speed + n * (d->espeed - d->speed) / nframes;
@@ -161,79 +251,30 @@ static const VSFrameRef* VS_CC rippleGetFrame(int in, int activationReason, void
 		
 
 		VSFrameRef* dst = vsapi->copyFrame(src, core);		
-		int nbytes = fi->bytesPerSample;
-		int nbits = fi->bitsPerSample;
-		int nb = fi->bitsPerSample;
-		int subH[] = { 0,fi->subSamplingH, fi->subSamplingH };
-		int subW[] = { 0,fi->subSamplingW, fi->subSamplingW };
-
-		int andH = ( 1 << subH[1]) - 1;
-		int andW = (1 << subW[1]) - 1;
-		int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;		
-
-		uint8_t* dp[] = { NULL, NULL, NULL, NULL };
-		const uint8_t* sp[] = { NULL, NULL, NULL, NULL };
-		int pitch[] = { 0,0,0 };		
-		
-		for (int p = 0; p < np; p++)
+		FramePlane pl[3];
+		int np = getFramePlanes(pl, dst, src, vsapi);
+		// displacements of this frame for each radius. None beyond ripple or at origin
+		ScratchArena* scratch = scratchBegin();
+		int* ytab = scratchAlloc<int>(scratch, sizeof(int) * 2 * (d->maxrad + 1));
+		int* xtab = ytab + d->maxrad + 1;
+
+		for (int radix = 0; radix <= d->maxrad; radix++)
 		{
-			sp[p] = vsapi->getReadPtr(src, p);
-			dp[p] = vsapi->getWritePtr(dst, p);
-			pitch[p] = vsapi->getStride(dst, p) / nbytes;			
-		}
-						// now create ripple
-		for (int h = pooly; h < pooly + poolHeight; h++)				//
-		{
-			int hh = (h - d->yo);			
-
-			int hsq = hh * hh;
+			ytab[radix] = 0;
+			xtab[radix] = 0;
 
-			for (int w = poolx; w < poolx + poolWidth; w++)
+			if (radix < rad && radix >= 1)
 			{
-				int ww = (w - d->xo);
-				//int wx = xcoord + w - width / 2;
-
-				int radix = (int)sqrt((float)(hsq + (ww * ww))); // radius of circle
-
-				if (radix < rad && radix >= 1)
-				{
-					// prevent div by zero
-					int rdisp = (radix + nn) % d->waveLength;	// position of wave at this point on this frame
-					int ydisp = (int)(d->sintbl[rdisp] * ampl);	// how much we move in y direction 
-					int xdisp = (int)(d->sintbl[(radix + nn + d->waveLength / 2) % d->waveLength] * ampl);	// how much we move in x direction
-
-					if ((h + ydisp) >= 0 && (h + ydisp) < poolHeight 
-						&& w + xdisp >= 0 && w + xdisp < poolWidth)
-					{
-						for (int p = 0; p < np; p++)
-						{
-
-							if (fi->sampleType == stInteger && nbytes == 1)
-
-								*(dp[p] + ((h) >> subH[p]) * pitch[p] + ((w) >> subW[p]))
-								= *(sp[p] + ((h + ydisp) >> subH[p]) * pitch[p]
-									+ ((w + xdisp) >> subW[p]));
-
-							else if (fi->sampleType == stInteger && nbytes == 2)
-
-								*((uint16_t*)(dp[p]) + ((h) >> subH[p]) * pitch[p] + ((w) >> subW[p]))
-								= *((uint16_t*)(sp[p]) + ((h + ydisp) >> subH[p]) * pitch[p]
-									+ ((w + xdisp) >> subW[p]));
-
-							else if (fi->sampleType == stFloat && nbytes == 4)
-
-								*((float*)(dp[p]) + +((h) >> subH[p]) * pitch[p] + ((w) >> subW[p]))
-								= *((float*)(sp[p]) + ((h + ydisp) >> subH[p]) * pitch[p]
-									+ ((w + xdisp) >> subW[p]));
-						}
-
-					}	// if h + ydisp
-
-				}	// if radix
-			}	// for w
+				// prevent div by zero
+				int rdisp = (radix + nn) % d->waveLength;	// position of wave at this point on this frame
+				ytab[radix] = (int)(d->sintbl[rdisp] * ampl);
+				xtab[radix] = (int)(d->sintbl[(radix + nn + d->waveLength / 2) % d->waveLength] * ampl);
+			}
 		}
-						
-		
+		// now create ripple, in bands of pool rows
+		RippleBand band = { pl, np, d, ytab, xtab };
+		bandsRun(d->threads, d->sht, rippleBand, &band);
+		scratchEnd(scratch);
 		
 		//vs_aligned_free (wspan);
 		vsapi->freeFrame( src);
@@ -247,6 +288,8 @@ static void VS_CC rippleFree(void* instanceData, VSCore* core, const VSAPI* vsap
     RippleData* d = (RippleData*)instanceData;
     vsapi->freeNode(d->node);	
 	vs_aligned_free(d->sintbl);
+	vs_aligned_free(d->radmap);
+    bandsDetach();
     free(d);
 }
 
@@ -429,12 +472,24 @@ static void VS_CC rippleCreate(const VSMap* in, VSMap* out, void* userData, VSCo
 		vsapi->freeNode(d.node);
 		return;
 	}
+
+	d.threads = int64ToIntS(vsapi->propGetInt(in, "threads", 0, &err));
+	if (err)
+		d.threads = 1;
+	else if (d.threads < 0 || d.threads > BAND_MAX_THREADS)
+	{
+		vsapi->setError(out, "Ripple: threads must be 1 to 64, or 0 for all cores");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.threads = bandThreads(d.threads);
 	
 
 	
     data = (RippleData*)malloc(sizeof(d));
     *data = d;	
 
+    bandsAttach();
     vsapi->createFilter(in, out, "Ripple", rippleInit, rippleGetFrame, rippleFree, fmParallel, 0, data, core);
 }
 
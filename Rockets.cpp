@@ -42,9 +42,16 @@ typedef struct {
 	int* px, * py, * xcoord;
 	uint8_t red[3];
 	uint8_t white[3];
+	uint32_t seed;	// instance seed for counter based random numbers
 
 } RocketsData;
 
+// plumes of rockets in flight in frame n, drawn as particles. finc is fixed at compile time
+template <typename finc>
+void rocketsKernel(const FramePlane* pl, int np, const VSFormat* fi, const RocketsData* d, int n);
+// w[i] is x of parabola sqrt(pp4 * hh) + xcoord at hh = hh0 + i, for count rows
+void rocketsTrack(int* w, int count, int hh0, double pp4, int xcoord);
+
 
 
 static void VS_CC rocketsInit(VSMap* in, VSMap* out, void** instanceData, 
@@ -93,28 +100,180 @@ static void VS_CC rocketsInit(VSMap* in, VSMap* out, void** instanceData,
 		d->rise = d->inity - d->targety;		
 	}
 	//	auto start = (std::chrono::system_clock::now()) % RAND_MAX;
-	srand(((d->EndFrame - d->StartFrame) * (d->EndFrame - d->StartFrame)
-		* (d->EndFrame - d->StartFrame)) | 1);
+	uint32_t nf = (uint32_t)(d->EndFrame - d->StartFrame);
+	d->seed = (nf * nf * nf) | 1;
+	RandomSequence rs;
+	startRandomSequence(&rs, d->seed);
 	// table of parabola constants for nrockets
 	for (int i = 0; i < d->nrockets; i++)
 	{
-		d->xcoord[i] = d->leftx + (rand() % (d->rightx - d->leftx));	// rocket firing x coordinate 
+		d->xcoord[i] = d->leftx + nextRandom(&rs, d->rightx - d->leftx);	// rocket firing x coordinate 
 
 		if (!d->target)
 		{
-			d->py[i] = d->rise / 2 + (rand() % (d->rise / 2));	// parabola y
-			d->px[i] = d->rise / 4 + (rand() % (d->rise / 4));	// parabola x
+			d->py[i] = d->rise / 2 + nextRandom(&rs, d->rise / 2);	// parabola y
+			d->px[i] = d->rise / 4 + nextRandom(&rs, d->rise / 4);	// parabola x
 		}
 		else // if (d->target)
 		{			
-			d->py[i] = (9 * d->rise / 10) + (rand() % ( (d->rise / 10) ));	// parabola y
+			d->py[i] = (9 * d->rise / 10) + nextRandom(&rs, d->rise / 10);	// parabola y
 			d->px[i] = (9 * (d->targetx - d->xcoord[i])) / 10 
-				+ (rand() % ((d->targetx - d->xcoord[i])/ 10)); 	// parabola x
+				+ nextRandom(&rs, (d->targetx - d->xcoord[i]) / 10); 	// parabola x
 		}
 	}
 
 }
 
+//----------------------------------------------------------------------------------------------
+#ifdef VFX_X86_SIMD
+// returns rows done
+VFX_TARGET("sse4.1") int rocketsTrackSse41(int* w, int count, int hh0, double pp4, int xcoord)
+{
+	const __m128d vpp4 = _mm_set1_pd(pp4);
+	const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3), vx = _mm_set1_epi32(xcoord);
+	int i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i hh = _mm_add_epi32(_mm_set1_epi32(hh0 + i), lanes);
+		__m128d lo = _mm_sqrt_pd(_mm_mul_pd(vpp4, _mm_cvtepi32_pd(hh)));
+		__m128d hi = _mm_sqrt_pd(_mm_mul_pd(vpp4, _mm_cvtepi32_pd(_mm_unpackhi_epi64(hh, hh))));
+		__m128i x = _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+
+		_mm_storeu_si128((__m128i*)(w + i), _mm_add_epi32(x, vx));
+	}
+	return i;
+}
+
+VFX_TARGET("avx2") int rocketsTrackAvx2(int* w, int count, int hh0, double pp4, int xcoord)
+{
+	const __m256d vpp4 = _mm256_set1_pd(pp4);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), vx = _mm256_set1_epi32(xcoord);
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i hh = _mm256_add_epi32(_mm256_set1_epi32(hh0 + i), lanes);
+		__m256d lo = _mm256_sqrt_pd(_mm256_mul_pd(vpp4, _mm256_cvtepi32_pd(_mm256_castsi256_si128(hh))));
+		__m256d hi = _mm256_sqrt_pd(_mm256_mul_pd(vpp4, _mm256_cvtepi32_pd(_mm256_extracti128_si256(hh, 1))));
+		__m256i x = _mm256_setr_m128i(_mm256_cvttpd_epi32(lo), _mm256_cvttpd_epi32(hi));
+
+		_mm256_storeu_si256((__m256i*)(w + i), _mm256_add_epi32(x, vx));
+	}
+	return i;
+}
+#endif
+
+void rocketsTrack(int* w, int count, int hh0, double pp4, int xcoord)
+{
+	int i = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_AVX2)
+		i = rocketsTrackAvx2(w, count, hh0, pp4, xcoord);
+	else if (simdLevel >= SIMD_SSE41)
+		i = rocketsTrackSse41(w, count, hh0, pp4, xcoord);
+#endif
+	for (; i < count; i++)
+		w[i] = (int)sqrt(pp4 * (hh0 + i)) + xcoord;
+}
+
+template <typename finc>
+void rocketsKernel(const FramePlane* pl, int np, const VSFormat* fi, const RocketsData* d, int n)
+{
+	int wd = d->vi->width;
+	// red and white in sample type
+	finc colors[6];
+
+	for (int p = 0; p < 3; p++)
+	{
+		for (int c = 0; c < 2; c++)
+		{
+			int col = c == 0 ? d->red[p] : d->white[p];
+
+			if (sizeof(finc) == 4)
+				colors[3 * c + p] = (finc)(p == 0 || fi->colorFamily == cmRGB ? col / 256.0f : (col - 128) / 256.0f);
+			else
+				colors[3 * c + p] = (finc)(col << (fi->bitsPerSample - 8));
+		}
+	}
+	uint32_t key = randomKey(d->seed, n);
+	int rockets = 1 + (n / d->interval) % d->life;
+	// plume is 64 wide at target, else widens down to 2 + dy / 16
+	int capacity = 0, maxdy = 0;
+
+	for (int r = 0; r < rockets; r++)
+	{
+		int m = (n / d->interval - r) % d->nrockets;
+		int dy = (d->py[m] * (d->life - r * d->interval - n % d->interval)) / d->life / 4;
+		capacity += VSMAX(dy, 0) * VSMAX(64, 2 + VSMAX(dy, 0) / 16);
+		maxdy = VSMAX(maxdy, dy);
+	}
+	ScratchArena* scratch = scratchBegin();
+	uint32_t* rnd = scratchAlloc<uint32_t>(scratch, sizeof(uint32_t) * wd);
+	// parabola x of each plume row
+	int* track = scratchAlloc<int>(scratch, sizeof(int) * (maxdy + 1));
+	Particles ps;
+	particlesBegin(&ps, scratch, capacity);
+
+	for (int r = 0; r < rockets; r++)
+	{
+		int m = (n / d->interval - r) % d->nrockets;
+
+		float pp = (d->px[m] * d->px[m]) / (4.0f * (d->py[m]));	// parameter p of parabola
+		int factor = (d->life - r * d->interval - n % d->interval);	// to make appearance smaller at height
+		int yy = (d->py[m] * factor) / d->life;	// location of rocket relative to parabola 0,0
+		int dy = yy / 4;
+		int col = 0;			
+
+		// rows within frame and above pot
+		int hh0 = VSMAX(yy - dy, 3), hh1 = VSMIN(yy, d->inity - 2);
+
+		if (hh1 > hh0)
+			rocketsTrack(track, hh1 - hh0, hh0, 4.0 * pp, d->xcoord[m]);
+
+		for (int hh = yy - dy; hh < yy; hh++)
+		{
+			if (hh < d->inity - 2 && hh >  2)		// ensure within frame and above pot
+			{
+				int plume = 2 + (dy - yy + hh) / 16;	// width of plume on this frame
+				int w = track[hh - hh0];
+				// this is to ensure rockets fire in all directions
+				if (d->xcoord[m] - d->leftx > (d->rightx - d->leftx) / 2
+					&& !d->target)
+					w = -w;  // relative x coord is translated to image coord
+				else if (d->target)
+				{						
+					if (w < 50 && d->inity - d->py[m] + hh < d->targety + 50)
+					{
+						col = 1;
+						plume = 64;
+					}
+					w = d->targetx - w;
+				}
+
+				if (w > plume / 2 && w < wd - plume / 2)
+				{
+					// some randomness to give wavy appearence to plume
+					fillRandom(rnd, plume, key, r, hh * wd);
+					int* x = ps.x + ps.count, * y = ps.y + ps.count, * id = ps.id + ps.count;
+					int k = 0;
+
+					for (int i = 0; i < plume; i++)
+					{
+						x[k] = -plume / 2 + i + w;
+						y[k] = d->inity - d->py[m] + hh;
+						id[k] = col;
+						k += (rnd[i] & 1) == 0;
+					}
+					ps.count += k;
+				}	
+			}		
+		}
+	}
+	particlesStamp(pl, np, &ps, colors, 1, 1, PARTICLE_CHROMA_COVER);
+	scratchEnd(scratch);
+}
+
 //----------------------------------------------------------------------------------------------
 static const VSFrameRef* VS_CC rocketsGetFrame(int in, int activationReason, void** instanceData,
 					void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi)
@@ -133,108 +292,19 @@ static const VSFrameRef* VS_CC rocketsGetFrame(int in, int activationReason, voi
 		int nframes = d->EndFrame - d->StartFrame + 1;
 
 		const VSFormat* fi = d->vi->format;
-		int ht = d->vi->height;
-		int wd = d->vi->width;		
 
 		VSFrameRef* dst = vsapi->copyFrame(src, core);		
+		FramePlane pl[3];
+		int np = getFramePlanes(pl, dst, NULL, vsapi);
 		int nbytes = fi->bytesPerSample;
-		int nbits = fi->bitsPerSample;
-		int nb = fi->bitsPerSample;
-		int subH[] = { 0,fi->subSamplingH, fi->subSamplingH };
-		int subW[] = { 0,fi->subSamplingW, fi->subSamplingW };
-
-		int andH = ( 1 << subH[1]) - 1;
-		int andW = (1 << subW[1]) - 1;
-		int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;		
-
-		uint8_t* dp[] = { NULL, NULL, NULL, NULL };
-		//const uint8_t* sp[] = { NULL, NULL, NULL, NULL };
-		int pitch[] = { 0,0,0 };		
-		
-		for (int p = 0; p < np; p++)
-		{
-			//sp[p] = vsapi->getReadPtr(src, p);
-			dp[p] = vsapi->getWritePtr(dst, p);
-			pitch[p] = vsapi->getStride(dst, p) / nbytes;			
-		}
-						// now create rockets
-		
-		int rockets = 1 + (n / d->interval) % d->life;
-
-		for (int r = 0; r < rockets; r++)
-		{
-			int m = (n / d->interval - r) % d->nrockets;
-
-			float pp = (d->px[m] * d->px[m]) / (4.0f * (d->py[m]));	// parameter p of parabola
-			int factor = (d->life - r * d->interval - n % d->interval);	// to make appearance smaller at height
-			int yy = (d->py[m] * factor) / d->life;	// location of rocket relative to parabola 0,0
-			int dy = yy / 4;
-			unsigned char* col = d->red;			
-
-			for (int hh = yy - dy; hh < yy; hh++)
-			{
-				if (hh < d->inity - 2 && hh >  2)		// ensure within frame and above pot
-				{
-					int plume = 2 + (dy - yy + hh) / 16;	// width of plume on this frame
-					int w = (int)sqrt(4.0 * pp * (hh)) + d->xcoord[m];
-					// this is to ensure rockets fire in all directions
-					if (d->xcoord[m] - d->leftx > (d->rightx - d->leftx) / 2
-						&& !d->target)
-						w = -w;  // relative x coord is translated to image coord
-					else if (d->target)
-					{						
-						if (w < 50 && d->inity - d->py[m] + hh < d->targety + 50)
-						{
-							col = d->white;
-							plume = 64;
-						}
-						w = d->targetx - w;
-					}
-					
+		// format decides kernel once per frame
+		if (nbytes == 1)
+			rocketsKernel<uint8_t>(pl, np, fi, d, n);
+		else if (nbytes == 2)
+			rocketsKernel<uint16_t>(pl, np, fi, d, n);
+		else
+			rocketsKernel<float>(pl, np, fi, d, n);
 
-					if ( true) //(rand() & 1) == 0)	// <(RAND_MAX/2))
-					{
-						if (w > plume / 2 && w < wd - plume / 2)
-						{
-							for (int i = 0; i < plume; i++)
-							{
-								if ((rand() & 1) == 0)		// some randomness to give wavy appearence to plume
-								{
-									for (int p = 0; p < np; p++)
-									{
-										if (fi->sampleType == stInteger && nbytes == 1)
-										{
-											*(dp[p] + ((d->inity - d->py[m] + hh) >> subH[p]) * pitch[p]
-												+ ((-plume / 2 + i + w) >> subW[p])) = col[p];
-										}
-										else if (fi->sampleType == stInteger && nbytes == 2)
-										{
-											*((uint16_t*)(dp[p]) + ((d->inity - d->py[m] + hh) >> subH[p]) * pitch[p]
-												+ ((-plume / 2 + i + w) >> subW[p])) = col[p] << (nbits - 8);
-										}
-
-										else if (fi->sampleType == stFloat && nbytes == 4)
-										{
-											if (p == 0 || fi->colorFamily == cmRGB)
-												*((float*)(dp[p]) + ((d->inity - d->py[m] + hh)) * pitch[p]
-													+ -plume / 2 + i + w) = col[p] / 256.0f;
-											
-											else
-												*((float*)(dp[p]) + ((d->inity - d->py[m] + hh) >> subH[p]) * pitch[p]
-													+ ((-plume / 2 + i + w) >> subW[p])) = (col[p] - 128) / 256.0f;
-										}
-									}
-								}	
-							}	
-
-						}	
-					}							
-				}	
-			}		
-		}
-						
-		
-		
 		//vs_aligned_free (wspan);
 		vsapi->freeFrame( src);
 		return (dst);
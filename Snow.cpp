@@ -40,6 +40,7 @@ typedef struct {
 	int cellsize;
 	int nflakes;
 	uint8_t col[3];
+	uint32_t seed;	// instance seed for counter based random numbers
 
 } SnowData;
 
@@ -67,12 +68,17 @@ static void VS_CC snowInit(VSMap* in, VSMap* out, void** instanceData,
 
 	d->sy = d->degree + d->nflakes;
 
+	uint32_t nf = (uint32_t)(d->EndFrame - d->StartFrame);
+	d->seed = (nf * nf * nf) | 1;
+	RandomSequence rs;
+	startRandomSequence(&rs, d->seed);
+
 	for (int i = 0; i < d->nflakes; i++)
 	{
 
-		d->degree[i] = rand() % 360;
+		d->degree[i] = nextRandom(&rs, 360);
 
-		d->sy[i] = rand() % d->cell;
+		d->sy[i] = nextRandom(&rs, d->cell);
 
 	}
 	if (d->vi->format->colorFamily == cmRGB)
@@ -203,6 +209,7 @@ static const VSFrameRef* VS_CC snowGetFrame(int in, int activationReason, void**
 		float fps = (float)(d->vi->fpsNum / d->vi->fpsDen);
 		float yspeed = ((100 - d->fall) * fps) / 100;	// numb of frames  to fall by arbitrary choice
 		int maxdx = (d->cell * d->drift) / 100;
+		uint32_t key = randomKey(d->seed, n);
 
 		for (int i = 0; i < nh; i++)
 		{
@@ -212,8 +219,8 @@ static const VSFrameRef* VS_CC snowGetFrame(int in, int activationReason, void**
 				float radian = (float)((d->degree[(i * nw + j) % d->nflakes])
 					/ M_PI + (2.0 * n / fps));	// 2*fps is arbitrary choice
 
-				int yy = 8 + (int)(d->cell * i + d->sy[(i * nw + j) % d->nflakes] + n * d->deltay + (rand() % 4)) % (ht - 16);	// avoid access violation. enables fold back
-				int xx = 8 + (int)((d->cell * (j)) + maxdx * sin(radian) + (rand() % 4)) % (wd - 16);	// avoid access violation and enable foldback
+				int yy = 8 + (int)(d->cell * i + d->sy[(i * nw + j) % d->nflakes] + n * d->deltay + randomInRange(key, i, 2 * j, 4)) % (ht - 16);	// avoid access violation. enables fold back
+				int xx = 8 + (int)((d->cell * (j)) + maxdx * sin(radian) + randomInRange(key, i, 2 * j + 1, 4)) % (wd - 16);	// avoid access violation and enable foldback
 				if (yy > 8 && xx > 8 && yy - 8 < ht && xx - 8 < wd)
 				{
 					for (int p = 0; p < np; p++)
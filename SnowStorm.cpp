@@ -33,6 +33,16 @@ typedef struct {
 	uint8_t col[3];
 
 } SnowStormData;
+
+// flakes of which random numbers are drawn together
+#define SNOW_CHUNK 1024
+
+// columns of numbers flakes of frame n, sorted by row. rowStart has ht entries
+void snowFlakes(int* flakes, int* rowStart, int numbers, int n, int wd, int ht, ScratchArena* scratch);
+// each flake whitens its sample and the ones right and below
+template <typename finc>
+void snowStamp(const FramePlane* pl, int np, const finc* col, const int* flakes, const int* rowStart, int nrows);
+
 static void VS_CC snowstormInit(VSMap* in, VSMap* out, void** instanceData, 
 		VSNode* node, VSCore* core, const VSAPI* vsapi) {
     SnowStormData* d = (SnowStormData*)*instanceData;
@@ -53,6 +63,100 @@ static void VS_CC snowstormInit(VSMap* in, VSMap* out, void** instanceData,
 
 }
 
+//----------------------------------------------------------------------------------------------
+// v % d for v of 0 to 2^31 + frames. Quotient from double may be one off, so is corrected
+static inline int snowMod(int64_t v, int d, double rd)
+{
+	int r = (int)(v - (int64_t)(v * rd) * d);
+
+	r += r < 0 ? d : 0;
+	return r >= d ? r - d : r;
+}
+
+void snowFlakes(int* flakes, int* rowStart, int numbers, int n, int wd, int ht, ScratchArena* scratch)
+{
+	// key does not change with frame
+	uint32_t key = randomKey((2 << 16) - 1, 0);
+	int* ys = scratchAlloc<int>(scratch, sizeof(int) * numbers);
+	int* xs = scratchAlloc<int>(scratch, sizeof(int) * numbers);
+	uint32_t* rnd = scratchAlloc<uint32_t>(scratch, sizeof(uint32_t) * 2 * SNOW_CHUNK);
+	double rht = 1.0 / (ht - 1), rwd = 1.0 / (wd - 1);
+	// flakes are on rows 0 to ht - 2
+	int nrows = ht - 1;
+
+	for (int y = 0; y <= nrows; y++)
+		rowStart[y] = 0;
+
+	for (int i0 = 0; i0 < numbers; i0 += SNOW_CHUNK)
+	{
+		int cnt = VSMIN(SNOW_CHUNK, numbers - i0);
+		// values 2 * i and 2 * i + 1 are y and x of flake i
+		fillRandom(rnd, 2 * cnt, key, 0, 2 * i0);
+
+		// n is to give continuous motion illusion.
+		// as each frame we use the same key, random numbers would be identical
+		for (int k = 0; k < cnt; k++)
+		{
+			ys[i0 + k] = snowMod((int64_t)n + (rnd[2 * k] >> 1), ht - 1, rht);
+			xs[i0 + k] = snowMod((int64_t)n + (rnd[2 * k + 1] >> 1), wd - 1, rwd);
+		}
+		for (int k = 0; k < cnt; k++)
+			rowStart[ys[i0 + k] + 1]++;
+	}
+	// counting sort by row
+	for (int y = 0; y < nrows; y++)
+		rowStart[y + 1] += rowStart[y];
+	int* next = scratchAlloc<int>(scratch, sizeof(int) * nrows);
+
+	for (int y = 0; y < nrows; y++)
+		next[y] = rowStart[y];
+
+	for (int i = 0; i < numbers; i++)
+		flakes[next[ys[i]]++] = xs[i];
+}
+
+// a row of flakes at a time, so that the rows written stay in cache
+template <typename finc>
+void snowStamp(const FramePlane* pl, int np, const finc* col, const int* flakes, const int* rowStart, int nrows)
+{
+	for (int y = 0; y < nrows; y++)
+	{
+		const int* f = flakes + rowStart[y];
+		int nf = rowStart[y + 1] - rowStart[y];
+
+		for (int p = 0; p < np; p++)
+		{
+			int pitch = pl[p].pitch, subW = pl[p].subW, subH = pl[p].subH;
+			finc* dp = (finc*)pl[p].dp + (y >> subH) * pitch;
+			finc c = col[p];
+
+			if (subW == 0 && subH == 0)
+			{
+				for (int i = 0; i < nf; i++)
+				{
+					dp[f[i]] = c;
+					dp[f[i] + 1] = c;
+					dp[f[i] + pitch] = c;
+				}
+				continue;
+			}
+			// subsampled. Samples already written by same flake are skipped
+			bool below = ((y + 1) >> subH) != (y >> subH);
+
+			for (int i = 0; i < nf; i++)
+			{
+				int cx = f[i] >> subW;
+				dp[cx] = c;
+
+				if (((f[i] + 1) >> subW) != cx)
+					dp[cx + 1] = c;
+				if (below)
+					dp[cx + pitch] = c;
+			}
+		}
+	}
+}
+
 //----------------------------------------------------------------------------------------------
 static const VSFrameRef* VS_CC snowstormGetFrame(int in, int activationReason, void** instanceData,
 					void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi)
@@ -77,24 +181,8 @@ static const VSFrameRef* VS_CC snowstormGetFrame(int in, int activationReason, v
 		VSFrameRef* dst = vsapi->copyFrame(src, core);		
 		int nbytes = fi->bytesPerSample;
 		int nbits = fi->bitsPerSample;
-		int nb = fi->bitsPerSample;
-		int subH[] = { 0,fi->subSamplingH, fi->subSamplingH };
-		int subW[] = { 0,fi->subSamplingW, fi->subSamplingW };
-
-		int andH = ( 1 << subH[1]) - 1;
-		int andW = (1 << subW[1]) - 1;
-		int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;		
-
-		uint8_t* dp[] = { NULL, NULL, NULL, NULL };
-		//const uint8_t* sp[] = { NULL, NULL, NULL, NULL };
-		int pitch[] = { 0,0,0 };		
-		
-		for (int p = 0; p < np; p++)
-		{
-			//sp[p] = vsapi->getReadPtr(src, p);
-			dp[p] = vsapi->getWritePtr(dst, p);
-			pitch[p] = vsapi->getStride(dst, p) / nbytes;			
-		}
+		FramePlane pl[3];
+		int np = getFramePlanes(pl, dst, NULL, vsapi);
 						// now create snowstorm
 		
 		int maxnum = (ht * wd) >> 3;
@@ -116,58 +204,39 @@ static const VSFrameRef* VS_CC snowstormGetFrame(int in, int activationReason, v
 			numbers = numbers + (n * (minnum - numbers)) / nframes;
 		// else if d->type[1] == 2 constant
 
-		srand((2 << 16) - 1);
+		ScratchArena* scratch = scratchBegin();
+		int* flakes = scratchAlloc<int>(scratch, sizeof(int) * numbers);
+		int* rowStart = scratchAlloc<int>(scratch, sizeof(int) * ht);
 
-		for (int i = 0; i < numbers; i++)
-		{
-			// n is to give continuous motion illusion.
-			// as each frame we are initializing rand, random numbers would be identical
-			int yoffset = (n + rand()) % (ht - 1);
-			int xoffset = (n + rand()) % (wd - 1);
+		snowFlakes(flakes, rowStart, numbers, n, wd, ht, scratch);
 
+		if (nbytes == 1)
+			snowStamp(pl, np, d->col, flakes, rowStart, ht - 1);
+		else if (nbytes == 2)
+		{
+			uint16_t col[3];
+			for (int p = 0; p < np; p++)
+				col[p] = d->col[p] << (nbits - 8);
+			snowStamp(pl, np, col, flakes, rowStart, ht - 1);
+		}
+		else
+		{
+			float col[3];
 			for (int p = 0; p < np; p++)
 			{
-				if (fi->sampleType == stInteger && nbytes == 1)
-				{
-					unsigned char* dpp = dp[p];
-					uint8_t col = d->col[p];
-
-					*(dpp + (yoffset >> subH[p]) * pitch[p] + (xoffset >> subW[p])) = col;
-					*(dpp + ((yoffset + 1) >> subH[p]) * pitch[p] + (xoffset >> subW[p])) = col;
-					*(dpp + (yoffset >> subH[p]) * pitch[p] + ((xoffset + 1) >> subW[p])) = col;
-
-				}
+				col[p] = (d->col[p]) / 255.0f;
 
-				else if (fi->sampleType == stInteger && nbytes == 2)
+				if (fi->colorFamily == cmYUV)
 				{
-					uint16_t* dpp = (uint16_t*)(dp[p]);
-					uint16_t col = d->col[p] << (nbits - 8);
-
-					*(dpp + (yoffset >> subH[p]) * pitch[p] + (xoffset >> subW[p])) = col;
-					*(dpp + ((yoffset + 1) >> subH[p]) * pitch[p] + (xoffset >> subW[p])) = col;
-					*(dpp + (yoffset >> subH[p]) * pitch[p] + ((xoffset + 1) >> subW[p])) = col;
-
+					if (p == 0)
+						col[p] = ((d->col[p]) - 16) / 235.0f;
+					else
+						col[p] = ((d->col[p]) - 128) / 235.0f;
 				}
-
-				if (fi->sampleType == stFloat && nbytes == 4)
-				{
-					float* dpp = (float*)(dp[p]);
-					float col = (d->col[p]) / 255.0f;
-
-					if (fi->colorFamily == cmYUV)
-						if (p == 0)
-							col = ((d->col[p]) - 16) / 235.0f;
-						else
-							col = ((d->col[p]) - 128) / 235.0f;
-
-					*(dpp + (yoffset >> subH[p]) * pitch[p] + (xoffset >> subW[p])) = col;
-					*(dpp + ((yoffset + 1) >> subH[p]) * pitch[p] + (xoffset >> subW[p])) = col;
-					*(dpp + (yoffset >> subH[p]) * pitch[p] + ((xoffset + 1) >> subW[p])) = col;
-
-				}
-
 			}
-		}		
+			snowStamp(pl, np, col, flakes, rowStart, ht - 1);
+		}
+		scratchEnd(scratch);
 		
 		vsapi->freeFrame( src);
 		return (dst);
@@ -224,7 +293,7 @@ static void VS_CC snowstormCreate(const VSMap* in, VSMap* out, void* userData, V
 	}
 
 	int temp = vsapi->propNumElements(in, "type");
-	if (temp == 0)
+	if (temp <= 0)
 	{
 		d.type[0] = 1;
 		d.type[1] = 1;
@@ -51,9 +51,12 @@ static void VS_CC sparklerInit(VSMap* in, VSMap* out, void** instanceData,
 	d->nbeams = 64;
 	d->xy = (int*)vs_aligned_malloc(sizeof(int) * d->nbeams, 32);
 
+	RandomSequence rs;
+	startRandomSequence(&rs, (uint32_t)d->radius | 1);
+
 	for (int i = 0; i < d->nbeams; i++)
 	{
-		d->xy[i] = (rand() % (3 * d->radius) / 4) + d->radius / 4;
+		d->xy[i] = (nextRandom(&rs, 3 * d->radius) / 4) + d->radius / 4;
 		if ((i % 4) > 1) d->xy[i] = -d->xy[i];
 	}
 	d->span = d->radius / 4;
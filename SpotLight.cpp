@@ -370,7 +370,7 @@ static void VS_CC spotlightCreate(const VSMap* in, VSMap* out, void* userData,
 		return;
 	}
 	int temp = vsapi->propNumElements(in, "rgb");
-	if (temp == 0)
+	if (temp <= 0)
 	{
 		d.rgb[0] = 255;
 		d.rgb[1] = 255;
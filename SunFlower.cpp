@@ -38,55 +38,101 @@ typedef struct {
 	float grav, persist;
 
 	uint8_t* rayColors;
+	uint32_t seed;	// instance seed for counter based random numbers
 } SunFlowerData;
 
 
 
-template <typename finc>
-void drawRaysSunFlower(finc** dp, int* dpitch, int* subW, int* subH,
-	int radius1, int radius2, int radmax, int x, int y, int wd, int ht,
-	float alfa, float gravity, int np, finc* col, bool embers);
-
+// points of a ray from radius1 to radius2 at angle alfa, bent down by gravity, as
+// particles of color id. Embers are every third of ray length only
+void sunflowerRay(Particles* ps, int radius1, int radius2, int radmax, int x, int y,
+	float alfa, float gravity, int id, bool embers);
 	
 //--------------------------------------------------------------------------------------------
-
-template <typename finc>
-void drawRaysSunFlower(finc** dp, int* dpitch, int* subW, int* subH,
-	int radius1, int radius2, int radmax, int x, int y, int wd, int ht,
-	float alfa, float gravity, int np, finc * col, bool embers)
-	
+#ifdef VFX_X86_SIMD
+// points r0, r0 + step, .. of a ray. Returns points done
+VFX_TARGET("sse4.1") int sunflowerRaySse41(int* px, int* py, int count, int r0, int step, int x, int y,
+	float ca, float sa, float gravity, float radmax)
 {
-	
-	for (int r = radius1; r < radius2; r++)
-	{
-		int rmod = (radius2 - radius1) / 3;
-
-		if (embers && (r % rmod) != 0) continue;	// (rand() % 20) < 16) continue;
+	const __m128 vca = _mm_set1_ps(ca), vsa = _mm_set1_ps(sa), vg = _mm_set1_ps(gravity), vrad = _mm_set1_ps(radmax);
+	const __m128d half = _mm_set1_pd(0.5);
+	const __m128i vx = _mm_set1_epi32(x), vy = _mm_set1_epi32(y);
+	const __m128i lanes = _mm_setr_epi32(0, step, 2 * step, 3 * step);
+	int k = 0;
 
-		int newx = (int)(r * cos(alfa) + 0.5);
+	for (; k + 4 <= count; k += 4)
+	{
+		__m128 r = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(r0 + k * step), lanes));
+		__m128 rc = _mm_mul_ps(r, vca), rs = _mm_mul_ps(r, vsa);
+		__m128 fall = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(vg, r), r), vrad);
+		// r * ca + 0.5 and r * sa + 0.5 + fall are in double, two lanes at a time
+		__m128d xlo = _mm_add_pd(_mm_cvtps_pd(rc), half);
+		__m128d xhi = _mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(rc, rc)), half);
+		__m128d ylo = _mm_add_pd(_mm_add_pd(_mm_cvtps_pd(rs), half), _mm_cvtps_pd(fall));
+		__m128d yhi = _mm_add_pd(_mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(rs, rs)), half), _mm_cvtps_pd(_mm_movehl_ps(fall, fall)));
+
+		_mm_storeu_si128((__m128i*)(px + k), _mm_add_epi32(vx, _mm_unpacklo_epi64(_mm_cvttpd_epi32(xlo), _mm_cvttpd_epi32(xhi))));
+		_mm_storeu_si128((__m128i*)(py + k), _mm_add_epi32(vy, _mm_unpacklo_epi64(_mm_cvttpd_epi32(ylo), _mm_cvttpd_epi32(yhi))));
+	}
+	return k;
+}
 
-		if (newx + x <= 0 || newx + x >= wd - 2)	// we will make line thick
-			continue;
+VFX_TARGET("avx2") int sunflowerRayAvx2(int* px, int* py, int count, int r0, int step, int x, int y,
+	float ca, float sa, float gravity, float radmax)
+{
+	const __m256 vca = _mm256_set1_ps(ca), vsa = _mm256_set1_ps(sa), vg = _mm256_set1_ps(gravity), vrad = _mm256_set1_ps(radmax);
+	const __m256d half = _mm256_set1_pd(0.5);
+	const __m256i vx = _mm256_set1_epi32(x), vy = _mm256_set1_epi32(y);
+	const __m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(step));
+	int k = 0;
 
-		int newy = (int)((r * sin(alfa) + 0.5) + (gravity * r * r) / radmax);
+	for (; k + 8 <= count; k += 8)
+	{
+		__m256 r = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(r0 + k * step), lanes));
+		__m256 rc = _mm256_mul_ps(r, vca), rs = _mm256_mul_ps(r, vsa);
+		__m256 fall = _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(vg, r), r), vrad);
+		// r * ca + 0.5 and r * sa + 0.5 + fall are in double, four lanes at a time
+		__m256d xlo = _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(rc)), half);
+		__m256d xhi = _mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(rc, 1)), half);
+		__m256d ylo = _mm256_add_pd(_mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(rs)), half),
+			_mm256_cvtps_pd(_mm256_castps256_ps128(fall)));
+		__m256d yhi = _mm256_add_pd(_mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(rs, 1)), half),
+			_mm256_cvtps_pd(_mm256_extractf128_ps(fall, 1)));
+
+		_mm256_storeu_si256((__m256i*)(px + k), _mm256_add_epi32(vx, _mm256_setr_m128i(_mm256_cvttpd_epi32(xlo), _mm256_cvttpd_epi32(xhi))));
+		_mm256_storeu_si256((__m256i*)(py + k), _mm256_add_epi32(vy, _mm256_setr_m128i(_mm256_cvttpd_epi32(ylo), _mm256_cvttpd_epi32(yhi))));
+	}
+	return k;
+}
+#endif
 
-		if (newy + y <= 1 || newy + y >= ht - 2)	// we will make line thick
-			continue;
+void sunflowerRay(Particles* ps, int radius1, int radius2, int radmax, int x, int y,
+	float alfa, float gravity, int id, bool embers)
+{
+	int rmod = (radius2 - radius1) / 3;
+	int step = embers ? rmod : 1;
+	int r0 = embers && rmod > 0 ? ((radius1 + rmod - 1) / rmod) * rmod : radius1;
 
-		for (int p = 0; p < np; p++)
-		{
-			for ( int i = 0; i < 2; i ++)
-			{
-				for (int j = 0; j < 2; j++)
-				{
-					// draw a thick line
-					*(dp[p] + ((y + newy + i) >> subH[p]) * dpitch[p] 
-						+ ((x + newx + j) >> subW[p]))
-						= col[p];
-				}				
-			}
-		}
+	if (step <= 0)
+		return;
+	const float ca = cos(alfa), sa = sin(alfa);
+	int* px = ps->x + ps->count, * py = ps->y + ps->count, * pid = ps->id + ps->count;
+	int count = radius2 > r0 ? (radius2 - r0 + step - 1) / step : 0;
+	int k = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_AVX2)
+		k = sunflowerRayAvx2(px, py, count, r0, step, x, y, ca, sa, gravity, (float)radmax);
+	else if (simdLevel >= SIMD_SSE41)
+		k = sunflowerRaySse41(px, py, count, r0, step, x, y, ca, sa, gravity, (float)radmax);
+#endif
+	for (int r = r0 + k * step; k < count; r += step, k++)
+	{
+		px[k] = x + (int)(r * ca + 0.5);
+		py[k] = y + (int)((r * sa + 0.5) + (gravity * r * r) / radmax);
 	}
+	for (int i = 0; i < count; i++)
+		pid[i] = id;
+	ps->count += count;
 }
 
 static void VS_CC sunflowerInit(VSMap* in, VSMap* out, void** instanceData,
@@ -95,6 +141,8 @@ static void VS_CC sunflowerInit(VSMap* in, VSMap* out, void** instanceData,
 	SunFlowerData* d = (SunFlowerData*)*instanceData;
 	vsapi->setVideoInfo(d->vi, 1, node);
 	const VSFormat* fi = d->vi->format;
+	uint32_t nf = (uint32_t)(d->EndFrame - d->StartFrame);
+	d->seed = (nf * nf * nf) | 1;
 
 	d->rayColors = (uint8_t*)vs_aligned_malloc(sizeof(float) * 8 * 3, 32);
 	
@@ -208,6 +256,7 @@ static const VSFrameRef* VS_CC sunflowerGetFrame(int in, int activationReason, v
 		int xcoord = d->startx + (n * (d->endx - d->startx)) / nframes;
 		int ycoord = d->starty + (n * (d->endy - d->starty)) / nframes;
 		uint8_t smoke[3];
+		uint32_t key = randomKey(d->seed, n);
 
 		// generate smoke
 		for (int h = ycoord - rsmoke; h < ycoord + rsmoke; h++)
@@ -220,19 +269,19 @@ static const VSFrameRef* VS_CC sunflowerGetFrame(int in, int activationReason, v
 				{
 					if (w > 2 && w < wd - 2)
 					{
-						int delta = rsmoke - rand() % (2 + rsmoke / 4);	// to create hazy boundary
+						int delta = rsmoke - randomInRange(key, 2 * h, w, 2 + rsmoke / 4);	// to create hazy boundary
 
 						if ((w - xcoord) * (w - xcoord) + (hsq) <= delta * delta)
 						{
 							if (fi->colorFamily == cmYUV)
 							{
-								smoke[0] = (rand() % 60) + 60;
+								smoke[0] = randomInRange(key, 2 * h + 1, w, 60) + 60;
 								smoke[1] = 127;
 								smoke[2] = 127;
 							}
 							else //RGB
 							{
-								smoke[0] = (rand() % 60) + 60;
+								smoke[0] = randomInRange(key, 2 * h + 1, w, 60) + 60;
 								smoke[1] = smoke[0];
 								smoke[2] = smoke[0];
 							}
@@ -267,63 +316,41 @@ static const VSFrameRef* VS_CC sunflowerGetFrame(int in, int activationReason, v
 			}
 		}
 		// create sunflower with 18 long and 18 short rays
+		ScratchArena* scratch = scratchBegin();
+		Particles ps;
+		particlesBegin(&ps, scratch, 36 * (VSMAX(lrayend - lraystart, 0) + VSMAX(srayend - sraystart, 0)));
+
 		for (int i = 0; i < 36; i++)
 		{
 			int lmod = (int)(4 * perception * len);
 			int smod = (int)(4 * perception * slen);
 
-			bool embers1 = lraystart > d->radmax - rand() % lmod ? true : false;
-			bool embers2 = sraystart > d->radmax / 2 - rand() % smod ? true : false;
+			// rows of smoke are even and odd streams. rays use streams beyond frame height
+			bool embers1 = lraystart > d->radmax - randomInRange(key, 2 * ht, 2 * i, lmod) ? true : false;
+			bool embers2 = sraystart > d->radmax / 2 - randomInRange(key, 2 * ht, 2 * i + 1, smod) ? true : false;
 
 			float alfa = (float)((M_PI * i * 10) / 180.0f);
 			float alfa2 = (float)(M_PI * ((35 - i) * 10 + 5.0f)) / 180.0f;			
+			// As our color array 0th is grey and 1 to 6 are colors and 7 is white
+			int rayCol = d->color ? i % 7 + 1 : 7;
 
-			if (fi->sampleType == stInteger && nbytes == 1)
-			{
-				// As our color array 0th is grey and 1 to 6 are colors and 7 is white
-				uint8_t* rayCol = d->rayColors + 3 * (i % 7) + 3;
-				if (!d->color)
-					rayCol = d->rayColors + 21;
-
-				// long rays	
-				drawRaysSunFlower(dp, pitch, subW, subH, lraystart, lrayend, d->radmax,
-					xcoord, ycoord, wd, ht, alfa, gravity, np, rayCol, embers1);
-				// short rays
-				drawRaysSunFlower(dp, pitch, subW, subH, sraystart, srayend, d->radmax,
-					xcoord, ycoord, wd, ht, alfa2, gravity2, np, rayCol, embers2);
-			}
-			else if (fi->sampleType == stInteger && nbytes == 2)
-			{
-				// As our color array 0th is grey and 1 to 6 are colors and 7 is white
-				uint16_t* rayCol = (uint16_t*)d->rayColors + 3 * (i % 7) + 3;
-				uint16_t** dpp = (uint16_t**)dp;
-				if (!d->color)
-					rayCol = (uint16_t*)d->rayColors + 21;
-
-				// long rays	
-				drawRaysSunFlower(dpp, pitch, subW, subH, lraystart, lrayend, d->radmax,
-					xcoord, ycoord, wd, ht, alfa, gravity, np, rayCol, embers1);
-				// short rays
-				drawRaysSunFlower(dpp, pitch, subW, subH, sraystart, srayend, d->radmax,
-					xcoord, ycoord, wd, ht, alfa2, gravity2, np, rayCol, embers2);
-			}
-			else if (fi->sampleType == stFloat && nbytes == 4)
-			{
-				// As our color array 0th is grey and 1 to 6 are colors and 7 is white
-				float* rayCol = (float*)d->rayColors + 3 * (i % 7) + 3;
-				float** dpp = (float**)dp;
-				if (!d->color)
-					rayCol = (float*)d->rayColors + 21;
-
-				// long rays	
-				drawRaysSunFlower(dpp, pitch, subW, subH, lraystart, lrayend, d->radmax,
-					xcoord, ycoord, wd, ht, alfa, gravity, np, rayCol, embers1);
-				// short rays
-				drawRaysSunFlower(dpp, pitch, subW, subH, sraystart, srayend, d->radmax,
-					xcoord, ycoord, wd, ht, alfa2, gravity2, np, rayCol, embers2);
-			}
-
-		}			
+			// long rays	
+			sunflowerRay(&ps, lraystart, lrayend, d->radmax, xcoord, ycoord, alfa, gravity, rayCol, embers1);
+			// short rays
+			sunflowerRay(&ps, sraystart, srayend, d->radmax, xcoord, ycoord, alfa2, gravity2, rayCol, embers2);
+		}
+		// rays are made thick
+		particlesCull(&ps, 0, 1, wd - 2, ht - 2);
+		FramePlane pl[3];
+		getFramePlanes(pl, dst, NULL, vsapi);
+
+		if (nbytes == 1)
+			particlesStamp(pl, np, &ps, d->rayColors, 2, 2, PARTICLE_CHROMA_COVER);
+		else if (nbytes == 2)
+			particlesStamp(pl, np, &ps, (uint16_t*)d->rayColors, 2, 2, PARTICLE_CHROMA_COVER);
+		else
+			particlesStamp(pl, np, &ps, (float*)d->rayColors, 2, 2, PARTICLE_CHROMA_COVER);
+		scratchEnd(scratch);
 		
 		vsapi->freeFrame( src);
 		return (dst);
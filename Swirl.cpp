@@ -3,7 +3,8 @@ Swirl is a function for vfx, a vapoursynth plugin
  . Selected part of Image  swirls in the direction specified.
 Thickness controls coarseness of image. Smaller it is it will be finer but slower. The swirl
 radius increases from zero at first frame to maximum (radius) specified for grow% length and
-swirls till steady% length and decreases to zero at end. Thread safe
+swirls till steady% length and decreases to zero at end. Rotation angle of each distance from
+center is tabled once a frame and every pixel of swirl is drawn once. Thread safe
 
 Author V.C.Mohan.
 Date 9 April 2021
@@ -39,71 +40,192 @@ typedef struct {
 	int grow;		// swirl radius grows to radmax upto this frame
 	int steady;		// swirl radius remains constant till this frame.
 					// After this it decreases to zero
+	int intp;		// sampling. 0 nearest, 1 bilinear, 2 bicubic
+	int span;		// interpolation taps. 0 for nearest
+	int quantiles;
+	float* coeff;	// interpolation coefficients
+	int16_t* q14Coeff;	// same for 8 bit in integer. NULL for other formats
+	int threads;	// threads doing bands of rows of a frame
 } SwirlData;
 
-template <typename finc>
-void rotateRing(finc** dp, const finc** sp, int* pitch,
-	int wd, int ht, int* subW, int* subH, int np,
-	int radius, int thickness, int cx, int cy, float alfa);
+// swirl of a frame, for bands of its rows
+typedef struct {
+	const FramePlane* pl;
+	int np;
+	const SwirlData* d;
+	const float* cosr;
+	const float* sinr;
+	int radius;
+	int cmin;
+} SwirlBand;
 
 template <typename finc>
-void rotateRing(finc** dp, const finc** sp, int* pitch,
-	int wd, int ht, int* subW, int* subH, int np,
-	int radius, int thickness, int cx, int cy, float alfa)
+void swirlPlanes(const FramePlane* pl, int np, const VSFormat* fi, const SwirlData* d,
+	const float* cosr, const float* sinr, int radius, int cmin, int wd, int ht, int y0, int y1);
+// all planes in rows row0 to row1 - 1
+static void swirlBand(void* work, int row0, int row1);
+
+// swirls np planes of same size, at their own resolution. cosr and sinr are indexed by
+// distance from center rounded up. Distances cmin to radius swirl. Geometry is at the
+// luma position of a sample. Luma size planes are interpolated if asked. Only luma rows
+// y0 to y1 - 1 are done
+template <typename finc>
+void swirlPlanes(const FramePlane* pl, int np, const VSFormat* fi, const SwirlData* d,
+	const float* cosr, const float* sinr, int radius, int cmin, int wd, int ht, int y0, int y1)
 {
-	int sx = VSMAX(cx - radius, 0);
-	int ex = VSMIN(cx + radius, wd - 2);
-	int sy = VSMAX(cy - radius,0 );
-	int ey = VSMIN(cy + radius, ht - 2);
+	int cx = d->sx, cy = d->sy;
 	int rsq = radius * radius;
-	int ring = (radius - thickness);
-	if (ring <= thickness) return;
-	int ringsq = ring * ring;
+	int clearsq = (cmin - 1) * (cmin - 1);
 
-	int andH = (1 << subH[1]) - 1;
-	int andW = (1 << subW[1]) - 1;
-	float sinalfa = sin(alfa);
-	float cosalfa = cos(alfa);
+	finc* dp[] = { (finc*)pl[0].dp, np > 1 ? (finc*)pl[1].dp : NULL, np > 2 ? (finc*)pl[2].dp : NULL };
+	const finc* sp[] = { (const finc*)pl[0].sp, np > 1 ? (const finc*)pl[1].sp : NULL, np > 2 ? (const finc*)pl[2].sp : NULL };
+	int pitch = pl[0].pitch;
+	int subW = pl[0].subW, subH = pl[0].subH;
+	bool interpolate = d->span > 0 && subW == 0 && subH == 0;
+	int span2 = d->span / 2;
+	finc min[3], max[3];
 
-	for (int h = sy; h < ey; h++)
+	for (int p = 0; p < np; p++)
+	{
+		if (sizeof(finc) == 4)
+		{
+			// U, V float planes are centered on 0
+			bool uv = p > 0 && fi->colorFamily == cmYUV;
+			min[p] = (finc)(uv ? -0.5f : 0.0f);
+			max[p] = (finc)(uv ? 0.5f : 1.0f);
+		}
+		else
+		{
+			min[p] = 0;
+			max[p] = (finc)((1 << fi->bitsPerSample) - 1);
+		}
+	}
+	int wstart = planeStart(VSMAX(cx - radius, 0), subW), wend = planeStart(VSMIN(cx + radius, wd - 2), subW);
+	int hstart = planeStart(VSMAX(cy - radius, y0), subH), hend = planeStart(VSMIN(cy + radius, VSMIN(ht - 2, y1)), subH);
+	// interpolated samples of a span are done as a batch
+	int maxn = VSMAX(wend - wstart, 0) + 1;
+	ScratchArena* scratch = scratchBegin();
+	int* offs = scratchAlloc<int>(scratch, sizeof(int) * maxn);
+	int* qxs = scratchAlloc<int>(scratch, sizeof(int) * maxn);
+	int* qys = scratchAlloc<int>(scratch, sizeof(int) * maxn);
+	int* wps = scratchAlloc<int>(scratch, sizeof(int) * maxn);
+	float* out = scratchAlloc<float>(scratch, sizeof(float) * maxn);
+	int* iout = scratchAlloc<int>(scratch, sizeof(int) * maxn);
+
+	for (int hp = hstart; hp < hend; hp++)
 	{
+		int h = hp << subH;	// luma coordinates
 		int hsq = (cy - h) * (cy - h);
+		int x0[2], x1[2];
+		int nspans = ringRowSpans(x0, x1, cx, rsq, clearsq, h - cy, subW, wstart, wend);
 
-		for (int w = sx; w < ex; w++)
+		for (int k = 0; k < nspans; k++)
 		{
-			if (hsq + (cx - w) * (cx - w) <= rsq
-				&& hsq + (cx - w) * (cx - w) > ringsq)
+			int n = 0;
+			int c = isqrt(hsq + (cx - (x0[k] << subW)) * (cx - (x0[k] << subW)));
+
+			for (int wp = x0[k], w = x0[k] << subW; wp < x1[k]; wp++, w += 1 << subW)
 			{
-				float newx = (cx - w) * cosalfa - (cy - h) * sinalfa;
+				int dsq = hsq + (cx - w) * (cx - w);
+				// distance rounded up. It changes little along a row
+				while (c * c < dsq)
+					c++;
+				while (c > 0 && (c - 1) * (c - 1) >= dsq)
+					c--;
+				float newx = (cx - w) * cosr[c] - (cy - h) * sinr[c];
+				float newy = (cx - w) * sinr[c] + (cy - h) * cosr[c];
+
+				if (interpolate)
+				{
+					float fx = newx + cx, fy = newy + cy;
+					int x = (int)floorf(fx), y = (int)floorf(fy);
+
+					if (x >= span2 - 1 && x < wd - span2 && y >= span2 - 1 && y < ht - span2)
+					{
+						offs[n] = y * pitch + x;
+						qxs[n] = (int)((fx - x) * d->quantiles);
+						qys[n] = (int)((fy - y) * d->quantiles);
+						wps[n++] = wp;
+						continue;
+					}
+					// near frame edges take nearest
+				}
 				int x = (int)newx + cx;
-				float newy = (cx - w) * sinalfa + (cy - h) * cosalfa;
 				int y = (int)newy + cy;
 
 				if (y >= 0 && y < ht && x >= 0 && x < wd)
 				{
+					for (int p = 0; p < np; p++)
+						*(dp[p] + hp * pitch + wp) = *(sp[p] + (y >> subH) * pitch + (x >> subW));
+				}
+			}
+			for (int p = 0; p < np && n > 0; p++)
+			{
+				if (sizeof(finc) == 1 && d->q14Coeff != NULL)
+				{
+					LaQuantileBatchQ14(iout, (const uint8_t*)sp[p], pitch, offs, qxs, qys, n, d->span, d->q14Coeff);
 
-					*(dp[0] + h * pitch[0] + w) = *(sp[0] + y * pitch[0] + x);
-					if ((h & andH) == 0 && (w & andW) == 0)
-					{
-						for (int p = 1; p < np; p++)
-						{
-							*(dp[p] + (h >> subH[p]) * pitch[p] + (w >> subW[p]))
-								= *(sp[p] + (y >> subH[p]) * pitch[p] + (x >> subW[p]));
-						}
-					}
+					for (int i = 0; i < n; i++)
+						dp[p][hp * pitch + wps[i]] = iclamp(iout[i], min[p], max[p]);
+					continue;
 				}
+				LaQuantileBatch(out, sp[p], pitch, offs, qxs, qys, n, d->span, d->coeff);
+
+				for (int i = 0; i < n; i++)
+					dp[p][hp * pitch + wps[i]] = clamp(out[i], min[p], max[p]);
 			}
 		}
 	}
+	scratchEnd(scratch);
 }
 
+static void swirlBand(void* work, int row0, int row1)
+{
+	const SwirlBand* b = (const SwirlBand*)work;
+	const SwirlData* d = b->d;
+	const VSFormat* fi = d->vi->format;
+	int nfull = lumaSizePlanes(b->pl, b->np);
+	// luma size planes, then subsampled ones at own size
+	for (int p = 0; p < b->np; p += nfull, nfull = b->np - nfull)
+	{
+		if (fi->bytesPerSample == 1)
+			swirlPlanes<uint8_t>(b->pl + p, nfull, fi, d, b->cosr, b->sinr, b->radius, b->cmin,
+				d->vi->width, d->vi->height, row0, row1);
+		else if (fi->bytesPerSample == 2)
+			swirlPlanes<uint16_t>(b->pl + p, nfull, fi, d, b->cosr, b->sinr, b->radius, b->cmin,
+				d->vi->width, d->vi->height, row0, row1);
+		else
+			swirlPlanes<float>(b->pl + p, nfull, fi, d, b->cosr, b->sinr, b->radius, b->cmin,
+				d->vi->width, d->vi->height, row0, row1);
+	}
+}
 
 static void VS_CC swirlInit(VSMap* in, VSMap* out, void** instanceData,
 	VSNode* node, VSCore* core, const VSAPI* vsapi)
 {
 	SwirlData* d = (SwirlData*)*instanceData;
 	vsapi->setVideoInfo(d->vi, 1, node);
-	const VSFormat* fi = d->vi->format;
+
+	d->coeff = NULL;
+	d->q14Coeff = NULL;
+	d->span = d->intp == 0 ? 0 : d->intp == 1 ? 2 : 4;
+
+	if (d->span > 0)
+	{
+		d->quantiles = 64;
+		d->coeff = (float*)vs_aligned_malloc(sizeof(float) * (d->quantiles + 1) * d->span, 32);
+
+		if (d->span == 2)
+			LinearIntCoeff(d->coeff, d->quantiles);
+		else
+			CubicIntCoeff(d->coeff, d->quantiles);
+
+		if (d->vi->format->sampleType == stInteger && d->vi->format->bitsPerSample == 8)
+		{
+			d->q14Coeff = (int16_t*)vs_aligned_malloc(sizeof(int16_t) * (d->quantiles + 1) * d->span, 32);
+			Q14Coeff(d->q14Coeff, d->coeff, d->span, d->quantiles + 1);
+		}
+	}
 }
 //----------------------------------------------------------------------------------------------
 static const VSFrameRef* VS_CC swirlGetFrame(int in, int activationReason, void** instanceData,
@@ -122,66 +244,48 @@ static const VSFrameRef* VS_CC swirlGetFrame(int in, int activationReason, void*
 		int n = in - d->StartFrame;
 		int nframes = d->EndFrame - d->StartFrame + 1;
 
-		const VSFormat* fi = d->vi->format;
 		int ht = d->vi->height;
-		int wd = d->vi->width;		
 
 		VSFrameRef* dst = vsapi->copyFrame(src, core);		
-		int nbytes = fi->bytesPerSample;
-		int nbits = fi->bitsPerSample;
-		int nb = fi->bitsPerSample;
-		int subH[] = { 0,fi->subSamplingH, fi->subSamplingH };
-		int subW[] = { 0,fi->subSamplingW, fi->subSamplingW };
-
-		int andH = ( 1 << subH[1]) - 1;
-		int andW = (1 << subW[1]) - 1;
-		int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;		
-
-		uint8_t* dp[] = { NULL, NULL, NULL, NULL };
-		const uint8_t* sp[] = { NULL, NULL, NULL, NULL };
-		int pitch[] = { 0,0,0 };		
-		
-		for (int p = 0; p < np; p++)
-		{
-			sp[p] = vsapi->getReadPtr(src, p);
-			dp[p] = vsapi->getWritePtr(dst, p);
-			pitch[p] = vsapi->getStride(dst, p) / nbytes;			
-		}
-
+		FramePlane pl[3];
+		int np = getFramePlanes(pl, dst, src, vsapi);
 		int growth = (d->grow * nframes) / 100;
 		int steady = (d->steady * nframes) / 100;
 						// now create swirl		
 		int radius =  n < growth ? ( n * d->radmax) / growth
-			: n < steady ? d->radmax : d->radmax * ( nframes - n) / (nframes - d->steady);
+			: n < steady ? d->radmax : d->radmax * ( nframes - n) / (nframes - steady);
+		// rings of thick pixels every thick / 2 from radius inwards. Drawn from outside in,
+		// inner ring decides angle of a distance. Ring of radius i covers i - thick < dist <= i
+		int ilast = radius;
 
-		for (int i = radius ; i > d->thick; i -= d->thick / 2)
-		//for (int i = 2 * d->thick; i < radius; i += d->thick / 2)
-		{			
-			float alfa = (float)(M_PI * i * n) / 180.0f;
-			if (d->dir)
-				alfa = -alfa;						
+		while (ilast - d->thick / 2 > 2 * d->thick)
+			ilast -= d->thick / 2;
 
-			if (fi->sampleType == stInteger && nbytes == 1)
-			{
-				rotateRing(dp, sp, pitch,
-					wd, ht, subW, subH, np,
-					i, d->thick, d->sx, d->sy, alfa);
-			}
-			else if (fi->sampleType == stInteger && nbytes == 2)
-			{
-				rotateRing((uint16_t**)dp, (const uint16_t**)sp, pitch,
-					wd, ht, subW, subH, np,
-					i, d->thick, d->sx, d->sy, alfa);
-			}
-			else if (fi->sampleType == stFloat && nbytes == 4)
+		if (ilast > 2 * d->thick)
+		{
+			int cmin = ilast - d->thick + 1;
+			ScratchArena* scratch = scratchBegin();
+			float* cosr = scratchAlloc<float>(scratch, sizeof(float) * 2 * (radius + 1));
+			float* sinr = cosr + radius + 1;
+
+			for (int i = radius; i >= ilast; i -= d->thick / 2)
 			{
+				float alfa = (float)(M_PI * i * n) / 180.0f;
+				if (d->dir)
+					alfa = -alfa;
+				float cosalfa = cos(alfa), sinalfa = sin(alfa);
 
-				rotateRing((float**)dp, (const float**)sp, pitch,
-					wd, ht, subW, subH, np,
-					i, d->thick, d->sx, d->sy, alfa);
+				for (int c = i - d->thick + 1; c <= i; c++)
+				{
+					cosr[c] = cosalfa;
+					sinr[c] = sinalfa;
+				}
 			}
-
-		}			
+			// in bands of rows
+			SwirlBand band = { pl, np, d, cosr, sinr, radius, cmin };
+			bandsRun(d->threads, ht, swirlBand, &band);
+			scratchEnd(scratch);
+		}
 		
 		vsapi->freeFrame( src);
 		return (dst);
@@ -193,6 +297,11 @@ static const VSFrameRef* VS_CC swirlGetFrame(int in, int activationReason, void*
 static void VS_CC swirlFree(void* instanceData, VSCore* core, const VSAPI* vsapi) {
     SwirlData* d = (SwirlData*)instanceData;
     vsapi->freeNode(d->node);
+	if (d->coeff != NULL)
+		vs_aligned_free(d->coeff);
+	if (d->q14Coeff != NULL)
+		vs_aligned_free(d->q14Coeff);
+    bandsDetach();
     free(d);
 }
 
@@ -307,10 +416,32 @@ static void VS_CC swirlCreate(const VSMap* in, VSMap* out, void* userData,
 	else
 		d.dir = true;
 
+
+	d.intp = int64ToIntS(vsapi->propGetInt(in, "intp", 0, &err));
+	if (err)
+		d.intp = 0;
+	else if (d.intp < 0 || d.intp > 2)
+	{
+		vsapi->setError(out, "Swirl: intp can be 0 for nearest, 1 for bilinear or 2 for bicubic sampling");
+		vsapi->freeNode(d.node);
+		return;
+	}
+
+	d.threads = int64ToIntS(vsapi->propGetInt(in, "threads", 0, &err));
+	if (err)
+		d.threads = 1;
+	else if (d.threads < 0 || d.threads > BAND_MAX_THREADS)
+	{
+		vsapi->setError(out, "Swirl: threads must be 1 to 64, or 0 for all cores");
+		vsapi->freeNode(d.node);
+		return;
+	}
+	d.threads = bandThreads(d.threads);
 		
     data = (SwirlData*)malloc(sizeof(d));
     *data = d;	
 
+    bandsAttach();
     vsapi->createFilter(in, out, "Swirl", swirlInit, swirlGetFrame, swirlFree, fmParallel, 0, data, core);
 }
 
@@ -320,7 +451,7 @@ static void VS_CC swirlCreate(const VSMap* in, VSMap* out, void* userData,
 VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegisterFunction registerFunc, VSPlugin* plugin) {
     configFunc("com.effects.vxf", "Swirl", "Effect swirl ", VAPOURSYNTH_API_VERSION, 1, plugin);
     registerFunc("Swirl", "clip:clip;sf:int:opt;ef:int:opt;rad:int:opt;x:int:opt;y:int:opt;"
-	"q:int:opt;dir:int:opt;grow:int:opt;steady:int:opt;", swirlCreate, 0, plugin);
+	"q:int:opt;dir:int:opt;grow:int:opt;steady:int:opt;intp:int:opt;", swirlCreate, 0, plugin);
 	
 }
 */
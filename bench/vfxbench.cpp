@@ -0,0 +1,910 @@
+/*---------------------------------------------------------------------------------------
+vfxbench measures throughput of vfx functions without a VapourSynth install.
+vfx.cpp is compiled into this program and VapourSynthPluginInit is called with a
+local stand in for VSAPI and VSCore. Each registered function is created on a
+synthetic clip with default arguments and its GetFrame is run over N frames.
+Report is JSON on stdout (or the -o file), progress goes to stderr.
+
+Build from the repository root, with VapourSynth.h and VSHelper.h on include path
+	g++ -O2 -std=c++17 -I. -I<vapoursynth include> bench/vfxbench.cpp -o vfxbench -lpthread
+
+Usage
+	vfxbench [-f Fog,Lens] [-F YUV420P8,RGBS] [-s 1080p,1024x768] [-n frames] [-t threads]
+		[-a vert=0,mag=2.5] [-S avx2] [-o file]
+
+	-f	functions to run. Default all registered
+	-F	formats. Gray8 YUV420P8 YUV420P10 YUV420P16 YUV444PS YUV420PS RGB24 RGBS. Default all
+	-s	sizes. 720p 1080p 4K 8K or WxH. Default all four
+	-n	frames timed per run, at least 2. Default 10
+	-t	threads calling GetFrame together as fmParallel would. Default 1
+	-a	arguments given to every function that has them. Type is as registered.
+		Elements of an array are separated by colons, as abc=0.1:0:-0.05
+	-S	highest instruction set used. none sse41 avx2 avx512. Default best of cpu
+
+Remap gets mapx and mapy of one GrayS frame, positions shifted by a fraction of a
+sample so that interpolation is used. Synthetic clip is BENCH_CLIP_FRAMES long (or N if more) so that defaults of
+functions that need a minimum duration are valid. Frames 0 to N - 1 are timed.
+Each run is made in a child process where fork is available, and a crash is
+reported as error of that run. ns_per_pixel is wall time divided by luma pixels
+of all timed frames. checksum is a hash of output of all frames so that two
+builds can be compared for changes in output as well as in speed.
+-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../vfx.cpp"
+
+#define BENCH_CLIP_FRAMES 100
+
+//-------------------------------------------------------------------------
+// stand in for core objects. VSAPI declares these as incomplete types
+struct VSCore { int dummy; };
+struct VSPlugin { int dummy; };
+struct VSFrameContext { int dummy; };
+
+typedef struct {
+	std::string key;
+	char type;	// i f n s
+	std::vector<int64_t> i;
+	std::vector<double> f;
+	std::vector<VSNodeRef*> n;
+	std::vector<std::string> s;
+} BenchProp;
+
+struct VSMap {
+	std::vector<BenchProp> props;
+	std::string error;
+};
+
+struct VSFrameRef {
+	const VSFormat* fi;
+	int width[3], height[3], stride[3];
+	uint8_t* data[3];
+	std::atomic<int> refs;
+};
+
+struct VSNode { VSNodeRef* ref; };
+
+struct VSNodeRef {
+	VSVideoInfo vi;
+	VSNode handle;
+	const VSFrameRef* frame;	// source clip. same frame for every n
+	// filter node
+	const char* name;
+	VSFilterInit init;
+	VSFilterGetFrame getFrame;
+	VSFilterFree free;
+	void* instanceData;
+};
+
+static VSCore benchCore;
+static VSAPI benchApi;
+
+//-------------------------------------------------------------------------
+static VSFrameRef* newFrame(const VSFormat* fi, int wd, int ht)
+{
+	VSFrameRef* f = new VSFrameRef;
+	f->fi = fi;
+	f->refs = 1;
+
+	for (int p = 0; p < 3; p++)
+	{
+		f->data[p] = NULL;
+		f->width[p] = f->height[p] = f->stride[p] = 0;
+
+		if (p >= fi->numPlanes)
+			continue;
+		f->width[p] = p == 0 ? wd : wd >> fi->subSamplingW;
+		f->height[p] = p == 0 ? ht : ht >> fi->subSamplingH;
+		// 64 byte aligned rows as core does
+		f->stride[p] = (f->width[p] * fi->bytesPerSample + 63) & ~63;
+		f->data[p] = vs_aligned_malloc<uint8_t>((size_t)f->stride[p] * f->height[p], 64);
+	}
+	return f;
+}
+
+static void VS_CC benchFreeFrame(const VSFrameRef* cf)
+{
+	if (cf == NULL)
+		return;
+	VSFrameRef* f = (VSFrameRef*)cf;
+
+	if (--f->refs > 0)
+		return;
+	for (int p = 0; p < 3; p++)
+		vs_aligned_free(f->data[p]);
+	delete f;
+}
+
+static VSFrameRef* VS_CC benchNewVideoFrame(const VSFormat* format, int width, int height, const VSFrameRef* propSrc, VSCore* core)
+{
+	return newFrame(format, width, height);
+}
+
+static VSFrameRef* VS_CC benchCopyFrame(const VSFrameRef* src, VSCore* core)
+{
+	VSFrameRef* f = newFrame(src->fi, src->width[0], src->height[0]);
+
+	for (int p = 0; p < src->fi->numPlanes && p < 3; p++)
+		memcpy(f->data[p], src->data[p], (size_t)src->stride[p] * src->height[p]);
+	return f;
+}
+
+static int VS_CC benchGetStride(const VSFrameRef* f, int plane) { return f->stride[plane]; }
+static const uint8_t* VS_CC benchGetReadPtr(const VSFrameRef* f, int plane) { return f->data[plane]; }
+static uint8_t* VS_CC benchGetWritePtr(VSFrameRef* f, int plane) { return f->data[plane]; }
+static const VSFormat* VS_CC benchGetFrameFormat(const VSFrameRef* f) { return f->fi; }
+static int VS_CC benchGetFrameWidth(const VSFrameRef* f, int plane) { return f->width[plane]; }
+static int VS_CC benchGetFrameHeight(const VSFrameRef* f, int plane) { return f->height[plane]; }
+
+//-------------------------------------------------------------------------
+static const VSFrameRef* VS_CC benchGetFrameFilter(int n, VSNodeRef* node, VSFrameContext* frameCtx)
+{
+	// only source clips are inputs in the bench
+	VSFrameRef* f = (VSFrameRef*)node->frame;
+	f->refs++;
+	return f;
+}
+
+// as getFrameFilter. Functions may read a frame of an input in Create
+static const VSFrameRef* VS_CC benchGetFrame(int n, VSNodeRef* node, char* errorMsg, int bufSize)
+{
+	return benchGetFrameFilter(n, node, NULL);
+}
+
+static void VS_CC benchRequestFrameFilter(int n, VSNodeRef* node, VSFrameContext* frameCtx) {}
+static void VS_CC benchReleaseFrameEarly(VSNodeRef* node, int n, VSFrameContext* frameCtx) {}
+// nodes are owned by the bench and released after each run
+static void VS_CC benchFreeNode(VSNodeRef* node) {}
+
+static const VSVideoInfo* VS_CC benchGetVideoInfo(VSNodeRef* node) { return &node->vi; }
+
+static void VS_CC benchSetVideoInfo(const VSVideoInfo* vi, int numOutputs, VSNode* node)
+{
+	node->ref->vi = *vi;
+}
+
+//-------------------------------------------------------------------------
+static BenchProp* findProp(const VSMap* map, const char* key)
+{
+	for (size_t k = 0; k < map->props.size(); k++)
+		if (map->props[k].key == key)
+			return (BenchProp*)&map->props[k];
+	return NULL;
+}
+
+static BenchProp* setProp(VSMap* map, const char* key, char type, int append)
+{
+	BenchProp* pr = findProp(map, key);
+
+	if (pr == NULL)
+	{
+		map->props.push_back(BenchProp());
+		pr = &map->props.back();
+		pr->key = key;
+	}
+	else if (append == paReplace)
+	{
+		pr->i.clear();
+		pr->f.clear();
+		pr->n.clear();
+		pr->s.clear();
+	}
+	pr->type = type;
+	return pr;
+}
+
+static int VS_CC benchPropNumElements(const VSMap* map, const char* key)
+{
+	BenchProp* pr = findProp(map, key);
+
+	if (pr == NULL)
+		return -1;
+	return (int)(pr->type == 'i' ? pr->i.size() : pr->type == 'f' ? pr->f.size()
+		: pr->type == 's' ? pr->s.size() : pr->n.size());
+}
+
+static int64_t VS_CC benchPropGetInt(const VSMap* map, const char* key, int index, int* error)
+{
+	BenchProp* pr = findProp(map, key);
+	int e = pr == NULL ? peUnset : pr->type != 'i' ? peType : index < 0 || index >= (int)pr->i.size() ? peIndex : 0;
+
+	if (error)
+		*error = e;
+	return e ? 0 : pr->i[index];
+}
+
+static double VS_CC benchPropGetFloat(const VSMap* map, const char* key, int index, int* error)
+{
+	BenchProp* pr = findProp(map, key);
+	int e = pr == NULL ? peUnset : pr->type != 'f' ? peType : index < 0 || index >= (int)pr->f.size() ? peIndex : 0;
+
+	if (error)
+		*error = e;
+	return e ? 0 : pr->f[index];
+}
+
+static const char* VS_CC benchPropGetData(const VSMap* map, const char* key, int index, int* error)
+{
+	BenchProp* pr = findProp(map, key);
+	int e = pr == NULL ? peUnset : pr->type != 's' ? peType : index < 0 || index >= (int)pr->s.size() ? peIndex : 0;
+
+	if (error)
+		*error = e;
+	return e ? NULL : pr->s[index].c_str();
+}
+
+static VSNodeRef* VS_CC benchPropGetNode(const VSMap* map, const char* key, int index, int* error)
+{
+	BenchProp* pr = findProp(map, key);
+	int e = pr == NULL ? peUnset : pr->type != 'n' ? peType : index < 0 || index >= (int)pr->n.size() ? peIndex : 0;
+
+	if (error)
+		*error = e;
+	return e ? NULL : pr->n[index];
+}
+
+static int VS_CC benchPropSetInt(VSMap* map, const char* key, int64_t i, int append)
+{
+	setProp(map, key, 'i', append)->i.push_back(i);
+	return 0;
+}
+
+static int VS_CC benchPropSetFloat(VSMap* map, const char* key, double d, int append)
+{
+	setProp(map, key, 'f', append)->f.push_back(d);
+	return 0;
+}
+
+static int VS_CC benchPropSetNode(VSMap* map, const char* key, VSNodeRef* node, int append)
+{
+	setProp(map, key, 'n', append)->n.push_back(node);
+	return 0;
+}
+
+static void VS_CC benchSetError(VSMap* map, const char* errorMessage)
+{
+	map->props.clear();
+	map->error = errorMessage ? errorMessage : "error";
+}
+
+static const char* VS_CC benchGetError(const VSMap* map)
+{
+	return map->error.empty() ? NULL : map->error.c_str();
+}
+
+static void VS_CC benchSetFilterError(const char* errorMessage, VSFrameContext* frameCtx)
+{
+	fprintf(stderr, "vfxbench: filter error %s\n", errorMessage);
+}
+
+static void VS_CC benchLogMessage(int msgType, const char* msg)
+{
+	fprintf(stderr, "vfxbench: %s\n", msg);
+}
+
+//-------------------------------------------------------------------------
+static void VS_CC benchCreateFilter(const VSMap* in, VSMap* out, const char* name, VSFilterInit init,
+	VSFilterGetFrame getFrame, VSFilterFree free, int filterMode, int flags, void* instanceData, VSCore* core)
+{
+	VSNodeRef* node = new VSNodeRef;
+	memset(node, 0, sizeof(VSNodeRef));
+	node->handle.ref = node;
+	node->name = name;
+	node->init = init;
+	node->getFrame = getFrame;
+	node->free = free;
+	node->instanceData = instanceData;
+
+	init((VSMap*)in, out, &node->instanceData, &node->handle, core, &benchApi);
+
+	if (benchGetError(out))
+	{
+		free(node->instanceData, core, &benchApi);
+		delete node;
+		return;
+	}
+	benchPropSetNode(out, "clip", node, paReplace);
+}
+
+//-------------------------------------------------------------------------
+typedef struct {
+	std::string name;
+	std::string args;
+	VSPublicFunction create;
+} BenchFunction;
+
+static std::vector<BenchFunction> benchFunctions;
+
+static void VS_CC benchConfigPlugin(const char* identifier, const char* defaultNamespace, const char* name,
+	int apiVersion, int readonly, VSPlugin* plugin) {}
+
+static void VS_CC benchRegisterFunction(const char* name, const char* args, VSPublicFunction argsFunc,
+	void* functionData, VSPlugin* plugin)
+{
+	BenchFunction bf;
+	bf.name = name;
+	bf.args = args;
+	bf.create = argsFunc;
+	benchFunctions.push_back(bf);
+}
+
+static void initBenchApi()
+{
+	memset(&benchApi, 0, sizeof(VSAPI));
+	benchApi.freeFrame = benchFreeFrame;
+	benchApi.freeNode = benchFreeNode;
+	benchApi.newVideoFrame = benchNewVideoFrame;
+	benchApi.copyFrame = benchCopyFrame;
+	benchApi.createFilter = benchCreateFilter;
+	benchApi.setError = benchSetError;
+	benchApi.getError = benchGetError;
+	benchApi.setFilterError = benchSetFilterError;
+	benchApi.getFrame = benchGetFrame;
+	benchApi.getFrameFilter = benchGetFrameFilter;
+	benchApi.requestFrameFilter = benchRequestFrameFilter;
+	benchApi.releaseFrameEarly = benchReleaseFrameEarly;
+	benchApi.getStride = benchGetStride;
+	benchApi.getReadPtr = benchGetReadPtr;
+	benchApi.getWritePtr = benchGetWritePtr;
+	benchApi.getVideoInfo = benchGetVideoInfo;
+	benchApi.setVideoInfo = benchSetVideoInfo;
+	benchApi.getFrameFormat = benchGetFrameFormat;
+	benchApi.getFrameWidth = benchGetFrameWidth;
+	benchApi.getFrameHeight = benchGetFrameHeight;
+	benchApi.propNumElements = benchPropNumElements;
+	benchApi.propGetInt = benchPropGetInt;
+	benchApi.propGetFloat = benchPropGetFloat;
+	benchApi.propGetData = benchPropGetData;
+	benchApi.propGetNode = benchPropGetNode;
+	benchApi.propSetInt = benchPropSetInt;
+	benchApi.propSetFloat = benchPropSetFloat;
+	benchApi.propSetNode = benchPropSetNode;
+	benchApi.logMessage = benchLogMessage;
+}
+
+//-------------------------------------------------------------------------
+static VSFormat makeFormat(const char* name, int id, int family, int stype, int bits, int ssw, int ssh)
+{
+	VSFormat f;
+	memset(&f, 0, sizeof(VSFormat));
+	strncpy(f.name, name, sizeof(f.name) - 1);
+	f.id = id;
+	f.colorFamily = family;
+	f.sampleType = stype;
+	f.bitsPerSample = bits;
+	f.bytesPerSample = bits <= 8 ? 1 : bits <= 16 ? 2 : 4;
+	f.subSamplingW = ssw;
+	f.subSamplingH = ssh;
+	f.numPlanes = family == cmGray ? 1 : 3;
+	return f;
+}
+
+static VSFormat benchFormats[] = {
+	makeFormat("Gray8", pfGray8, cmGray, stInteger, 8, 0, 0),
+	makeFormat("YUV420P8", pfYUV420P8, cmYUV, stInteger, 8, 1, 1),
+	makeFormat("YUV420P10", pfYUV420P10, cmYUV, stInteger, 10, 1, 1),
+	makeFormat("YUV420P16", pfYUV420P16, cmYUV, stInteger, 16, 1, 1),
+	makeFormat("YUV444PS", pfYUV444PS, cmYUV, stFloat, 32, 0, 0),
+	makeFormat("YUV420PS", pfNone, cmYUV, stFloat, 32, 1, 1),	// no preset in API 3
+	makeFormat("RGB24", pfRGB24, cmRGB, stInteger, 8, 0, 0),
+	makeFormat("RGBS", pfRGBS, cmRGB, stFloat, 32, 0, 0),
+};
+
+typedef struct {
+	const char* name;
+	int width;
+	int height;
+} BenchSize;
+
+static const BenchSize benchSizes[] = {
+	{ "720p", 1280, 720 },
+	{ "1080p", 1920, 1080 },
+	{ "4K", 3840, 2160 },
+	{ "8K", 7680, 4320 },
+};
+
+//-------------------------------------------------------------------------
+// synthetic picture. gradients with some texture, in legal range of format
+static void fillPattern(VSFrameRef* f, int variant)
+{
+	const VSFormat* fi = f->fi;
+
+	for (int p = 0; p < fi->numPlanes && p < 3; p++)
+	{
+		int wd = f->width[p], ht = f->height[p];
+		bool chroma = fi->colorFamily == cmYUV && p > 0;
+
+		for (int h = 0; h < ht; h++)
+		{
+			uint8_t* dp = f->data[p] + (size_t)h * f->stride[p];
+
+			for (int w = 0; w < wd; w++)
+			{
+				// 0 to 1
+				float v = chroma ? (float)(p == 1 ? w : h) / (p == 1 ? wd : ht)
+					: 0.5f * (float)(w + h) / (wd + ht)
+					+ 0.25f * (((w >> 4) + (h >> 4) + variant) & 1)
+					+ 0.25f * (float)((w * 7 + h * 13 + p * 5 + variant * 3) & 63) / 64;
+				if (v > 1.0f)
+					v = 1.0f;
+
+				if (fi->sampleType == stFloat)
+					((float*)dp)[w] = chroma ? v - 0.5f : v;
+				else if (fi->bytesPerSample == 1)
+					dp[w] = (uint8_t)(v * 255);
+				else
+					((uint16_t*)dp)[w] = (uint16_t)(v * ((1 << fi->bitsPerSample) - 1));
+			}
+		}
+	}
+}
+
+static uint64_t frameHash(const VSFrameRef* f)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	for (int p = 0; p < f->fi->numPlanes && p < 3; p++)
+	{
+		int rowsize = f->width[p] * f->fi->bytesPerSample;
+
+		for (int h = 0; h < f->height[p]; h++)
+		{
+			const uint8_t* sp = f->data[p] + (size_t)h * f->stride[p];
+
+			for (int w = 0; w < rowsize; w++)
+				hash = (hash ^ sp[w]) * 0x100000001b3ull;
+		}
+	}
+	return hash;
+}
+
+//-------------------------------------------------------------------------
+typedef struct {
+	std::string error;
+	double seconds;
+	uint64_t checksum;
+} BenchResult;
+
+static VSNodeRef* newSource(const VSFormat* fi, int wd, int ht, int nframes, int variant)
+{
+	VSNodeRef* node = new VSNodeRef;
+	memset(node, 0, sizeof(VSNodeRef));
+	node->handle.ref = node;
+	node->vi.format = fi;
+	node->vi.fpsNum = 25;
+	node->vi.fpsDen = 1;
+	node->vi.width = wd;
+	node->vi.height = ht;
+	node->vi.numFrames = nframes;
+	VSFrameRef* f = newFrame(fi, wd, ht);
+	fillPattern(f, variant);
+	node->frame = f;
+	return node;
+}
+
+static const VSFormat benchGrayS = makeFormat("GrayS", pfGrayS, cmGray, stFloat, 32, 0, 0);
+
+// one frame map of source positions along x (axis 0) or y, shifted by a fraction
+static VSNodeRef* newMapSource(int wd, int ht, int axis)
+{
+	VSNodeRef* node = newSource(&benchGrayS, wd, ht, 1, 0);
+	VSFrameRef* f = (VSFrameRef*)node->frame;
+
+	for (int h = 0; h < ht; h++)
+	{
+		float* dp = (float*)(f->data[0] + (size_t)h * f->stride[0]);
+
+		for (int w = 0; w < wd; w++)
+			dp[w] = axis == 0 ? w + 10.25f : h + 5.5f;
+	}
+	return node;
+}
+
+static void freeSource(VSNodeRef* node)
+{
+	benchFreeFrame(node->frame);
+	delete node;
+}
+
+static const VSFrameRef* runFrame(VSNodeRef* node, int n)
+{
+	void* frameData = NULL;
+	VSFrameContext ctx;
+	node->getFrame(n, arInitial, &node->instanceData, &frameData, &ctx, &benchCore, &benchApi);
+	return node->getFrame(n, arAllFramesReady, &node->instanceData, &frameData, &ctx, &benchCore, &benchApi);
+}
+
+static std::vector<std::string> benchArgs;	// name=value
+
+// type of argument as in registered args string, 0 if function does not have it
+static char argType(const std::string& args, const std::string& name)
+{
+	size_t pos = 0;
+
+	while (pos < args.size())
+	{
+		size_t end = args.find(';', pos);
+		std::string item = args.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+		size_t colon = item.find(':');
+
+		if (colon != std::string::npos && item.substr(0, colon) == name)
+			return item.compare(colon + 1, 5, "float") == 0 ? 'f' : item.compare(colon + 1, 3, "int") == 0 ? 'i'
+				: item.compare(colon + 1, 4, "data") == 0 ? 's' : 0;
+		if (end == std::string::npos)
+			break;
+		pos = end + 1;
+	}
+	return 0;
+}
+
+static BenchResult runOne(const BenchFunction& bf, const VSFormat* fi, int wd, int ht, int nframes, int nthreads)
+{
+	BenchResult res;
+	res.seconds = 0;
+	res.checksum = 0;
+
+	int clipframes = nframes > BENCH_CLIP_FRAMES ? nframes : BENCH_CLIP_FRAMES;
+	VSNodeRef* src = newSource(fi, wd, ht, clipframes, 0);
+	VSNodeRef* bsrc = newSource(fi, wd, ht, clipframes, 1);
+	VSNodeRef* mapx = newMapSource(wd, ht, 0);
+	VSNodeRef* mapy = newMapSource(wd, ht, 1);
+	VSMap in, out;
+	benchPropSetNode(&in, "clip", src, paReplace);
+	// map clip arguments get maps, any other a second clip with different picture
+	size_t pos = 0;
+
+	while ((pos = bf.args.find(":clip", pos)) != std::string::npos)
+	{
+		size_t start = bf.args.rfind(';', pos);
+		start = start == std::string::npos ? 0 : start + 1;
+		std::string key = bf.args.substr(start, pos - start);
+
+		if (key == "mapx" || key == "mapy")
+			benchPropSetNode(&in, key.c_str(), key == "mapx" ? mapx : mapy, paReplace);
+		else if (key != "clip")
+			benchPropSetNode(&in, key.c_str(), bsrc, paReplace);
+		pos++;
+	}
+
+	for (size_t k = 0; k < benchArgs.size(); k++)
+	{
+		size_t eq = benchArgs[k].find('=');
+		std::string name = benchArgs[k].substr(0, eq);
+		const char* val = eq == std::string::npos ? "1" : benchArgs[k].c_str() + eq + 1;
+		char type = argType(bf.args, name);
+
+		if (type == 's')
+		{
+			setProp(&in, name.c_str(), 's', paReplace)->s.push_back(val);
+			continue;
+		}
+		// elements of an array are separated by :
+		for (int append = paReplace; val != NULL; append = paAppend)
+		{
+			if (type == 'i')
+				benchPropSetInt(&in, name.c_str(), atoi(val), append);
+			else if (type == 'f')
+				benchPropSetFloat(&in, name.c_str(), atof(val), append);
+			val = strchr(val, ':');
+			val = val != NULL ? val + 1 : NULL;
+		}
+	}
+
+	bf.create(&in, &out, NULL, &benchCore, &benchApi);
+	VSNodeRef* node = benchPropGetNode(&out, "clip", 0, NULL);
+
+	if (benchGetError(&out) || node == NULL)
+	{
+		res.error = benchGetError(&out) ? benchGetError(&out) : "no clip returned";
+		freeSource(src);
+		freeSource(bsrc);
+		freeSource(mapx);
+		freeSource(mapy);
+		return res;
+	}
+	// first frame not timed. one time allocations, page faults
+	benchFreeFrame(runFrame(node, 0));
+
+	std::atomic<int> next(0);
+	std::atomic<uint64_t> checksum(0);
+
+	auto worker = [&]() {
+		int n;
+		while ((n = next++) < nframes)
+		{
+			const VSFrameRef* f = runFrame(node, n);
+			// sum so that order of frames from threads does not matter
+			checksum += frameHash(f) * (2 * n + 1);
+			benchFreeFrame(f);
+		}
+	};
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	if (nthreads <= 1)
+		worker();
+	else
+	{
+		std::vector<std::thread> pool;
+		for (int t = 0; t < nthreads; t++)
+			pool.push_back(std::thread(worker));
+		for (int t = 0; t < nthreads; t++)
+			pool[t].join();
+	}
+	auto t1 = std::chrono::steady_clock::now();
+
+	res.seconds = std::chrono::duration<double>(t1 - t0).count();
+	res.checksum = checksum;
+
+	node->free(node->instanceData, &benchCore, &benchApi);
+	delete node;
+	freeSource(src);
+	freeSource(bsrc);
+	freeSource(mapx);
+	freeSource(mapy);
+	return res;
+}
+
+#ifndef _WIN32
+// each run in a child process, so that a function crashing on some format does
+// not end the whole report, and memory of one run does not carry to the next
+static BenchResult runIsolated(const BenchFunction& bf, const VSFormat* fi, int wd, int ht, int nframes, int nthreads)
+{
+	BenchResult res;
+	res.seconds = 0;
+	res.checksum = 0;
+	int fd[2];
+
+	if (pipe(fd) != 0)
+		return runOne(bf, fi, wd, ht, nframes, nthreads);
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+
+	if (pid < 0)
+	{
+		close(fd[0]);
+		close(fd[1]);
+		return runOne(bf, fi, wd, ht, nframes, nthreads);
+	}
+	if (pid == 0)
+	{
+		close(fd[0]);
+		BenchResult cres = runOne(bf, fi, wd, ht, nframes, nthreads);
+		char buf[1024];
+		int len = snprintf(buf, sizeof(buf), "%.9f %llu %s", cres.seconds,
+			(unsigned long long)cres.checksum, cres.error.c_str());
+		if (write(fd[1], buf, len) != len)
+			_exit(2);
+		_exit(0);
+	}
+	close(fd[1]);
+	std::string msg;
+	char buf[256];
+	ssize_t len;
+
+	while ((len = read(fd[0], buf, sizeof(buf))) > 0)
+		msg.append(buf, len);
+	close(fd[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+
+	if (WIFSIGNALED(status))
+	{
+		snprintf(buf, sizeof(buf), "crashed with signal %d", WTERMSIG(status));
+		res.error = buf;
+		return res;
+	}
+	unsigned long long sum = 0;
+	int used = 0;
+
+	if (sscanf(msg.c_str(), "%lf %llu %n", &res.seconds, &sum, &used) < 2)
+	{
+		res.error = "no result from run";
+		return res;
+	}
+	res.checksum = sum;
+	res.error = msg.substr(used);
+	return res;
+}
+#else
+#define runIsolated runOne
+#endif
+
+//-------------------------------------------------------------------------
+static std::vector<std::string> splitList(const char* s)
+{
+	std::vector<std::string> list;
+	std::string item;
+
+	for (const char* c = s; ; c++)
+	{
+		if (*c == ',' || *c == 0)
+		{
+			if (!item.empty())
+				list.push_back(item);
+			item.clear();
+			if (*c == 0)
+				break;
+		}
+		else
+			item += *c;
+	}
+	return list;
+}
+
+static bool inList(const std::vector<std::string>& list, const std::string& name)
+{
+	if (list.empty())
+		return true;
+	for (size_t k = 0; k < list.size(); k++)
+		if (list[k] == name)
+			return true;
+	return false;
+}
+
+static std::string jsonString(const std::string& s)
+{
+	std::string js = "\"";
+
+	for (size_t k = 0; k < s.size(); k++)
+	{
+		if (s[k] == '"' || s[k] == '\\')
+			js += '\\';
+		if ((unsigned char)s[k] >= 0x20)
+			js += s[k];
+	}
+	return js + "\"";
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: vfxbench [-f functions] [-F formats] [-s sizes] [-n frames] [-t threads] [-a name=value] [-S simd] [-o file]\n");
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> fnames, fmtnames, sizenames;
+	int nframes = 10, nthreads = 1, simd = SIMD_AVX512;
+	const char* outname = NULL;
+
+	for (int a = 1; a < argc; a++)
+	{
+		std::string opt = argv[a];
+
+		if (a + 1 >= argc)
+		{
+			usage();
+			return 1;
+		}
+		const char* val = argv[++a];
+
+		if (opt == "-f")
+			fnames = splitList(val);
+		else if (opt == "-F")
+			fmtnames = splitList(val);
+		else if (opt == "-s")
+			sizenames = splitList(val);
+		else if (opt == "-n")
+			nframes = atoi(val);
+		else if (opt == "-t")
+			nthreads = atoi(val);
+		else if (opt == "-a")
+			benchArgs = splitList(val);
+		else if (opt == "-S")
+		{
+			const char* isa[] = { "none", "sse41", "avx2", "avx512" };
+
+			for (simd = SIMD_AVX512; simd >= 0 && strcmp(val, isa[simd]) != 0; simd--)
+				;
+		}
+		else if (opt == "-o")
+			outname = val;
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+	if (nframes < 2 || nthreads < 1 || simd < 0)
+	{
+		usage();
+		return 1;
+	}
+
+	std::vector<BenchSize> sizes;
+
+	if (sizenames.empty())
+		sizes.assign(benchSizes, benchSizes + sizeof(benchSizes) / sizeof(BenchSize));
+
+	for (size_t k = 0; k < sizenames.size(); k++)
+	{
+		BenchSize bs = { NULL, 0, 0 };
+
+		for (size_t j = 0; j < sizeof(benchSizes) / sizeof(BenchSize); j++)
+			if (sizenames[k] == benchSizes[j].name)
+				bs = benchSizes[j];
+
+		if (bs.name == NULL && sscanf(sizenames[k].c_str(), "%dx%d", &bs.width, &bs.height) == 2
+			&& bs.width > 0 && bs.height > 0)
+			bs.name = sizenames[k].c_str();
+
+		if (bs.name == NULL)
+		{
+			fprintf(stderr, "vfxbench: unknown size %s\n", sizenames[k].c_str());
+			return 1;
+		}
+		sizes.push_back(bs);
+	}
+
+	initBenchApi();
+	VSPlugin plugin;
+	VapourSynthPluginInit(benchConfigPlugin, benchRegisterFunction, &plugin);
+	simdSelect(simd);
+	laQuantileSelect(simd);
+
+	FILE* fp = outname ? fopen(outname, "w") : stdout;
+
+	if (fp == NULL)
+	{
+		fprintf(stderr, "vfxbench: can not open %s\n", outname);
+		return 1;
+	}
+	fprintf(fp, "{\n  \"frames\": %d,\n  \"threads\": %d,\n  \"results\": [", nframes, nthreads);
+	bool first = true;
+
+	for (size_t k = 0; k < benchFunctions.size(); k++)
+	{
+		const BenchFunction& bf = benchFunctions[k];
+
+		if (!inList(fnames, bf.name))
+			continue;
+
+		for (size_t j = 0; j < sizeof(benchFormats) / sizeof(VSFormat); j++)
+		{
+			const VSFormat* fi = &benchFormats[j];
+
+			if (!inList(fmtnames, fi->name))
+				continue;
+
+			for (size_t s = 0; s < sizes.size(); s++)
+			{
+				fprintf(stderr, "%s %s %s\n", bf.name.c_str(), fi->name, sizes[s].name);
+
+				BenchResult res = runIsolated(bf, fi, sizes[s].width, sizes[s].height, nframes, nthreads);
+
+				fprintf(fp, "%s\n    {\"function\": %s, \"format\": %s, \"size\": %s, \"width\": %d, \"height\": %d, ",
+					first ? "" : ",", jsonString(bf.name).c_str(), jsonString(fi->name).c_str(),
+					jsonString(sizes[s].name).c_str(), sizes[s].width, sizes[s].height);
+				first = false;
+
+				if (!res.error.empty())
+				{
+					fprintf(fp, "\"error\": %s}", jsonString(res.error).c_str());
+					continue;
+				}
+				double pixels = (double)sizes[s].width * sizes[s].height * nframes;
+				fprintf(fp, "\"seconds\": %.6f, \"fps\": %.3f, \"ns_per_pixel\": %.4f, \"checksum\": \"%016llx\"}",
+					res.seconds, nframes / res.seconds, res.seconds * 1e9 / pixels,
+					(unsigned long long)res.checksum);
+				fflush(fp);
+			}
+		}
+	}
+	fprintf(fp, "\n  ]\n}\n");
+
+	if (outname)
+		fclose(fp);
+	return 0;
+}
@@ -0,0 +1,171 @@
+#pragma once
+#ifndef COUNTER_BASED_RANDOM_H_V_C_MOHAN
+#define COUNTER_BASED_RANDOM_H_V_C_MOHAN
+/*............................................................................
+ Counter based random numbers for vfx functions. Philox 2x32 - 10 rounds.
+ Value returned depends only on key and counter. No hidden state is kept, so
+ GetFrame running in several threads can draw any number in any order and
+ same frame is produced every time. Do not use rand() or srand() in GetFrame.
+
+ key	: instance seed and frame number mixed by randomKey
+ stream	: upper counter word. row, plane, ring or particle group
+ index	: lower counter word. pixel or particle number
+
+ fillRandom and fillRandomInRange generate RANDOM_LANES values at a time in
+ plain loops that the compiler vectorizes, or 8 at a time with AVX2 when the
+ SIMD level allows. Values are same either way. Use them for per pixel noise
+ and for bulk particle positions.
+-----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "simdLevel.h"
+
+#define RANDOM_LANES 16
+
+typedef struct {
+	uint32_t key;
+	uint32_t stream;
+	uint32_t next;	// counter of next value to be drawn
+} RandomSequence;
+
+uint32_t randomKey(uint32_t seed, int frame);
+uint32_t randomValue(uint32_t key, uint32_t stream, uint32_t index);
+// returns 0 to range - 1. 0 if range is not positive
+int randomInRange(uint32_t key, uint32_t stream, uint32_t index, int range);
+void fillRandom(uint32_t* buf, int count, uint32_t key, uint32_t stream, uint32_t index);
+void fillRandomInRange(int* buf, int count, uint32_t key, uint32_t stream, uint32_t index, int range);
+// sequential draws. For Init where a table is filled in order
+void startRandomSequence(RandomSequence* rs, uint32_t seed, uint32_t stream = 0);
+int nextRandom(RandomSequence* rs, int range);
+
+//----------------------------------------------------------------------------
+#define PHILOX_M2x32 0xD256D193u
+#define PHILOX_W32 0x9E3779B9u
+
+uint32_t randomKey(uint32_t seed, int frame)
+{
+	// splitmix64 finalizer to spread seed and frame over all bits of key
+	uint64_t z = ((uint64_t)seed << 32) ^ (uint32_t)frame;
+	z += 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	z ^= z >> 31;
+	return (uint32_t)(z ^ (z >> 32));
+}
+
+uint32_t randomValue(uint32_t key, uint32_t stream, uint32_t index)
+{
+	uint32_t c0 = index, c1 = stream;
+
+	for (int r = 0; r < 10; r++)
+	{
+		uint64_t prod = (uint64_t)PHILOX_M2x32 * c0;
+		c0 = (uint32_t)(prod >> 32) ^ key ^ c1;
+		c1 = (uint32_t)prod;
+		key += PHILOX_W32;
+	}
+	return c0;
+}
+
+int randomInRange(uint32_t key, uint32_t stream, uint32_t index, int range)
+{
+	if (range <= 0)
+		return 0;
+	// multiply and shift in place of modulo. No division and no bias towards low values
+	return (int)(((uint64_t)randomValue(key, stream, index) * (uint32_t)range) >> 32);
+}
+
+#ifdef VFX_X86_SIMD
+// 8 counters a step. Even and odd lanes are multiplied apart. Returns values made
+VFX_TARGET("avx2") static int fillRandomAvx2(uint32_t* buf, int count, uint32_t key, uint32_t stream, uint32_t index)
+{
+	const __m256i m = _mm256_set1_epi32((int)PHILOX_M2x32);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((int)(index + i)), lanes);
+		__m256i c1 = _mm256_set1_epi32((int)stream);
+		uint32_t rkey = key;
+
+		for (int r = 0; r < 10; r++)
+		{
+			__m256i pe = _mm256_mul_epu32(c0, m);
+			__m256i po = _mm256_mul_epu32(_mm256_srli_epi64(c0, 32), m);
+			// high and low halves of products back to their lanes
+			__m256i hi = _mm256_blend_epi32(_mm256_srli_epi64(pe, 32), po, 0xAA);
+			__m256i lo = _mm256_blend_epi32(pe, _mm256_slli_epi64(po, 32), 0xAA);
+			c0 = _mm256_xor_si256(_mm256_xor_si256(hi, _mm256_set1_epi32((int)rkey)), c1);
+			c1 = lo;
+			rkey += PHILOX_W32;
+		}
+		_mm256_storeu_si256((__m256i*)(buf + i), c0);
+	}
+	return i;
+}
+#endif
+
+void fillRandom(uint32_t* buf, int count, uint32_t key, uint32_t stream, uint32_t index)
+{
+	uint32_t c0[RANDOM_LANES], c1[RANDOM_LANES];
+	int done = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_AVX2)
+		done = fillRandomAvx2(buf, count, key, stream, index);
+#endif
+
+	for (int i = done; i < count; i += RANDOM_LANES)
+	{
+		// all lanes go through the rounds together
+		for (int k = 0; k < RANDOM_LANES; k++)
+		{
+			c0[k] = index + i + k;
+			c1[k] = stream;
+		}
+		uint32_t rkey = key;
+
+		for (int r = 0; r < 10; r++)
+		{
+			for (int k = 0; k < RANDOM_LANES; k++)
+			{
+				uint64_t prod = (uint64_t)PHILOX_M2x32 * c0[k];
+				c0[k] = (uint32_t)(prod >> 32) ^ rkey ^ c1[k];
+				c1[k] = (uint32_t)prod;
+			}
+			rkey += PHILOX_W32;
+		}
+		int nlanes = count - i < RANDOM_LANES ? count - i : RANDOM_LANES;
+
+		for (int k = 0; k < nlanes; k++)
+			buf[i + k] = c0[k];
+	}
+}
+
+void fillRandomInRange(int* buf, int count, uint32_t key, uint32_t stream, uint32_t index, int range)
+{
+	if (range <= 0)
+	{
+		for (int i = 0; i < count; i++)
+			buf[i] = 0;
+		return;
+	}
+	// same bits as unsigned values, scaled in place
+	fillRandom((uint32_t*)buf, count, key, stream, index);
+
+	for (int i = 0; i < count; i++)
+		buf[i] = (int)(((uint64_t)(uint32_t)buf[i] * (uint32_t)range) >> 32);
+}
+
+void startRandomSequence(RandomSequence* rs, uint32_t seed, uint32_t stream)
+{
+	rs->key = randomKey(seed, 0);
+	rs->stream = stream;
+	rs->next = 0;
+}
+
+int nextRandom(RandomSequence* rs, int range)
+{
+	return randomInRange(rs->key, rs->stream, rs->next++, range);
+}
+
+#endif
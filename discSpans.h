@@ -0,0 +1,80 @@
+#pragma once
+#ifndef DISC_SPANS_H_V_C_MOHAN
+#define DISC_SPANS_H_V_C_MOHAN
+//------------------------------------------------------------------------------
+// Row spans of discs and rings, so that effects loop only over samples inside
+// instead of testing every sample of the bounding box. A row is given by its
+// luma distance dy from center. Spans are half open [x0, x1) in plane samples
+// whose luma position (x << subW) is inside, clipped to plane range [xmin, xmax).
+// Requires framePlanes.h
+//------------------------------------------------------------------------------
+#include "framePlanes.h"
+
+// integer square root, largest k with k * k <= v. v >= 0
+int isqrt(int v);
+// plane span of luma range [lx0, lx1] inclusive. false if empty
+bool lumaRangeSpan(int* x0, int* x1, int lx0, int lx1, int subW, int xmin, int xmax);
+// largest dx with dx * dx + dy * dy <= rsq, or -1 if row misses the disc
+int discHalfWidth(int rsq, int dy);
+// span of disc dx * dx + dy * dy <= rsq. false if empty
+bool discRowSpan(int* x0, int* x1, int cx, int rsq, int dy, int subW, int xmin, int xmax);
+// spans of ring ringsq < dx * dx + dy * dy <= rsq. x0, x1 hold 2.
+// returns number of spans, 0 to 2. Left span is first
+int ringRowSpans(int* x0, int* x1, int cx, int rsq, int ringsq, int dy, int subW, int xmin, int xmax);
+
+//------------------------------------------------------------------------------
+int isqrt(int v)
+{
+	int k = (int)sqrt((double)v);
+	// correct float rounding
+	while (k > 0 && k * k > v)
+		k--;
+	while ((k + 1) * (k + 1) <= v)
+		k++;
+	return k;
+}
+
+int discHalfWidth(int rsq, int dy)
+{
+	int rem = rsq - dy * dy;
+
+	return rem < 0 ? -1 : isqrt(rem);
+}
+
+bool lumaRangeSpan(int* x0, int* x1, int lx0, int lx1, int subW, int xmin, int xmax)
+{
+	*x0 = VSMAX(planeStart(lx0, subW), xmin);
+	*x1 = VSMIN(planeStart(lx1 + 1, subW), xmax);
+	return *x0 < *x1;
+}
+
+bool discRowSpan(int* x0, int* x1, int cx, int rsq, int dy, int subW, int xmin, int xmax)
+{
+	int dx = discHalfWidth(rsq, dy);
+
+	if (dx < 0)
+		return false;
+	return lumaRangeSpan(x0, x1, cx - dx, cx + dx, subW, xmin, xmax);
+}
+
+int ringRowSpans(int* x0, int* x1, int cx, int rsq, int ringsq, int dy, int subW, int xmin, int xmax)
+{
+	int dx = discHalfWidth(rsq, dy);
+
+	if (dx < 0)
+		return 0;
+	int dxin = discHalfWidth(ringsq, dy);
+
+	if (dxin < 0)
+		return lumaRangeSpan(x0, x1, cx - dx, cx + dx, subW, xmin, xmax) ? 1 : 0;
+
+	int nspans = 0;
+
+	if (lumaRangeSpan(x0, x1, cx - dx, cx - dxin - 1, subW, xmin, xmax))
+		nspans++;
+	if (lumaRangeSpan(x0 + nspans, x1 + nspans, cx + dxin + 1, cx + dx, subW, xmin, xmax))
+		nspans++;
+	return nspans;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef FRAME_PLANES_H_V_C_MOHAN
+#define FRAME_PLANES_H_V_C_MOHAN
+//------------------------------------------------------------------------------
+// Each plane is processed at its own width and height. Sample (x, y) of a
+// subsampled plane stands for luma (x << subW, y << subH), so geometry found in
+// luma coordinates is evaluated there and no luma pixel needs a parity check.
+// For luma, RGB and 4:4:4 planes subW = subH = 0 and coordinates are same.
+// Planes of same size share geometry, so kernels take a run of such planes:
+// planes 0 to lumaSizePlanes - 1, and then the rest which are subsampled.
+//------------------------------------------------------------------------------
+typedef struct {
+	uint8_t* dp;
+	const uint8_t* sp;
+	int pitch;		// in samples
+	int width;
+	int height;
+	int subW;		// log2 of horizontal subsampling
+	int subH;		// log2 of vertical subsampling
+} FramePlane;
+
+// fills up to 3 planes, returns number of planes. src can be NULL
+int getFramePlanes(FramePlane* planes, VSFrameRef* dst, const VSFrameRef* src, const VSAPI* vsapi);
+// number of leading planes of luma size. np for RGB, Gray and 4:4:4, else 1
+int lumaSizePlanes(const FramePlane* planes, int np);
+// first plane coordinate at or after luma coordinate. start or end of a luma range
+int planeStart(int luma, int sub);
+
+//------------------------------------------------------------------------------
+int getFramePlanes(FramePlane* planes, VSFrameRef* dst, const VSFrameRef* src, const VSAPI* vsapi)
+{
+	const VSFormat* fi = vsapi->getFrameFormat(dst);
+	int np = fi->numPlanes > 3 ? 3 : fi->numPlanes;
+
+	for (int p = 0; p < np; p++)
+	{
+		planes[p].dp = vsapi->getWritePtr(dst, p);
+		planes[p].sp = src != NULL ? vsapi->getReadPtr(src, p) : NULL;
+		planes[p].pitch = vsapi->getStride(dst, p) / fi->bytesPerSample;
+		planes[p].width = vsapi->getFrameWidth(dst, p);
+		planes[p].height = vsapi->getFrameHeight(dst, p);
+		planes[p].subW = p == 0 ? 0 : fi->subSamplingW;
+		planes[p].subH = p == 0 ? 0 : fi->subSamplingH;
+	}
+	return np;
+}
+
+int lumaSizePlanes(const FramePlane* planes, int np)
+{
+	int n = 1;
+
+	while (n < np && planes[n].subW == 0 && planes[n].subH == 0)
+		n++;
+	return n;
+}
+
+int planeStart(int luma, int sub)
+{
+	// rounds up. arithmetic shift keeps it right for negative values
+	return (luma + (1 << sub) - 1) >> sub;
+}
+
+#endif
@@ -9,10 +9,16 @@ void CubicIntCoeff(float* cbuf, int quantiles);
 
 void LinearIntCoeff(float* cbuf, int quantiles);
 
+// integer coefficients rounded from float cbuf, so that each of nsets sets of span
+// sums exactly to 1 << 14 (Q14, for 8 bit samples) or 1 << 30 (Q30, 9 to 16 bit)
+void Q14Coeff(int16_t* ibuf, const float* cbuf, int span, int nsets);
+
+void Q30Coeff(int32_t* ibuf, const float* cbuf, int span, int nsets);
+
 //-------------------------------------------------------------------
 template <typename finc>
 float LaQuantile(const finc* point, int spitch,
-	int span, int qx, int qy, float* lbuf);
+	int span, int qx, int qy, const float* lbuf);
 
 template <typename finc>
 bool needNotInterpolate(const finc* sp, int pitch, int kb);
@@ -21,10 +27,25 @@ template <typename finc>
 float alongLineInterpolate(const finc* point, int step,
 	int span, int quant, float *iBuf);
 
+// integer LaQuantile for 8 bit samples. Row sums in Q14 are rounded to Q6, so that
+// both passes multiply 16 bit values. Result is rounded, not clamped
+int LaQuantileQ14(const uint8_t* point, int spitch,
+	int span, int qx, int qy, const int16_t* ibuf);
+
+// integer alongLineInterpolate. Result is rounded, not clamped
+int alongLineInterpolateQ14(const uint8_t* point, int step,
+	int span, int quant, const int16_t* ibuf);
+
+int alongLineInterpolateQ30(const uint16_t* point, int step,
+	int span, int quant, const int32_t* ibuf);
+
 //restricts values to min and max
 //---------------------------------------------------------------------------------
 template <typename  finc>
 finc clamp(float val, finc min, finc max);
+// for integer results
+template <typename  finc>
+finc iclamp(int val, finc min, finc max);
 //--------------------------------------------------------------------------------
 template <typename  finc>
 finc clamp(float val, finc min, finc max)
@@ -32,6 +53,12 @@ finc clamp(float val, finc min, finc max)
 
 	return (finc)(val < min ? min : val > max ? max : val);
 }
+template <typename  finc>
+finc iclamp(int val, finc min, finc max)
+{
+
+	return (finc)(val < min ? min : val > max ? max : val);
+}
 //----------------------------------------------------------------------------------
 float fclamp(float val, float min, float max)
 {
@@ -44,7 +71,7 @@ template <typename finc>
 // this is general. can be used for any span 2 4 6 and bytes per pixel planar formats
 
 float LaQuantile(const finc* point, int spitch,
-	int span, int qx, int qy, float* lbuf)
+	int span, int qx, int qy, const float* lbuf)
 {
 	// nb = bit depth of sample. for float 0
 	// span = 6 for 6 x 6 point interpolation
@@ -58,7 +85,7 @@ float LaQuantile(const finc* point, int spitch,
 	}
 	float xy[6];	//
 	point += (-span / 2 + 1) * spitch;
-	float* lbufr = lbuf + span * qx;
+	const float* lbufr = lbuf + span * qx;
 
 	for (int h = 0; h < span; h++)
 	{
@@ -103,12 +130,95 @@ float alongLineInterpolate(const finc* point, int step,
 	}
 	return sum;
 }
+//-------------------------------------------------------------------------------------------------
+int LaQuantileQ14(const uint8_t* point, int spitch,
+	int span, int qx, int qy, const int16_t* ibuf)
+{
+	if (span == 0)
+	{
+		// near point
+		return *point;
+	}
+	point += (-span / 2 + 1) * spitch;
+	const int16_t* cx = ibuf + span * qx;
+	const int16_t* cy = ibuf + span * qy;
+	int sum = 0;
+
+	for (int h = 0; h < span; h++)
+	{
+		int xy = 0;
+
+		for (int w = 0; w < span; w++)
+		{
+			xy += point[w - span / 2 + 1] * cx[w];
+		}
+		sum += ((xy + (1 << 7)) >> 8) * cy[h];
+		point += spitch;
+	}
+
+	return (sum + (1 << 19)) >> 20;
+}
+//-------------------------------------------------
+int alongLineInterpolateQ14(const uint8_t* point, int step,
+	int span, int quant, const int16_t* ibuf)
+{
+	int sum = 0;
+
+	for (int i = 0; i < span; i++)
+	{
+		sum += ibuf[span * quant + i] * point[(i + 1 - span / 2) * step];
+	}
+	return (sum + (1 << 13)) >> 14;
+}
+
+int alongLineInterpolateQ30(const uint16_t* point, int step,
+	int span, int quant, const int32_t* ibuf)
+{
+	int64_t sum = 0;
+
+	for (int i = 0; i < span; i++)
+	{
+		sum += (int64_t)ibuf[span * quant + i] * point[(i + 1 - span / 2) * step];
+	}
+	return (int)((sum + (1 << 29)) >> 30);
+}
+//.....................................................................
+template <typename icoef>
+void quantizeCoeff(icoef* ibuf, const float* cbuf, int span, int nsets, int prec)
+{
+	for (int s = 0; s < nsets * span; s += span)
+	{
+		int64_t sum = 0;
+		int big = s;
+
+		for (int i = s; i < s + span; i++)
+		{
+			ibuf[i] = (icoef)llrint((double)cbuf[i] * (double)(1LL << prec));
+			sum += ibuf[i];
+
+			if (fabs(cbuf[i]) > fabs(cbuf[big]))
+				big = i;
+		}
+		// rounding error goes to largest tap
+		ibuf[big] += (icoef)((1LL << prec) - sum);
+	}
+}
+
+void Q14Coeff(int16_t* ibuf, const float* cbuf, int span, int nsets)
+{
+	quantizeCoeff(ibuf, cbuf, span, nsets, 14);
+}
+
+void Q30Coeff(int32_t* ibuf, const float* cbuf, int span, int nsets)
+{
+	quantizeCoeff(ibuf, cbuf, span, nsets, 30);
+}
 //.....................................................................
 void LinearIntCoeff(float* cbuf, int quantiles)
 {
 	float q = 0, qinc = 1.0f / quantiles;
 
-	for (int i = 0; i < 2 * quantiles; i += 2)
+	for (int i = 0; i <= 2 * quantiles; i += 2)
 	{
 		cbuf[i] = 1.0f - q;
 		cbuf[i + 1] = q;
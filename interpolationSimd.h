@@ -0,0 +1,463 @@
+#pragma once
+#ifndef INTERPOLATION_SIMD_H_V_C_MOHAN
+#define INTERPOLATION_SIMD_H_V_C_MOHAN
+//------------------------------------------------------------------------------
+// LaQuantile for a batch of output samples, 4, 8 or 16 at a time with SSE4.1,
+// AVX2 or AVX-512. For each row of span the source samples of all lanes are
+// gathered and multiplied with horizontal taps of their qx, and row sums then with
+// vertical taps of their qy, in same order as LaQuantile so results are same.
+// 8 bit samples can be done in integer with Q14 coefficients. There a pair of
+// taps is gathered as one dword and multiplied with pmaddwd, and row sums too.
+// Instruction set is chosen once at plugin load by laQuantileSelect, within
+// simdLevel. Scalar LaQuantile is the fallback, and does the tail of each batch.
+// Requires interpolationMethods.h
+//------------------------------------------------------------------------------
+#include "interpolationMethods.h"
+#include "simdLevel.h"
+
+// chooses LaQuantileBatch code, not above maxLevel nor simdLevel. Returns level chosen
+int laQuantileSelect(int maxLevel);
+// out[i] is LaQuantile(sp + offs[i], spitch, span, qx[i], qy[i], lbuf) before clamp.
+// spitch > 0. sp is start of plane, as integer lanes read up to 3 bytes before a tap
+template <typename finc>
+void LaQuantileBatch(float* out, const finc* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const float* lbuf);
+// same with LaQuantileQ14 for 8 bit samples. out is rounded, not clamped
+void LaQuantileBatchQ14(int* out, const uint8_t* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const int16_t* ibuf);
+
+//------------------------------------------------------------------------------
+static int laQuantileLevel = SIMD_NONE;
+
+template <typename finc>
+void LaQuantileBatchScalar(float* out, const finc* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const float* lbuf)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = LaQuantile(sp + offs[i], spitch, span, qx[i], qy[i], lbuf);
+}
+
+void LaQuantileBatchQ14Scalar(int* out, const uint8_t* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const int16_t* ibuf)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = LaQuantileQ14(sp + offs[i], spitch, span, qx[i], qy[i], ibuf);
+}
+
+#ifdef VFX_X86_SIMD
+//..............................................................................
+// SSE4.1 has no gather, lanes are loaded one by one
+template <typename finc>
+VFX_TARGET("sse4.1") int LaQuantileSse41(float* out, const finc* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const float* lbuf)
+{
+	int first = -(span / 2 - 1) * (spitch + 1);
+	int i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		const finc* pt[4];
+		const float* cx[4];
+		const float* cy[4];
+
+		for (int k = 0; k < 4; k++)
+		{
+			pt[k] = sp + offs[i + k] + first;
+			cx[k] = lbuf + span * qx[i + k];
+			cy[k] = lbuf + span * qy[i + k];
+		}
+		__m128 sum = _mm_setzero_ps();
+
+		for (int r = 0; r < span; r++)
+		{
+			__m128 xy = _mm_setzero_ps();
+
+			for (int t = 0; t < span; t++)
+			{
+				__m128 s = _mm_setr_ps((float)pt[0][t], (float)pt[1][t], (float)pt[2][t], (float)pt[3][t]);
+				__m128 c = _mm_setr_ps(cx[0][t], cx[1][t], cx[2][t], cx[3][t]);
+				xy = _mm_add_ps(xy, _mm_mul_ps(s, c));
+			}
+			sum = _mm_add_ps(sum, _mm_mul_ps(xy, _mm_setr_ps(cy[0][r], cy[1][r], cy[2][r], cy[3][r])));
+
+			for (int k = 0; k < 4; k++)
+				pt[k] += spitch;
+		}
+		_mm_storeu_ps(out + i, sum);
+	}
+	return i;
+}
+
+//..............................................................................
+// integer samples are gathered as the dword ending at them, so nothing past the
+// plane is read
+VFX_TARGET("avx2") static inline __m256 laGather8(const float* sp, __m256i idx)
+{
+	return _mm256_i32gather_ps(sp, idx, 4);
+}
+
+VFX_TARGET("avx2") static inline __m256 laGather8(const uint16_t* sp, __m256i idx)
+{
+	__m256i v = _mm256_i32gather_epi32((const int*)(sp - 1), idx, 2);
+	return _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16));
+}
+
+VFX_TARGET("avx2") static inline __m256 laGather8(const uint8_t* sp, __m256i idx)
+{
+	__m256i v = _mm256_i32gather_epi32((const int*)(sp - 3), idx, 1);
+	return _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 24));
+}
+
+template <typename finc>
+VFX_TARGET("avx2") int LaQuantileAvx2(float* out, const finc* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const float* lbuf)
+{
+	// samples read before a tap by dword gather
+	const __m256i back = _mm256_set1_epi32(4 / (int)sizeof(finc) - 1);
+	const __m256i first = _mm256_set1_epi32(-(span / 2 - 1) * (spitch + 1));
+	const __m256i vspan = _mm256_set1_epi32(span);
+	int i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i row = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(offs + i)), first);
+
+		if (_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(back, row))) != 0)
+		{
+			// at very start of plane
+			LaQuantileBatchScalar(out + i, sp, spitch, offs + i, qx + i, qy + i, 8, span, lbuf);
+			continue;
+		}
+		__m256i qxs = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(qx + i)), vspan);
+		__m256i qys = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(qy + i)), vspan);
+		__m256 cx[6], cy[6];
+
+		for (int t = 0; t < span; t++)
+		{
+			cx[t] = _mm256_i32gather_ps(lbuf, _mm256_add_epi32(qxs, _mm256_set1_epi32(t)), 4);
+			cy[t] = _mm256_i32gather_ps(lbuf, _mm256_add_epi32(qys, _mm256_set1_epi32(t)), 4);
+		}
+		__m256 sum = _mm256_setzero_ps();
+
+		for (int r = 0; r < span; r++)
+		{
+			__m256 xy = _mm256_setzero_ps();
+
+			for (int t = 0; t < span; t++)
+				xy = _mm256_add_ps(xy, _mm256_mul_ps(laGather8(sp, _mm256_add_epi32(row, _mm256_set1_epi32(t))), cx[t]));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(xy, cy[r]));
+			row = _mm256_add_epi32(row, _mm256_set1_epi32(spitch));
+		}
+		_mm256_storeu_ps(out + i, sum);
+	}
+	return i;
+}
+
+//..............................................................................
+// gcc 12 avx512 intrinsics pass an undefined vector as unused merge source, which
+// -Wall reports as uninitialized use in every caller. Nothing is read from it
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+VFX_TARGET("avx512f") static inline __m512 laGather16(const float* sp, __m512i idx)
+{
+	return _mm512_i32gather_ps(idx, sp, 4);
+}
+
+VFX_TARGET("avx512f") static inline __m512 laGather16(const uint16_t* sp, __m512i idx)
+{
+	__m512i v = _mm512_i32gather_epi32(idx, (const int*)(sp - 1), 2);
+	return _mm512_cvtepi32_ps(_mm512_srli_epi32(v, 16));
+}
+
+VFX_TARGET("avx512f") static inline __m512 laGather16(const uint8_t* sp, __m512i idx)
+{
+	__m512i v = _mm512_i32gather_epi32(idx, (const int*)(sp - 3), 1);
+	return _mm512_cvtepi32_ps(_mm512_srli_epi32(v, 24));
+}
+
+template <typename finc>
+VFX_TARGET("avx512f") int LaQuantileAvx512(float* out, const finc* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const float* lbuf)
+{
+	const __m512i back = _mm512_set1_epi32(4 / (int)sizeof(finc) - 1);
+	const __m512i first = _mm512_set1_epi32(-(span / 2 - 1) * (spitch + 1));
+	const __m512i vspan = _mm512_set1_epi32(span);
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		__m512i row = _mm512_add_epi32(_mm512_loadu_si512((const void*)(offs + i)), first);
+
+		if (_mm512_cmpgt_epi32_mask(back, row) != 0)
+		{
+			LaQuantileBatchScalar(out + i, sp, spitch, offs + i, qx + i, qy + i, 16, span, lbuf);
+			continue;
+		}
+		__m512i qxs = _mm512_mullo_epi32(_mm512_loadu_si512((const void*)(qx + i)), vspan);
+		__m512i qys = _mm512_mullo_epi32(_mm512_loadu_si512((const void*)(qy + i)), vspan);
+		__m512 cx[6], cy[6];
+
+		for (int t = 0; t < span; t++)
+		{
+			cx[t] = _mm512_i32gather_ps(_mm512_add_epi32(qxs, _mm512_set1_epi32(t)), lbuf, 4);
+			cy[t] = _mm512_i32gather_ps(_mm512_add_epi32(qys, _mm512_set1_epi32(t)), lbuf, 4);
+		}
+		__m512 sum = _mm512_setzero_ps();
+
+		for (int r = 0; r < span; r++)
+		{
+			__m512 xy = _mm512_setzero_ps();
+
+			for (int t = 0; t < span; t++)
+				xy = _mm512_add_ps(xy, _mm512_mul_ps(laGather16(sp, _mm512_add_epi32(row, _mm512_set1_epi32(t))), cx[t]));
+			sum = _mm512_add_ps(sum, _mm512_mul_ps(xy, cy[r]));
+			row = _mm512_add_epi32(row, _mm512_set1_epi32(spitch));
+		}
+		_mm512_storeu_ps(out + i, sum);
+	}
+	return i;
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+//..............................................................................
+// Q14 for 8 bit. Taps t, t + 1 come from the dword ending at t + 1, whose bytes 2
+// and 3 are spread to 16 bit halves, and so 2 bytes before first tap are read.
+// Coefficient pairs are dwords of ibuf as span is even. Row sums rounded to Q6
+// are paired for vertical taps in same way
+VFX_TARGET("sse4.1") static inline __m128i laPairs4(const uint8_t* sp, const int* idx)
+{
+	int v[4];
+
+	for (int k = 0; k < 4; k++)
+		memcpy(v + k, sp + idx[k], 4);
+	__m128i spread = _mm_setr_epi8(2, -1, 3, -1, 6, -1, 7, -1, 10, -1, 11, -1, 14, -1, 15, -1);
+	return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)v), spread);
+}
+
+VFX_TARGET("sse4.1") int LaQuantileQ14Sse41(int* out, const uint8_t* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const int16_t* ibuf)
+{
+	int first = -(span / 2 - 1) * (spitch + 1) - 2;
+	const int* ipair = (const int*)ibuf;
+	const __m128i lo16 = _mm_set1_epi32(0xffff);
+	int i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		int row[4];
+		bool low = false;
+
+		for (int k = 0; k < 4; k++)
+		{
+			row[k] = offs[i + k] + first;
+			low |= row[k] < 0;
+		}
+		if (low)
+		{
+			// at very start of plane
+			LaQuantileBatchQ14Scalar(out + i, sp, spitch, offs + i, qx + i, qy + i, 4, span, ibuf);
+			continue;
+		}
+		__m128i cx[3], cy[3], xy[6];
+
+		for (int k = 0; k < span / 2; k++)
+		{
+			cx[k] = _mm_setr_epi32(ipair[qx[i] * span / 2 + k], ipair[qx[i + 1] * span / 2 + k],
+				ipair[qx[i + 2] * span / 2 + k], ipair[qx[i + 3] * span / 2 + k]);
+			cy[k] = _mm_setr_epi32(ipair[qy[i] * span / 2 + k], ipair[qy[i + 1] * span / 2 + k],
+				ipair[qy[i + 2] * span / 2 + k], ipair[qy[i + 3] * span / 2 + k]);
+		}
+		for (int r = 0; r < span; r++)
+		{
+			__m128i acc = _mm_setzero_si128();
+
+			for (int k = 0; k < span / 2; k++)
+			{
+				int idx[4] = { row[0] + 2 * k, row[1] + 2 * k, row[2] + 2 * k, row[3] + 2 * k };
+				acc = _mm_add_epi32(acc, _mm_madd_epi16(laPairs4(sp, idx), cx[k]));
+			}
+			xy[r] = _mm_srai_epi32(_mm_add_epi32(acc, _mm_set1_epi32(1 << 7)), 8);
+
+			for (int k = 0; k < 4; k++)
+				row[k] += spitch;
+		}
+		__m128i sum = _mm_setzero_si128();
+
+		for (int k = 0; k < span / 2; k++)
+		{
+			__m128i pair = _mm_or_si128(_mm_and_si128(xy[2 * k], lo16), _mm_slli_epi32(xy[2 * k + 1], 16));
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(pair, cy[k]));
+		}
+		_mm_storeu_si128((__m128i*)(out + i), _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << 19)), 20));
+	}
+	return i;
+}
+
+VFX_TARGET("avx2") int LaQuantileQ14Avx2(int* out, const uint8_t* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const int16_t* ibuf)
+{
+	const __m256i first = _mm256_set1_epi32(-(span / 2 - 1) * (spitch + 1) - 2);
+	const __m256i vhalf = _mm256_set1_epi32(span / 2);
+	const __m256i spread = _mm256_setr_epi8(2, -1, 3, -1, 6, -1, 7, -1, 10, -1, 11, -1, 14, -1, 15, -1,
+		2, -1, 3, -1, 6, -1, 7, -1, 10, -1, 11, -1, 14, -1, 15, -1);
+	const __m256i lo16 = _mm256_set1_epi32(0xffff);
+	const int* ipair = (const int*)ibuf;
+	int i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i row = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(offs + i)), first);
+
+		if (_mm256_movemask_ps(_mm256_castsi256_ps(row)) != 0)
+		{
+			LaQuantileBatchQ14Scalar(out + i, sp, spitch, offs + i, qx + i, qy + i, 8, span, ibuf);
+			continue;
+		}
+		__m256i qxs = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(qx + i)), vhalf);
+		__m256i qys = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(qy + i)), vhalf);
+		__m256i cx[3], cy[3], xy[6];
+
+		for (int k = 0; k < span / 2; k++)
+		{
+			cx[k] = _mm256_i32gather_epi32(ipair, _mm256_add_epi32(qxs, _mm256_set1_epi32(k)), 4);
+			cy[k] = _mm256_i32gather_epi32(ipair, _mm256_add_epi32(qys, _mm256_set1_epi32(k)), 4);
+		}
+		for (int r = 0; r < span; r++)
+		{
+			__m256i acc = _mm256_setzero_si256();
+
+			for (int k = 0; k < span / 2; k++)
+			{
+				__m256i v = _mm256_i32gather_epi32((const int*)sp, _mm256_add_epi32(row, _mm256_set1_epi32(2 * k)), 1);
+				acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_shuffle_epi8(v, spread), cx[k]));
+			}
+			xy[r] = _mm256_srai_epi32(_mm256_add_epi32(acc, _mm256_set1_epi32(1 << 7)), 8);
+			row = _mm256_add_epi32(row, _mm256_set1_epi32(spitch));
+		}
+		__m256i sum = _mm256_setzero_si256();
+
+		for (int k = 0; k < span / 2; k++)
+		{
+			__m256i pair = _mm256_or_si256(_mm256_and_si256(xy[2 * k], lo16), _mm256_slli_epi32(xy[2 * k + 1], 16));
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(pair, cy[k]));
+		}
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(1 << 19)), 20));
+	}
+	return i;
+}
+
+// undefined merge source of gcc intrinsics, as for LaQuantileAvx512
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+VFX_TARGET("avx512f,avx512bw") int LaQuantileQ14Avx512(int* out, const uint8_t* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const int16_t* ibuf)
+{
+	const __m512i first = _mm512_set1_epi32(-(span / 2 - 1) * (spitch + 1) - 2);
+	const __m512i vhalf = _mm512_set1_epi32(span / 2);
+	const __m512i spread = _mm512_broadcast_i32x4(_mm_setr_epi8(2, -1, 3, -1, 6, -1, 7, -1, 10, -1, 11, -1, 14, -1, 15, -1));
+	const __m512i lo16 = _mm512_set1_epi32(0xffff);
+	const int* ipair = (const int*)ibuf;
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		__m512i row = _mm512_add_epi32(_mm512_loadu_si512((const void*)(offs + i)), first);
+
+		if (_mm512_cmplt_epi32_mask(row, _mm512_setzero_si512()) != 0)
+		{
+			LaQuantileBatchQ14Scalar(out + i, sp, spitch, offs + i, qx + i, qy + i, 16, span, ibuf);
+			continue;
+		}
+		__m512i qxs = _mm512_mullo_epi32(_mm512_loadu_si512((const void*)(qx + i)), vhalf);
+		__m512i qys = _mm512_mullo_epi32(_mm512_loadu_si512((const void*)(qy + i)), vhalf);
+		__m512i cx[3], cy[3], xy[6];
+
+		for (int k = 0; k < span / 2; k++)
+		{
+			cx[k] = _mm512_i32gather_epi32(_mm512_add_epi32(qxs, _mm512_set1_epi32(k)), ipair, 4);
+			cy[k] = _mm512_i32gather_epi32(_mm512_add_epi32(qys, _mm512_set1_epi32(k)), ipair, 4);
+		}
+		for (int r = 0; r < span; r++)
+		{
+			__m512i acc = _mm512_setzero_si512();
+
+			for (int k = 0; k < span / 2; k++)
+			{
+				__m512i v = _mm512_i32gather_epi32(_mm512_add_epi32(row, _mm512_set1_epi32(2 * k)), (const int*)sp, 1);
+				acc = _mm512_add_epi32(acc, _mm512_madd_epi16(_mm512_shuffle_epi8(v, spread), cx[k]));
+			}
+			xy[r] = _mm512_srai_epi32(_mm512_add_epi32(acc, _mm512_set1_epi32(1 << 7)), 8);
+			row = _mm512_add_epi32(row, _mm512_set1_epi32(spitch));
+		}
+		__m512i sum = _mm512_setzero_si512();
+
+		for (int k = 0; k < span / 2; k++)
+		{
+			__m512i pair = _mm512_or_si512(_mm512_and_si512(xy[2 * k], lo16), _mm512_slli_epi32(xy[2 * k + 1], 16));
+			sum = _mm512_add_epi32(sum, _mm512_madd_epi16(pair, cy[k]));
+		}
+		_mm512_storeu_si512((void*)(out + i), _mm512_srai_epi32(_mm512_add_epi32(sum, _mm512_set1_epi32(1 << 19)), 20));
+	}
+	return i;
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+//------------------------------------------------------------------------------
+int laQuantileSelect(int maxLevel)
+{
+	laQuantileLevel = simdLevel < maxLevel ? simdLevel : maxLevel;
+	return laQuantileLevel;
+}
+
+template <typename finc>
+void LaQuantileBatch(float* out, const finc* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const float* lbuf)
+{
+	int done = 0;
+	// span 0 is nearest sample and span is at most 6
+#ifdef VFX_X86_SIMD
+	if (span > 0 && span <= 6)
+	{
+		if (laQuantileLevel >= SIMD_AVX512)
+			done = LaQuantileAvx512(out, sp, spitch, offs, qx, qy, n, span, lbuf);
+		// also tail of avx512
+		if (laQuantileLevel >= SIMD_AVX2)
+			done += LaQuantileAvx2(out + done, sp, spitch, offs + done, qx + done, qy + done, n - done, span, lbuf);
+		else if (laQuantileLevel >= SIMD_SSE41)
+			done = LaQuantileSse41(out, sp, spitch, offs, qx, qy, n, span, lbuf);
+	}
+#endif
+	LaQuantileBatchScalar(out + done, sp, spitch, offs + done, qx + done, qy + done, n - done, span, lbuf);
+}
+
+void LaQuantileBatchQ14(int* out, const uint8_t* sp, int spitch, const int* offs,
+	const int* qx, const int* qy, int n, int span, const int16_t* ibuf)
+{
+	int done = 0;
+	// pairs of taps need even span
+#ifdef VFX_X86_SIMD
+	if (span > 0 && span <= 6 && (span & 1) == 0)
+	{
+		if (laQuantileLevel >= SIMD_AVX512)
+			done = LaQuantileQ14Avx512(out, sp, spitch, offs, qx, qy, n, span, ibuf);
+		if (laQuantileLevel >= SIMD_AVX2)
+			done += LaQuantileQ14Avx2(out + done, sp, spitch, offs + done, qx + done, qy + done, n - done, span, ibuf);
+		else if (laQuantileLevel >= SIMD_SSE41)
+			done = LaQuantileQ14Sse41(out, sp, spitch, offs, qx, qy, n, span, ibuf);
+	}
+#endif
+	LaQuantileBatchQ14Scalar(out + done, sp, spitch, offs + done, qx + done, qy + done, n - done, span, ibuf);
+}
+
+#endif
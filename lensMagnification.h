@@ -2,7 +2,8 @@
 /*............................................................................
  For vapoursynth
 Lens Magnification creates a disc with underlying image magnified uniformly or 
-varying as seen through a water drop. Requires interpolationMethods.h
+varying as seen through a water drop. Requires interpolationMethods.h,
+interpolationSimd.h, framePlanes.h, discSpans.h, scratchArena.h and warpMap.h
 
  Author V.C.Mohan
  Date 13 Mar 2021
@@ -27,88 +28,192 @@ This program is free software: you can redistribute it and/or modify
 #define LENS_MAGNIFICATION_V_C_MOHAN_2021
 
 #include "interpolationMethods.h"
-
-// circular area magnification by a lens. cx, cy center coordinates
+#include "interpolationSimd.h"
+#include "framePlanes.h"
+#include "discSpans.h"
+#include "scratchArena.h"
+#include "warpMap.h"
+
+// warp map of a lens of radius and magnification mag. Row r is at dy = r - radius
+// from center and holds entries for dx = -hw to hw, hw its discHalfWidth
+WarpMap* lensWarpMap(int radius, float mag, int quantiles, bool drop);
+// circular area magnification by a lens in np planes of same size. cx, cy center
+// coordinates in luma. min, max are clamp limits of each of the np planes.
+// map is lensWarpMap of radius. q14Coeff, if not NULL, interpolates 8 bit samples in integer.
+// Only luma rows y0 to y1 - 1 are done, so that bands of rows can be done by threads
+template <typename finc>
+void circularLensMagnification(const FramePlane* pl, int np, const finc* min, const finc* max,
+     int ht, int wd, int radius, int cx, int cy, const WarpMap* map, int span,
+     float * coeff, const int16_t* q14Coeff, int y0, int y1);
+// magnifies all planes of frame, each at its own resolution, in luma rows y0 to y1 - 1
 template <typename finc>
-void circularLensMagnification(finc** dp, const finc** sp, int np, int* pitch,
-     int ht, int wd, int* subW , int* subH , finc min, finc max,
-     int radius, int cx, int cy, float mag,  int span, 
-     float * coeff, int quantiles, bool drop);
+void lensMagnifyPlanes(const FramePlane* pl, int np, const VSFormat* fi,
+    int ht, int wd, int radius, int cx, int cy, const WarpMap* map, int span,
+    float* coeff, const int16_t* q14Coeff, int y0, int y1);
+
+//.....................................................................................
+WarpMap* lensWarpMap(int radius, float mag, int quantiles, bool drop)
+{
+    int rsq = radius * radius;
+    float rmag = mag;
+    ScratchArena* tmp = scratchBegin();
+    int* rowLength = scratchAlloc<int>(tmp, sizeof(int) * (2 * radius + 1));
+
+    for (int r = 0; r <= 2 * radius; r++)
+        rowLength[r] = 2 * discHalfWidth(rsq, r - radius) + 1;
+
+    WarpMap* map = warpMapCreate(2 * radius + 1, rowLength);
+    scratchEnd(tmp);
+
+    for (int r = 0; r <= 2 * radius; r++)
+    {
+        // offsets from output to center, as center - output
+        int v = radius - r;
+        int hw = discHalfWidth(rsq, v);
+        WarpEntry* e = warpMapRow(map, r);
+
+        for (int u = hw; u >= -hw; u--, e++)
+        {
+            if (drop)
+            {
+                // magnification decreases from center towards periphery
+                rmag = mag * (1.0f + ((v * v + u * u) / (float)rsq)) / 2.0f;
+            }
+            float xsource = u / rmag;
+            int xs = (int)xsource;
+            if (u > 0)
+                xs++;
+
+            float ysource = v / rmag;
+            int ys = (int)ysource;
+            if (v > 0)
+                ys++;
+
+            e->dx = (int16_t)(u - xs);
+            e->dy = (int16_t)(v - ys);
+            e->qx = (uint8_t)(int)(fabs(xsource - xs) * quantiles);
+            e->qy = (uint8_t)(int)(fabs(ysource - ys) * quantiles);
+        }
+    }
+    return map;
+}
 
 //.....................................................................................
 template <typename finc>
-void circularLensMagnification(finc** dp, const finc** sp, int np, int* pitch,
-    int ht, int wd, int* subW , int* subH , finc min, finc max,
-    int radius, int cx, int cy, float mag, int span,
-    float* coeff, int quantiles, bool drop)
+void circularLensMagnification(const FramePlane* pl, int np, const finc* min, const finc* max,
+    int ht, int wd, int radius, int cx, int cy, const WarpMap* map, int span,
+    float* coeff, const int16_t* q14Coeff, int y0, int y1)
 {
     int sx = VSMIN(VSMAX(cx - radius, span / 2), wd - span / 2);
     int ex = VSMIN(VSMAX(cx + radius, span / 2), wd - span / 2 );
 
     int sy = VSMIN(VSMAX(cy - radius, span / 2), ht - span / 2);
     int ey = VSMIN(VSMAX(cy + radius, span / 2), ht - span / 2);
+    // band of rows
+    sy = VSMAX(sy, y0);
+    ey = VSMIN(ey, y1);
     int rsq = radius * radius;
-    float rmag = mag;
-
-    int andH = (1 << subH[1]) - 1;
-    int andW = (1 << subW[1]) - 1;    
 
-    for (int h = sy; h < ey; h++)
+    int pitch = pl[0].pitch;
+    int subW = pl[0].subW, subH = pl[0].subH;
+    // subsampled planes take nearest sample, others are interpolated
+    bool interpolate = subW == 0 && subH == 0;
+    int wstart = planeStart(sx, subW), wend = planeStart(ex, subW);
+
+    // interpolated rows are done as a batch. source offsets and quantiles of a row
+    ScratchArena* scratch = scratchBegin();
+    int* offs = scratchAlloc<int>(scratch, sizeof(int) * (wend - wstart + 1));
+    int* qxs = scratchAlloc<int>(scratch, sizeof(int) * (wend - wstart + 1));
+    int* qys = scratchAlloc<int>(scratch, sizeof(int) * (wend - wstart + 1));
+    float* out = scratchAlloc<float>(scratch, sizeof(float) * (wend - wstart + 1));
+    int* iout = scratchAlloc<int>(scratch, sizeof(int) * (wend - wstart + 1));
+
+    for (int hp = planeStart(sy, subH); hp < planeStart(ey, subH); hp++)
     {
-        int hsq = (cy - h) * (cy - h);
+        int h = hp << subH;     // luma coordinates
+        int x0, x1;
+        // samples of this row inside lens
+        if (!discRowSpan(&x0, &x1, cx, rsq, cy - h, subW, wstart, wend))
+            continue;
+        // map entry of luma w is at w - cx + hw of row
+        const WarpEntry* row = warpMapRow(map, h - cy + radius) + discHalfWidth(rsq, cy - h) - cx;
+
+        for (int wp = x0, w = x0 << subW; wp < x1; wp++, w += 1 << subW)
+        {
+            const WarpEntry* e = row + w;
+            int framex = w + e->dx;
+            int framey = h + e->dy;
+
+            if (interpolate)
+            {
+                offs[wp - x0] = framey * pitch + framex;
+                qxs[wp - x0] = e->qx;
+                qys[wp - x0] = e->qy;
+                continue;
+            }
+            for (int p = 0; p < np; p++)
+            {
+                finc* dpp = (finc*)pl[p].dp;
+                const finc* spp = (const finc*)pl[p].sp;
 
-        for (int w = sx; w < ex; w++)
+                dpp[hp * pitch + wp] 
+                    = spp[(framey >> subH) * pitch + (framex >> subW)];
+            }
+        }
+        if (interpolate)
         {
-            if (hsq + (cx - w) * (cx - w) <= rsq)
+            for (int p = 0; p < np; p++)
             {
-                if (drop)
-                {
-                    // magnification decreases from center towards periphery
-                    rmag = mag * (1.0f + ((hsq + (cx - w) * (cx - w)) / (float)rsq) ) / 2.0f;
-                }
-                float xsource = (cx - w) / rmag;
-                
-                int xs = (int)xsource;
-                if (cx > w)
-                    xs++;
-                int qx = (int)(fabs(xsource - xs) * quantiles);
-                int framex = cx - xs;
-
-                float ysource = (cy - h) / rmag;
-                int ys = (int)ysource;
-                if (cy > h)
-                    ys++;
-                int qy = (int)(fabs(ysource - ys) * quantiles);
-                int framey = cy - ys;
-
-                for (int p = 0; p < np; p++)
+                finc* dpp = (finc*)pl[p].dp + h * pitch;
+
+                if (sizeof(finc) == 1 && q14Coeff != NULL)
                 {
-                    
-                    finc* dpp = (finc*)(dp[p]); //+ sy * pitch[p];
-                    const finc* spp = (finc*)(sp[p]); // +sy * pitch[p];
-
-                    if (p == 0 || (subH[p] == 0 && subW[p] == 0))
-                    {                        
-                        dpp[h * pitch[p] + w]
-                            = clamp(LaQuantile(spp + framey * pitch[p] + framex, pitch[p],
-                                span, qx, qy, coeff), min, max);
-                    }
-
-                    else if ( p > 0 && (h & andH) == 0 && (w & andW) == 0)
-                    {
-                        
-                        dpp[(h >> subH[p]) * pitch[p] + (w >> subW[p])] 
-                            = spp[(framey >> subH[p]) * pitch[p] + (framex >> subW[p])];
-                    }
+                    LaQuantileBatchQ14(iout, (const uint8_t*)pl[p].sp, pitch, offs, qxs, qys, x1 - x0, span, q14Coeff);
 
+                    for (int k = 0; k < x1 - x0; k++)
+                        dpp[x0 + k] = iclamp(iout[k], min[p], max[p]);
+                    continue;
                 }
+                LaQuantileBatch(out, (const finc*)pl[p].sp, pitch, offs, qxs, qys, x1 - x0, span, coeff);
+
+                for (int k = 0; k < x1 - x0; k++)
+                    dpp[x0 + k] = clamp(out[k], min[p], max[p]);
             }
+        }
+    }
+    scratchEnd(scratch);
+}
+
+//.....................................................................................
+template <typename finc>
+void lensMagnifyPlanes(const FramePlane* pl, int np, const VSFormat* fi,
+    int ht, int wd, int radius, int cx, int cy, const WarpMap* map, int span,
+    float* coeff, const int16_t* q14Coeff, int y0, int y1)
+{
+    finc min[3], max[3];
 
+    for (int p = 0; p < np; p++)
+    {
+        if (sizeof(finc) == 4)
+        {
+            // U, V float planes are centered on 0
+            bool uv = p > 0 && fi->colorFamily == cmYUV;
+            min[p] = (finc)(uv ? -0.5f : 0.0f);
+            max[p] = (finc)(uv ? 0.5f : 1.0f);
+        }
+        else
+        {
+            min[p] = (finc)((fi->colorFamily == cmRGB ? 0 : 16) << (fi->bitsPerSample - 8));
+            max[p] = (finc)((fi->colorFamily == cmRGB ? 255 : 236) << (fi->bitsPerSample - 8));
         }
     }
+    // luma size planes, then subsampled ones
+    int nfull = lumaSizePlanes(pl, np);
 
-    
-}
+    for (int p = 0; p < np; p += nfull, nfull = np - nfull)
 
+        circularLensMagnification<finc>(pl + p, nfull, min + p, max + p,
+            ht, wd, radius, cx, cy, map, span, coeff, q14Coeff, y0, y1);
+}
 
 #endif
\ No newline at end of file
@@ -0,0 +1,220 @@
+#pragma once
+#ifndef PARTICLES_H_V_C_MOHAN
+#define PARTICLES_H_V_C_MOHAN
+//------------------------------------------------------------------------------
+// Particles of firework like effects. Each property is an array of its own, so
+// that an effect finds positions of all particles of a frame from their closed
+// form trajectories over the particle index, 4 or 8 at a time with SSE4.1 or
+// AVX2 as simdLevel allows and in a scalar loop for the tail. particlesCull then
+// drops particles out of drawable area, keeping order, and particlesStamp draws
+// the rest. Particles are drawn in order, so a later one covers an earlier one,
+// same as when drawn one by one.
+// Positions are in luma coordinates. Arrays are from scratch memory of frame,
+// and an effect with many particles may draw and clear them in batches.
+// Requires simdLevel.h and scratchArena.h
+//------------------------------------------------------------------------------
+typedef struct {
+	int* x;
+	int* y;
+	int* id;	// color of particle, or its entry in effect tables
+	int count;
+	int capacity;
+} Particles;
+
+// on subsampled planes every plane sample under a dot is written
+#define PARTICLE_CHROMA_COVER 0
+// on subsampled planes only a dot with top left on a plane sample writes that sample
+#define PARTICLE_CHROMA_ALIGNED 1
+
+// arrays for capacity particles. count is 0
+void particlesBegin(Particles* ps, ScratchArena* scratch, int capacity);
+// keeps particles with x0 < x < x1 and y0 < y < y1
+void particlesCull(Particles* ps, int x0, int y0, int x1, int y1);
+// draws dots of dotw x doth samples with top left at particle, colors[3 * id + p] on plane p
+template <typename finc>
+void particlesStamp(const FramePlane* pl, int np, const Particles* ps, const finc* colors,
+	int dotw, int doth, int chroma);
+
+//------------------------------------------------------------------------------
+void particlesBegin(Particles* ps, ScratchArena* scratch, int capacity)
+{
+	ps->x = scratchAlloc<int>(scratch, sizeof(int) * capacity);
+	ps->y = scratchAlloc<int>(scratch, sizeof(int) * capacity);
+	ps->id = scratchAlloc<int>(scratch, sizeof(int) * capacity);
+	ps->count = 0;
+	ps->capacity = capacity;
+}
+
+#ifdef VFX_X86_SIMD
+// kept lanes of a vector packed to its front. Lane order of each mask is in
+// nibbles, and also as pshufb control for 4 lanes
+typedef struct ParticlePackTable {
+	uint32_t order[256];
+	uint8_t shuffle[16][16];
+	uint8_t kept[256];
+
+	ParticlePackTable()
+	{
+		for (int m = 0; m < 256; m++)
+		{
+			int k = 0;
+			order[m] = 0;
+
+			for (int lane = 0; lane < 8; lane++)
+			{
+				if (m & (1 << lane))
+				{
+					if (m < 16)
+						for (int b = 0; b < 4; b++)
+							shuffle[m][4 * k + b] = (uint8_t)(4 * lane + b);
+					order[m] |= (uint32_t)lane << (4 * k++);
+				}
+			}
+			kept[m] = (uint8_t)k;
+			// rest of lanes are zero
+			for (int j = k; m < 16 && j < 4; j++)
+				for (int b = 0; b < 4; b++)
+					shuffle[m][4 * j + b] = 0x80;
+		}
+	}
+} ParticlePackTable;
+
+static const ParticlePackTable particlePack;
+
+// appends lanes of mask keep at ps->count. All 4 lanes are stored, so ps->count
+// must not be past the index of first lane, when packing in place
+VFX_TARGET("sse4.1") static inline void particlesPackSse41(Particles* ps, __m128i x, __m128i y, __m128i id, int keep)
+{
+	__m128i sh = _mm_loadu_si128((const __m128i*)particlePack.shuffle[keep]);
+	int k = ps->count;
+
+	_mm_storeu_si128((__m128i*)(ps->x + k), _mm_shuffle_epi8(x, sh));
+	_mm_storeu_si128((__m128i*)(ps->y + k), _mm_shuffle_epi8(y, sh));
+	_mm_storeu_si128((__m128i*)(ps->id + k), _mm_shuffle_epi8(id, sh));
+	ps->count += particlePack.kept[keep];
+}
+
+// same for 8 lanes
+VFX_TARGET("avx2") static inline void particlesPackAvx2(Particles* ps, __m256i x, __m256i y, __m256i id, int keep)
+{
+	__m256i order = _mm256_srlv_epi32(_mm256_set1_epi32((int)particlePack.order[keep]), _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28));
+	int k = ps->count;
+
+	order = _mm256_and_si256(order, _mm256_set1_epi32(7));
+	_mm256_storeu_si256((__m256i*)(ps->x + k), _mm256_permutevar8x32_epi32(x, order));
+	_mm256_storeu_si256((__m256i*)(ps->y + k), _mm256_permutevar8x32_epi32(y, order));
+	_mm256_storeu_si256((__m256i*)(ps->id + k), _mm256_permutevar8x32_epi32(id, order));
+	ps->count += particlePack.kept[keep];
+}
+
+// kept ones of first n are appended at ps->count. Returns particles examined
+VFX_TARGET("sse4.1") int particlesCullSse41(Particles* ps, int n, int x0, int y0, int x1, int y1)
+{
+	const __m128i vx0 = _mm_set1_epi32(x0), vy0 = _mm_set1_epi32(y0);
+	const __m128i vx1 = _mm_set1_epi32(x1), vy1 = _mm_set1_epi32(y1);
+	int i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)(ps->x + i));
+		__m128i y = _mm_loadu_si128((const __m128i*)(ps->y + i));
+		__m128i id = _mm_loadu_si128((const __m128i*)(ps->id + i));
+		__m128i in = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(x, vx0), _mm_cmplt_epi32(x, vx1)),
+			_mm_and_si128(_mm_cmpgt_epi32(y, vy0), _mm_cmplt_epi32(y, vy1)));
+
+		particlesPackSse41(ps, x, y, id, _mm_movemask_ps(_mm_castsi128_ps(in)));
+	}
+	return i;
+}
+
+VFX_TARGET("avx2") int particlesCullAvx2(Particles* ps, int n, int x0, int y0, int x1, int y1)
+{
+	const __m256i vx0 = _mm256_set1_epi32(x0), vy0 = _mm256_set1_epi32(y0);
+	const __m256i vx1 = _mm256_set1_epi32(x1), vy1 = _mm256_set1_epi32(y1);
+	int i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)(ps->x + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(ps->y + i));
+		__m256i id = _mm256_loadu_si256((const __m256i*)(ps->id + i));
+		__m256i in = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(x, vx0), _mm256_cmpgt_epi32(vx1, x)),
+			_mm256_and_si256(_mm256_cmpgt_epi32(y, vy0), _mm256_cmpgt_epi32(vy1, y)));
+
+		particlesPackAvx2(ps, x, y, id, _mm256_movemask_ps(_mm256_castsi256_ps(in)));
+	}
+	return i;
+}
+#endif
+
+void particlesCull(Particles* ps, int x0, int y0, int x1, int y1)
+{
+	int n = ps->count, i = 0, k;
+	// kept ones of vector part are at front, and tail follows them
+	ps->count = 0;
+#ifdef VFX_X86_SIMD
+	if (simdLevel >= SIMD_AVX2)
+		i = particlesCullAvx2(ps, n, x0, y0, x1, y1);
+	else if (simdLevel >= SIMD_SSE41)
+		i = particlesCullSse41(ps, n, x0, y0, x1, y1);
+#endif
+	k = ps->count;
+	// every particle is copied, and only kept ones advance k. No branch
+	for (; i < n; i++)
+	{
+		int x = ps->x[i], y = ps->y[i];
+
+		ps->x[k] = x;
+		ps->y[k] = y;
+		ps->id[k] = ps->id[i];
+		k += (x > x0) & (x < x1) & (y > y0) & (y < y1);
+	}
+	ps->count = k;
+}
+
+template <typename finc>
+void particlesStamp(const FramePlane* pl, int np, const Particles* ps, const finc* colors,
+	int dotw, int doth, int chroma)
+{
+	for (int p = 0; p < np; p++)
+	{
+		finc* dp = (finc*)pl[p].dp;
+		int pitch = pl[p].pitch, subW = pl[p].subW, subH = pl[p].subH;
+
+		if (subW == 0 && subH == 0)
+		{
+			for (int i = 0; i < ps->count; i++)
+			{
+				finc c = colors[3 * ps->id[i] + p];
+				finc* d = dp + ps->y[i] * pitch + ps->x[i];
+
+				for (int h = 0; h < doth; h++, d += pitch)
+					for (int w = 0; w < dotw; w++)
+						d[w] = c;
+			}
+			continue;
+		}
+		int andW = (1 << subW) - 1, andH = (1 << subH) - 1;
+
+		for (int i = 0; i < ps->count; i++)
+		{
+			finc c = colors[3 * ps->id[i] + p];
+			int x = ps->x[i], y = ps->y[i];
+
+			if (chroma == PARTICLE_CHROMA_ALIGNED)
+			{
+				if ((x & andW) == 0 && (y & andH) == 0)
+					dp[(y >> subH) * pitch + (x >> subW)] = c;
+				continue;
+			}
+			// plane samples under dot, each once
+			int cx0 = x >> subW, cx1 = (x + dotw - 1) >> subW;
+
+			for (int cy = y >> subH; cy <= (y + doth - 1) >> subH; cy++)
+				for (int cx = cx0; cx <= cx1; cx++)
+					dp[cy * pitch + cx] = c;
+		}
+	}
+}
+
+#endif
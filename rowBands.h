@@ -0,0 +1,231 @@
+#pragma once
+#ifndef ROW_BANDS_H_V_C_MOHAN
+#define ROW_BANDS_H_V_C_MOHAN
+//------------------------------------------------------------------------------
+// Work of one frame split into bands of rows, processed by a pool of worker
+// threads. VapourSynth runs frames in parallel, but a single frame, as of a
+// still image, has one thread. With this it uses up to threads cores.
+// Bands are dealt in equal shares to threads taking part, the calling thread
+// being one. A thread that ends its share steals bands from the end of other
+// shares. Bands must write disjoint samples, so that output is same for any
+// number of threads. Workers are started when first needed and are stopped when
+// last filter using bands is freed, as the plugin may be unloaded after that.
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define BAND_MAX_THREADS 64
+// rows of a band, less if that gives fewer than 4 bands a thread
+#define BAND_ROWS 16
+
+// processes rows row0 to row1 - 1 of work
+typedef void (*BandFunc)(void* work, int row0, int row1);
+
+typedef struct BandJob {
+	BandFunc fn;
+	void* work;
+	int nrows;
+	int bandRows;
+	int nshares;
+	// bands [next, end) of each share, as next | end << 32
+	std::atomic<uint64_t> share[BAND_MAX_THREADS];
+	int joined;				// shares given out. Share 0 is of caller
+	int active;				// workers in job
+	struct BandJob* next;	// in queue of jobs wanting workers
+} BandJob;
+
+typedef struct {
+	std::mutex lock;
+	std::condition_variable wake;	// workers wait for jobs
+	std::condition_variable idle;	// callers wait for workers to leave their job
+	BandJob* jobs;
+	std::thread worker[BAND_MAX_THREADS];
+	int nworkers;
+	int users;			// filter instances between bandsAttach and bandsDetach
+	int generation;		// workers of an older generation exit
+} BandPool;
+
+// threads param of a filter. 0 is all cores
+int bandThreads(int threads);
+// a filter instance calls bandsAttach before createFilter and bandsDetach in its free.
+// Last detach stops and joins workers
+void bandsAttach();
+void bandsDetach();
+// runs fn over rows 0 to nrows - 1 on up to threads threads, and returns when all are done.
+// threads 1 runs fn on all rows in calling thread
+void bandsRun(int threads, int nrows, BandFunc fn, void* work);
+
+//------------------------------------------------------------------------------
+// never freed. A host may exit with filters not freed and workers running, and
+// destroying a joinable std::thread then would terminate the process
+static BandPool* bandPool()
+{
+	static BandPool* pool = new BandPool();
+	return pool;
+}
+
+// next band of share s, from its front if own, else from its end. -1 if none
+static int bandTake(BandJob* job, int s, bool own)
+{
+	uint64_t v = job->share[s].load();
+
+	while (true)
+	{
+		uint32_t next = (uint32_t)v, end = (uint32_t)(v >> 32);
+
+		if (next >= end)
+			return -1;
+		uint64_t nv = own ? v + 1 : ((uint64_t)(end - 1) << 32) | next;
+
+		if (job->share[s].compare_exchange_weak(v, nv))
+			return own ? (int)next : (int)end - 1;
+	}
+}
+
+static void bandDo(BandJob* job, int band)
+{
+	int row0 = band * job->bandRows;
+
+	job->fn(job->work, row0, VSMIN(row0 + job->bandRows, job->nrows));
+}
+
+// own share, then steals. Shares only shrink, so one round over others is enough
+static void bandWork(BandJob* job, int s)
+{
+	int band;
+
+	while ((band = bandTake(job, s, true)) >= 0)
+		bandDo(job, band);
+
+	for (int k = 1; k < job->nshares; k++)
+	{
+		int victim = (s + k) % job->nshares;
+
+		while ((band = bandTake(job, victim, false)) >= 0)
+			bandDo(job, band);
+	}
+}
+
+static void bandWorker(BandPool* pool, int generation)
+{
+	std::unique_lock<std::mutex> guard(pool->lock);
+
+	while (true)
+	{
+		while (pool->jobs == NULL && pool->generation == generation)
+			pool->wake.wait(guard);
+
+		if (pool->generation != generation)
+			return;
+
+		BandJob* job = pool->jobs;
+		int s = job->joined++;
+
+		if (job->joined == job->nshares)
+			pool->jobs = job->next;
+		job->active++;
+		guard.unlock();
+		bandWork(job, s);
+		guard.lock();
+
+		if (--job->active == 0)
+			pool->idle.notify_all();
+	}
+}
+
+int bandThreads(int threads)
+{
+	if (threads == 0)
+		threads = (int)std::thread::hardware_concurrency();
+	return VSMIN(VSMAX(threads, 1), BAND_MAX_THREADS);
+}
+
+void bandsAttach()
+{
+	BandPool* pool = bandPool();
+	std::lock_guard<std::mutex> guard(pool->lock);
+
+	pool->users++;
+}
+
+void bandsDetach()
+{
+	BandPool* pool = bandPool();
+	std::thread stopped[BAND_MAX_THREADS];
+	int nstopped = 0;
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+
+		if (--pool->users > 0)
+			return;
+		// no filter is left to run a job, so workers are all waiting
+		pool->generation++;
+		for (; nstopped < pool->nworkers; nstopped++)
+			stopped[nstopped] = std::move(pool->worker[nstopped]);
+		pool->nworkers = 0;
+	}
+	pool->wake.notify_all();
+
+	for (int k = 0; k < nstopped; k++)
+		stopped[k].join();
+}
+
+void bandsRun(int threads, int nrows, BandFunc fn, void* work)
+{
+	if (nrows <= 0)
+		return;
+	int bandRows = BAND_ROWS;
+
+	if (threads > 1 && nrows < 4 * threads * bandRows)
+		bandRows = VSMAX(nrows / (4 * threads), 1);
+	int nbands = (nrows + bandRows - 1) / bandRows;
+
+	threads = VSMIN(threads, nbands);
+	if (threads <= 1)
+	{
+		fn(work, 0, nrows);
+		return;
+	}
+	BandJob job;
+	job.fn = fn;
+	job.work = work;
+	job.nrows = nrows;
+	job.bandRows = bandRows;
+	job.nshares = threads;
+	job.joined = 1;
+	job.active = 0;
+
+	for (int s = 0; s < threads; s++)
+	{
+		uint64_t first = (uint64_t)nbands * s / threads, end = (uint64_t)nbands * (s + 1) / threads;
+		job.share[s].store(first | (end << 32));
+	}
+	BandPool* pool = bandPool();
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+
+		for (; pool->nworkers < threads - 1; pool->nworkers++)
+			pool->worker[pool->nworkers] = std::thread(bandWorker, pool, pool->generation);
+		job.next = pool->jobs;
+		pool->jobs = &job;
+	}
+	pool->wake.notify_all();
+	bandWork(&job, 0);
+
+	std::unique_lock<std::mutex> guard(pool->lock);
+	// shares not taken by workers were done by stealing
+	for (BandJob** j = &pool->jobs; *j != NULL; j = &(*j)->next)
+	{
+		if (*j == &job)
+		{
+			*j = job.next;
+			break;
+		}
+	}
+	while (job.active > 0)
+		pool->idle.wait(guard);
+}
+
+#endif
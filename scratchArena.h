@@ -0,0 +1,107 @@
+#pragma once
+#ifndef SCRATCH_ARENA_H_V_C_MOHAN
+#define SCRATCH_ARENA_H_V_C_MOHAN
+//------------------------------------------------------------------------------
+// Per thread scratch memory for tables that live only during one GetFrame.
+// Each worker thread keeps its own block, so after the first few frames no
+// allocation is made. scratchBegin and scratchEnd bracket the frame, and all
+// memory handed out in between is released at scratchEnd.
+// If a request does not fit, a larger block is made and the old one is kept
+// until the outermost scratchEnd, so earlier pointers stay valid.
+//------------------------------------------------------------------------------
+#define SCRATCH_ALIGN 32
+#define SCRATCH_MIN_SIZE (64 * 1024)
+
+typedef struct ScratchBlock {
+	struct ScratchBlock* prev;	// retired blocks
+	size_t size;				// usable bytes after header
+} ScratchBlock;
+
+typedef struct ScratchArena {
+	ScratchBlock* block;
+	size_t used;
+	int depth;
+
+	~ScratchArena();
+} ScratchArena;
+
+// arena of calling thread. Nested calls share it
+ScratchArena* scratchBegin();
+// bytes of memory aligned to SCRATCH_ALIGN. Not initialized
+template <typename T>
+T* scratchAlloc(ScratchArena* arena, size_t bytes);
+// releases all memory got since the outermost scratchBegin
+void scratchEnd(ScratchArena* arena);
+
+//------------------------------------------------------------------------------
+// header is padded to alignment so that data starts aligned
+#define SCRATCH_HEADER (((sizeof(ScratchBlock) + SCRATCH_ALIGN - 1) / SCRATCH_ALIGN) * SCRATCH_ALIGN)
+
+static ScratchBlock* scratchNewBlock(size_t size, ScratchBlock* prev)
+{
+	ScratchBlock* b = (ScratchBlock*)vs_aligned_malloc(SCRATCH_HEADER + size, SCRATCH_ALIGN);
+	b->prev = prev;
+	b->size = size;
+	return b;
+}
+
+static void scratchFreeRetired(ScratchBlock* b)
+{
+	while (b != NULL)
+	{
+		ScratchBlock* prev = b->prev;
+		vs_aligned_free(b);
+		b = prev;
+	}
+}
+
+ScratchArena::~ScratchArena()
+{
+	if (block != NULL)
+	{
+		scratchFreeRetired(block->prev);
+		vs_aligned_free(block);
+	}
+}
+
+ScratchArena* scratchBegin()
+{
+	static thread_local ScratchArena arena = { NULL, 0, 0 };
+
+	arena.depth++;
+	return &arena;
+}
+
+template <typename T>
+T* scratchAlloc(ScratchArena* arena, size_t bytes)
+{
+	bytes = ((bytes + SCRATCH_ALIGN - 1) / SCRATCH_ALIGN) * SCRATCH_ALIGN;
+
+	if (arena->block == NULL || arena->used + bytes > arena->block->size)
+	{
+		size_t size = arena->block == NULL ? SCRATCH_MIN_SIZE : 2 * arena->block->size;
+		while (size < arena->used + bytes)
+			size *= 2;
+		// keep current block, as it may hold memory still in use
+		arena->block = scratchNewBlock(size, arena->block);
+		// size covers all retired usage, so next frame fits in one block
+		arena->used = 0;
+	}
+	T* p = (T*)((uint8_t*)arena->block + SCRATCH_HEADER + arena->used);
+	arena->used += bytes;
+	return p;
+}
+
+void scratchEnd(ScratchArena* arena)
+{
+	if (--arena->depth > 0)
+		return;
+	if (arena->block != NULL)
+	{
+		scratchFreeRetired(arena->block->prev);
+		arena->block->prev = NULL;
+	}
+	arena->used = 0;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+#ifndef SIMD_LEVEL_H_V_C_MOHAN
+#define SIMD_LEVEL_H_V_C_MOHAN
+//------------------------------------------------------------------------------
+// Instruction set used by the SIMD kernels of vfx functions. simdSelect is
+// called once at plugin load and sets simdLevel, which kernels test to choose
+// their code. Each kernel has a scalar loop as fallback and for the tail.
+//------------------------------------------------------------------------------
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define VFX_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define VFX_TARGET(isa)
+#elif defined(__clang__)
+#define VFX_TARGET(isa) __attribute__((target(isa)))
+#else
+// no fused multiply add, so that results are same as scalar code
+#define VFX_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#endif
+#endif
+
+enum { SIMD_NONE, SIMD_SSE41, SIMD_AVX2, SIMD_AVX512 };
+
+// best instruction set of this cpu and os
+int cpuSimdLevel();
+// sets simdLevel to best of cpu, not above maxLevel. Returns level chosen
+int simdSelect(int maxLevel);
+
+//------------------------------------------------------------------------------
+static int simdLevel = SIMD_NONE;
+
+#ifdef VFX_X86_SIMD
+int cpuSimdLevel()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int r[4];
+
+	__cpuid(r, 0);
+	int maxLeaf = r[0];
+	__cpuid(r, 1);
+	bool sse41 = (r[2] >> 19) & 1;
+	bool osxsave = (r[2] >> 27) & 1;
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool avx2 = false, avx512 = false;
+
+	if (maxLeaf >= 7)
+	{
+		__cpuidex(r, 7, 0);
+		// os must save ymm, and for avx512 also zmm and mask registers. avx512 needs F and BW
+		avx2 = ((r[1] >> 5) & 1) && (xcr0 & 0x06) == 0x06;
+		avx512 = ((r[1] >> 16) & 1) && ((r[1] >> 30) & 1) && (xcr0 & 0xe6) == 0xe6;
+	}
+#else
+	__builtin_cpu_init();
+	bool sse41 = __builtin_cpu_supports("sse4.1");
+	bool avx2 = __builtin_cpu_supports("avx2");
+	bool avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+	return avx512 ? SIMD_AVX512 : avx2 ? SIMD_AVX2 : sse41 ? SIMD_SSE41 : SIMD_NONE;
+}
+#else
+int cpuSimdLevel()
+{
+	return SIMD_NONE;
+}
+#endif
+
+int simdSelect(int maxLevel)
+{
+	int level = cpuSimdLevel();
+
+	simdLevel = level < maxLevel ? level : maxLevel;
+	return simdLevel;
+}
+
+#endif
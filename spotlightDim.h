@@ -2,7 +2,7 @@
 #ifndef SPOTLIGHT_DIM_A_COLOR_PLANE_V_C_MOHAN
 #define SPOTLIGHT_DIM_A_COLOR_PLANE_V_C_MOHAN
 
-// dims a color plane 
+// dims a color plane. Spot lights need discSpans.h
 
 template <typename finc>
 void dimplaneRGB(finc* dp, const finc* sp, int pitch,
@@ -66,22 +66,22 @@ void RGBspotLight(finc* dp, const finc* sp, int pitch,
 
 	for (int h = sy; h < ey; h++)
 	{
-		int hsq = (h - y) * (h - y);
+		int x0, x1;
+		// samples of this row within spot
+		if (!discRowSpan(&x0, &x1, x, rsq, h - y, 0, sx, ex))
+			continue;
 
-		for (int w = sx; w < ex; w++)
+		for (int w = x0; w < x1; w++)
 		{
-			if (hsq + (w - x) * (w - x) <= rsq)
-			{				
-				finc col = *(sp + (h * pitch + w));
-				if ( color < col)
-				{
-
-					*(dp + h * pitch + w) = color;
-				}
-				else
-				{
-					*(dp + h * pitch + w) = col;
-				}
+			finc col = *(sp + (h * pitch + w));
+			if ( color < col)
+			{
+
+				*(dp + h * pitch + w) = color;
+			}
+			else
+			{
+				*(dp + h * pitch + w) = col;
 			}
 		}
 	}
@@ -109,20 +109,18 @@ void YUVspotLight(finc* dp, const finc* sp, int pitch,
 
 	for (int h = sy; h < ey; h++)
 	{
-		int hsq = ( ((h << subH) - y) * ((h << subH) - y) );
+		int x0, x1;
+		// samples of this row whose luma position is within spot
+		if (!discRowSpan(&x0, &x1, x, rsq, (h << subH) - y, subW, sx, ex))
+			continue;
 
-		for (int w = sx; w < ex; w++)
+		for (int w = x0; w < x1; w++)
 		{
-			int wsq = ( ((w << subW) - x) * ((w << subW) - x) );
-
-			if (hsq + wsq <= rsq)
-			{				
-				finc col = *(sp + h * pitch + w);
-				*(dp + h * pitch + w)
-					= col >= gray && color > gray ||  
-					 col <= gray && color < gray ? (col + color)/2
-					:(col);				
-			}
+			finc col = *(sp + h * pitch + w);
+			*(dp + h * pitch + w)
+				= col >= gray && color > gray ||  
+				 col <= gray && color < gray ? (col + color)/2
+				:(col);				
 		}
 	}
 
@@ -33,12 +33,21 @@ This program is free software: you can redistribute it and/or modify
 
 
 #include "interpolationMethods.h"
+#include "simdLevel.h"
+#include "interpolationSimd.h"
 #include "statsAndOffsetsLUT.h"
+#include "framePlanes.h"
+#include "discSpans.h"
+#include "scratchArena.h"
+#include "warpMap.h"
+#include "rowBands.h"
+#include "counterRandom.h"
 #include "colorconverter.h"
 #include "ConvertBGRforInput.h"
 #include "lensMagnification.h"
 #include "spotlightDim.h"
 #include "raysAndFlowers.h"
+#include "particles.h"
 #include "FisheyeMethods.h"
 #include "FourFoldSymmetricMarking.h"
 #include "Squircles.h"
@@ -54,11 +63,13 @@ This program is free software: you can redistribute it and/or modify
 #include "FlowerPot.cpp"
 #include "Fog.cpp"
 #include "Lens.cpp"
+#include "LensCorrect.cpp"
 # include "LineMagnifier.cpp"
 #include "Pool.cpp"
 #include "Rain.cpp"
 #include "Rainbow.cpp"
 #include "RearViewMirror.cpp"
+#include "Remap.cpp"
 #include "Ripple.cpp"
 #include "Rockets.cpp"
 #include "Snow.cpp"
@@ -74,6 +85,9 @@ This program is free software: you can redistribute it and/or modify
 
 VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegisterFunction registerFunc, VSPlugin* plugin) {
 	configFunc("com.mohanvc.vfx", "vfx", "Special Effects ", VAPOURSYNTH_API_VERSION, 1, plugin);
+	// best SIMD code for this cpu, for effects and for interpolation
+	simdSelect(SIMD_AVX512);
+	laQuantileSelect(SIMD_AVX512);
 	
 	registerFunc("Balloon", "clip:clip;sf:int:opt;ef:int:opt;rad:int:opt;color:int[]:opt;opacity:float:opt;nhops:int:opt;"
 		"rise:int:opt;sx:int:opt;fx:int:opt;fy:int:opt;light:int:opt;refl:float:opt;offset:float:opt;"
@@ -87,10 +101,10 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegiste
 							"rad:int:opt;rise:int:opt;life:int:opt;nbf:int:opt;", bubblesCreate, 0, plugin);
 
 	registerFunc("Binoculars", "clip:clip;sf:int:opt;ef:int:opt;rad:int:opt;sx:int:opt;sy:int:opt;ex:int:opt;"
-								"ey:int:opt;mag:int:opt;emag:int:opt;", binocularsCreate, 0, plugin);
+								"ey:int:opt;mag:int:opt;emag:int:opt;cache:int:opt;", binocularsCreate, 0, plugin);
 
 	registerFunc("Conez", "clip:clip;bkg:clip;sf:int:opt;ef:int:opt;vert:int:opt;prog:int:opt;"
-							"top:int:opt;base:int:opt;", conezCreate, 0, plugin);
+							"top:int:opt;base:int:opt;cache:int:opt;threads:int:opt;", conezCreate, 0, plugin);
 
 	registerFunc("DiscoLights", "clip:clip;sf:int:opt;ef:int:opt;life:int:opt;type:int:opt;"
 							"nspots:int:opt;minrad:int:opt;dim:float:opt;", discolightsCreate, 0, plugin);
@@ -99,24 +113,28 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegiste
 							"ts:float:opt;tf:int:opt;", flashesCreate, 0, plugin);
 
 	registerFunc("FiguredGlass", "clip:clip;sf:int:opt;ef:int:opt;rad:int:opt;"
-						"mag:float:opt;drop:int:opt;", figuredglassCreate, 0, plugin);
+						"mag:float:opt;drop:int:opt;threads:int:opt;", figuredglassCreate, 0, plugin);
 	
 	registerFunc("FlowerPot", "clip:clip;sf:int:opt;ef:int:opt;x:int:opt;y:int:opt;rise:int:opt;"
 					"ex:int:opt;ey:int:opt;zoom:float:opt;color:int:opt;", flowerpotCreate, 0, plugin);
 
 	registerFunc("Fog", "clip:clip;sf:int:opt;ef:int:opt;fog:float:opt;efog:float:opt;"
-							"vary:float:opt;", fogCreate, 0, plugin);
+							"vary:float:opt;mode:int:opt;scale:int:opt;octaves:int:opt;windx:float:opt;"
+							"windy:float:opt;grad:float:opt;lowres:int:opt;", fogCreate, 0, plugin);
 
 	registerFunc("Lens", "clip:clip;sf:int:opt;ef:int:opt;rad:int:opt;mag:float:opt;drop:int:opt;"
-			"x:int:opt;y:int:opt;ex:int:opt;ey:int:opt;erad:int:opt;emag:float:opt;", lensCreate, 0, plugin);
+			"x:int:opt;y:int:opt;ex:int:opt;ey:int:opt;erad:int:opt;emag:float:opt;cache:int:opt;threads:int:opt;", lensCreate, 0, plugin);
 	
+	registerFunc("LensCorrect", "clip:clip;method:int:opt;x:int:opt;y:int:opt;rad:int:opt;fov:float:opt;"
+			"cvx:float:opt;k:float:opt;abc:float[]:opt;q:int:opt;mapfile:data:opt;threads:int:opt;", lenscorrectCreate, 0, plugin);
+
 	registerFunc("LineMagnifier", "clip:clip;sf:int:opt;ef:int:opt;lwidth:int:opt;mag:float:opt;drop:int:opt;"
 				"xy:int:opt;exy:int:opt;vert:int:opt;", linemagnifierCreate, 0, plugin);
 
 	registerFunc("Pool", "clip:clip;sf:int:opt;ef:int:opt;x:int:opt;y:int:opt;ex:int:opt;"
 				"ey:int:opt;wd:int:opt;ewd:int:opt;ht:int:opt;eht:int:opt;wavelen:int:opt;"
 				"amp:int:opt;eamp:int:opt;speed:float:opt;espeed:float:opt;"
-				"paint:int:opt;color:int[]:opt;", poolCreate, 0, plugin);
+				"paint:int:opt;color:int[]:opt;threads:int:opt;", poolCreate, 0, plugin);
 
 	registerFunc("Rain", "clip:clip;sf:int:opt;ef:int:opt;type:int:opt;etype:int:opt;"
 					"slant:int:opt;eslant:int:opt;opq:float:opt;box:int:opt;span:int:opt;", rainCreate, 0, plugin);
@@ -126,12 +144,14 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegiste
 					"lx:int:opt;elx:int:opt;rx:int:opt;erx:int:opt;", rainbowCreate, 0, plugin);
 	registerFunc("RearViewMirror", "clip:clip;bclip:clip;method:int:opt;"
 				"mcx:int:opt;mcy:int:opt;mwd:int:opt;mht:int:opt;oval:int:opt;border:int:opt;"
-				"cvx:float:opt;fov:float:opt;test:int:opt;dim:float:opt;q:int:opt;dots:int:opt;", rearviewmirrorCreate, 0, plugin);
+				"cvx:float:opt;fov:float:opt;test:int:opt;dim:float:opt;q:int:opt;dots:int:opt;threads:int:opt;", rearviewmirrorCreate, 0, plugin);
+
+	registerFunc("Remap", "clip:clip;mapx:clip;mapy:clip;q:int:opt;rel:int:opt;threads:int:opt;", remapCreate, 0, plugin);
 
 	registerFunc("Ripple", "clip:clip;sf:int:opt;ef:int:opt;wavelen:int:opt;speed:float:opt;"
 		"espeed:float:opt;poolx:int:opt;pooly:int:opt;"
 		"wd:int:opt;ht:int:opt;origin:int:opt;xo:int:opt;yo:int:opt;"
-		"amp:int:opt;eamp:int:opt;ifr:int:opt;dfr:int:opt;", rippleCreate, 0, plugin);
+		"amp:int:opt;eamp:int:opt;ifr:int:opt;dfr:int:opt;threads:int:opt;", rippleCreate, 0, plugin);
 
 	registerFunc("Rockets", "clip:clip;sf:int:opt;ef:int:opt;life:float:opt;interval:float:opt;"
 						"lx:int:opt;rx:int:opt;y:int:opt;rise:int:opt;"
@@ -152,5 +172,5 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegiste
 		"ex:int:opt;ey:int:opt;color:int:opt;gravity:float:opt;persistance:float:opt;", sunflowerCreate, 0, plugin);
 
 	registerFunc("Swirl", "clip:clip;sf:int:opt;ef:int:opt;rad:int:opt;x:int:opt;y:int:opt;"
-		"q:int:opt;dir:int:opt;grow:int:opt;steady:int:opt;", swirlCreate, 0, plugin);
+		"q:int:opt;dir:int:opt;grow:int:opt;steady:int:opt;intp:int:opt;threads:int:opt;", swirlCreate, 0, plugin);
 }
\ No newline at end of file
@@ -0,0 +1,401 @@
+#pragma once
+#ifndef WARP_MAP_H_V_C_MOHAN
+#define WARP_MAP_H_V_C_MOHAN
+//------------------------------------------------------------------------------
+// Source position and interpolation quantiles of each output sample of a
+// distortion whose geometry does not change between frames. Built once, then
+// every frame only reads it instead of evaluating the mapping per sample.
+// Rows may be of different lengths, as for a disc. Offsets are in luma samples
+// from the output position, so one map serves any place the geometry is put.
+// Maps of animated geometry are kept in a WarpCache, shared by all threads of a
+// filter instance. It keeps recently used maps within a byte budget, so that a
+// frame asked again, or another frame of same geometry, does not rebuild one.
+//------------------------------------------------------------------------------
+#include <stdio.h>
+#include <mutex>
+
+#define WARP_KEY_SIZE 4
+// qx of an entry whose source is outside frame
+#define WARP_SKIP 255
+
+typedef struct {
+	int16_t dx;		// source x - output x
+	int16_t dy;		// source y - output y
+	uint8_t qx;		// quantile of fraction in x
+	uint8_t qy;		// and y
+} WarpEntry;
+
+typedef struct {
+	WarpEntry* entry;
+	int* rowStart;	// index of first entry of each row. nrows + 1 values
+	int nrows;
+} WarpMap;
+
+typedef struct WarpCacheItem {
+	struct WarpCacheItem* prev;	// more recently used
+	struct WarpCacheItem* next;	// less recently used
+	int key[WARP_KEY_SIZE];
+	WarpMap* map;
+	size_t bytes;
+	int refs;					// frames using map now
+} WarpCacheItem;
+
+typedef struct {
+	std::mutex lock;
+	WarpCacheItem* head;		// most recently used
+	WarpCacheItem* tail;
+	size_t bytes;
+	size_t budget;
+	int64_t hits;
+	int64_t misses;
+} WarpCache;
+
+// how a full row is sampled
+typedef struct {
+	int span;		// interpolation taps. 0 nearest
+	int quantiles;
+	const float* coeff;
+	const int16_t* q14Coeff;	// same for 8 bit in integer. NULL for other formats
+} WarpSampler;
+
+// per thread buffers of a row of wd samples
+typedef struct {
+	int* offs;
+	int* qx;
+	int* qy;
+	int* w;
+	float* out;
+	int* iout;
+} WarpRowBuffers;
+
+// map of nrows, row r having rowLength[r] entries. Entries are not initialized
+WarpMap* warpMapCreate(int nrows, const int* rowLength);
+void warpMapFree(WarpMap* map);
+// entries of row r
+WarpEntry* warpMapRow(const WarpMap* map, int r);
+size_t warpMapBytes(const WarpMap* map);
+// key value of a float parameter. Exact, so that a cached map is as one built
+int warpKeyFloat(float v);
+
+// cache keeping unused maps up to budget bytes. 0 keeps none
+WarpCache* warpCacheCreate(size_t budget);
+// frees cache and its maps. None may be in use. NULL is ignored
+void warpCacheFree(WarpCache* cache);
+// map of key, or NULL if not cached. A map found is held until warpCacheRelease
+const WarpMap* warpCacheFind(WarpCache* cache, const int* key);
+// adds map built for key and holds it. If another thread added key meanwhile,
+// map is freed and that one is returned instead
+const WarpMap* warpCacheInsert(WarpCache* cache, const int* key, WarpMap* map);
+// ends use of a map got from Find or Insert
+void warpCacheRelease(WarpCache* cache, const WarpMap* map);
+// logs hits and misses so far as a debug message of filter. Frames are not touched,
+// as the counts depend on order in which threads asked frames. Nothing for NULL
+void warpCacheLog(WarpCache* cache, const char* filter, const VSAPI* vsapi);
+
+// buffers for rows up to wd samples, from scratch
+void warpRowBuffers(WarpRowBuffers* buf, ScratchArena* scratch, int wd);
+// luma row h of np planes from e, wd entries with offsets in luma samples. Luma size
+// planes are interpolated, falling back to nearest near frame edges. Subsampled planes
+// take the nearest sample, on their rows only. Entries of WARP_SKIP are set to fill of
+// their plane, or left if fill is NULL
+template <typename finc>
+void warpSampleRow(const FramePlane* pl, int np, const VSFormat* fi, int wd, int ht,
+	const WarpEntry* e, int h, const WarpSampler* s, const finc* fill, WarpRowBuffers* buf);
+
+//------------------------------------------------------------------------------
+WarpMap* warpMapCreate(int nrows, const int* rowLength)
+{
+	size_t nentries = 0;
+
+	for (int r = 0; r < nrows; r++)
+		nentries += rowLength[r];
+
+	WarpMap* map = (WarpMap*)vs_aligned_malloc(sizeof(WarpMap), 32);
+	map->rowStart = (int*)vs_aligned_malloc(sizeof(int) * (nrows + 1), 32);
+	map->entry = (WarpEntry*)vs_aligned_malloc(sizeof(WarpEntry) * (nentries + 1), 32);
+	map->nrows = nrows;
+	map->rowStart[0] = 0;
+
+	for (int r = 0; r < nrows; r++)
+		map->rowStart[r + 1] = map->rowStart[r] + rowLength[r];
+
+	return map;
+}
+
+void warpMapFree(WarpMap* map)
+{
+	if (map == NULL)
+		return;
+	vs_aligned_free(map->entry);
+	vs_aligned_free(map->rowStart);
+	vs_aligned_free(map);
+}
+
+WarpEntry* warpMapRow(const WarpMap* map, int r)
+{
+	return map->entry + map->rowStart[r];
+}
+
+size_t warpMapBytes(const WarpMap* map)
+{
+	return sizeof(WarpMap) + sizeof(int) * (map->nrows + 1)
+		+ sizeof(WarpEntry) * (map->rowStart[map->nrows] + 1);
+}
+
+int warpKeyFloat(float v)
+{
+	int k;
+
+	memcpy(&k, &v, sizeof(int));
+	return k;
+}
+
+//------------------------------------------------------------------------------
+WarpCache* warpCacheCreate(size_t budget)
+{
+	WarpCache* cache = new WarpCache;
+
+	cache->head = cache->tail = NULL;
+	cache->bytes = 0;
+	cache->budget = budget;
+	cache->hits = cache->misses = 0;
+	return cache;
+}
+
+void warpCacheFree(WarpCache* cache)
+{
+	if (cache == NULL)
+		return;
+	WarpCacheItem* it = cache->head;
+
+	while (it != NULL)
+	{
+		WarpCacheItem* next = it->next;
+		warpMapFree(it->map);
+		free(it);
+		it = next;
+	}
+	delete cache;
+}
+
+static void warpCacheUnlink(WarpCache* cache, WarpCacheItem* it)
+{
+	if (it->prev != NULL)
+		it->prev->next = it->next;
+	else
+		cache->head = it->next;
+	if (it->next != NULL)
+		it->next->prev = it->prev;
+	else
+		cache->tail = it->prev;
+}
+
+static void warpCachePushFront(WarpCache* cache, WarpCacheItem* it)
+{
+	it->prev = NULL;
+	it->next = cache->head;
+	if (cache->head != NULL)
+		cache->head->prev = it;
+	cache->head = it;
+	if (cache->tail == NULL)
+		cache->tail = it;
+}
+
+// drops least recently used maps not in use till within budget. Lock is held
+static void warpCacheEvict(WarpCache* cache)
+{
+	WarpCacheItem* it = cache->tail;
+
+	while (it != NULL && cache->bytes > cache->budget)
+	{
+		WarpCacheItem* prev = it->prev;
+
+		if (it->refs == 0)
+		{
+			warpCacheUnlink(cache, it);
+			cache->bytes -= it->bytes;
+			warpMapFree(it->map);
+			free(it);
+		}
+		it = prev;
+	}
+}
+
+const WarpMap* warpCacheFind(WarpCache* cache, const int* key)
+{
+	std::lock_guard<std::mutex> guard(cache->lock);
+
+	for (WarpCacheItem* it = cache->head; it != NULL; it = it->next)
+	{
+		if (memcmp(it->key, key, sizeof(it->key)) != 0)
+			continue;
+		warpCacheUnlink(cache, it);
+		warpCachePushFront(cache, it);
+		it->refs++;
+		cache->hits++;
+		return it->map;
+	}
+	cache->misses++;
+	return NULL;
+}
+
+const WarpMap* warpCacheInsert(WarpCache* cache, const int* key, WarpMap* map)
+{
+	std::lock_guard<std::mutex> guard(cache->lock);
+
+	for (WarpCacheItem* it = cache->head; it != NULL; it = it->next)
+	{
+		if (memcmp(it->key, key, sizeof(it->key)) != 0)
+			continue;
+		warpMapFree(map);
+		it->refs++;
+		return it->map;
+	}
+	WarpCacheItem* it = (WarpCacheItem*)malloc(sizeof(WarpCacheItem));
+	memcpy(it->key, key, sizeof(it->key));
+	it->map = map;
+	it->bytes = warpMapBytes(map);
+	it->refs = 1;
+	warpCachePushFront(cache, it);
+	cache->bytes += it->bytes;
+	warpCacheEvict(cache);
+	return map;
+}
+
+void warpCacheRelease(WarpCache* cache, const WarpMap* map)
+{
+	std::lock_guard<std::mutex> guard(cache->lock);
+
+	for (WarpCacheItem* it = cache->head; it != NULL; it = it->next)
+	{
+		if (it->map != map)
+			continue;
+		it->refs--;
+		break;
+	}
+	warpCacheEvict(cache);
+}
+
+void warpCacheLog(WarpCache* cache, const char* filter, const VSAPI* vsapi)
+{
+	if (cache == NULL)
+		return;
+	int64_t hits, misses;
+	{
+		std::lock_guard<std::mutex> guard(cache->lock);
+		hits = cache->hits;
+		misses = cache->misses;
+	}
+	char msg[128];
+	snprintf(msg, sizeof(msg), "%s: warp cache %lld hits, %lld misses", filter, (long long)hits, (long long)misses);
+	vsapi->logMessage(mtDebug, msg);
+}
+
+//------------------------------------------------------------------------------
+void warpRowBuffers(WarpRowBuffers* buf, ScratchArena* scratch, int wd)
+{
+	buf->offs = scratchAlloc<int>(scratch, sizeof(int) * wd);
+	buf->qx = scratchAlloc<int>(scratch, sizeof(int) * wd);
+	buf->qy = scratchAlloc<int>(scratch, sizeof(int) * wd);
+	buf->w = scratchAlloc<int>(scratch, sizeof(int) * wd);
+	buf->out = scratchAlloc<float>(scratch, sizeof(float) * wd);
+	buf->iout = scratchAlloc<int>(scratch, sizeof(int) * wd);
+}
+
+template <typename finc>
+void warpSampleRow(const FramePlane* pl, int np, const VSFormat* fi, int wd, int ht,
+	const WarpEntry* e, int h, const WarpSampler* s, const finc* fill, WarpRowBuffers* buf)
+{
+	int span2 = s->span / 2;
+	int nfull = lumaSizePlanes(pl, np);
+	finc min[3], max[3];
+
+	for (int p = 0; p < np; p++)
+	{
+		if (sizeof(finc) == 4)
+		{
+			// U, V float planes are centered on 0
+			bool uv = p > 0 && fi->colorFamily == cmYUV;
+			min[p] = (finc)(uv ? -0.5f : 0.0f);
+			max[p] = (finc)(uv ? 0.5f : 1.0f);
+		}
+		else
+		{
+			min[p] = 0;
+			max[p] = (finc)((1 << fi->bitsPerSample) - 1);
+		}
+	}
+	int pitch = pl[0].pitch;
+	int n = 0;
+
+	for (int w = 0; w < wd; w++)
+	{
+		if (e[w].qx == WARP_SKIP)
+		{
+			for (int p = 0; p < nfull && fill != NULL; p++)
+				((finc*)pl[p].dp)[h * pitch + w] = fill[p];
+			continue;
+		}
+		int x = w + e[w].dx, y = h + e[w].dy;
+
+		if (s->span > 0 && x >= span2 - 1 && x < wd - span2 && y >= span2 - 1 && y < ht - span2)
+		{
+			buf->offs[n] = y * pitch + x;
+			buf->qx[n] = e[w].qx;
+			buf->qy[n] = e[w].qy;
+			buf->w[n++] = w;
+			continue;
+		}
+		// near frame edges take nearest
+		x = VSMIN(x + (2 * e[w].qx >= s->quantiles), wd - 1);
+		y = VSMIN(y + (2 * e[w].qy >= s->quantiles), ht - 1);
+
+		for (int p = 0; p < nfull; p++)
+			((finc*)pl[p].dp)[h * pitch + w] = ((const finc*)pl[p].sp)[y * pitch + x];
+	}
+	for (int p = 0; p < nfull && n > 0; p++)
+	{
+		finc* dp = (finc*)pl[p].dp + h * pitch;
+
+		if (sizeof(finc) == 1 && s->q14Coeff != NULL)
+		{
+			LaQuantileBatchQ14(buf->iout, (const uint8_t*)pl[p].sp, pitch, buf->offs, buf->qx, buf->qy,
+				n, s->span, s->q14Coeff);
+
+			for (int i = 0; i < n; i++)
+				dp[buf->w[i]] = iclamp(buf->iout[i], min[p], max[p]);
+			continue;
+		}
+		LaQuantileBatch(buf->out, (const finc*)pl[p].sp, pitch, buf->offs, buf->qx, buf->qy,
+			n, s->span, s->coeff);
+
+		for (int i = 0; i < n; i++)
+			dp[buf->w[i]] = clamp(buf->out[i], min[p], max[p]);
+	}
+	if (nfull == np)
+		return;
+	int subW = pl[nfull].subW, subH = pl[nfull].subH;
+
+	if ((h & ((1 << subH) - 1)) != 0)
+		return;
+	int hp = h >> subH, cpitch = pl[nfull].pitch;
+
+	for (int wp = 0; wp < pl[nfull].width; wp++)
+	{
+		const WarpEntry* ew = e + (wp << subW);
+
+		if (ew->qx == WARP_SKIP)
+		{
+			for (int p = nfull; p < np && fill != NULL; p++)
+				((finc*)pl[p].dp)[hp * cpitch + wp] = fill[p];
+			continue;
+		}
+		int x = VSMIN((wp << subW) + ew->dx + (2 * ew->qx >= s->quantiles), wd - 1) >> subW;
+		int y = VSMIN(h + ew->dy + (2 * ew->qy >= s->quantiles), ht - 1) >> subH;
+
+		for (int p = nfull; p < np; p++)
+			((finc*)pl[p].dp)[hp * cpitch + wp] = ((const finc*)pl[p].sp)[y * cpitch + x];
+	}
+}
+
+#endif